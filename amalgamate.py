@@ -54,8 +54,20 @@ HEADERS = [
 SOURCES = [
         Copy("src/vec4.hpp"),
         Copy("src/json.hpp"),
+        Copy("src/parallel.hpp"),
+        Copy("src/categorical.hpp"),
+        Copy("src/convert.hpp"),
+        Copy("src/async.hpp"),
+        Copy("src/cache.hpp"),
+        Copy("src/shap.hpp"),
+        Copy("src/transform.hpp"),
+        Copy("src/mapped_file.hpp"),
         Copy("src/catboost.cpp"),
+        Copy("src/categorical.cpp"),
         Copy("src/cb.cpp"),
+        Copy("src/thread_pool.cpp"),
+        Copy("src/batching.cpp"),
+        Copy("src/matrix.cpp"),
 ]
 
 def main():
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
 #include <istream>
 #include <memory>
+#include <ostream>
 #include <string>
 #include <vector>
 
@@ -11,11 +16,349 @@
 
 namespace catboost {
 
+/// Kernel used for single predictions.
+enum class Kernel {
+    /// Choose kernel by model size.
+    Auto,
+    /// Evaluate groups of trees one by one.
+    Plain,
+    /// Compute leaf indexes of the next groups while leaf values of the
+    /// previous ones are being loaded. Faster for models that do not fit
+    /// into cache.
+    Pipelined,
+};
+
+/// Type of predicted values. Meaning of types depends on the loss function
+/// of the model, which is read from its "model_info".
+enum class PredictionType {
+    /// Sum of leaf values with scale and bias of the model.
+    RawFormulaVal,
+    /// Probability of class one for binary classification (Logloss,
+    /// CrossEntropy), softmax of raw values for MultiClass, sigmoid of every
+    /// raw value for MultiClassOneVsAll, MultiLogloss and MultiCrossEntropy.
+    Probability,
+    /// Index of the predicted class: one value per example for MultiClass and
+    /// MultiClassOneVsAll, 0 or 1 for every value of other classifiers.
+    Class,
+    /// Exponent of raw values, for example for Poisson or Tweedie models.
+    Exponent,
+    /// Logarithm of Probability.
+    LogProbability,
+};
+
+/// Accuracy of exp and log computed by prediction types other than
+/// RawFormulaVal.
+enum class Accuracy {
+    /// Standard library functions.
+    Exact,
+    /// Vectorized polynomial approximations with relative error about 1e-15.
+    High,
+    /// Faster approximations with relative error below 1e-8, which is enough
+    /// for probabilities stored as float.
+    Fast,
+};
+
+class Executor;
+
+/// Model options.
+struct Options {
+    /// Kernel for single predictions. Kernel::Auto chooses it by model size
+    /// or by benchmark if autotune is set.
+    Kernel kernel = Kernel::Auto;
+
+    /// Number of examples evaluated together by batch predictions: 1, 2, 4,
+    /// 8 or 16. Zero means default width (8) or benchmarked one if autotune
+    /// is set.
+    size_t batch_width = 0;
+
+    /// Benchmark kernels and batch widths on random examples when the model
+    /// is loaded and use the fastest ones. Values set explicitly are not
+    /// tuned, so they could be used to reproduce the choice.
+    bool autotune = false;
+
+    /// Batches smaller than this are predicted by apply_parallel on the
+    /// calling thread. Zero chooses the threshold by model size.
+    size_t parallel_min_rows = 0;
+
+    /// Number of threads evaluating a single prediction. Trees are split into
+    /// this number of ranges on load. Threads are waiting for predictions all
+    /// the time the model is loaded, so it is worth for huge models only.
+    /// Non-symmetric trees are always evaluated by the calling thread.
+    size_t tree_threads = 1;
+
+    /// Single predictions are evaluated by several threads only if the model
+    /// has at least this number of trees.
+    size_t tree_parallel_min_trees = 5000;
+
+    /// Sum leaf values one by one in the order of trees in the model file.
+    /// Predictions are bit-identical for SSE and non-SSE builds and do not
+    /// depend on the kernel, but they are slower and never use tree threads.
+    bool fixed_order = false;
+
+    /// Accuracy of exp and log of prediction types.
+    Accuracy accuracy = Accuracy::High;
+
+    /// Prepare tables of SHAP values when options are set instead of the
+    /// first call of shap_values, so explanations have steady latency.
+    bool shap = false;
+
+    /// Predict buckets by a copy of compiled trees on used features numbered
+    /// densely, the most used first. Used features of every block of examples
+    /// are packed into short rows before evaluation, which is faster for
+    /// models using a small part of wide rows. The copy is compiled on load
+    /// of a model having unused features and no categorical ones, and takes
+    /// as much memory as the model.
+    bool compact_features = false;
+
+    /// Size in bytes of the cache of predictions of dense examples, zero
+    /// disables it. Sums of leaf values are cached by used features of
+    /// examples, and identical examples are predicted once while they stay
+    /// in the cache. Slots and counters take at most this size, examples
+    /// are not cached if it is too small for one slot. Lookups and updates
+    /// do not lock, so the model could be applied by several threads. Models
+    /// with categorical features are not cached.
+    size_t cache_size = 0;
+
+    /// Predict identical examples of a bucket once. Examples are compared by
+    /// used features, which are hashed for every example, so it is worth for
+    /// buckets with many duplicates only. Always done if the cache is enabled.
+    bool dedupe_rows = false;
+
+    /// Executor running predictions of apply_async, default_executor() if
+    /// null. It should outlive the model.
+    Executor* executor = nullptr;
+};
+
+/// Executor runs tasks of parallel predictions.
+class Executor {
+public:
+    virtual ~Executor() = default;
+
+    /// Number of tasks that could run in parallel with the calling thread.
+    virtual size_t concurrency() const = 0;
+
+    /// Schedule task for execution. Task should be run exactly once.
+    virtual void submit(std::function<void()> task) = 0;
+};
+
+/// Simple thread pool.
+class ThreadPool : public Executor {
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+
+public:
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool(ThreadPool&&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ThreadPool& operator=(ThreadPool&&) = delete;
+
+    /// Create pool using all available CPUs. Calling thread is counted as
+    /// one of them. CPU affinity and cgroup CPU quota are respected.
+    ThreadPool();
+
+    /// Create pool with given number of threads.
+    explicit ThreadPool(size_t threads);
+
+    ~ThreadPool() override;
+
+    size_t concurrency() const override;
+
+    void submit(std::function<void()> task) override;
+};
+
+/// Return thread pool shared by all models.
+Executor& default_executor();
+
+/// Hash of categorical feature value, the same as CatBoost computes.
+/// Models take categorical features as such hashes.
+/// @argument value - pointer to value bytes
+/// @argument size - size of value
+int32_t hash_cat_feature(const char* value, size_t size);
+
+/// Hash of categorical feature value.
+inline int32_t hash_cat_feature(const std::string& value) { return hash_cat_feature(value.data(), value.size()); }
+
+/// Hash of integer categorical feature. Integers are hashed as their
+/// decimal representation.
+int32_t hash_cat_feature(int64_t value);
+
+/// Hash several categorical feature values, for example all categorical
+/// features of a bucket of examples.
+/// @argument values - array of values
+/// @argument size - number of values
+/// @argument out - array to save size hashes
+void hash_cat_features(const std::string* values, size_t size, int32_t* out);
+
+/// IEEE 754 half precision feature value, passed to Model::apply as bits.
+struct Float16 {
+    uint16_t bits;
+};
+
+/// bfloat16 feature value: upper 16 bits of a float.
+struct BFloat16 {
+    uint16_t bits;
+};
+
+/// Model statistics.
+struct ModelStats {
+    size_t tree_count = 0;
+    size_t feature_count = 0;
+    size_t max_depth = 0;
+    /// Size of leaf values in bytes.
+    size_t values_size = 0;
+    /// Kernel for single predictions.
+    Kernel kernel = Kernel::Auto;
+    /// Number of examples evaluated together by batch predictions.
+    size_t batch_width = 0;
+    /// True if autotuner has chosen kernel or batch width.
+    bool autotuned = false;
+    /// Number of threads evaluating a single prediction.
+    size_t tree_threads = 1;
+    /// Number of non-symmetric (Depthwise or Lossguide) trees in tree_count.
+    size_t nonsymmetric_tree_count = 0;
+    /// Number of values predicted for every example.
+    size_t dimension = 1;
+    /// Number of categorical features.
+    size_t cat_feature_count = 0;
+    /// Number of CTR features computed from categorical ones.
+    size_t ctr_count = 0;
+    /// Number of float features used by splits and CTRs.
+    size_t used_feature_count = 0;
+    /// True if buckets are predicted on packed used features.
+    bool compact_features = false;
+};
+
+/// Counters of the prediction cache (see Options::cache_size). Identical
+/// examples of a bucket are looked up once.
+struct CacheStats {
+    /// Number of examples found in the cache.
+    uint64_t hits = 0;
+    /// Number of examples predicted and added to the cache.
+    uint64_t misses = 0;
+    /// Number of examples the cache could keep.
+    size_t capacity = 0;
+    /// Memory taken by the cache in bytes.
+    size_t size = 0;
+};
+
+/// Order of features in a FeatureMatrix file.
+enum class MatrixLayout : uint32_t {
+    /// Values of every feature are stored together (column-major).
+    Columns,
+    /// Features of every example are stored together (row-major).
+    Rows,
+};
+
+/// Header of a feature matrix file, stored in the first 64 bytes in
+/// little-endian order. Features are float32 lines (columns or rows) of
+/// stride values starting right after the header, labels are rows float64
+/// values at label_offset. Columns are padded to 64 bytes, so every column
+/// starts at an aligned address of a mapped file.
+struct MatrixHeader {
+    /// "CBMATRIX".
+    char magic[8];
+    uint32_t version;
+    /// MatrixLayout.
+    uint32_t layout;
+    uint64_t rows;
+    uint64_t features;
+    /// Distance between the starts of lines in values.
+    uint64_t stride;
+    /// Offset of labels in bytes, 0 if there are no labels.
+    uint64_t label_offset;
+    /// Size of the file in bytes.
+    uint64_t size;
+    uint64_t reserved;
+};
+
+/// Feature matrix of examples in the binary format of MatrixHeader. The file
+/// is mapped into memory, and features and labels are used in place: there
+/// is no parsing or copying on load. Feature j of example i is
+/// data()[i * row_stride() + j * column_stride()] for both layouts, so the
+/// matrix could be passed to Model::apply_strided or Model::apply as is.
+/// Files are written by FeatureMatrix::write or converted from TSV files by
+/// catboost-matrix.
+class FeatureMatrix {
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+
+public:
+    FeatureMatrix(const FeatureMatrix&) = delete;
+    FeatureMatrix& operator=(const FeatureMatrix&) = delete;
+
+    /// Create empty matrix.
+    FeatureMatrix();
+
+    /// Map matrix from file.
+    explicit FeatureMatrix(const std::string& filename);
+
+    FeatureMatrix(FeatureMatrix&& other) noexcept;
+    FeatureMatrix& operator=(FeatureMatrix&& other) noexcept;
+    ~FeatureMatrix();
+
+    /// Map matrix from file, the previous one is unmapped.
+    void load(const std::string& filename);
+
+    /// Number of examples.
+    size_t rows() const;
+
+    /// Number of features of every example.
+    size_t features() const;
+
+    MatrixLayout layout() const;
+
+    /// Pointer to feature 0 of example 0.
+    const float* data() const;
+
+    /// Distance between examples in values.
+    ptrdiff_t row_stride() const;
+
+    /// Distance between features in values.
+    ptrdiff_t column_stride() const;
+
+    /// Feature j of example i.
+    float at(size_t i, size_t j) const { return data()[i * row_stride() + j * column_stride()]; }
+
+    /// Features of example i, the layout should be Rows.
+    const float* row(size_t i) const;
+
+    /// Values of feature j of all examples, the layout should be Columns.
+    const float* column(size_t j) const;
+
+    /// Labels of examples or null if the file has no labels.
+    const double* label() const;
+
+    /// Header of a file with the given dimensions.
+    static MatrixHeader header(size_t rows, size_t features, MatrixLayout layout, bool has_label);
+
+    /// Write matrix given by strides into file.
+    /// @argument filename - name of file to write
+    /// @argument features - pointer to feature 0 of example 0
+    /// @argument rows - number of examples
+    /// @argument count - number of features of every example
+    /// @argument row_stride - distance between examples in values
+    /// @argument column_stride - distance between features in values
+    /// @argument label - array of rows labels or null
+    /// @argument layout - layout of the file
+    static void write(const std::string& filename, const float* features, size_t rows, size_t count,
+                      ptrdiff_t row_stride, ptrdiff_t column_stride, const double* label = nullptr,
+                      MatrixLayout layout = MatrixLayout::Columns);
+};
+
+std::ostream& operator<<(std::ostream& out, Kernel kernel);
+std::ostream& operator<<(std::ostream& out, const ModelStats& stats);
+
 class Model {
     struct Impl;
     std::unique_ptr<Impl> impl_;
     double bias_ = 0.0;
     double scale_ = 1.0;
+    Options options_;
+
+    // Model set compiles its models into Impl.
+    friend class ModelSet;
+    // Scorer keeps leaves of sparse trees of Impl.
+    friend class Scorer;
 
 public:
     Model(const Model&) = delete;
@@ -36,6 +379,12 @@ public:
     /// Model should be stored in JSON format.
     explicit Model(std::istream& in);
 
+    /// Load model from file using options.
+    Model(const std::string& filename, const Options& options);
+
+    /// Load model from stream using options.
+    Model(std::istream& in, const Options& options);
+
     ~Model();
 
     /// Load model from file.
@@ -48,34 +397,240 @@ public:
     /// Model should be stored in JSON format.
     void load(std::istream& in);
 
+    /// Load model from file using options.
+    void load(const std::string& filename, const Options& options);
+
+    /// Load model from stream using options.
+    void load(std::istream& in, const Options& options);
+
     /// Apply model to features.
     /// @argument features - pointer to array of features
     /// @argument count - number of factors provided
+    /// @argument type - type of predicted value
     /// @returns predicted value
-    double apply(const float* features, size_t count) const;
+    /// Model should predict one value of the type (see dimension()) and
+    /// should not have splits on categorical features. Scale, bias and
+    /// transform of the type are applied by one pass over the predictions.
+    double apply(const float* features, size_t count, PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply multidimensional (MultiClass, MultiRMSE, etc.) model to features.
+    /// @argument features - pointer to array of features
+    /// @argument count - number of factors provided
+    /// @argument out - array to save dims predicted values
+    /// @argument dims - number of values, should be equal to dimension(type)
+    /// @argument type - type of predicted values
+    void apply(const float* features, size_t count, double* out, size_t dims,
+               PredictionType type = PredictionType::RawFormulaVal) const;
 
     /// Apply model to a bucket of examples.
     /// @argument features - array of arrays of features
     /// @argument size - number of examples in the set
     /// @argument count - number of features for each example
     /// @argument y - array to save predicted values.
+    /// @argument type - type of predicted values
     /// This function is equal to:
     /// for (size_t i = 0; i < size; ++i)
     ///     y[i] = predict([features[i]], count);
     /// but more efficient because of vectorization.
-    void apply(const float* const* features, size_t size, size_t count, double* y) const;
+    void apply(const float* const* features, size_t size, size_t count, double* y,
+               PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply multidimensional model to a bucket of examples.
+    /// @argument features - array of arrays of features
+    /// @argument size - number of examples in the set
+    /// @argument count - number of features for each example
+    /// @argument out - array to save size * dims predicted values, values
+    /// of example i start at out[i * dims]
+    /// @argument dims - number of values, should be equal to dimension(type)
+    /// @argument type - type of predicted values
+    void apply(const float* const* features, size_t size, size_t count, double* out, size_t dims,
+               PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply model to a bucket of examples using several threads.
+    /// Examples are split into chunks which are processed by the calling
+    /// thread and executor threads. Small buckets are processed by the calling
+    /// thread only (see Options::parallel_min_rows).
+    /// @argument features - array of arrays of features
+    /// @argument size - number of examples in the set
+    /// @argument count - number of features for each example
+    /// @argument y - array to save predicted values.
+    /// @argument executor - executor to run tasks, default_executor() if null.
+    /// @argument type - type of predicted values
+    void apply_parallel(const float* const* features, size_t size, size_t count, double* y,
+                        Executor* executor = nullptr, PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply model to all examples of a feature matrix, see apply_strided.
+    /// @argument matrix - mapped feature matrix
+    /// @argument out - array to save matrix.rows() * dims predicted values
+    /// @argument dims - number of values, should be equal to dimension(type)
+    /// @argument type - type of predicted values
+    void apply(const FeatureMatrix& matrix, double* out, size_t dims,
+               PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply model to all examples of a feature matrix using several
+    /// threads. Rows are split into chunks as by apply_parallel.
+    /// @argument matrix - mapped feature matrix
+    /// @argument out - array to save matrix.rows() * dims predicted values
+    /// @argument dims - number of values, should be equal to dimension(type)
+    /// @argument executor - executor to run tasks, default_executor() if null.
+    /// @argument type - type of predicted values
+    void apply_parallel(const FeatureMatrix& matrix, double* out, size_t dims, Executor* executor = nullptr,
+                        PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply model to features asynchronously. Features are copied into a
+    /// queue, and tasks of Options::executor predict waiting examples by
+    /// buckets, so examples submitted by many callers or while a bucket is
+    /// being predicted share batch kernels. The model waits for submitted
+    /// examples when it is destroyed or loaded again.
+    /// Predictions may run on the caller's thread, for example when the
+    /// executor has no threads on a single CPU host.
+    /// @argument features - pointer to array of features
+    /// @argument count - number of factors provided
+    /// @argument type - type of predicted value
+    /// @returns future of the predicted value
+    std::future<double> apply_async(const float* features, size_t count,
+                                    PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply multidimensional model to features asynchronously and call
+    /// done on the executor thread when predicted values are written. Done
+    /// may run on the caller's thread, for example when the executor has no
+    /// threads on a single CPU host. It should not destroy the model, which
+    /// waits for done to return.
+    /// @argument features - pointer to array of features
+    /// @argument count - number of factors provided
+    /// @argument out - array to save dims predicted values, it should be
+    /// valid until done is called
+    /// @argument dims - number of values, should be equal to dimension(type)
+    /// @argument done - continuation, which should not throw
+    /// @argument type - type of predicted values
+    void apply_async(const float* features, size_t count, double* out, size_t dims, std::function<void()> done,
+                     PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply model to features of another type: T is double, int32_t,
+    /// Float16 or BFloat16. The first feature_count() features are converted
+    /// to float by vector instructions and rounded as by static_cast.
+    /// @argument features - pointer to array of features
+    /// @argument count - number of factors provided
+    /// @argument type - type of predicted value
+    /// @returns predicted value
+    template <typename T>
+    double apply(const T* features, size_t count, PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply multidimensional model to features of another type.
+    /// @argument out - array to save dims predicted values
+    /// @argument dims - number of values, should be equal to dimension(type)
+    template <typename T>
+    void apply(const T* features, size_t count, double* out, size_t dims,
+               PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply model to a bucket of examples with features of another type.
+    /// Examples are converted by blocks, so every feature is converted once.
+    /// @argument features - array of arrays of features
+    /// @argument size - number of examples in the set
+    /// @argument count - number of features for each example
+    /// @argument y - array to save predicted values.
+    template <typename T>
+    void apply(const T* const* features, size_t size, size_t count, double* y,
+               PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply multidimensional model to a bucket of examples with features of
+    /// another type.
+    /// @argument out - array to save size * dims predicted values
+    /// @argument dims - number of values, should be equal to dimension(type)
+    template <typename T>
+    void apply(const T* const* features, size_t size, size_t count, double* out, size_t dims,
+               PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply multidimensional model to a strided matrix of examples, such as
+    /// a NumPy array in C or Fortran order: feature j of example i is
+    /// features[i * row_stride + j * column_stride]. T is float or double.
+    /// Rows of float matrices with unit column stride are passed to kernels
+    /// as is, otherwise used features of blocks of examples are gathered
+    /// column by column, so every column is read sequentially.
+    /// @argument features - pointer to feature 0 of example 0
+    /// @argument size - number of examples in the matrix
+    /// @argument count - number of features for each example
+    /// @argument row_stride - distance between examples in elements
+    /// @argument column_stride - distance between features in elements
+    /// @argument out - array to save size * dims predicted values
+    /// @argument dims - number of values, should be equal to dimension(type)
+    template <typename T>
+    void apply_strided(const T* features, size_t size, size_t count, ptrdiff_t row_stride, ptrdiff_t column_stride,
+                       double* out, size_t dims, PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Set default values of features of sparse examples (zeros after load).
+    /// Leaves of all trees for them are found here, so it should not be
+    /// called while the model is applied by other threads.
+    /// @argument defaults - array of feature_count() default values
+    /// @argument count - number of values provided
+    void set_default_features(const float* defaults, size_t count);
+
+    /// Apply model to a sparse example: features not given have default
+    /// values. Only trees split by the given features are evaluated, so the
+    /// result could differ from the prediction of the dense example in the
+    /// last bits. Model should not have categorical features. Every thread
+    /// keeps default features of the last four models it applied to sparse
+    /// examples, a thread applying more models by turns copies them for
+    /// every example.
+    /// @argument indexes - array of indexes of given features
+    /// @argument values - array of their values
+    /// @argument count - number of features given
+    /// @argument type - type of predicted value
+    /// @returns predicted value
+    double apply_sparse(const uint32_t* indexes, const float* values, size_t count,
+                        PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply multidimensional model to a sparse example.
+    /// @argument out - array to save dims predicted values
+    /// @argument dims - number of values, should be equal to dimension(type)
+    void apply_sparse(const uint32_t* indexes, const float* values, size_t count, double* out, size_t dims,
+                      PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply model to a bucket of sparse examples in CSR format.
+    /// @argument offsets - array of size + 1 positions, features of example i
+    /// are indexes[offsets[i]], values[offsets[i]] ... before offsets[i + 1]
+    /// @argument size - number of examples in the set
+    /// @argument indexes - array of indexes of given features
+    /// @argument values - array of their values
+    /// @argument y - array to save predicted values.
+    /// @argument type - type of predicted values
+    void apply_sparse(const size_t* offsets, size_t size, const uint32_t* indexes, const float* values, double* y,
+                      PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply multidimensional model to a bucket of sparse examples in CSR
+    /// format.
+    /// @argument out - array to save size * dims predicted values, values
+    /// of example i start at out[i * dims]
+    /// @argument dims - number of values, should be equal to dimension(type)
+    void apply_sparse(const size_t* offsets, size_t size, const uint32_t* indexes, const float* values, double* out,
+                      size_t dims, PredictionType type = PredictionType::RawFormulaVal) const;
 
     /// Apply model to features.
     /// @argument features - vector of features
+    /// @argument type - type of predicted value
     /// @returns predicted value
-    double apply(const std::vector<float>& features) const { return apply(features.data(), features.size()); }
+    double apply(const std::vector<float>& features, PredictionType type = PredictionType::RawFormulaVal) const {
+        return apply(features.data(), features.size(), type);
+    }
+
+    /// Apply multidimensional model to features.
+    /// @argument features - vector of features
+    /// @argument out - array to save dims predicted values
+    /// @argument dims - number of values, should be equal to dimension(type)
+    /// @argument type - type of predicted values
+    void apply(const std::vector<float>& features, double* out, size_t dims,
+               PredictionType type = PredictionType::RawFormulaVal) const {
+        apply(features.data(), features.size(), out, dims, type);
+    }
 
     /// Apply model to a bucket of examples.
     /// Each example should have not less features than feature count.
     /// @argument features - input vectors
     /// @argument y - output predictions. This vector will be resized to the
     /// correct size automatically.
-    void apply(const std::vector<std::vector<float>>& features, std::vector<double>& y) const {
+    /// @argument type - type of predicted values
+    void apply(const std::vector<std::vector<float>>& features, std::vector<double>& y,
+               PredictionType type = PredictionType::RawFormulaVal) const {
         static constexpr size_t max_bucket = 16;
         const float* bucket[max_bucket];
         const size_t fcount = feature_count();
@@ -96,7 +651,7 @@ public:
 
                 bucket[j] = features[i + j].data();
             }
-            apply(bucket, max_bucket, fcount, y.data() + i);
+            apply(bucket, max_bucket, fcount, y.data() + i, type);
         }
 
         size_t cnt = 0;
@@ -107,11 +662,410 @@ public:
             }
             bucket[cnt] = features[i + cnt].data();
         }
-        apply(bucket, cnt, fcount, y.data() + i);
+        apply(bucket, cnt, fcount, y.data() + i, type);
     }
 
+    /// Apply model with categorical features.
+    /// @argument features - pointer to array of float features
+    /// @argument count - number of float features provided
+    /// @argument cat_features - pointer to array of hashes of categorical
+    /// features (see hash_cat_feature)
+    /// @argument cat_count - number of categorical features provided
+    /// @argument type - type of predicted value
+    /// @returns predicted value
+    double apply(const float* features, size_t count, const int32_t* cat_features, size_t cat_count,
+                 PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply multidimensional model with categorical features.
+    /// @argument out - array to save dims predicted values
+    /// @argument dims - number of values, should be equal to dimension(type)
+    /// @argument type - type of predicted values
+    void apply(const float* features, size_t count, const int32_t* cat_features, size_t cat_count, double* out,
+               size_t dims, PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply model with categorical features to a bucket of examples.
+    /// @argument features - array of arrays of float features
+    /// @argument size - number of examples in the set
+    /// @argument count - number of float features for each example
+    /// @argument cat_features - array of arrays of hashes of categorical features
+    /// @argument cat_count - number of categorical features for each example
+    /// @argument y - array to save predicted values.
+    /// @argument type - type of predicted values
+    void apply(const float* const* features, size_t size, size_t count, const int32_t* const* cat_features,
+               size_t cat_count, double* y, PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply multidimensional model with categorical features to a bucket
+    /// of examples.
+    /// @argument out - array to save size * dims predicted values, values
+    /// of example i start at out[i * dims]
+    /// @argument dims - number of values, should be equal to dimension(type)
+    /// @argument type - type of predicted values
+    void apply(const float* const* features, size_t size, size_t count, const int32_t* const* cat_features,
+               size_t cat_count, double* out, size_t dims, PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply model with categorical features.
+    /// @argument features - vector of float features
+    /// @argument cat_features - vector of categorical features
+    /// @argument type - type of predicted value
+    /// @returns predicted value
+    double apply(const std::vector<float>& features, const std::vector<std::string>& cat_features,
+                 PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply model with categorical features to a bucket of examples.
+    /// Categorical features of all examples are hashed together.
+    /// @argument features - float features of examples
+    /// @argument cat_features - categorical features of examples
+    /// @argument y - output predictions. This vector will be resized to the
+    /// correct size automatically.
+    /// @argument type - type of predicted values
+    void apply(const std::vector<std::vector<float>>& features,
+               const std::vector<std::vector<std::string>>& cat_features, std::vector<double>& y,
+               PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Return number of SHAP values of an example:
+    /// (feature_count() + cat_feature_count() + 1) * dimension().
+    size_t shap_size() const;
+
+    /// Compute SHAP values (contributions of features to the raw prediction)
+    /// of an example by TreeSHAP with leaf weights as covers, as CatBoost
+    /// does. Model should have oblivious trees only, with leaf weights.
+    /// Contributions of leaves of every tree are precomputed once (see
+    /// Options::shap), so an explanation costs a few predictions.
+    /// @argument features - pointer to array of features
+    /// @argument count - number of factors provided
+    /// @argument out - array to save SHAP values: for every dimension d,
+    /// contribution of feature f is out[d * (n + 1) + f] and expected value
+    /// of the model is out[d * (n + 1) + n], where n is the number of float
+    /// and categorical features. Their sum is the raw prediction.
+    /// @argument out_size - size of out, should be equal to shap_size()
+    void shap_values(const float* features, size_t count, double* out, size_t out_size) const;
+
+    /// Compute SHAP values of an example with categorical features. Float
+    /// features come first and categorical ones follow them in out.
+    /// Contribution of a CTR of several features is shared equally by them.
+    void shap_values(const float* features, size_t count, const int32_t* cat_features, size_t cat_count, double* out,
+                     size_t out_size) const;
+
+    /// Compute SHAP values of a bucket of examples.
+    /// @argument features - array of arrays of features
+    /// @argument size - number of examples in the set
+    /// @argument count - number of features for each example
+    /// @argument out - array to save size * out_size values, values of
+    /// example i start at out[i * out_size]
+    /// @argument out_size - number of values of every example, should be
+    /// equal to shap_size()
+    void shap_values(const float* const* features, size_t size, size_t count, double* out, size_t out_size) const;
+
+    /// Compute SHAP values of a bucket of examples with categorical features.
+    void shap_values(const float* const* features, size_t size, size_t count, const int32_t* const* cat_features,
+                     size_t cat_count, double* out, size_t out_size) const;
+
+    /// Compute SHAP values of a bucket of examples using several threads.
+    /// @argument executor - executor to run tasks, default_executor() if null.
+    void shap_values_parallel(const float* const* features, size_t size, size_t count, double* out, size_t out_size,
+                              Executor* executor = nullptr) const;
+
+    /// Return number of trees: oblivious ones followed by non-symmetric ones,
+    /// in the order of the model file.
+    size_t tree_count() const;
+
+    /// Compute index of the leaf every tree sends an example to, for example
+    /// to use leaves as features of another model. Indexes are written in
+    /// the original order of trees and found by the same kernels as
+    /// predictions. Leaf of an oblivious tree has bit i set if split i of the
+    /// tree goes right (index of its value in the model file), leaves of a
+    /// non-symmetric tree are numbered breadth-first from the left.
+    /// Categorical features are not supported.
+    /// @argument features - pointer to array of features
+    /// @argument count - number of factors provided
+    /// @argument out - array to save indexes of trees from begin to end
+    /// @argument out_size - size of out, should be equal to end - begin
+    /// @argument begin - position of the first tree
+    /// @argument end - position after the last tree, zero for tree_count()
+    /// Throws if some tree in the range has more than 256 leaves.
+    void calc_leaf_indexes(const float* features, size_t count, uint8_t* out, size_t out_size, size_t begin = 0,
+                           size_t end = 0) const;
+
+    /// Compute leaf indexes of trees with up to 65536 leaves.
+    void calc_leaf_indexes(const float* features, size_t count, uint16_t* out, size_t out_size, size_t begin = 0,
+                           size_t end = 0) const;
+
+    /// Compute leaf indexes of a bucket of examples. Examples are evaluated
+    /// several at once by batch kernels.
+    /// @argument features - array of arrays of features
+    /// @argument size - number of examples in the set
+    /// @argument count - number of features for each example
+    /// @argument out - array to save size * out_size indexes, indexes of
+    /// example i start at out[i * out_size]
+    /// @argument out_size - number of indexes of every example, should be
+    /// equal to end - begin
+    void calc_leaf_indexes(const float* const* features, size_t size, size_t count, uint8_t* out, size_t out_size,
+                           size_t begin = 0, size_t end = 0) const;
+
+    void calc_leaf_indexes(const float* const* features, size_t size, size_t count, uint16_t* out, size_t out_size,
+                           size_t begin = 0, size_t end = 0) const;
+
     /// Return number of features model was trainer on.
     size_t feature_count() const;
+
+    /// Return number of categorical features model was trained on.
+    size_t cat_feature_count() const;
+
+    /// Compile the model for examples with fixed values of some float
+    /// features, for example user and context features shared by all
+    /// candidates of a ranking request. Splits by fixed features are replaced
+    /// by the branches their values go to: oblivious trees lose levels,
+    /// non-symmetric trees are cut, and trees without other splits are added
+    /// to bias. The specialized model takes the same features, values of fixed
+    /// ones are ignored unless CTRs use them. Its options are the options of
+    /// this model with tuned kernel and batch width, one tree thread, SHAP
+    /// tables prepared on demand and no prediction cache.
+    /// @argument indexes - indexes of fixed features
+    /// @argument values - their values
+    /// @argument count - number of fixed features
+    /// @argument out - model to load the specialized model into, it could be
+    /// this model
+    void specialize(const uint32_t* indexes, const float* values, size_t count, Model& out) const;
+
+    /// Return indexes of float features used by splits and CTRs of the
+    /// model, the most used first. Other features could have any values.
+    std::vector<uint32_t> used_features() const;
+
+    /// Return number of values predicted for every example: number of
+    /// classes for MultiClass models, number of targets for multi-target
+    /// ones and one for other models.
+    size_t dimension() const;
+
+    /// Return number of values of prediction type for every example. It is
+    /// one for Class of MultiClass models and dimension() otherwise. Throws
+    /// if the type is not supported by the model.
+    size_t dimension(PredictionType type) const;
+
+    /// Change model options. If model is loaded and autotune is set
+    /// autotuner runs immediately.
+    void set_options(const Options& options);
+
+    /// Return model options.
+    const Options& options() const { return options_; }
+
+    /// Select kernel for single predictions.
+    /// Kernel::Auto (default) chooses it by model size on load.
+    void set_kernel(Kernel kernel);
+
+    /// Return kernel used for single predictions.
+    Kernel kernel() const;
+
+    /// Return model statistics including kernel and batch width in use.
+    ModelStats stats() const;
+
+    /// Return counters of the prediction cache, zeros if it is disabled.
+    /// Counters are reset when options are changed.
+    CacheStats cache_stats() const;
+};
+
+/// Session scoring one example while a few of its features change, for
+/// example price or position of a candidate in a re-ranking loop. Leaves of
+/// all trees and the sum of their values are kept for current features, and
+/// an update evaluates only trees split by changed features. The sum is
+/// updated by differences of leaf values and added from leaves again every
+/// 64 updates, so its error is bounded by rounding errors of the leaf
+/// changes of at most 64 updates, and predictions could differ from
+/// Model::apply in the last bits. Models with categorical features are not
+/// supported. The model should not be reloaded or destroyed while scorers
+/// use it. Scorer is not thread-safe, every thread should have its own.
+class Scorer {
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+
+public:
+    Scorer(const Scorer&) = delete;
+    Scorer& operator=(const Scorer&) = delete;
+    Scorer(Scorer&&) noexcept;
+    Scorer& operator=(Scorer&&) noexcept;
+
+    /// Create scorer for default features of the model, see
+    /// Model::set_default_features.
+    explicit Scorer(const Model& model);
+
+    ~Scorer();
+
+    /// Set all features. Leaves of all trees are found again, so it costs
+    /// about as much as a prediction.
+    /// @argument features - pointer to array of features
+    /// @argument count - number of factors provided
+    void reset(const float* features, size_t count);
+
+    /// Change features. Features used by many splits are handled like reset.
+    /// @argument indexes - indexes of changed features, they could repeat and
+    /// the last value is used
+    /// @argument values - new values of the features
+    /// @argument count - number of changed features
+    void update(const uint32_t* indexes, const float* values, size_t count);
+
+    /// Return prediction for current features.
+    double apply(PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Write dims values of prediction for current features to out.
+    void apply(double* out, size_t dims, PredictionType type = PredictionType::RawFormulaVal) const;
+};
+
+/// Several models applied to the same examples, for example the main model
+/// together with challengers and shadow ones. Models are compiled into one
+/// multidimensional model: trees with the same splits are evaluated once for
+/// all models having them, and all trees are evaluated in one pass over
+/// features. Models should not have categorical features.
+class ModelSet {
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+
+public:
+    ModelSet(const ModelSet&) = delete;
+    ModelSet(ModelSet&&) = delete;
+    ModelSet& operator=(const ModelSet&) = delete;
+    ModelSet& operator=(ModelSet&&) = delete;
+
+    /// Create empty set.
+    ModelSet();
+
+    /// Load models from files.
+    /// @argument filenames - names of files with models in JSON format
+    /// @argument options - options of the compiled model
+    explicit ModelSet(const std::vector<std::string>& filenames, const Options& options = Options{});
+
+    ~ModelSet();
+
+    /// Load models from files. Weights are reset to equal ones.
+    void load(const std::vector<std::string>& filenames, const Options& options = Options{});
+
+    /// Load models from streams.
+    void load(const std::vector<std::istream*>& models, const Options& options = Options{});
+
+    /// Return number of models.
+    size_t size() const;
+
+    /// Return number of values predicted for every example by all models.
+    size_t dimension() const;
+
+    /// Return position of the first value of model index in predicted
+    /// values. Model index predicts values from offset(index) to
+    /// offset(index + 1), offset(size()) is dimension().
+    size_t offset(size_t index) const;
+
+    /// Set weights of models for blend. Models have equal weights
+    /// 1 / size() by default.
+    void set_weights(const std::vector<double>& weights);
+
+    /// Return weights of models.
+    const std::vector<double>& weights() const;
+
+    /// Apply all models to features.
+    /// @argument features - pointer to array of features
+    /// @argument count - number of factors provided
+    /// @argument out - array to save values of all models, the same as
+    /// their Model::apply with scale and bias give
+    /// @argument out_size - size of out, should be equal to dimension()
+    void apply(const float* features, size_t count, double* out, size_t out_size) const;
+
+    /// Apply all models to a bucket of examples.
+    /// @argument features - array of arrays of features
+    /// @argument size - number of examples in the set
+    /// @argument count - number of features for each example
+    /// @argument out - array to save size * out_size values, values of
+    /// example i start at out[i * out_size]
+    /// @argument out_size - number of values of every example, should be
+    /// equal to dimension()
+    void apply(const float* const* features, size_t size, size_t count, double* out, size_t out_size) const;
+
+    /// Return weighted sum of predictions of models. Every model should
+    /// predict one value.
+    double blend(const float* features, size_t count) const;
+
+    /// Compute weighted sums of predictions of a bucket of examples.
+    /// @argument y - array to save size values
+    void blend(const float* const* features, size_t size, size_t count, double* y) const;
+
+    /// Return number of features models were trained on.
+    size_t feature_count() const;
+
+    /// Return statistics of the compiled model. Its tree_count is the number
+    /// of distinct trees of all models.
+    ModelStats stats() const;
+};
+
+/// Options of BatchingModel.
+struct BatchingOptions {
+    /// Largest number of examples predicted together.
+    size_t max_batch = 64;
+
+    /// Longest time in microseconds an example waits for others before its
+    /// batch is predicted. Time of prediction is not counted.
+    size_t latency_budget_us = 50;
+};
+
+/// Counters of BatchingModel.
+struct BatchingStats {
+    /// Number of predicted examples.
+    uint64_t examples = 0;
+    /// Number of predicted batches.
+    uint64_t batches = 0;
+    /// Number of batches predicted smaller than expected because the latency
+    /// budget of their oldest example ran out.
+    uint64_t timeouts = 0;
+};
+
+/// Model applied to single examples of many threads by batch kernels.
+/// Calling threads put their examples into a lock-free ring and one of them
+/// predicts the examples of all waiting threads as a bucket, while others
+/// spin and then sleep until their values are written. The batch waits for
+/// as many examples as recent batches had, so a lone caller does not wait
+/// at all, but not longer than the latency budget of its oldest example.
+/// Features are not copied. The model should not be reloaded or destroyed
+/// while it is used, models with categorical features are not supported.
+class BatchingModel {
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+
+public:
+    BatchingModel(const BatchingModel&) = delete;
+    BatchingModel(BatchingModel&&) = delete;
+    BatchingModel& operator=(const BatchingModel&) = delete;
+    BatchingModel& operator=(BatchingModel&&) = delete;
+
+    /// Create batching wrapper of the loaded model.
+    explicit BatchingModel(const Model& model, const BatchingOptions& options = BatchingOptions{});
+
+    ~BatchingModel();
+
+    /// Apply model to features, see Model::apply.
+    /// @argument features - pointer to array of features
+    /// @argument count - number of factors provided
+    /// @argument type - type of predicted value
+    /// @returns predicted value
+    double apply(const float* features, size_t count, PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply multidimensional model to features.
+    /// @argument features - pointer to array of features
+    /// @argument count - number of factors provided
+    /// @argument out - array to save dims predicted values
+    /// @argument dims - number of values, should be equal to dimension(type)
+    /// of the model
+    /// @argument type - type of predicted values
+    void apply(const float* features, size_t count, double* out, size_t dims,
+               PredictionType type = PredictionType::RawFormulaVal) const;
+
+    /// Apply model to features.
+    double apply(const std::vector<float>& features, PredictionType type = PredictionType::RawFormulaVal) const {
+        return apply(features.data(), features.size(), type);
+    }
+
+    /// Return the wrapped model.
+    const Model& model() const;
+
+    /// Return options of batch formation.
+    const BatchingOptions& options() const;
+
+    /// Return counters of predicted examples and batches.
+    BatchingStats stats() const;
 };
 
 // namespace catboost
@@ -2,6 +2,8 @@
 #define CATBOOST_C_INTERFACE_H__INC
 
 #include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 #ifdef __cplusplus
@@ -9,6 +11,29 @@ extern "C" {
 #endif
 
 typedef struct catboost_model_info_st catboost_model_info_t;
+typedef struct catboost_model_set_st catboost_model_set_t;
+typedef struct catboost_scorer_st catboost_scorer_t;
+typedef struct catboost_batching_model_st catboost_batching_model_t;
+typedef struct catboost_matrix_st catboost_matrix_t;
+
+/// Executor for parallel predictions.
+typedef struct catboost_executor_st {
+    /// Number of tasks that could run in parallel with the calling thread.
+    size_t concurrency;
+    /// Schedule task(arg) for execution. Task should be run exactly once.
+    void (*submit)(void* ctx, void (*task)(void* arg), void* arg);
+    /// User data passed to submit.
+    void* ctx;
+} catboost_executor_t;
+
+/// Type of predicted values, see catboost::PredictionType.
+typedef enum catboost_prediction_type_en {
+    CB_RAW_FORMULA_VAL = 0,
+    CB_PROBABILITY = 1,
+    CB_CLASS = 2,
+    CB_EXPONENT = 3,
+    CB_LOG_PROBABILITY = 4,
+} catboost_prediction_type_t;
 
 /// Load model from file.
 /// @argument filename - name of file to load model from.
@@ -45,11 +70,438 @@ double cb_model_apply(const catboost_model_info_t* model, const float* features,
 /// @returns 0 on success, -1 on error.
 int cb_model_apply_many(const catboost_model_info_t* model, const float* const* features, size_t size, size_t count, double* y);
 
+/// Apply model to the bucket using several threads.
+/// @argument model - loaded model to apply
+/// @argument features - array of arrays of features
+/// @argument size - number of examples in the set
+/// @argument count - number of features for each example
+/// @argument y - array to save predicted values.
+/// @argument executor - executor to run tasks. If NULL library thread pool is used.
+/// Small buckets are processed by the calling thread only.
+/// @returns 0 on success, -1 on error.
+int cb_model_apply_parallel(const catboost_model_info_t* model, const float* const* features, size_t size, size_t count,
+                            double* y, const catboost_executor_t* executor);
+
+/// Apply multidimensional (MultiClass, MultiRMSE, etc.) model to the list of features.
+/// @argument model - loaded model to apply
+/// @argument features - pointer to array of features
+/// @argument count - number of factors provided
+/// @argument out - array to save dims predicted values
+/// @argument dims - number of values, should be equal to cb_model_dimension(model)
+/// @returns 0 on success, -1 on error.
+int cb_model_apply_multi(const catboost_model_info_t* model, const float* features, size_t count, double* out,
+                         size_t dims);
+
+/// Apply multidimensional model to the bucket.
+/// @argument model - loaded model to apply
+/// @argument features - array of arrays of features
+/// @argument size - number of examples in the set
+/// @argument count - number of features for each example
+/// @argument out - array to save size * dims predicted values, values of example i start at out[i * dims]
+/// @argument dims - number of values, should be equal to cb_model_dimension(model)
+/// @returns 0 on success, -1 on error.
+int cb_model_apply_multi_many(const catboost_model_info_t* model, const float* const* features, size_t size,
+                              size_t count, double* out, size_t dims);
+
+/// Apply model and transform predictions to the type (probability, class, etc.).
+/// @argument model - loaded model to apply
+/// @argument features - pointer to array of features
+/// @argument count - number of factors provided
+/// @argument type - type of predicted values
+/// @argument out - array to save dims predicted values
+/// @argument dims - number of values, should be equal to cb_model_prediction_dimension(model, type)
+/// @returns 0 on success, -1 on error.
+int cb_model_apply_typed(const catboost_model_info_t* model, const float* features, size_t count,
+                         catboost_prediction_type_t type, double* out, size_t dims);
+
+/// Apply model to the bucket and transform predictions to the type.
+/// @argument model - loaded model to apply
+/// @argument features - array of arrays of features
+/// @argument size - number of examples in the set
+/// @argument count - number of features for each example
+/// @argument type - type of predicted values
+/// @argument out - array to save size * dims predicted values, values of example i start at out[i * dims]
+/// @argument dims - number of values, should be equal to cb_model_prediction_dimension(model, type)
+/// @returns 0 on success, -1 on error.
+int cb_model_apply_typed_many(const catboost_model_info_t* model, const float* const* features, size_t size,
+                              size_t count, catboost_prediction_type_t type, double* out, size_t dims);
+
+/// Apply model to double features. They are converted to float as by a cast, rounded to nearest.
+/// Arguments and result are the same as of cb_model_apply_typed.
+int cb_model_apply_double(const catboost_model_info_t* model, const double* features, size_t count,
+                          catboost_prediction_type_t type, double* out, size_t dims);
+
+/// Apply model to the bucket of double features, see cb_model_apply_typed_many.
+int cb_model_apply_double_many(const catboost_model_info_t* model, const double* const* features,
+                               size_t size, size_t count, catboost_prediction_type_t type, double* out,
+                               size_t dims);
+
+/// Apply model to int32 features. They are converted to float as by a cast, rounded to nearest.
+/// Arguments and result are the same as of cb_model_apply_typed.
+int cb_model_apply_int32(const catboost_model_info_t* model, const int32_t* features, size_t count,
+                         catboost_prediction_type_t type, double* out, size_t dims);
+
+/// Apply model to the bucket of int32 features, see cb_model_apply_typed_many.
+int cb_model_apply_int32_many(const catboost_model_info_t* model, const int32_t* const* features,
+                              size_t size, size_t count, catboost_prediction_type_t type, double* out,
+                              size_t dims);
+
+/// Apply model to IEEE half precision features passed as bits. They are converted to float exactly.
+/// Arguments and result are the same as of cb_model_apply_typed.
+int cb_model_apply_fp16(const catboost_model_info_t* model, const uint16_t* features, size_t count,
+                        catboost_prediction_type_t type, double* out, size_t dims);
+
+/// Apply model to the bucket of fp16 features, see cb_model_apply_typed_many.
+int cb_model_apply_fp16_many(const catboost_model_info_t* model, const uint16_t* const* features,
+                             size_t size, size_t count, catboost_prediction_type_t type, double* out,
+                             size_t dims);
+
+/// Apply model to bfloat16 features passed as bits (upper halves of floats).
+/// Arguments and result are the same as of cb_model_apply_typed.
+int cb_model_apply_bf16(const catboost_model_info_t* model, const uint16_t* features, size_t count,
+                        catboost_prediction_type_t type, double* out, size_t dims);
+
+/// Apply model to the bucket of bf16 features, see cb_model_apply_typed_many.
+int cb_model_apply_bf16_many(const catboost_model_info_t* model, const uint16_t* const* features,
+                             size_t size, size_t count, catboost_prediction_type_t type, double* out,
+                             size_t dims);
+
+/// Apply model to a strided matrix of examples, such as a NumPy array in C or Fortran order.
+/// @argument model - loaded model to apply
+/// @argument features - pointer to feature 0 of example 0
+/// @argument size - number of examples in the matrix
+/// @argument count - number of features for each example
+/// @argument row_stride - distance between examples in elements, count for C order
+/// @argument column_stride - distance between features in elements, size for Fortran order
+/// @argument type - type of predicted values
+/// @argument out - array to save size * dims predicted values, values of example i start at out[i * dims]
+/// @argument dims - number of values, should be equal to cb_model_prediction_dimension(model, type)
+/// @returns 0 on success, -1 on error.
+int cb_model_apply_strided(const catboost_model_info_t* model, const float* features, size_t size, size_t count,
+                           ptrdiff_t row_stride, ptrdiff_t column_stride, catboost_prediction_type_t type,
+                           double* out, size_t dims);
+
+/// Apply model to a strided matrix of double features, see cb_model_apply_strided.
+int cb_model_apply_double_strided(const catboost_model_info_t* model, const double* features, size_t size,
+                                  size_t count, ptrdiff_t row_stride, ptrdiff_t column_stride,
+                                  catboost_prediction_type_t type, double* out, size_t dims);
+
+/// Set default values of features of sparse examples (zeros after load).
+/// @argument model - loaded model
+/// @argument defaults - array of default values of all features of the model
+/// @argument count - number of values provided
+/// @returns 0 on success, -1 on error.
+int cb_model_set_default_features(catboost_model_info_t* model, const float* defaults, size_t count);
+
+/// Apply model to a sparse example, features not given have default values.
+/// @argument model - loaded model to apply
+/// @argument indexes - array of indexes of given features
+/// @argument values - array of their values
+/// @argument count - number of features given
+/// @argument type - type of predicted values
+/// @argument out - array to save dims predicted values
+/// @argument dims - number of values, should be equal to cb_model_prediction_dimension(model, type)
+/// @returns 0 on success, -1 on error.
+int cb_model_apply_sparse(const catboost_model_info_t* model, const uint32_t* indexes, const float* values,
+                          size_t count, catboost_prediction_type_t type, double* out, size_t dims);
+
+/// Apply model to a bucket of sparse examples in CSR format.
+/// @argument model - loaded model to apply
+/// @argument offsets - array of size + 1 positions, features of example i are at positions from offsets[i]
+/// to offsets[i + 1] of indexes and values
+/// @argument size - number of examples in the set
+/// @argument indexes - array of indexes of given features
+/// @argument values - array of their values
+/// @argument type - type of predicted values
+/// @argument out - array to save size * dims predicted values, values of example i start at out[i * dims]
+/// @argument dims - number of values, should be equal to cb_model_prediction_dimension(model, type)
+/// @returns 0 on success, -1 on error.
+int cb_model_apply_sparse_csr(const catboost_model_info_t* model, const size_t* offsets, size_t size,
+                              const uint32_t* indexes, const float* values, catboost_prediction_type_t type,
+                              double* out, size_t dims);
+
+/// Create scorer of one example whose features change, see catboost::Scorer.
+/// @argument model - loaded model without categorical features, it should not be freed before the scorer
+/// Returns scorer for default features of the model. On error function returns NULL and sets reason string.
+catboost_scorer_t* cb_scorer_create(const catboost_model_info_t* model);
+
+/// Free the scorer.
+void cb_scorer_free(catboost_scorer_t* scorer);
+
+/// Set all features of the scorer.
+/// @argument features - pointer to array of features
+/// @argument count - number of factors provided
+/// @returns 0 on success, -1 on error.
+int cb_scorer_reset(catboost_scorer_t* scorer, const float* features, size_t count);
+
+/// Change features of the scorer, only trees split by them are evaluated.
+/// @argument indexes - array of indexes of changed features
+/// @argument values - array of their new values
+/// @argument count - number of changed features
+/// @returns 0 on success, -1 on error.
+int cb_scorer_update(catboost_scorer_t* scorer, const uint32_t* indexes, const float* values, size_t count);
+
+/// Get prediction for current features of the scorer.
+/// @argument type - type of predicted values
+/// @argument out - array to save dims predicted values
+/// @argument dims - number of values, should be equal to cb_model_prediction_dimension(model, type)
+/// @returns 0 on success, -1 on error.
+int cb_scorer_apply(const catboost_scorer_t* scorer, catboost_prediction_type_t type, double* out, size_t dims);
+
+/// Hash categorical feature value the same way CatBoost does.
+/// @argument value - pointer to value bytes
+/// @argument size - size of value
+/// @returns hash to pass to cb_model_apply_cat.
+int32_t cb_hash_cat_feature(const char* value, size_t size);
+
+/// Apply model with categorical features.
+/// @argument model - loaded model to apply
+/// @argument features - pointer to array of float features
+/// @argument count - number of float features provided
+/// @argument cat_features - pointer to array of hashes of categorical features
+/// @argument cat_count - number of categorical features provided
+/// @returns predicted value. On error function returns NaN.
+double cb_model_apply_cat(const catboost_model_info_t* model, const float* features, size_t count,
+                          const int32_t* cat_features, size_t cat_count);
+
+/// Apply model with categorical features to the bucket.
+/// @argument model - loaded model to apply
+/// @argument features - array of arrays of float features
+/// @argument size - number of examples in the set
+/// @argument count - number of float features for each example
+/// @argument cat_features - array of arrays of hashes of categorical features
+/// @argument cat_count - number of categorical features for each example
+/// @argument y - array to save predicted values.
+/// @returns 0 on success, -1 on error.
+int cb_model_apply_cat_many(const catboost_model_info_t* model, const float* const* features, size_t size,
+                            size_t count, const int32_t* const* cat_features, size_t cat_count, double* y);
+
+/// Get number of categorical features model was trained on.
+/// @argument model - loaded model
+/// @returns number of categorical features expected by the model.
+size_t cb_model_cat_feature_count(const catboost_model_info_t* model);
+
+/// Get number of values predicted for every example.
+/// @argument model - loaded model
+/// @returns number of classes for MultiClass models, number of targets for multi-target ones and 1 for others.
+size_t cb_model_dimension(const catboost_model_info_t* model);
+
+/// Get number of values of prediction type for every example.
+/// @argument model - loaded model
+/// @argument type - type of predicted values
+/// @returns number of values or 0 if the model does not support the type.
+size_t cb_model_prediction_dimension(const catboost_model_info_t* model, catboost_prediction_type_t type);
+
+/// Get number of SHAP values of an example.
+/// @argument model - loaded model
+/// @returns (feature count + categorical feature count + 1) * dimension.
+size_t cb_model_shap_size(const catboost_model_info_t* model);
+
+/// Compute SHAP values (contributions of features) of an example, see catboost::Model::shap_values.
+/// @argument model - loaded model with oblivious trees and leaf weights
+/// @argument features - pointer to array of features
+/// @argument count - number of factors provided
+/// @argument out - array to save SHAP values: contribution of feature f to dimension d is out[d * (n + 1) + f] and
+/// expected value is out[d * (n + 1) + n], where n is the number of features
+/// @argument out_size - size of out, should be equal to cb_model_shap_size(model)
+/// @returns 0 on success, -1 on error.
+int cb_model_shap_values(const catboost_model_info_t* model, const float* features, size_t count, double* out,
+                         size_t out_size);
+
+/// Compute SHAP values of the bucket.
+/// @argument model - loaded model with oblivious trees and leaf weights
+/// @argument features - array of arrays of features
+/// @argument size - number of examples in the set
+/// @argument count - number of features for each example
+/// @argument out - array to save size * out_size values, values of example i start at out[i * out_size]
+/// @argument out_size - number of values of every example, should be equal to cb_model_shap_size(model)
+/// @returns 0 on success, -1 on error.
+int cb_model_shap_values_many(const catboost_model_info_t* model, const float* const* features, size_t size,
+                              size_t count, double* out, size_t out_size);
+
+/// Compute SHAP values of the bucket using several threads.
+/// @argument executor - executor to run tasks. If NULL library thread pool is used.
+/// @returns 0 on success, -1 on error.
+int cb_model_shap_values_parallel(const catboost_model_info_t* model, const float* const* features, size_t size,
+                                  size_t count, double* out, size_t out_size, const catboost_executor_t* executor);
+
+/// Compute SHAP values of an example with categorical features. Categorical features follow float ones in out.
+/// @returns 0 on success, -1 on error.
+int cb_model_shap_values_cat(const catboost_model_info_t* model, const float* features, size_t count,
+                             const int32_t* cat_features, size_t cat_count, double* out, size_t out_size);
+
+/// Get number of trees of the model.
+/// @argument model - loaded model
+/// @returns number of oblivious and non-symmetric trees.
+size_t cb_model_tree_count(const catboost_model_info_t* model);
+
+/// Compute leaf index of every tree for an example, see catboost::Model::calc_leaf_indexes.
+/// @argument model - loaded model without categorical features
+/// @argument features - pointer to array of features
+/// @argument count - number of factors provided
+/// @argument out - array to save leaf indexes of trees from begin to end in the order of the model file
+/// @argument out_size - size of out, should be equal to end - begin
+/// @argument begin - position of the first tree
+/// @argument end - position after the last tree, 0 for cb_model_tree_count(model)
+/// @returns 0 on success, -1 on error.
+int cb_model_calc_leaf_indexes(const catboost_model_info_t* model, const float* features, size_t count,
+                               uint16_t* out, size_t out_size, size_t begin, size_t end);
+
+/// Compute leaf indexes of the bucket, indexes of example i start at out[i * out_size].
+/// @returns 0 on success, -1 on error.
+int cb_model_calc_leaf_indexes_many(const catboost_model_info_t* model, const float* const* features, size_t size,
+                                    size_t count, uint16_t* out, size_t out_size, size_t begin, size_t end);
+
 /// Get number of features model was trained on.
 /// @argument model - loaded model to apply
 /// @returns number of features expected by the model.
 size_t cb_model_feature_count(const catboost_model_info_t* model);
 
+/// Compile the model for examples with fixed values of some float features, see catboost::Model::specialize.
+/// @argument model - loaded model
+/// @argument indexes - array of indexes of fixed features
+/// @argument values - array of their values
+/// @argument count - number of fixed features
+/// Returns specialized model to free by cb_model_free. On error function returns NULL and sets reason string.
+catboost_model_info_t* cb_model_specialize(const catboost_model_info_t* model, const uint32_t* indexes,
+                                           const float* values, size_t count);
+
+/// Get indexes of float features used by the model, the most used first.
+/// @argument model - loaded model
+/// @argument out - array to save indexes, could be NULL if size is 0
+/// @argument size - size of out, at most size indexes are written
+/// @returns number of used features.
+size_t cb_model_used_features(const catboost_model_info_t* model, uint32_t* out, size_t size);
+
+/// Enable the cache of predictions of dense examples, see catboost::Options::cache_size.
+/// @argument model - loaded model
+/// @argument size - size of the cache in bytes, 0 disables it
+/// @argument dedupe_rows - non-zero to predict identical examples of a bucket once without the cache
+/// @returns 0 on success, -1 on error.
+int cb_model_set_cache(catboost_model_info_t* model, size_t size, int dedupe_rows);
+
+/// Get counters of the prediction cache, zeros if it is disabled.
+/// @argument model - loaded model
+/// @argument hits - number of examples found in the cache, could be NULL
+/// @argument misses - number of examples predicted and added to the cache, could be NULL
+/// @returns 0 on success, -1 on error.
+int cb_model_cache_stats(const catboost_model_info_t* model, uint64_t* hits, uint64_t* misses);
+
+/// Submit an example to be predicted asynchronously by the library thread
+/// pool. Features are copied, and examples submitted concurrently are
+/// predicted by buckets. cb_model_free waits for submitted examples.
+/// @argument model - loaded model to apply
+/// @argument features - pointer to array of features
+/// @argument count - number of factors provided
+/// @argument type - type of predicted values
+/// @argument out - array to save dims predicted values, valid until done is called
+/// @argument dims - number of values, should be equal to cb_model_prediction_dimension(model, type)
+/// @argument done - completion callback called on a pool thread, when out is written. It may run on the caller's
+/// thread, for example when the pool has no threads on a single CPU host. It should not free the model, because
+/// cb_model_free waits for done to return.
+/// @argument cookie - user pointer passed to done
+/// @returns 0 on success, -1 on error. Done is not called on error.
+int cb_model_submit(const catboost_model_info_t* model, const float* features, size_t count,
+                    catboost_prediction_type_t type, double* out, size_t dims, void (*done)(void* cookie),
+                    void* cookie);
+
+/// Create wrapper of the model predicting examples of concurrent callers by buckets, see catboost::BatchingModel.
+/// @argument model - loaded model without categorical features, it should not be freed before the wrapper
+/// @argument max_batch - largest number of examples predicted together
+/// @argument latency_budget_us - longest wait of an example for others in microseconds
+/// Returns the wrapper. On error function returns NULL and sets reason string.
+catboost_batching_model_t* cb_batching_model_create(const catboost_model_info_t* model, size_t max_batch,
+                                                    size_t latency_budget_us);
+
+/// Free the wrapper. It should not be used by other threads.
+void cb_batching_model_free(catboost_batching_model_t* batching);
+
+/// Apply model to features together with examples of other threads.
+/// @argument batching - wrapper of the model
+/// @argument features - pointer to array of features
+/// @argument count - number of factors provided
+/// @argument type - type of predicted values
+/// @argument out - array to save dims predicted values
+/// @argument dims - number of values, should be equal to cb_model_prediction_dimension(model, type)
+/// @returns 0 on success, -1 on error.
+int cb_batching_model_apply(const catboost_batching_model_t* batching, const float* features, size_t count,
+                            catboost_prediction_type_t type, double* out, size_t dims);
+
+/// Load several models applied together, see catboost::ModelSet.
+/// @argument filenames - names of files to load models from
+/// @argument count - number of files
+/// Returns loaded set. On error function returns NULL and sets reason string.
+catboost_model_set_t* cb_model_set_load(const char* const* filenames, size_t count);
+
+/// Free model set memory.
+void cb_model_set_free(catboost_model_set_t* set);
+
+/// Get number of values predicted for every example by all models of the set.
+size_t cb_model_set_dimension(const catboost_model_set_t* set);
+
+/// Apply all models of the set to the list of features.
+/// @argument set - loaded model set
+/// @argument features - pointer to array of features
+/// @argument count - number of factors provided
+/// @argument out - array to save values of all models in the order of files
+/// @argument out_size - size of out, should be equal to cb_model_set_dimension(set)
+/// @returns 0 on success, -1 on error.
+int cb_model_set_apply(const catboost_model_set_t* set, const float* features, size_t count, double* out,
+                       size_t out_size);
+
+/// Apply all models of the set to the bucket, values of example i start at out[i * out_size].
+/// @returns 0 on success, -1 on error.
+int cb_model_set_apply_many(const catboost_model_set_t* set, const float* const* features, size_t size, size_t count,
+                            double* out, size_t out_size);
+
+/// Set weights of models for blending.
+/// @argument weights - weight of every model in the order of files
+/// @argument count - number of weights
+/// @returns 0 on success, -1 on error.
+int cb_model_set_weights(catboost_model_set_t* set, const double* weights, size_t count);
+
+/// Get weighted sum of predictions of one-dimensional models of the set.
+/// @returns blended value. On error function returns NaN.
+double cb_model_set_blend(const catboost_model_set_t* set, const float* features, size_t count);
+
+/// Map feature matrix file, see catboost::FeatureMatrix.
+/// @argument filename - name of file written by catboost-matrix or catboost::FeatureMatrix::write
+/// Returns mapped matrix. On error function returns NULL and sets reason string.
+catboost_matrix_t* cb_matrix_load(const char* filename);
+
+/// Unmap feature matrix. Pointers to its features and labels become invalid.
+void cb_matrix_free(catboost_matrix_t* matrix);
+
+/// Get number of examples of the matrix.
+size_t cb_matrix_rows(const catboost_matrix_t* matrix);
+
+/// Get number of features of every example of the matrix.
+size_t cb_matrix_features(const catboost_matrix_t* matrix);
+
+/// Get features of the matrix: feature j of example i is data[i * row_stride + j * column_stride].
+/// @argument matrix - mapped matrix
+/// @argument row_stride - pointer to save distance between examples in elements
+/// @argument column_stride - pointer to save distance between features in elements
+/// @returns pointer to feature 0 of example 0.
+const float* cb_matrix_data(const catboost_matrix_t* matrix, ptrdiff_t* row_stride, ptrdiff_t* column_stride);
+
+/// Get labels of the matrix.
+/// @returns pointer to cb_matrix_rows(matrix) labels or NULL if the file has no labels.
+const double* cb_matrix_label(const catboost_matrix_t* matrix);
+
+/// Apply model to all examples of the matrix.
+/// @argument model - loaded model to apply
+/// @argument matrix - mapped matrix
+/// @argument type - type of predicted values
+/// @argument out - array to save cb_matrix_rows(matrix) * dims predicted values
+/// @argument dims - number of values, should be equal to cb_model_prediction_dimension(model, type)
+/// @argument executor - executor to run tasks. If NULL library thread pool is used.
+/// Small matrices are processed by the calling thread only.
+/// @returns 0 on success, -1 on error.
+int cb_model_apply_matrix(const catboost_model_info_t* model, const catboost_matrix_t* matrix,
+                          catboost_prediction_type_t type, double* out, size_t dims,
+                          const catboost_executor_t* executor);
+
 /// Get last error information as a string.
 /// @returns last error description.
 const char* cb_model_last_error(void);
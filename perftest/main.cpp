@@ -1,15 +1,24 @@
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstring>
 #include <functional>
+#include <future>
+#include <numeric>
 #include <set>
+#include <thread>
+#include <utility>
 
 #include "catboost.hpp"
+#include "cmdline.hpp"
 #include "codrna.cpp"
 #include "creditgermany.cpp"
 #include "dll.hpp"
 #include "msrank.cpp"
 #include "perf_test.hpp"
+#include "synthetic.hpp"
 
 #ifdef WIN32
 #define CATBOOST_LIBRARY "build/libcatboostmodel.dll"
@@ -57,13 +66,363 @@ static struct CatboostAPIInitializer {
 struct JsonModel {
     catboost::Model model_;
 
-    explicit JsonModel(const std::string& filename) { model_.load(filename); }
+    explicit JsonModel(const std::string& filename, const catboost::Options& options = {})
+        : model_(filename, options) {}
+
+    explicit JsonModel(std::istream& in, const catboost::Options& options = {}) : model_(in, options) {}
 
     double predict(const std::vector<float>& x) const { return model_.apply(x); }
 
     void predict(const std::vector<std::vector<float>>& x, std::vector<double>& y) const { model_.apply(x, y); }
 };
 
+// Multidimensional model. Returns the first dimension to compare with labels.
+struct MultiModel {
+    catboost::Model model_;
+    mutable std::vector<double> out_;
+
+    MultiModel(std::istream& in, const catboost::Options& options) : model_(in, options) {}
+
+    double predict(const std::vector<float>& x) const {
+        out_.resize(model_.dimension());
+        model_.apply(x, out_.data(), out_.size());
+        return out_[0];
+    }
+
+    void predict(const std::vector<std::vector<float>>& x, std::vector<double>& y) const {
+        const size_t dims = model_.dimension();
+        std::vector<const float*> rows;
+        rows.reserve(x.size());
+        for (const auto& row : x) rows.push_back(row.data());
+        out_.resize(x.size() * dims);
+        model_.apply(rows.data(), rows.size(), x[0].size(), out_.data(), dims);
+        y.resize(x.size());
+        for (size_t i = 0; i < x.size(); ++i) y[i] = out_[i * dims];
+    }
+};
+
+// Model with categorical features. The last columns of examples are numbers
+// of categories, which are passed as precomputed hashes or as strings.
+struct CatModel {
+    catboost::Model model_;
+    std::vector<int32_t> hashes_;
+    std::vector<std::string> strings_;
+    bool use_strings_ = false;
+
+    CatModel(std::istream& in, const catboost::Options& options, size_t values) : model_(in, options) {
+        for (size_t v = 0; v < values; ++v) {
+            hashes_.push_back(catboost::hash_cat_feature(static_cast<int64_t>(v)));
+            strings_.push_back(std::to_string(v));
+        }
+    }
+
+    // Hashes of categorical features of an example.
+    const int32_t* hash(const std::vector<float>& x, int32_t* out) const {
+        const size_t features = model_.feature_count();
+        const size_t cats = model_.cat_feature_count();
+        if (!use_strings_) {
+            for (size_t j = 0; j < cats; ++j) out[j] = hashes_[static_cast<size_t>(x[features + j])];
+            return out;
+        }
+        thread_local std::vector<std::string> values;
+        values.resize(cats);
+        for (size_t j = 0; j < cats; ++j) values[j] = strings_[static_cast<size_t>(x[features + j])];
+        catboost::hash_cat_features(values.data(), cats, out);
+        return out;
+    }
+
+    double predict(const std::vector<float>& x) const {
+        int32_t cats[64];
+        return model_.apply(x.data(), x.size(), hash(x, cats), model_.cat_feature_count());
+    }
+
+    void predict(const std::vector<std::vector<float>>& x, std::vector<double>& y) const {
+        const size_t cats = model_.cat_feature_count();
+        std::vector<int32_t> hashes(x.size() * cats);
+        std::vector<const float*> rows;
+        std::vector<const int32_t*> cat_rows;
+        for (size_t i = 0; i < x.size(); ++i) {
+            rows.push_back(x[i].data());
+            cat_rows.push_back(hash(x[i], hashes.data() + i * cats));
+        }
+        y.resize(x.size());
+        model_.apply(rows.data(), rows.size(), x[0].size(), cat_rows.data(), cats, y.data());
+    }
+};
+
+// Classifier predicting probabilities, either by the fused transform of the
+// library or by a separate pass over raw values. Returns probability of the
+// first class.
+struct ProbabilityModel {
+    catboost::Model model_;
+    bool fused_ = true;
+    mutable std::vector<double> out_;
+
+    ProbabilityModel(std::istream& in, const catboost::Options& options) : model_(in, options) {}
+
+    // Sigmoid or softmax of raw values of size examples.
+    static void probabilities(double* p, size_t size, size_t dims) {
+        if (dims == 1) {
+            for (size_t i = 0; i < size; ++i) p[i] = 1.0 / (1.0 + std::exp(-p[i]));
+            return;
+        }
+        for (size_t i = 0; i < size; ++i) {
+            double* x = p + i * dims;
+            const double max = *std::max_element(x, x + dims);
+            double sum = 0.0;
+            for (size_t d = 0; d < dims; ++d) {
+                x[d] = std::exp(x[d] - max);
+                sum += x[d];
+            }
+            for (size_t d = 0; d < dims; ++d) x[d] /= sum;
+        }
+    }
+
+    double predict(const std::vector<float>& x) const {
+        const size_t dims = model_.dimension();
+        out_.resize(dims);
+        if (fused_) {
+            model_.apply(x, out_.data(), dims, catboost::PredictionType::Probability);
+        } else {
+            model_.apply(x, out_.data(), dims);
+            probabilities(out_.data(), 1, dims);
+        }
+        return out_[0];
+    }
+
+    void predict(const std::vector<std::vector<float>>& x, std::vector<double>& y) const {
+        const size_t dims = model_.dimension();
+        std::vector<const float*> rows;
+        rows.reserve(x.size());
+        for (const auto& row : x) rows.push_back(row.data());
+        out_.resize(x.size() * dims);
+        if (fused_) {
+            model_.apply(rows.data(), rows.size(), x[0].size(), out_.data(), dims,
+                         catboost::PredictionType::Probability);
+        } else {
+            model_.apply(rows.data(), rows.size(), x[0].size(), out_.data(), dims);
+            probabilities(out_.data(), x.size(), dims);
+        }
+        y.resize(x.size());
+        for (size_t i = 0; i < x.size(); ++i) y[i] = out_[i * dims];
+    }
+};
+
+// SHAP values of examples computed by one or several threads. Returns
+// contribution of the first feature.
+struct ShapModel {
+    catboost::Model model_;
+    bool parallel_ = false;
+    mutable std::vector<double> out_;
+
+    ShapModel(std::istream& in, const catboost::Options& options) : model_(in, options) {}
+
+    double predict(const std::vector<float>& x) const {
+        out_.resize(model_.shap_size());
+        model_.shap_values(x.data(), x.size(), out_.data(), out_.size());
+        return out_[0];
+    }
+
+    void predict(const std::vector<std::vector<float>>& x, std::vector<double>& y) const {
+        const size_t size = model_.shap_size();
+        std::vector<const float*> rows;
+        rows.reserve(x.size());
+        for (const auto& row : x) rows.push_back(row.data());
+        out_.resize(x.size() * size);
+        if (parallel_) {
+            model_.shap_values_parallel(rows.data(), rows.size(), x[0].size(), out_.data(), size);
+        } else {
+            model_.shap_values(rows.data(), rows.size(), x[0].size(), out_.data(), size);
+        }
+        y.resize(x.size());
+        for (size_t i = 0; i < x.size(); ++i) y[i] = out_[i * size];
+    }
+};
+
+// Leaf indexes of all trees of examples. Returns sum of indexes.
+struct LeafIndexModel {
+    catboost::Model model_;
+    mutable std::vector<uint8_t> out_;
+
+    LeafIndexModel(std::istream& in, const catboost::Options& options) : model_(in, options) {}
+
+    double predict(const std::vector<float>& x) const {
+        out_.resize(model_.tree_count());
+        model_.calc_leaf_indexes(x.data(), x.size(), out_.data(), out_.size());
+        return std::accumulate(out_.begin(), out_.end(), 0.0);
+    }
+
+    void predict(const std::vector<std::vector<float>>& x, std::vector<double>& y) const {
+        const size_t trees = model_.tree_count();
+        std::vector<const float*> rows;
+        rows.reserve(x.size());
+        for (const auto& row : x) rows.push_back(row.data());
+        out_.resize(x.size() * trees);
+        model_.calc_leaf_indexes(rows.data(), rows.size(), x[0].size(), out_.data(), trees);
+        y.resize(x.size());
+        for (size_t i = 0; i < x.size(); ++i) {
+            y[i] = std::accumulate(out_.begin() + i * trees, out_.begin() + (i + 1) * trees, 0.0);
+        }
+    }
+};
+
+// Model applied to features of type T converted from the test data in
+// advance, so only conversion by the library is measured.
+template <typename T>
+struct TypedModel {
+    catboost::Model model_;
+    const TestData& data_;
+    std::vector<std::vector<T>> rows_;
+
+    TypedModel(std::istream& in, const catboost::Options& options, const TestData& data, T (*convert)(float))
+        : model_(in, options), data_(data) {
+        for (const auto& row : data.data) {
+            rows_.emplace_back();
+            for (float a : row) rows_.back().push_back(convert(a));
+        }
+    }
+
+    double predict(const std::vector<float>& x) const {
+        const auto& row = rows_[&x - data_.data.data()];
+        return model_.apply(row.data(), row.size());
+    }
+
+    void predict(const std::vector<std::vector<float>>& x, std::vector<double>& y) const {
+        std::vector<const T*> rows;
+        rows.reserve(x.size());
+        for (const auto& row : x) rows.push_back(rows_[&row - data_.data.data()].data());
+        y.resize(x.size());
+        model_.apply(rows.data(), rows.size(), rows_[0].size(), y.data());
+    }
+};
+
+// Model applied to the feature matrix of the test data in place.
+struct MatrixModel {
+    catboost::Model model_;
+    const TestData& data_;
+
+    MatrixModel(std::istream& in, const catboost::Options& options, const TestData& data)
+        : model_(in, options), data_(data) {}
+
+    void predict(const std::vector<std::vector<float>>& x, std::vector<double>& y) const {
+        y.resize(x.size());
+        model_.apply(data_.matrix, y.data(), 1);
+    }
+};
+
+// Model applied to nonzero features of the test data in CSR format.
+// Scorer of the first example, every prediction changes a few features.
+struct ScorerModel {
+    catboost::Model model_;
+    mutable catboost::Scorer scorer_;
+    std::vector<uint32_t> changed_;
+    mutable std::vector<float> values_;
+
+    ScorerModel(std::istream& in, const catboost::Options& options, const TestData& data,
+                std::vector<uint32_t> changed)
+        : model_(in, options), scorer_(model_), changed_(std::move(changed)), values_(changed_.size()) {
+        scorer_.reset(data.data[0].data(), data.data[0].size());
+    }
+
+    double predict(const std::vector<float>& x) const {
+        for (size_t i = 0; i < changed_.size(); ++i) values_[i] = x[changed_[i]];
+        scorer_.update(changed_.data(), values_.data(), changed_.size());
+        return scorer_.apply();
+    }
+};
+
+struct SparseModel {
+    catboost::Model model_;
+    const TestData& data_;
+    std::vector<size_t> offsets_{0};
+    std::vector<uint32_t> indexes_;
+    std::vector<float> values_;
+
+    SparseModel(std::istream& in, const catboost::Options& options, const TestData& data)
+        : model_(in, options), data_(data) {
+        for (const auto& row : data.data) {
+            for (size_t j = 0; j < row.size(); ++j) {
+                if (row[j] == 0.0f) continue;
+                indexes_.push_back(static_cast<uint32_t>(j));
+                values_.push_back(row[j]);
+            }
+            offsets_.push_back(indexes_.size());
+        }
+    }
+
+    double predict(const std::vector<float>& x) const {
+        const size_t i = &x - data_.data.data();
+        return model_.apply_sparse(indexes_.data() + offsets_[i], values_.data() + offsets_[i],
+                                   offsets_[i + 1] - offsets_[i]);
+    }
+
+    void predict(const std::vector<std::vector<float>>& x, std::vector<double>& y) const {
+        y.resize(x.size());
+        model_.apply_sparse(offsets_.data(), x.size(), indexes_.data(), values_.data(), y.data());
+    }
+};
+
+// One-vs-rest set of one-dimensional models.
+struct OneVsRestModel {
+    std::vector<std::unique_ptr<catboost::Model>> models_;
+    mutable std::vector<double> out_;
+
+    double predict(const std::vector<float>& x) const {
+        out_.resize(models_.size());
+        for (size_t d = 0; d < models_.size(); ++d) out_[d] = models_[d]->apply(x);
+        return out_[0];
+    }
+
+    void predict(const std::vector<std::vector<float>>& x, std::vector<double>& y) const {
+        std::vector<double> tmp;
+        for (size_t d = 1; d < models_.size(); ++d) models_[d]->apply(x, tmp);
+        models_[0]->apply(x, y);
+    }
+};
+
+// Models of a set applied together. Returns the value of the first model.
+struct ModelSetModel {
+    catboost::ModelSet set_;
+    mutable std::vector<double> out_;
+
+    ModelSetModel(const std::vector<std::istream*>& models, const catboost::Options& options) {
+        set_.load(models, options);
+    }
+
+    double predict(const std::vector<float>& x) const {
+        out_.resize(set_.dimension());
+        set_.apply(x.data(), x.size(), out_.data(), out_.size());
+        return out_[0];
+    }
+
+    void predict(const std::vector<std::vector<float>>& x, std::vector<double>& y) const {
+        const size_t dims = set_.dimension();
+        std::vector<const float*> rows;
+        rows.reserve(x.size());
+        for (const auto& row : x) rows.push_back(row.data());
+        out_.resize(x.size() * dims);
+        set_.apply(rows.data(), rows.size(), x[0].size(), out_.data(), dims);
+        y.resize(x.size());
+        for (size_t i = 0; i < x.size(); ++i) y[i] = out_[i * dims];
+    }
+};
+
+// Parallel predictions using thread pool.
+struct ParallelModel {
+    const catboost::Model& model_;
+    catboost::ThreadPool pool_;
+
+    ParallelModel(const catboost::Model& model, size_t threads) : model_(model), pool_(threads - 1) {}
+
+    void predict(const std::vector<std::vector<float>>& x, std::vector<double>& y) {
+        std::vector<const float*> rows;
+        rows.reserve(x.size());
+        for (const auto& row : x) rows.push_back(row.data());
+        y.resize(x.size());
+        model_.apply_parallel(rows.data(), rows.size(), x[0].size(), y.data(), &pool_);
+    }
+};
+
 struct YaModel {
     ModelCalcerHandle* handle_ = nullptr;
 
@@ -137,9 +496,10 @@ struct SingleTest {
     bool do_not_run_yandex = !CatboostAPI;
     bool do_not_run_compare = false;
 
-    SingleTest(const std::string& base_name)
-        : name{base_name}, jmodel{base_name + ".json"}, ymodel{base_name + ".cbm"} {
-        data.load_tsv(base_name + "_test.tsv");
+    SingleTest(const std::string& base_name, const catboost::Options& options = {})
+        : name{base_name}, jmodel{base_name + ".json", options}, ymodel{base_name + ".cbm"} {
+        data.load(base_name + "_test");
+        std::cout << name << ": " << jmodel.model_.stats() << std::endl;
     }
 
     void perf_tests() {
@@ -220,133 +580,612 @@ struct SingleTest {
     }
 };
 
-class CmdLine {
-    struct HelpMessage {
-        std::vector<std::string> names;
-        std::string help;
-        bool flag = true;
-        std::function<void(const char*)> action;
-
-        bool match(const char* s) const {
-            for (const auto& nm : names) {
-                if (nm == s) {
-                    return true;
-                }
-            }
-            return false;
-        }
+// Compare single prediction kernels on a random model.
+static void synthetic_test(size_t trees, size_t depth, const catboost::Options& options) {
+    static constexpr size_t features = 200;
+    static constexpr size_t rows = 20000;
+
+    std::cout << "synthetic: " << trees << " trees of depth " << depth << std::endl;
+    std::istringstream in{synthetic_model(trees, depth, features)};
+    JsonModel model{in, options};
+    TestData data;
+    synthetic_data(data, rows, features);
+    std::cout << "synthetic: " << model.model_.stats() << std::endl;
+
+    if (options.autotune) {
+        std::cout << "synthetic: bucket this library" << std::endl;
+        perf_test_buckets(model, data, 5);
+    }
+
+    const std::pair<catboost::Kernel, const char*> kernels[] = {
+        {catboost::Kernel::Plain, "plain"},
+        {catboost::Kernel::Pipelined, "pipelined"},
     };
-    std::vector<HelpMessage> args;
-    std::string description;
-
-public:
-    explicit CmdLine(const std::string& descr) : description(descr) {}
-
-    void print_usage(const std::string& prog) const {
-        std::cout << "Usage:" << std::endl;
-        std::cout << prog;
-        for (const auto& msg : args) {
-            std::cout << " [" << msg.names[0];
-            if (!msg.flag) {
-                std::cout << " <val>";
-            }
-            std::cout << "]";
-        }
-        std::cout << std::endl;
-        std::cout << "    " << description << std::endl;
-
-        std::cout << "Arguments:" << std::endl;
-        for (const auto& msg : args) {
-            for (size_t i = 0; i < msg.names.size(); ++i) {
-                if (i) std::cout << ", ";
-                std::cout << msg.names[i];
-            }
-            if (!msg.flag) std::cout << " <value>";
-            std::cout << std::endl;
-            std::cout << "    " << msg.help << std::endl;
+
+    for (const auto& kernel : kernels) {
+        model.model_.set_kernel(kernel.first);
+        std::cout << "synthetic: " << kernel.second << " kernel" << std::endl;
+        perf_test(model, data, 5);
+    }
+}
+
+// Compare oblivious and non-symmetric random models with the same number of
+// trees and leaves.
+static void nonsymmetric_test(size_t trees, size_t depth, const catboost::Options& options) {
+    static constexpr size_t features = 200;
+    static constexpr size_t rows = 20000;
+
+    TestData data;
+    synthetic_data(data, rows, features);
+
+    const std::pair<std::string, const char*> models[] = {
+        {synthetic_model(trees, depth, features), "oblivious"},
+        {synthetic_nonsymmetric_model(trees, depth, features), "non-symmetric"},
+    };
+
+    for (const auto& m : models) {
+        std::istringstream in{m.first};
+        JsonModel model{in, options};
+        std::cout << "nonsymmetric: " << m.second << " " << model.model_.stats() << std::endl;
+        std::cout << "nonsymmetric: " << m.second << " single" << std::endl;
+        perf_test(model, data, 5);
+        std::cout << "nonsymmetric: " << m.second << " bucket" << std::endl;
+        perf_test_buckets(model, data, 5);
+    }
+}
+
+// Compare multiclass random model with the same number of one-vs-rest
+// models of the same size.
+static void multiclass_test(size_t trees, size_t depth, size_t classes, const catboost::Options& options) {
+    static constexpr size_t features = 200;
+    static constexpr size_t rows = 20000;
+
+    TestData data;
+    synthetic_data(data, rows, features);
+
+    std::istringstream in{synthetic_model(trees, depth, features, 42, classes)};
+    MultiModel multi{in, options};
+    std::cout << "multiclass: " << multi.model_.stats() << std::endl;
+    std::cout << "multiclass: single" << std::endl;
+    perf_test(multi, data, 5);
+    std::cout << "multiclass: bucket" << std::endl;
+    perf_test_buckets(multi, data, 5);
+
+    OneVsRestModel ovr;
+    for (size_t d = 0; d < classes; ++d) {
+        std::istringstream m{synthetic_model(trees, depth, features, static_cast<unsigned>(42 + d))};
+        ovr.models_.emplace_back(new catboost::Model{m, options});
+    }
+    std::cout << "multiclass: " << classes << " one-vs-rest models " << ovr.models_[0]->stats() << std::endl;
+    std::cout << "multiclass: one-vs-rest single" << std::endl;
+    perf_test(ovr, data, 5);
+    std::cout << "multiclass: one-vs-rest bucket" << std::endl;
+    perf_test_buckets(ovr, data, 5);
+}
+
+// Measure predictions of a random model with categorical features given as
+// hashes and as strings.
+static void categorical_test(size_t trees, size_t depth, const catboost::Options& options) {
+    static constexpr size_t features = 200;
+    static constexpr size_t cats = 20;
+    static constexpr size_t values = 10000;
+    static constexpr size_t rows = 20000;
+
+    std::istringstream in{synthetic_categorical_model(trees, depth, features, cats, values)};
+    CatModel model{in, options, values};
+    std::cout << "categorical: " << model.model_.stats() << std::endl;
+
+    TestData data;
+    synthetic_data(data, rows, features + cats);
+    std::mt19937 gen{44};
+    std::uniform_int_distribution<size_t> category{0, values - 1};
+    for (auto& row : data.data) {
+        for (size_t j = features; j < features + cats; ++j) row[j] = static_cast<float>(category(gen));
+    }
+
+    for (bool strings : {false, true}) {
+        model.use_strings_ = strings;
+        const char* input = strings ? "strings" : "hashes";
+        std::cout << "categorical: " << input << " single" << std::endl;
+        perf_test(model, data, 5);
+        std::cout << "categorical: " << input << " bucket" << std::endl;
+        perf_test_buckets(model, data, 5);
+    }
+}
+
+// Compare probabilities computed by a separate pass over raw values with
+// fused transform of every accuracy on binary and multiclass random models.
+static void transform_test(size_t trees, size_t depth, size_t classes, catboost::Options options) {
+    static constexpr size_t features = 200;
+    static constexpr size_t rows = 200000;
+
+    TestData data;
+    synthetic_data(data, rows, features);
+
+    const std::pair<size_t, const char*> models[] = {{1, "Logloss"}, {classes, "MultiClass"}};
+    const std::pair<catboost::Accuracy, const char*> accuracies[] = {
+        {catboost::Accuracy::Exact, "exact"},
+        {catboost::Accuracy::High, "high"},
+        {catboost::Accuracy::Fast, "fast"},
+    };
+
+    for (const auto& m : models) {
+        std::istringstream in{synthetic_model(trees, depth, features, 42, m.first, m.second)};
+        ProbabilityModel model{in, options};
+        std::cout << "transform: " << m.second << " " << model.model_.stats() << std::endl;
+        model.fused_ = false;
+        std::cout << "transform: " << m.second << " separate pass bucket" << std::endl;
+        perf_test_buckets(model, data, 5);
+
+        model.fused_ = true;
+        for (const auto& accuracy : accuracies) {
+            options.accuracy = accuracy.first;
+            model.model_.set_options(options);
+            std::cout << "transform: " << m.second << " fused " << accuracy.second << " bucket" << std::endl;
+            perf_test_buckets(model, data, 5);
         }
     }
+}
+
+// Measure SHAP values of a random model: preparation of tables on load and
+// explanations compared with predictions.
+static void shap_test(size_t trees, size_t depth, catboost::Options options) {
+    static constexpr size_t features = 200;
+    static constexpr size_t rows = 20000;
+
+    TestData data;
+    synthetic_data(data, rows, features);
+    const std::string json = synthetic_model(trees, depth, features);
+
+    std::istringstream plain{json};
+    double begin = ftime();
+    JsonModel model{plain, options};
+    std::cout << "shap: load " << ftime() - begin << " seconds" << std::endl;
+    std::cout << "shap: " << model.model_.stats() << std::endl;
+    std::cout << "shap: prediction single" << std::endl;
+    perf_test(model, data, 5);
+
+    options.shap = true;
+    std::istringstream in{json};
+    begin = ftime();
+    ShapModel shap{in, options};
+    std::cout << "shap: load with tables " << ftime() - begin << " seconds" << std::endl;
+    std::cout << "shap: single" << std::endl;
+    perf_test(shap, data, 5);
+    std::cout << "shap: bucket" << std::endl;
+    perf_test_buckets(shap, data, 5);
+    shap.parallel_ = true;
+    std::cout << "shap: parallel bucket" << std::endl;
+    perf_test_buckets(shap, data, 5);
+}
 
-    CmdLine& flag(const std::string& f, bool& var, const std::string& help) {
-        args.emplace_back();
-        args.back().names.push_back(f);
-        args.back().flag = true;
-        args.back().help = help;
-        args.back().action = [&var](const char* v) { var = (v[0] == '1'); };
+// Measure a set of main, shadow and challenger models compared with the same
+// models applied one by one. Shadow model has the same trees as the main one.
+static void model_set_test(size_t trees, size_t depth, const catboost::Options& options) {
+    static constexpr size_t features = 200;
+    static constexpr size_t rows = 20000;
 
-        return *this;
+    TestData data;
+    synthetic_data(data, rows, features);
+    const std::string main = synthetic_model(trees, depth, features);
+    std::string shadow = main;
+    shadow.replace(shadow.rfind("[1,[0]]"), 7, "[2,[1]]");
+    const std::string challenger = synthetic_model(trees, depth, features, 43);
+
+    OneVsRestModel separate;
+    for (const std::string& json : {main, shadow, challenger}) {
+        std::istringstream m{json};
+        separate.models_.emplace_back(new catboost::Model{m, options});
     }
+    std::cout << "modelset: separate single" << std::endl;
+    perf_test(separate, data, 5);
+    std::cout << "modelset: separate bucket" << std::endl;
+    perf_test_buckets(separate, data, 5);
+
+    std::istringstream m0{main};
+    std::istringstream m1{shadow};
+    std::istringstream m2{challenger};
+    ModelSetModel set{{&m0, &m1, &m2}, options};
+    std::cout << "modelset: " << set.set_.stats() << std::endl;
+    std::cout << "modelset: set single" << std::endl;
+    perf_test(set, data, 5);
+    std::cout << "modelset: set bucket" << std::endl;
+    perf_test_buckets(set, data, 5);
+}
+
+// Measure leaf indexes of a random model compared with predictions.
+static void leaves_test(size_t trees, size_t depth, const catboost::Options& options) {
+    static constexpr size_t features = 200;
+    static constexpr size_t rows = 20000;
 
-    CmdLine& synonym(const std::string& f) {
-        args.back().names.push_back(f);
-        return *this;
+    TestData data;
+    synthetic_data(data, rows, features);
+    const std::string json = synthetic_model(trees, depth, features);
+
+    std::istringstream plain{json};
+    JsonModel model{plain, options};
+    std::cout << "leaves: " << model.model_.stats() << std::endl;
+    std::cout << "leaves: prediction single" << std::endl;
+    perf_test(model, data, 5);
+    std::cout << "leaves: prediction bucket" << std::endl;
+    perf_test_buckets(model, data, 5);
+
+    std::istringstream in{json};
+    LeafIndexModel leaves{in, options};
+    std::cout << "leaves: single" << std::endl;
+    perf_test(leaves, data, 5);
+    std::cout << "leaves: bucket" << std::endl;
+    perf_test_buckets(leaves, data, 5);
+}
+
+// Synthetic features in [0, 1) with truncated mantissas, small ones are zeros.
+static catboost::Float16 to_half(float a) {
+    if (a < 1.0f / 16384) return catboost::Float16{0};
+    uint32_t bits = 0;
+    std::memcpy(&bits, &a, sizeof(bits));
+    return catboost::Float16{static_cast<uint16_t>((((bits >> 23) - 112) << 10) | ((bits >> 13) & 0x3ff))};
+}
+
+static catboost::BFloat16 to_bfloat16(float a) {
+    uint32_t bits = 0;
+    std::memcpy(&bits, &a, sizeof(bits));
+    return catboost::BFloat16{static_cast<uint16_t>(bits >> 16)};
+}
+
+// Measure predictions of a random model on features of other types.
+static void typed_test(size_t trees, size_t depth, const catboost::Options& options) {
+    static constexpr size_t features = 200;
+    static constexpr size_t rows = 20000;
+
+    TestData data;
+    synthetic_data(data, rows, features);
+    const std::string json = synthetic_model(trees, depth, features);
+
+    std::istringstream plain{json};
+    JsonModel model{plain, options};
+    std::cout << "typed: float single" << std::endl;
+    perf_test(model, data, 5);
+    std::cout << "typed: float bucket" << std::endl;
+    perf_test_buckets(model, data, 5);
+
+    std::istringstream d{json};
+    TypedModel<double> doubles{d, options, data, [](float a) { return double{a}; }};
+    std::cout << "typed: double single" << std::endl;
+    perf_test(doubles, data, 5);
+    std::cout << "typed: double bucket" << std::endl;
+    perf_test_buckets(doubles, data, 5);
+
+    std::istringstream h{json};
+    TypedModel<catboost::Float16> halves{h, options, data, to_half};
+    std::cout << "typed: fp16 single" << std::endl;
+    perf_test(halves, data, 5);
+    std::cout << "typed: fp16 bucket" << std::endl;
+    perf_test_buckets(halves, data, 5);
+
+    std::istringstream b{json};
+    TypedModel<catboost::BFloat16> bfloats{b, options, data, to_bfloat16};
+    std::cout << "typed: bf16 single" << std::endl;
+    perf_test(bfloats, data, 5);
+    std::cout << "typed: bf16 bucket" << std::endl;
+    perf_test_buckets(bfloats, data, 5);
+}
+
+// Measure predictions of sparse examples of a random model with many features.
+static void sparse_test(size_t trees, size_t depth, const catboost::Options& options) {
+    static constexpr size_t features = 2000;
+    static constexpr size_t nonzero = 30;
+    static constexpr size_t rows = 20000;
+
+    TestData data;
+    std::mt19937 gen{43};
+    std::uniform_int_distribution<size_t> feature{0, features - 1};
+    std::uniform_real_distribution<float> value{0.0f, 1.0f};
+    data.label.assign(rows, 0.0);
+    data.data.assign(rows, std::vector<float>(features, 0.0f));
+    for (auto& row : data.data) {
+        for (size_t j = 0; j < nonzero; ++j) row[feature(gen)] = value(gen);
     }
+    const std::string json = synthetic_model(trees, depth, features);
+
+    std::istringstream plain{json};
+    JsonModel model{plain, options};
+    std::cout << "sparse: dense single" << std::endl;
+    perf_test(model, data, 5);
+    std::cout << "sparse: dense bucket" << std::endl;
+    perf_test_buckets(model, data, 5);
+
+    std::istringstream in{json};
+    SparseModel sparse{in, options, data};
+    std::cout << "sparse: sparse single" << std::endl;
+    perf_test(sparse, data, 5);
+    std::cout << "sparse: sparse bucket" << std::endl;
+    perf_test_buckets(sparse, data, 5);
+}
+
+// Measure predictions of a random model for examples which differ from the
+// first one by two features: full ones and updates of a scorer.
+static void scorer_test(size_t trees, size_t depth, const catboost::Options& options) {
+    static constexpr size_t features = 200;
+    static constexpr size_t rows = 20000;
+    const std::vector<uint32_t> changed{3, 17};
 
-    // synonym, but better :)
-    CmdLine& aka(const std::string& f) {
-        args.back().names.push_back(f);
-        return *this;
+    TestData data;
+    synthetic_data(data, rows, features);
+    for (auto& row : data.data) {
+        for (size_t j = 0; j < features; ++j) {
+            if (std::find(changed.begin(), changed.end(), j) == changed.end()) row[j] = data.data[0][j];
+        }
     }
+    const std::string json = synthetic_model(trees, depth, features);
+
+    std::istringstream plain{json};
+    JsonModel model{plain, options};
+    std::cout << "scorer: full single" << std::endl;
+    perf_test(model, data, 5);
+
+    std::istringstream in{json};
+    ScorerModel scorer{in, options, data, changed};
+    std::cout << "scorer: update of 2 features" << std::endl;
+    perf_test(scorer, data, 5);
+}
 
-    CmdLine& arg(const std::string& f, std::string& var, const std::string& help) {
-        args.emplace_back();
-        args.back().names.push_back(f);
-        args.back().flag = false;
-        args.back().help = help;
-        args.back().action = [&var](const char* v) { var = v; };
+// Measure buckets of candidates sharing half of features by a random model
+// and by the model specialized for these features, and time of
+// specialization.
+static void specialize_test(size_t trees, size_t depth, const catboost::Options& options) {
+    static constexpr size_t features = 200;
+    static constexpr size_t fixed = 100;
+    static constexpr size_t rows = 500;
+    static constexpr int builds = 20;
 
-        return *this;
+    TestData data;
+    synthetic_data(data, rows, features);
+    std::vector<uint32_t> indexes(fixed);
+    std::vector<float> values(fixed);
+    for (uint32_t f = 0; f < fixed; ++f) {
+        indexes[f] = f;
+        values[f] = data.data[0][f];
+        for (auto& row : data.data) row[f] = values[f];
     }
+    const std::string json = synthetic_model(trees, depth, features);
+
+    std::istringstream in{json};
+    JsonModel model{in, options};
+    std::cout << "specialize: " << model.model_.stats() << std::endl;
+    std::cout << "specialize: full model bucket" << std::endl;
+    perf_test_buckets(model, data, 5);
+
+    std::istringstream empty{"{\"features_info\":{\"float_features\":[]},\"oblivious_trees\":[]}"};
+    JsonModel specialized{empty, options};
+    double begin = ftime();
+    for (int i = 0; i < builds; ++i) {
+        model.model_.specialize(indexes.data(), values.data(), indexes.size(), specialized.model_);
+    }
+    std::cout << "specialize: " << specialized.model_.stats() << std::endl;
+    std::cout << "specialize: built in " << (ftime() - begin) / builds << " seconds" << std::endl;
+    std::cout << "specialize: specialized model bucket" << std::endl;
+    perf_test_buckets(specialized, data, 5);
+}
 
-    template <typename F>
-    CmdLine& action(const std::string& f, F&& func, const std::string& help) {
-        args.emplace_back();
-        args.back().names.push_back(f);
-        args.back().flag = false;
-        args.back().help = help;
-        args.back().action = std::forward<F>(func);
+// Measure predictions of a random model for examples repeated 10 times in
+// random order without cache, with deduplication of buckets and with cache.
+// Buckets are passed by one call. Every test runs several times, so the
+// cache is warm after the first one.
+static void cache_test(size_t trees, size_t depth, catboost::Options options) {
+    static constexpr size_t features = 200;
+    static constexpr size_t distinct = 2000;
+    static constexpr size_t repeats = 10;
 
-        return *this;
+    TestData data;
+    synthetic_data(data, distinct, features);
+    for (size_t r = 1; r < repeats; ++r) {
+        for (size_t i = 0; i < distinct; ++i) data.data.push_back(data.data[i]);
     }
+    std::shuffle(data.data.begin(), data.data.end(), std::mt19937{44});
+    data.label.assign(data.data.size(), 0.0);
+    const std::string json = synthetic_model(trees, depth, features);
+
+    std::istringstream plain{json};
+    MultiModel model{plain, options};
+    std::cout << "cache: no cache single" << std::endl;
+    perf_test(model, data, 5);
+    std::cout << "cache: no cache bucket" << std::endl;
+    perf_test_buckets(model, data, 5);
+
+    options.dedupe_rows = true;
+    std::istringstream dedupe_in{json};
+    MultiModel dedupe{dedupe_in, options};
+    std::cout << "cache: deduplicated bucket" << std::endl;
+    perf_test_buckets(dedupe, data, 5);
+
+    options.cache_size = 16 << 20;
+    std::istringstream in{json};
+    MultiModel cached{in, options};
+    std::cout << "cache: cached single" << std::endl;
+    perf_test(cached, data, 5);
+    std::cout << "cache: cached bucket" << std::endl;
+    perf_test_buckets(cached, data, 5);
+    const catboost::CacheStats stats = cached.model_.cache_stats();
+    std::cout << "cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.capacity
+              << " slots in " << stats.size << " bytes" << std::endl;
+}
 
-    bool parse(int argc, const char* argv[]) {
-        int argidx = 1;
-        while (argidx < argc) {
-            if (!std::strcmp(argv[argidx], "-h") || !std::strcmp(argv[argidx], "--help")) {
-                print_usage(argv[0]);
-                return false;
-            }
+// Measure predictions of single examples of a random model submitted
+// asynchronously by one and by several threads, and compare them with
+// synchronous predictions of the submitting thread.
+static void async_test(size_t trees, size_t depth, catboost::Options options) {
+    static constexpr size_t features = 200;
+    static constexpr size_t rows = 20000;
+    static constexpr size_t submitters = 4;
 
-            bool matched = false;
-            for (const auto& arg : args) {
-                if (arg.match(argv[argidx])) {
-                    matched = true;
-                    if (arg.flag) {
-                        arg.action("1");
-                    } else {
-                        if (argidx + 1 < argc) {
-                            arg.action(argv[++argidx]);
-                        } else {
-                            std::cerr << "Error: option " << argv[argidx] << " needs argument!" << std::endl;
-                            return false;
-                        }
+    TestData data;
+    synthetic_data(data, rows, features);
+    std::istringstream in{synthetic_model(trees, depth, features)};
+    catboost::Model model{in, options};
+    std::vector<double> y(rows);
+
+    double begin = ftime();
+    for (size_t i = 0; i < rows; ++i) y[i] = model.apply(data.data[i]);
+    std::cout << "async: synchronous " << (ftime() - begin) / rows * 1e6 << " us per example" << std::endl;
+
+    for (size_t threads : {size_t{1}, submitters}) {
+        for (int run = 0; run < 3; ++run) {
+            std::atomic<size_t> done{0};
+            begin = ftime();
+            std::vector<std::thread> pool;
+            for (size_t t = 0; t < threads; ++t) {
+                pool.emplace_back([&, t] {
+                    for (size_t i = t; i < rows; i += threads) {
+                        model.apply_async(data.data[i].data(), features, &y[i], 1, [&done] { ++done; });
                     }
-                    ++argidx;
-                }
-
-                if (matched) break;
+                });
             }
+            for (auto& t : pool) t.join();
+            while (done < rows) std::this_thread::yield();
+            std::cout << "async: " << threads << " submitting threads " << (ftime() - begin) / rows * 1e6
+                      << " us per example" << std::endl;
+        }
+    }
+
+    begin = ftime();
+    std::vector<std::future<double>> futures;
+    futures.reserve(rows);
+    for (size_t i = 0; i < rows; ++i) futures.push_back(model.apply_async(data.data[i].data(), features));
+    for (auto& f : futures) f.get();
+    std::cout << "async: futures " << (ftime() - begin) / rows * 1e6 << " us per example" << std::endl;
+}
 
-            if (!matched) {
-                std::cerr << "Error: unknown argument: " << argv[argidx] << std::endl;
-                print_usage(argv[0]);
-                return false;
+// Compare single predictions of many threads with and without batching.
+static void batching_test(size_t trees, size_t depth, const catboost::Options& options) {
+    static constexpr size_t features = 200;
+    static constexpr size_t rows = 20000;
+
+    TestData data;
+    synthetic_data(data, rows, features);
+    std::istringstream in{synthetic_model(trees, depth, features)};
+    catboost::Model model{in, options};
+    catboost::BatchingModel batching{model};
+    std::vector<double> y(rows);
+
+    for (size_t threads : {size_t{1}, size_t{8}, size_t{64}, size_t{256}}) {
+        const auto run = [&](const char* name, std::function<double(const std::vector<float>&)> apply) {
+            double begin = ftime();
+            std::vector<std::thread> pool;
+            for (size_t t = 0; t < threads; ++t) {
+                pool.emplace_back([&, t] {
+                    for (size_t i = t; i < rows; i += threads) y[i] = apply(data.data[i]);
+                });
             }
-        }
+            for (auto& t : pool) t.join();
+            std::cout << "batching: " << threads << " threads " << name << " " << (ftime() - begin) / rows * 1e6
+                      << " us per example" << std::endl;
+        };
+        run("apply", [&](const std::vector<float>& x) { return model.apply(x); });
+        const auto before = batching.stats();
+        run("batching", [&](const std::vector<float>& x) { return batching.apply(x); });
+        const auto after = batching.stats();
+        std::cout << "batching: " << double(after.examples - before.examples) / double(after.batches - before.batches)
+                  << " examples per batch, " << after.timeouts - before.timeouts << " timeouts" << std::endl;
+    }
+}
 
-        return true;
+// Measure loading of the codrna dataset from TSV and from feature matrices of
+// both layouts, and buckets predicted on the matrices in place.
+static void matrix_test(const catboost::Options& options) {
+    double begin = ftime();
+    TestData tsv;
+    tsv.load_tsv("codrna_test.tsv");
+    std::cout << "matrix: TSV loaded in " << ftime() - begin << " seconds" << std::endl;
+
+    const size_t rows = tsv.data.size();
+    const size_t features = tsv.data[0].size();
+    std::vector<float> x(rows * features);
+    for (size_t i = 0; i < rows; ++i) std::copy(tsv.data[i].begin(), tsv.data[i].end(), &x[i * features]);
+
+    for (auto layout : {catboost::MatrixLayout::Columns, catboost::MatrixLayout::Rows}) {
+        const std::string name = layout == catboost::MatrixLayout::Columns ? "columns" : "rows";
+        const std::string fnm = "codrna_test_" + name + ".cbfm";
+        catboost::FeatureMatrix::write(fnm, x.data(), rows, features, static_cast<ptrdiff_t>(features), 1,
+                                       tsv.label.data(), layout);
+
+        begin = ftime();
+        TestData data;
+        data.load_matrix(fnm);
+        std::cout << "matrix: " << name << " loaded in " << ftime() - begin << " seconds" << std::endl;
+
+        std::ifstream in{"codrna.json"};
+        MatrixModel model{in, options, data};
+        std::cout << "matrix: " << name << " bucket" << std::endl;
+        perf_test_buckets(model, data, 5);
+        std::remove(fnm.c_str());
     }
-};
+}
+
+// Measure buckets of a random model using a small part of wide rows with and
+// without packing of used features.
+static void compact_test(size_t trees, size_t depth, catboost::Options options) {
+    static constexpr size_t features = 720;
+    static constexpr size_t used = 120;
+    static constexpr size_t rows = 20000;
+
+    TestData data;
+    synthetic_data(data, rows, features);
+    const std::string json = synthetic_wide_model(trees, depth, features, used);
+
+    std::istringstream plain{json};
+    JsonModel model{plain, options};
+    std::cout << "compact: " << model.model_.stats() << std::endl;
+    std::cout << "compact: wide rows bucket" << std::endl;
+    perf_test_buckets(model, data, 5);
+
+    options.compact_features = true;
+    std::istringstream in{json};
+    JsonModel compact{in, options};
+    std::cout << "compact: " << compact.model_.stats() << std::endl;
+    std::cout << "compact: packed rows bucket" << std::endl;
+    perf_test_buckets(compact, data, 5);
+}
+
+// Measure scaling of parallel predictions on a random model.
+static void scaling_test(size_t trees, size_t depth, const catboost::Options& options) {
+    static constexpr size_t features = 200;
+    static constexpr size_t rows = 200000;
+
+    std::cout << "scaling: " << trees << " trees of depth " << depth << std::endl;
+    std::istringstream in{synthetic_model(trees, depth, features)};
+    catboost::Model model{in, options};
+    TestData data;
+    synthetic_data(data, rows, features);
+
+    size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= cpus; ++threads) {
+        ParallelModel pmodel{model, threads};
+        std::cout << "scaling: " << threads << " threads" << std::endl;
+        perf_test_buckets(pmodel, data, 5);
+    }
+}
+
+// Measure latency of single predictions of a random model evaluated by
+// several threads.
+static void tree_threads_test(size_t trees, size_t depth, catboost::Options options) {
+    static constexpr size_t features = 200;
+    static constexpr size_t rows = 2000;
+
+    std::cout << "tree-threads: " << trees << " trees of depth " << depth << std::endl;
+    std::istringstream in{synthetic_model(trees, depth, features)};
+    JsonModel model{in, options};
+    TestData data;
+    synthetic_data(data, rows, features);
+
+    size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    options.tree_parallel_min_trees = 0;
+    for (size_t threads = 1; threads <= cpus; ++threads) {
+        options.tree_threads = threads;
+        model.model_.set_options(options);
+        std::cout << "tree-threads: " << model.model_.stats() << std::endl;
+        perf_test(model, data, 5);
+    }
+}
 
 int main(int argc, const char* argv[]) {
     std::set<std::string> list_tests;
@@ -354,17 +1193,27 @@ int main(int argc, const char* argv[]) {
     bool do_not_run_static = false;
     bool do_not_run_yandex = false;
     bool do_not_run_compare = false;
+    std::string synthetic_trees = "20000";
+    std::string synthetic_depth = "8";
+    std::string classes = "10";
+    catboost::Options options;
 
     CmdLine args{"run performance tests."};
     args.arg("-d", root_path, "path to the tests directory (default: .)")
         .aka("--test-data")
         .action(
             "-t", [&list_tests](const char* v) { list_tests.emplace(v); },
-            "run this test. Default is to run all tests.")
+            "run this test. Default is to run all tests except synthetic, nonsymmetric, multiclass, categorical, "
+            "transform, shap, leaves, modelset, typed, sparse, compact, scorer, specialize, cache, async, batching, "
+            "matrix, scaling and tree-threads.")
         .aka("--run-tests")
         .flag("--no-static", do_not_run_static, "do not run static model tests")
         .flag("--no-yandex", do_not_run_yandex, "do not run Yandex model library tests")
-        .flag("--no-compare", do_not_run_compare, "run only performance test, no values comparation");
+        .flag("--no-compare", do_not_run_compare, "run only performance test, no values comparation")
+        .flag("--autotune", options.autotune, "choose kernels of this library by benchmark on load")
+        .arg("--synthetic-trees", synthetic_trees, "number of trees in synthetic test model (default: 20000)")
+        .arg("--synthetic-depth", synthetic_depth, "depth of trees in synthetic test model (default: 8)")
+        .arg("--classes", classes, "number of classes in multiclass test model (default: 10)");
 
     if (!args.parse(argc, argv)) {
         return 1;
@@ -381,7 +1230,7 @@ int main(int argc, const char* argv[]) {
     }
 
     if (list_tests.count("msrank")) {
-        SingleTest<StaticMSRankModel> model{"msrank"};
+        SingleTest<StaticMSRankModel> model{"msrank", options};
         model.do_not_run_static = do_not_run_static;
         model.do_not_run_yandex = do_not_run_yandex;
         model.do_not_run_compare = do_not_run_compare;
@@ -389,7 +1238,7 @@ int main(int argc, const char* argv[]) {
     }
 
     if (list_tests.count("creditgermany")) {
-        SingleTest<StaticCreditGermanyModel> model{"creditgermany"};
+        SingleTest<StaticCreditGermanyModel> model{"creditgermany", options};
         model.do_not_run_static = do_not_run_static;
         model.do_not_run_yandex = do_not_run_yandex;
         model.do_not_run_compare = do_not_run_compare;
@@ -397,12 +1246,89 @@ int main(int argc, const char* argv[]) {
     }
 
     if (list_tests.count("codrna")) {
-        SingleTest<StaticCodRNAModel> model{"codrna"};
+        SingleTest<StaticCodRNAModel> model{"codrna", options};
         model.do_not_run_static = do_not_run_static;
         model.do_not_run_yandex = do_not_run_yandex;
         model.do_not_run_compare = do_not_run_compare;
         model.run();
     }
 
+    // Synthetic test is slow to generate, so it runs only on demand.
+    if (list_tests.count("synthetic")) {
+        synthetic_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), options);
+    }
+
+    if (list_tests.count("nonsymmetric")) {
+        nonsymmetric_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), options);
+    }
+
+    if (list_tests.count("multiclass")) {
+        multiclass_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), std::stoul(classes), options);
+    }
+
+    if (list_tests.count("categorical")) {
+        categorical_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), options);
+    }
+
+    if (list_tests.count("transform")) {
+        transform_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), std::stoul(classes), options);
+    }
+
+    if (list_tests.count("shap")) {
+        shap_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), options);
+    }
+
+    if (list_tests.count("leaves")) {
+        leaves_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), options);
+    }
+
+    if (list_tests.count("sparse")) {
+        sparse_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), options);
+    }
+
+    if (list_tests.count("compact")) {
+        compact_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), options);
+    }
+
+    if (list_tests.count("scorer")) {
+        scorer_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), options);
+    }
+
+    if (list_tests.count("specialize")) {
+        specialize_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), options);
+    }
+
+    if (list_tests.count("cache")) {
+        cache_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), options);
+    }
+
+    if (list_tests.count("async")) {
+        async_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), options);
+    }
+
+    if (list_tests.count("matrix")) {
+        matrix_test(options);
+    }
+
+    if (list_tests.count("batching")) {
+        batching_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), options);
+    }
+
+    if (list_tests.count("typed")) {
+        typed_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), options);
+    }
+
+    if (list_tests.count("modelset")) {
+        model_set_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), options);
+    }
+
+    if (list_tests.count("scaling")) {
+        scaling_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), options);
+    }
+
+    if (list_tests.count("tree-threads")) {
+        tree_threads_test(std::stoul(synthetic_trees), std::stoul(synthetic_depth), options);
+    }
+
     return 0;
 }
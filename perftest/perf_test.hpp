@@ -8,6 +8,8 @@
 #include <string>
 #include <vector>
 
+#include "catboost.hpp"
+
 inline double ftime() {
     struct timeval tv;
     gettimeofday(&tv, nullptr);
@@ -17,6 +19,8 @@ inline double ftime() {
 struct TestData {
     std::vector<double> label;
     std::vector<std::vector<float>> data;
+    // Mapped dataset if it was loaded from a feature matrix.
+    catboost::FeatureMatrix matrix;
 
     std::vector<std::string> split_string(const std::string& s, const std::string& delimiter) {
         std::vector<std::string> res;
@@ -69,6 +73,29 @@ struct TestData {
 
         f.close();
     }
+
+    // Load feature matrix with labels written by catboost-matrix --label.
+    void load_matrix(const std::string& fnm) {
+        matrix.load(fnm);
+        if (!matrix.label()) {
+            throw std::runtime_error("Dataset has no labels");
+        }
+
+        label.assign(matrix.label(), matrix.label() + matrix.rows());
+        data.assign(matrix.rows(), std::vector<float>(matrix.features()));
+        for (size_t i = 0; i < matrix.rows(); ++i) {
+            for (size_t j = 0; j < matrix.features(); ++j) data[i][j] = matrix.at(i, j);
+        }
+    }
+
+    // Load name.cbfm if it exists, otherwise parse name.tsv.
+    void load(const std::string& name) {
+        if (std::ifstream{name + ".cbfm"}.good()) {
+            load_matrix(name + ".cbfm");
+        } else {
+            load_tsv(name + ".tsv");
+        }
+    }
 };
 
 template <typename Model>
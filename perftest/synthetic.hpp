@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "perf_test.hpp"
+
+// Random models let us test performance on models larger than we are able to
+// train on our datasets.
+
+// Generate JSON model with `trees` oblivious trees of depth `depth` on
+// `features` float features. Leaves have `dims` values and random weights,
+// which are drawn from another generator, so values do not depend on them.
+// Loss function is written to model info if it is set.
+inline std::string synthetic_model(size_t trees, size_t depth, size_t features, unsigned seed = 42,
+                                   size_t dims = 1, const std::string& loss = std::string{}) {
+    std::mt19937 gen{seed};
+    std::uniform_int_distribution<size_t> feature{0, features - 1};
+    std::uniform_real_distribution<float> border{0.0f, 1.0f};
+    std::normal_distribution<double> value{0.0, 0.01};
+    std::mt19937 weight_gen{seed + 1};
+    std::uniform_int_distribution<int> weight{0, 20};
+    std::ostringstream out;
+    out.precision(9);
+
+    out << "{\"features_info\":{\"float_features\":[";
+    for (size_t i = 0; i < features; ++i) {
+        if (i) out << ",";
+        out << "{\"flat_feature_index\":" << i << ",\"feature_index\":" << i << "}";
+    }
+    out << "]},\"oblivious_trees\":[";
+    for (size_t t = 0; t < trees; ++t) {
+        if (t) out << ",";
+        out << "{\"splits\":[";
+        for (size_t d = 0; d < depth; ++d) {
+            if (d) out << ",";
+            out << "{\"float_feature_index\":" << feature(gen) << ",\"border\":" << border(gen) << "}";
+        }
+        out << "],\"leaf_values\":[";
+        for (size_t l = 0; l < (static_cast<size_t>(1) << depth) * dims; ++l) {
+            if (l) out << ",";
+            out << value(gen);
+        }
+        out << "],\"leaf_weights\":[";
+        for (size_t l = 0; l < (static_cast<size_t>(1) << depth); ++l) {
+            if (l) out << ",";
+            out << weight(weight_gen);
+        }
+        out << "]}";
+    }
+    out << "],\"scale_and_bias\":[1,[0]]";
+    if (!loss.empty()) out << ",\"model_info\":{\"params\":{\"loss_function\":{\"type\":\"" << loss << "\"}}}";
+    out << "}";
+
+    return out.str();
+}
+
+// Generate JSON model with `trees` oblivious trees of depth `depth` on
+// `features` float features, whose splits use only `used` random features,
+// like models trained on wide rows with most features never chosen.
+inline std::string synthetic_wide_model(size_t trees, size_t depth, size_t features, size_t used,
+                                        unsigned seed = 42) {
+    std::mt19937 gen{seed};
+    std::vector<size_t> pool(features);
+    for (size_t i = 0; i < features; ++i) pool[i] = i;
+    std::shuffle(pool.begin(), pool.end(), gen);
+    std::uniform_int_distribution<size_t> feature{0, used - 1};
+    std::uniform_real_distribution<float> border{0.0f, 1.0f};
+    std::normal_distribution<double> value{0.0, 0.01};
+    std::ostringstream out;
+    out.precision(9);
+
+    out << "{\"features_info\":{\"float_features\":[";
+    for (size_t i = 0; i < features; ++i) {
+        if (i) out << ",";
+        out << "{\"flat_feature_index\":" << i << ",\"feature_index\":" << i << "}";
+    }
+    out << "]},\"oblivious_trees\":[";
+    for (size_t t = 0; t < trees; ++t) {
+        if (t) out << ",";
+        out << "{\"splits\":[";
+        for (size_t d = 0; d < depth; ++d) {
+            if (d) out << ",";
+            out << "{\"float_feature_index\":" << pool[feature(gen)] << ",\"border\":" << border(gen) << "}";
+        }
+        out << "],\"leaf_values\":[";
+        for (size_t l = 0; l < (static_cast<size_t>(1) << depth); ++l) {
+            if (l) out << ",";
+            out << value(gen);
+        }
+        out << "]}";
+    }
+    out << "],\"scale_and_bias\":[1,[0]]}";
+
+    return out.str();
+}
+
+// Generate JSON model with `trees` non-symmetric trees on `features` float
+// features. Trees grow like Lossguide ones: random leaves are split until
+// there are 2^depth of them, but no leaf is deeper than 2 * depth.
+inline std::string synthetic_nonsymmetric_model(size_t trees, size_t depth, size_t features, unsigned seed = 42) {
+    struct Node {
+        size_t level = 0;
+        size_t feature = 0;
+        float border = 0.0f;
+        size_t left = 0;
+    };
+
+    std::mt19937 gen{seed};
+    std::uniform_int_distribution<size_t> feature{0, features - 1};
+    std::uniform_real_distribution<float> border{0.0f, 1.0f};
+    std::normal_distribution<double> value{0.0, 0.01};
+    std::ostringstream out;
+    out.precision(9);
+
+    out << "{\"features_info\":{\"float_features\":[";
+    for (size_t i = 0; i < features; ++i) {
+        if (i) out << ",";
+        out << "{\"flat_feature_index\":" << i << ",\"feature_index\":" << i << "}";
+    }
+    out << "]},\"trees\":[";
+    for (size_t t = 0; t < trees; ++t) {
+        std::vector<Node> nodes(1);
+        std::vector<size_t> leaves{0};
+        while (leaves.size() < (static_cast<size_t>(1) << depth)) {
+            size_t pos = std::uniform_int_distribution<size_t>{0, leaves.size() - 1}(gen);
+            size_t n = leaves[pos];
+            if (nodes[n].level >= 2 * depth) continue;
+            nodes[n].feature = feature(gen);
+            nodes[n].border = border(gen);
+            nodes[n].left = nodes.size();
+            leaves[pos] = nodes.size();
+            leaves.push_back(nodes.size() + 1);
+            nodes.resize(nodes.size() + 2);
+            nodes[nodes.size() - 2].level = nodes[n].level + 1;
+            nodes[nodes.size() - 1].level = nodes[n].level + 1;
+        }
+
+        if (t) out << ",";
+        std::function<void(size_t)> write = [&](size_t n) {
+            if (!nodes[n].left) {
+                out << "{\"value\":" << value(gen) << "}";
+                return;
+            }
+            out << "{\"split\":{\"float_feature_index\":" << nodes[n].feature << ",\"border\":" << nodes[n].border
+                << "},\"left\":";
+            write(nodes[n].left);
+            out << ",\"right\":";
+            write(nodes[n].left + 1);
+            out << "}";
+        };
+        write(0);
+    }
+    out << "],\"scale_and_bias\":[1,[0]]}";
+
+    return out.str();
+}
+
+// Generate JSON model with `trees` oblivious trees of depth `depth` on
+// `features` float and `cats` categorical features. Categories are integers
+// from 0 to `values` - 1. Every categorical feature has Borders CTR with
+// counters of all values. Half of splits are on float features, a quarter on
+// CTRs and a quarter on one-hot values. Like CatBoost with default
+// one_hot_max_size, one-hot splits use only a few values.
+inline std::string synthetic_categorical_model(size_t trees, size_t depth, size_t features, size_t cats,
+                                               size_t values, unsigned seed = 42) {
+    static constexpr uint64_t magic = 0x4906ba494954cb65ull;
+    static constexpr size_t ctr_borders = 15;
+
+    std::mt19937 gen{seed};
+    std::uniform_int_distribution<size_t> feature{0, features - 1};
+    std::uniform_int_distribution<size_t> cat{0, cats - 1};
+    std::uniform_int_distribution<size_t> one_hot{0, std::min<size_t>(values, 4) - 1};
+    std::uniform_int_distribution<int> counter{0, 20};
+    std::uniform_int_distribution<int> kind{0, 3};
+    std::uniform_real_distribution<float> border{0.0f, 1.0f};
+    std::normal_distribution<double> value{0.0, 0.01};
+    std::ostringstream out;
+    out.precision(9);
+
+    out << "{\"features_info\":{\"float_features\":[";
+    for (size_t i = 0; i < features; ++i) {
+        if (i) out << ",";
+        out << "{\"flat_feature_index\":" << i << ",\"feature_index\":" << i << "}";
+    }
+    out << "],\"categorical_features\":[";
+    for (size_t i = 0; i < cats; ++i) {
+        if (i) out << ",";
+        out << "{\"flat_feature_index\":" << features + i << ",\"feature_index\":" << i << "}";
+    }
+    out << "],\"ctrs\":[";
+    for (size_t c = 0; c < cats; ++c) {
+        if (c) out << ",";
+        out << "{\"ctr_type\":\"Borders\",\"elements\":[{\"cat_feature_index\":" << c
+            << ",\"combination_element\":\"cat_feature_value\"}],\"identifier\":\"ctr" << c
+            << "\",\"prior_numerator\":0.5,\"prior_denomerator\":1,\"shift\":0,\"scale\":15,"
+               "\"target_border_idx\":0,\"borders\":[";
+        for (size_t b = 0; b < ctr_borders; ++b) out << (b ? "," : "") << b + 0.5;
+        out << "]}";
+    }
+    out << "]},\"ctr_data\":{";
+    for (size_t c = 0; c < cats; ++c) {
+        if (c) out << ",";
+        out << "\"ctr" << c << "\":{\"hash_stride\":3,\"hash_map\":[";
+        for (size_t v = 0; v < values; ++v) {
+            const auto h = static_cast<uint64_t>(catboost::hash_cat_feature(static_cast<int64_t>(v)));
+            out << (v ? "," : "") << "\"" << magic * (magic * h) << "\"," << counter(gen) << "," << counter(gen);
+        }
+        out << "]}";
+    }
+    out << "},\"oblivious_trees\":[";
+    for (size_t t = 0; t < trees; ++t) {
+        if (t) out << ",";
+        out << "{\"splits\":[";
+        for (size_t d = 0; d < depth; ++d) {
+            if (d) out << ",";
+            switch (kind(gen)) {
+                case 0:
+                    // CTRs have the same borders, so splits refer to them by index.
+                    out << "{\"split_type\":\"OnlineCtr\",\"border\":7.5,\"split_index\":"
+                        << cat(gen) * ctr_borders + 7 << "}";
+                    break;
+                case 1:
+                    out << "{\"split_type\":\"OneHotFeature\",\"cat_feature_index\":" << cat(gen)
+                        << ",\"value\":" << catboost::hash_cat_feature(static_cast<int64_t>(one_hot(gen))) << "}";
+                    break;
+                default:
+                    out << "{\"float_feature_index\":" << feature(gen) << ",\"border\":" << border(gen) << "}";
+                    break;
+            }
+        }
+        out << "],\"leaf_values\":[";
+        for (size_t l = 0; l < (static_cast<size_t>(1) << depth); ++l) {
+            if (l) out << ",";
+            out << value(gen);
+        }
+        out << "]}";
+    }
+    out << "],\"scale_and_bias\":[1,[0]]}";
+
+    return out.str();
+}
+
+// Generate `rows` random examples. Labels are zero.
+inline void synthetic_data(TestData& data, size_t rows, size_t features, unsigned seed = 43) {
+    std::mt19937 gen{seed};
+    std::uniform_real_distribution<float> x{0.0f, 1.0f};
+
+    data.label.assign(rows, 0.0);
+    data.data.resize(rows);
+    for (auto& row : data.data) {
+        row.resize(features);
+        for (auto& f : row) f = x(gen);
+    }
+}
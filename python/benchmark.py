@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+
+# Compare predictions of catboost_cxx with catboost.CatBoost.predict on datasets of perftest.
+# Usage: benchmark.py [-i ITERATIONS] [-b BATCH] [dataset...]
+import argparse
+import os
+import sys
+import time
+
+import numpy as np
+
+import catboost_cxx
+
+PERFTEST = os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), "perftest")
+DATASETS = ["codrna", "creditgermany"]
+
+
+def load_dataset(name):
+    data = np.loadtxt(os.path.join(PERFTEST, name + "_test.tsv"), dtype=np.float32, ndmin=2)
+    return data[:, 1:]
+
+
+def measure(name, iterations, predict, x):
+    best = float("inf")
+    for _ in range(iterations):
+        start = time.perf_counter()
+        predict(x)
+        best = min(best, time.perf_counter() - start)
+    print(f"    {name:<32} {best:.6f} s ({best / len(x) * 1e9:.1f} ns per prediction)")
+    return best
+
+
+def batches(predict, batch):
+    def run(x):
+        for i in range(0, len(x), batch):
+            predict(x[i:i + batch])
+    return run
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare catboost_cxx with catboost.CatBoost.predict")
+    parser.add_argument("-i", "--iterations", type=int, default=5, help="number of runs, the best time is printed")
+    parser.add_argument("-b", "--batch", type=int, default=0, help="predict by batches of this size")
+    parser.add_argument("datasets", nargs="*", default=DATASETS)
+    args = parser.parse_args()
+
+    try:
+        import catboost
+    except ImportError:
+        catboost = None
+        print("catboost package is not installed, only this library is measured", file=sys.stderr)
+
+    for name in args.datasets:
+        x = load_dataset(name)
+        model = catboost_cxx.Model(os.path.join(PERFTEST, name + ".json"))
+        out = np.empty(len(x))
+        print(f"{name}: {len(x)} examples, {model.feature_count} features")
+
+        def run(f):
+            return batches(f, args.batch) if args.batch else f
+
+        def predict_into(data):
+            model.predict_into(data, out[:len(data)])
+
+        x_fortran = np.asfortranarray(x)
+        x_double = x.astype(np.float64)
+        times = {
+            "catboost_cxx C order": measure("catboost_cxx C order", args.iterations, run(predict_into), x),
+            "catboost_cxx Fortran order": measure("catboost_cxx Fortran order", args.iterations, run(predict_into),
+                                                  x_fortran),
+            "catboost_cxx float64": measure("catboost_cxx float64", args.iterations, run(predict_into), x_double),
+        }
+
+        if catboost is not None:
+            reference = catboost.CatBoost()
+            reference.load_model(os.path.join(PERFTEST, name + ".cbm"))
+            expected = reference.predict(x)
+            model.predict_into(x, out)
+            print(f"    max delta {np.max(np.abs(out - expected)):.3g}")
+            base = measure("CatBoost.predict", args.iterations, run(reference.predict), x)
+            for k, t in times.items():
+                print(f"    {k} is {base / t:.2f} times faster")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,60 @@
+"""Applier of CatBoost models in JSON format over the C interface of catboost-cxx.
+
+Features are read from NumPy arrays (or any buffer) of float32 or float64 values
+in C or Fortran order without copies, and the GIL is released while they are
+predicted, so several Python threads could score at once.
+"""
+
+import struct
+
+import numpy as np
+
+from ._native import Model as _NativeModel
+
+__all__ = ["Model", "read_matrix"]
+
+_MATRIX_HEADER = struct.Struct("<8sII6Q")
+
+
+def read_matrix(path):
+    """Map a feature matrix written by catboost-matrix (see catboost::FeatureMatrix).
+
+    Returns (features, label): a read-only float32 array of examples x features
+    over the mapped file, row-major for the rows layout and column-major with
+    padded columns for the columns one, and a float64 array of labels or None.
+    Features are passed to Model.predict without copies.
+    """
+    with open(path, "rb") as f:
+        magic, version, layout, rows, features, stride, label_offset, size, _ = _MATRIX_HEADER.unpack(
+            f.read(_MATRIX_HEADER.size))
+    if magic != b"CBMATRIX" or version != 1 or layout > 1:
+        raise ValueError("%s is not a feature matrix" % path)
+    data = np.memmap(path, dtype=np.uint8, mode="r", shape=(size,))
+    strides = (4, 4 * stride) if layout == 0 else (4 * stride, 4)
+    x = np.ndarray((rows, features), dtype=np.float32, buffer=data, offset=_MATRIX_HEADER.size, strides=strides)
+    label = None
+    if label_offset:
+        label = np.ndarray((rows,), dtype=np.float64, buffer=data, offset=label_offset)
+    return x, label
+
+
+class Model(_NativeModel):
+    """CatBoost model loaded from JSON file or bytes."""
+
+    def predict(self, features, out=None, prediction_type="RawFormulaVal"):
+        """Predict an example or a matrix of examples.
+
+        Returns a vector of values of examples for one-dimensional predictions
+        and a matrix of examples x dimensions otherwise. Predictions are written
+        to out when it is given, it should be a C-contiguous float64 array of
+        the same shape.
+        """
+        if not hasattr(features, "__array_interface__") and not isinstance(features, memoryview):
+            features = np.asarray(features, dtype=np.float64)
+        dims = self.prediction_dimension(prediction_type)
+        if out is None:
+            size = features.shape[0] if len(features.shape) == 2 else None
+            shape = () if size is None else (size,)
+            out = np.empty(shape + ((dims,) if dims > 1 else ()), dtype=np.float64)
+        self.predict_into(features, out, prediction_type)
+        return out
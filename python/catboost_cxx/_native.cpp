@@ -0,0 +1,284 @@
+// CPython extension over the C interface of the library. Features are taken
+// from any object supporting the buffer protocol (NumPy arrays in C or
+// Fortran order, memoryviews) without copies, and predictions are written
+// to a preallocated buffer of doubles. The GIL is released while examples
+// are predicted.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <cstring>
+
+#include <cb.h>
+
+namespace {
+
+struct ModelObject {
+    PyObject_HEAD
+    catboost_model_info_t* model;
+};
+
+// Python buffer released when it goes out of scope.
+struct Buffer {
+    Py_buffer view;
+    bool acquired = false;
+
+    bool acquire(PyObject* obj, int flags) {
+        acquired = PyObject_GetBuffer(obj, &view, flags) == 0;
+        return acquired;
+    }
+
+    ~Buffer() {
+        if (acquired) PyBuffer_Release(&view);
+    }
+};
+
+// Format of single float or double value, with optional byte order of the host.
+char element_type(const char* format) {
+    if (format == nullptr) return 'B';
+    if (format[0] == '@' || format[0] == '=' || format[0] == (PY_LITTLE_ENDIAN ? '<' : '>')) ++format;
+    if ((format[0] == 'f' || format[0] == 'd') && format[1] == '\0') return format[0];
+    return '\0';
+}
+
+bool parse_prediction_type(PyObject* obj, catboost_prediction_type_t* type) {
+    if (obj == nullptr || obj == Py_None) {
+        *type = CB_RAW_FORMULA_VAL;
+        return true;
+    }
+
+    const char* name = PyUnicode_AsUTF8(obj);
+    if (name == nullptr) return false;
+
+    static const struct {
+        const char* name;
+        catboost_prediction_type_t type;
+    } types[] = {
+        {"RawFormulaVal", CB_RAW_FORMULA_VAL}, {"Probability", CB_PROBABILITY},
+        {"Class", CB_CLASS},                   {"Exponent", CB_EXPONENT},
+        {"LogProbability", CB_LOG_PROBABILITY},
+    };
+    for (const auto& t : types) {
+        if (std::strcmp(name, t.name) == 0) {
+            *type = t.type;
+            return true;
+        }
+    }
+
+    PyErr_Format(PyExc_ValueError, "Unknown prediction type: %s", name);
+    return false;
+}
+
+PyObject* set_last_error() {
+    PyErr_SetString(PyExc_RuntimeError, cb_model_last_error());
+    cb_model_last_error_clear();
+    return nullptr;
+}
+
+int model_init(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"path", "data", nullptr};
+    const char* path = nullptr;
+    const char* data = nullptr;
+    Py_ssize_t data_len = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|zy#", const_cast<char**>(keywords), &path, &data, &data_len)) {
+        return -1;
+    }
+    if ((path == nullptr) == (data == nullptr)) {
+        PyErr_SetString(PyExc_TypeError, "Either path or data of the model should be given");
+        return -1;
+    }
+
+    // Other threads could predict by the loaded model without the GIL, so it
+    // is never replaced.
+    auto* m = reinterpret_cast<ModelObject*>(self);
+    if (m->model) {
+        PyErr_SetString(PyExc_RuntimeError, "Model is already loaded, create a new one instead");
+        return -1;
+    }
+
+    catboost_model_info_t* model = nullptr;
+    Py_BEGIN_ALLOW_THREADS
+    model = path ? cb_model_load(path) : cb_model_load_from_string(data, static_cast<size_t>(data_len));
+    Py_END_ALLOW_THREADS
+    if (model == nullptr) {
+        set_last_error();
+        return -1;
+    }
+
+    // Another thread could initialize the model while the GIL was released.
+    if (m->model) {
+        cb_model_free(model);
+        PyErr_SetString(PyExc_RuntimeError, "Model is already loaded, create a new one instead");
+        return -1;
+    }
+    m->model = model;
+    return 0;
+}
+
+void model_dealloc(PyObject* self) {
+    auto* m = reinterpret_cast<ModelObject*>(self);
+    if (m->model) cb_model_free(m->model);
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free(self);
+    Py_DECREF(type);
+}
+
+catboost_model_info_t* loaded(PyObject* self) {
+    auto* m = reinterpret_cast<ModelObject*>(self);
+    if (m->model == nullptr) PyErr_SetString(PyExc_RuntimeError, "Model is not loaded");
+    return m->model;
+}
+
+PyObject* model_feature_count(PyObject* self, void*) {
+    catboost_model_info_t* model = loaded(self);
+    if (model == nullptr) return nullptr;
+    return PyLong_FromSize_t(cb_model_feature_count(model));
+}
+
+PyObject* model_dimension(PyObject* self, void*) {
+    catboost_model_info_t* model = loaded(self);
+    if (model == nullptr) return nullptr;
+    return PyLong_FromSize_t(cb_model_dimension(model));
+}
+
+PyObject* model_prediction_dimension(PyObject* self, PyObject* args) {
+    PyObject* type_obj = nullptr;
+    if (!PyArg_ParseTuple(args, "|O", &type_obj)) return nullptr;
+    catboost_prediction_type_t type;
+    if (!parse_prediction_type(type_obj, &type)) return nullptr;
+    catboost_model_info_t* model = loaded(self);
+    if (model == nullptr) return nullptr;
+    return PyLong_FromSize_t(cb_model_prediction_dimension(model, type));
+}
+
+// predict_into(features, out, prediction_type=None): features is a matrix of
+// examples (or one example) of float32 or float64 values with any strides,
+// out is a C-contiguous float64 buffer of size * dims values.
+PyObject* model_predict_into(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"features", "out", "prediction_type", nullptr};
+    PyObject* features_obj = nullptr;
+    PyObject* out_obj = nullptr;
+    PyObject* type_obj = nullptr;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|O", const_cast<char**>(keywords), &features_obj, &out_obj,
+                                     &type_obj)) {
+        return nullptr;
+    }
+
+    catboost_prediction_type_t type;
+    if (!parse_prediction_type(type_obj, &type)) return nullptr;
+    catboost_model_info_t* model = loaded(self);
+    if (model == nullptr) return nullptr;
+
+    Buffer features;
+    if (!features.acquire(features_obj, PyBUF_STRIDES | PyBUF_FORMAT)) return nullptr;
+    const Py_buffer& x = features.view;
+    const char element = element_type(x.format);
+    if (element == '\0' || x.itemsize != (element == 'f' ? 4 : 8)) {
+        PyErr_SetString(PyExc_TypeError, "Features should be float32 or float64 values");
+        return nullptr;
+    }
+    if (x.ndim != 1 && x.ndim != 2) {
+        PyErr_SetString(PyExc_ValueError, "Features should be a vector or a matrix");
+        return nullptr;
+    }
+    for (int i = 0; i < x.ndim; ++i) {
+        if (x.strides[i] % x.itemsize != 0) {
+            PyErr_SetString(PyExc_ValueError, "Strides of features should be multiples of the element size");
+            return nullptr;
+        }
+    }
+
+    const bool matrix = x.ndim == 2;
+    const size_t size = matrix ? static_cast<size_t>(x.shape[0]) : 1;
+    const size_t count = static_cast<size_t>(x.shape[matrix ? 1 : 0]);
+    const ptrdiff_t row_stride = matrix ? x.strides[0] / x.itemsize : 0;
+    const ptrdiff_t column_stride = x.strides[matrix ? 1 : 0] / x.itemsize;
+
+    Buffer out;
+    if (!out.acquire(out_obj, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | PyBUF_WRITABLE)) return nullptr;
+    if (element_type(out.view.format) != 'd' || out.view.itemsize != 8) {
+        PyErr_SetString(PyExc_TypeError, "Output should be float64 values");
+        return nullptr;
+    }
+    const size_t dims = cb_model_prediction_dimension(model, type);
+    if (dims == 0) {
+        PyErr_SetString(PyExc_ValueError, "Prediction type is not supported by the model");
+        return nullptr;
+    }
+    if (static_cast<size_t>(out.view.len) != size * dims * sizeof(double)) {
+        PyErr_Format(PyExc_ValueError, "Output should have %zu values", size * dims);
+        return nullptr;
+    }
+
+    double* y = static_cast<double*>(out.view.buf);
+    int rv = 0;
+    if (size > 0) {
+        Py_BEGIN_ALLOW_THREADS
+        if (element == 'f') {
+            rv = cb_model_apply_strided(model, static_cast<const float*>(x.buf), size, count, row_stride,
+                                        column_stride, type, y, dims);
+        } else {
+            rv = cb_model_apply_double_strided(model, static_cast<const double*>(x.buf), size, count, row_stride,
+                                               column_stride, type, y, dims);
+        }
+        Py_END_ALLOW_THREADS
+    }
+    if (rv != 0) return set_last_error();
+
+    Py_RETURN_NONE;
+}
+
+PyMethodDef model_methods[] = {
+    {"predict_into", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(model_predict_into)),
+     METH_VARARGS | METH_KEYWORDS,
+     "predict_into(features, out, prediction_type='RawFormulaVal')\n\n"
+     "Predict a float32 or float64 matrix of examples (or one example) with any strides into\n"
+     "a C-contiguous float64 buffer of examples * prediction_dimension(prediction_type) values."},
+    {"prediction_dimension", model_prediction_dimension, METH_VARARGS,
+     "prediction_dimension(prediction_type='RawFormulaVal')\n\nNumber of values predicted for every example."},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+PyGetSetDef model_getset[] = {
+    {"feature_count", model_feature_count, nullptr, "Number of float features of the model.", nullptr},
+    {"dimension", model_dimension, nullptr, "Number of raw values predicted for every example.", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr},
+};
+
+PyType_Slot model_slots[] = {
+    {Py_tp_doc, const_cast<char*>("Model(path=None, data=None)\n\nCatBoost model loaded from JSON file or bytes.")},
+    {Py_tp_init, reinterpret_cast<void*>(model_init)},
+    {Py_tp_dealloc, reinterpret_cast<void*>(model_dealloc)},
+    {Py_tp_new, reinterpret_cast<void*>(PyType_GenericNew)},
+    {Py_tp_methods, model_methods},
+    {Py_tp_getset, model_getset},
+    {0, nullptr},
+};
+
+PyType_Spec model_spec = {
+    "catboost_cxx._native.Model",
+    sizeof(ModelObject),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    model_slots,
+};
+
+PyModuleDef native_module = {
+    PyModuleDef_HEAD_INIT, "catboost_cxx._native", "Applier of CatBoost models over the C interface.", -1,
+    nullptr,
+};
+
+} // namespace
+
+PyMODINIT_FUNC PyInit__native(void) {
+    PyObject* module = PyModule_Create(&native_module);
+    if (module == nullptr) return nullptr;
+
+    PyObject* type = PyType_FromSpec(&model_spec);
+    if (type == nullptr || PyModule_AddObject(module, "Model", type) != 0) {
+        Py_XDECREF(type);
+        Py_DECREF(module);
+        return nullptr;
+    }
+    return module;
+}
@@ -0,0 +1,34 @@
+#!/usr/bin/env python3
+
+# Build Python extension together with the library:
+#     pip install ./python
+import glob
+import os
+import platform
+
+from setuptools import Extension, setup
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+args = ["-std=c++14"]
+if platform.machine() in ("x86_64", "AMD64", "i686"):
+    args.append("-msse4.1")
+else:
+    args.append("-DNOSSE")
+
+native = Extension(
+    "catboost_cxx._native",
+    sources=["catboost_cxx/_native.cpp"] + sorted(glob.glob(os.path.join(ROOT, "src", "*.cpp"))),
+    include_dirs=[os.path.join(ROOT, "include")],
+    extra_compile_args=args,
+    language="c++",
+)
+
+setup(
+    name="catboost-cxx",
+    version="0.1.0",
+    description="Fast applier of CatBoost models in JSON format",
+    packages=["catboost_cxx"],
+    ext_modules=[native],
+    install_requires=["numpy"],
+)
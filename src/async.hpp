@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "catboost.hpp"
+
+namespace catboost {
+
+namespace {
+
+// Queue of asynchronously submitted examples. Features are copied into
+// batches of up to batch_rows examples, and tasks of the executor take
+// batches from the front and predict them as buckets, so examples submitted
+// while a batch is being predicted are predicted together by the next one.
+// A task is scheduled by the first submission to an idle queue, and one more
+// for every full batch while there are fewer tasks than the executor could
+// run. The default executor is resolved by the first submission, so models
+// which are never applied asynchronously do not start its threads.
+class AsyncQueue {
+public:
+    static constexpr size_t batch_rows = 256;
+
+    // Predicts size examples of type to out, dims values per example.
+    using Predict = std::function<void(const float* const* f, size_t size, PredictionType type, double* out)>;
+
+    struct Request {
+        PredictionType type = PredictionType::RawFormulaVal;
+        // Output of dims values.
+        double* out = nullptr;
+        size_t dims = 1;
+        // Called on the executor thread when out is written, should not
+        // throw.
+        std::function<void()> done;
+    };
+
+private:
+    Executor* executor_;
+    const size_t width_;
+    size_t max_tasks_ = 0;
+    Predict predict_;
+
+    // Waiting examples: features of request i start at features[i * width_].
+    struct Batch {
+        std::vector<float> features;
+        std::vector<Request> requests;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable idle_;
+    std::deque<Batch> batches_;
+    size_t tasks_ = 0;
+
+    // Predict batches until the queue is empty.
+    void run() {
+        std::vector<const float*> rows;
+        std::vector<double> values;
+        std::vector<bool> done;
+        for (;;) {
+            Batch batch;
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                if (batches_.empty()) {
+                    if (--tasks_ == 0) idle_.notify_all();
+                    return;
+                }
+                batch = std::move(batches_.front());
+                batches_.pop_front();
+            }
+
+            // Examples of every prediction type are predicted by one bucket.
+            auto& requests = batch.requests;
+            done.assign(requests.size(), false);
+            for (size_t i = 0; i < requests.size(); ++i) {
+                if (done[i]) continue;
+                const PredictionType type = requests[i].type;
+                const size_t dims = requests[i].dims;
+                rows.clear();
+                for (size_t j = i; j < requests.size(); ++j) {
+                    if (requests[j].type == type) rows.push_back(&batch.features[j * width_]);
+                }
+                values.resize(rows.size() * dims);
+                predict_(rows.data(), rows.size(), type, values.data());
+                size_t k = 0;
+                for (size_t j = i; j < requests.size(); ++j) {
+                    if (requests[j].type != type) continue;
+                    std::copy(&values[k * dims], &values[(k + 1) * dims], requests[j].out);
+                    done[j] = true;
+                    ++k;
+                }
+            }
+            for (auto& request : requests) request.done();
+        }
+    }
+
+public:
+    // Queue of examples of width features predicted on the executor,
+    // default_executor() if null.
+    AsyncQueue(Executor* executor, size_t width, Predict predict)
+        : executor_{executor}, width_{width}, predict_{std::move(predict)} {}
+
+    AsyncQueue(const AsyncQueue&) = delete;
+    AsyncQueue& operator=(const AsyncQueue&) = delete;
+
+    // Wait for submitted examples.
+    ~AsyncQueue() {
+        std::unique_lock<std::mutex> lock{mutex_};
+        idle_.wait(lock, [this] { return tasks_ == 0; });
+    }
+
+    // Copy width features of an example to the queue.
+    void submit(const float* f, Request request) {
+        bool schedule = false;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            if (!max_tasks_) {
+                if (!executor_) executor_ = &default_executor();
+                max_tasks_ = std::max<size_t>(executor_->concurrency(), 1);
+            }
+            if (batches_.empty() || batches_.back().requests.size() == batch_rows) batches_.emplace_back();
+            auto& batch = batches_.back();
+            batch.features.insert(batch.features.end(), f, f + width_);
+            batch.requests.push_back(std::move(request));
+            if (tasks_ == 0 || (tasks_ < max_tasks_ && batches_.size() > tasks_)) {
+                ++tasks_;
+                schedule = true;
+            }
+        }
+        if (schedule) executor_->submit([this] { run(); });
+    }
+};
+
+// anonymous namespace
+} // namespace
+
+// namespace catboost
+} // namespace catboost
@@ -0,0 +1,339 @@
+#include "catboost.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "parallel.hpp"
+
+namespace catboost {
+
+namespace {
+
+// Example of a thread calling BatchingModel::apply. It lives on the stack of
+// the thread, which waits until its state is Done or it is asked to Lead,
+// that is to predict batches in place of the previous combiner.
+struct BatchRequest {
+    enum State : uint32_t {
+        Waiting,
+        Sleeping,
+        Done,
+        Lead,
+    };
+
+    const float* features;
+    double* out;
+    size_t dims;
+    PredictionType type;
+    std::chrono::steady_clock::time_point arrived;
+    std::exception_ptr error;
+    std::atomic<uint32_t> state{Waiting};
+
+    // Set final state. The request could be destroyed as soon as the state is
+    // changed, so only the address is used by the wake up after it.
+    void finish(State s) {
+        if (state.exchange(s) == Sleeping) futex_wake(state);
+    }
+
+    // Wait until the state is Done or Lead: spin for a while and sleep.
+    uint32_t wait(size_t spin_count) {
+        for (size_t i = 0; i < spin_count; ++i) {
+            const uint32_t s = state.load(std::memory_order_acquire);
+            if (s >= Done) return s;
+            cpu_relax();
+        }
+
+        for (;;) {
+            uint32_t s = Waiting;
+            if (!state.compare_exchange_strong(s, Sleeping) && s >= Done) return s;
+            futex_wait(state, Sleeping);
+            s = state.load(std::memory_order_acquire);
+            if (s >= Done) return s;
+        }
+    }
+};
+
+} // namespace
+
+// Waiting examples are kept in a bounded ring of pointers to requests with
+// sequence numbers of slots (Vyukov MPMC queue) with a single consumer: the
+// thread which holds busy. It is taken by a caller which finds it free after
+// putting its example, and is handed over to the owner of the oldest waiting
+// example when the combiner's own example is predicted.
+struct BatchingModel::Impl {
+    struct Slot {
+        std::atomic<size_t> seq{0};
+        BatchRequest* request = nullptr;
+        char padding[64 - sizeof(std::atomic<size_t>) - sizeof(BatchRequest*)];
+    };
+
+    // Word on its own cache line.
+    struct Padded {
+        std::atomic<size_t> value{0};
+        char padding[64 - sizeof(std::atomic<size_t>)];
+    };
+
+    const Model& model;
+    const BatchingOptions options;
+    const size_t feature_count;
+    const std::chrono::microseconds budget;
+    // Spinning only delays other threads on a single CPU.
+    const size_t spin_count;
+    const size_t yield_period;
+    std::unique_ptr<Slot[]> slots;
+    size_t mask = 0;
+
+    Padded tail;
+    Padded busy;
+
+    // State of the combiner.
+    size_t head = 0;
+    double expected = 1.0;
+    std::vector<BatchRequest*> batch;
+    std::vector<const float*> rows;
+    std::vector<double> values;
+    std::vector<BatchRequest*> finished;
+
+    std::atomic<uint64_t> examples{0};
+    std::atomic<uint64_t> batches{0};
+    std::atomic<uint64_t> timeouts{0};
+
+    Impl(const Model& m, const BatchingOptions& o)
+        : model(m),
+          options(o),
+          feature_count(m.feature_count()),
+          budget(static_cast<std::chrono::microseconds::rep>(o.latency_budget_us)),
+          spin_count(available_cpus() > 1 ? 4000 : 0),
+          yield_period(available_cpus() > 1 ? 64 : 1) {
+        size_t capacity = 64;
+        while (capacity < 4 * options.max_batch) capacity *= 2;
+        slots.reset(new Slot[capacity]);
+        for (size_t i = 0; i < capacity; ++i) slots[i].seq.store(i, std::memory_order_relaxed);
+        mask = capacity - 1;
+        // Combiner does not allocate outside of the try block of predict, so
+        // an exception can not leave busy taken.
+        batch.reserve(options.max_batch);
+        rows.reserve(options.max_batch);
+        finished.reserve(options.max_batch);
+    }
+
+    void put(BatchRequest* request) {
+        size_t pos = tail.value.load(std::memory_order_relaxed);
+        for (size_t spins = 0;; ++spins) {
+            Slot& slot = slots[pos & mask];
+            const size_t seq = slot.seq.load(std::memory_order_acquire);
+            const auto diff = static_cast<ptrdiff_t>(seq - pos);
+            if (diff == 0) {
+                // Sequentially consistent with the check of busy in apply, see
+                // release.
+                if (tail.value.compare_exchange_weak(pos, pos + 1, std::memory_order_seq_cst,
+                                                     std::memory_order_relaxed)) {
+                    slot.request = request;
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return;
+                }
+            } else {
+                // The ring is full or another thread took the slot.
+                if (diff < 0 && spins % yield_period == yield_period - 1) std::this_thread::yield();
+                cpu_relax();
+                pos = tail.value.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Number of examples put into the ring after head, up to limit.
+    size_t published(size_t limit) const {
+        size_t n = 0;
+        while (n < limit && slots[(head + n) & mask].seq.load(std::memory_order_acquire) == head + n + 1) ++n;
+        return n;
+    }
+
+    // Predict examples of the batch, every prediction type by one bucket.
+    void predict() {
+        const size_t n = batch.size();
+        for (size_t i = 0; i < n; ++i) {
+            BatchRequest* first = batch[i];
+            if (!first) continue;
+            const PredictionType type = first->type;
+            const size_t dims = first->dims;
+
+            rows.clear();
+            for (size_t j = i; j < n; ++j) {
+                if (batch[j] && batch[j]->type == type) rows.push_back(batch[j]->features);
+            }
+
+            std::exception_ptr error;
+            try {
+                if (rows.size() == 1) {
+                    model.apply(rows[0], feature_count, first->out, dims, type);
+                } else {
+                    values.resize(rows.size() * dims);
+                    model.apply(rows.data(), rows.size(), feature_count, values.data(), dims, type);
+                }
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            size_t row = 0;
+            for (size_t j = i; j < n; ++j) {
+                BatchRequest* r = batch[j];
+                if (!r || r->type != type) continue;
+                if (error) {
+                    r->error = error;
+                } else if (rows.size() > 1) {
+                    std::copy(&values[row * dims], &values[(row + 1) * dims], r->out);
+                }
+                ++row;
+                // Requests are finished by combine after the whole batch.
+                batch[j] = nullptr;
+                finished.push_back(r);
+            }
+        }
+    }
+
+    // Predict batches until the own example is predicted and release or hand
+    // over the ring.
+    void combine(BatchRequest* own) {
+        bool own_done = own->state.load(std::memory_order_acquire) == BatchRequest::Done;
+        while (!own_done) {
+            // Wait for as many examples as recent batches had, but not longer
+            // than the latency budget of the oldest one.
+            const size_t target =
+                std::min(options.max_batch, std::max<size_t>(1, static_cast<size_t>(expected + 0.5)));
+            size_t n = published(options.max_batch);
+            if (n < target) {
+                std::chrono::steady_clock::time_point deadline{};
+                for (size_t spins = 0; n < target; ++spins) {
+                    if (n > 0) {
+                        if (deadline == std::chrono::steady_clock::time_point{}) {
+                            deadline = slots[head & mask].request->arrived + budget;
+                        }
+                        if (std::chrono::steady_clock::now() >= deadline) {
+                            timeouts.fetch_add(1, std::memory_order_relaxed);
+                            break;
+                        }
+                    }
+                    if (spins % yield_period == yield_period - 1) std::this_thread::yield();
+                    cpu_relax();
+                    n = published(options.max_batch);
+                }
+            }
+
+            batch.clear();
+            for (size_t i = 0; i < n; ++i) {
+                Slot& slot = slots[(head + i) & mask];
+                batch.push_back(slot.request);
+                slot.seq.store(head + i + mask + 1, std::memory_order_release);
+            }
+            head += n;
+            expected += (static_cast<double>(n) - expected) / 8.0;
+
+            finished.clear();
+            predict();
+            examples.fetch_add(n, std::memory_order_relaxed);
+            batches.fetch_add(1, std::memory_order_relaxed);
+            for (BatchRequest* r : finished) {
+                if (r == own) {
+                    own_done = true;
+                } else {
+                    r->finish(BatchRequest::Done);
+                }
+            }
+        }
+        release();
+    }
+
+    // Hand the ring over to the owner of the oldest waiting example or free
+    // it if there are no examples. A caller stores tail and then loads busy,
+    // and release stores busy and then loads tail: all four operations are
+    // sequentially consistent, so either the caller takes busy or release
+    // sees its example.
+    void release() {
+        for (;;) {
+            if (tail.value.load() != head) {
+                // The example is put, wait until it is published.
+                while (published(1) == 0) cpu_relax();
+                slots[head & mask].request->finish(BatchRequest::Lead);
+                return;
+            }
+            busy.value.store(0);
+            // Examples put after the check above found the ring busy.
+            if (tail.value.load() == head || busy.value.exchange(1)) return;
+        }
+    }
+
+    void apply(const float* features, size_t count, double* out, size_t dims, PredictionType type) {
+        if (count < feature_count) {
+            throw std::runtime_error("Not enough features");
+        }
+
+        if (dims != model.dimension(type)) {
+            throw std::runtime_error("Wrong number of model dimensions");
+        }
+
+        BatchRequest request;
+        request.features = features;
+        request.out = out;
+        request.dims = dims;
+        request.type = type;
+        request.arrived = std::chrono::steady_clock::now();
+        put(&request);
+
+        if (busy.value.exchange(1) == 0 || request.wait(spin_count) == BatchRequest::Lead) {
+            combine(&request);
+        }
+
+        if (request.error) std::rethrow_exception(request.error);
+    }
+};
+
+BatchingModel::BatchingModel(const Model& model, const BatchingOptions& options) {
+    if (model.dimension() == 0) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (model.cat_feature_count() > 0) {
+        throw std::runtime_error("Models with categorical features are not supported");
+    }
+
+    if (options.max_batch == 0) {
+        throw std::runtime_error("Batch should have at least one example");
+    }
+
+    impl_.reset(new Impl(model, options));
+}
+
+BatchingModel::~BatchingModel() {}
+
+double BatchingModel::apply(const float* features, size_t count, PredictionType type) const {
+    if (impl_->model.dimension(type) != 1) {
+        throw std::runtime_error("Model predicts several values, use apply with dims");
+    }
+
+    double y = 0.0;
+    impl_->apply(features, count, &y, 1, type);
+    return y;
+}
+
+void BatchingModel::apply(const float* features, size_t count, double* out, size_t dims, PredictionType type) const {
+    impl_->apply(features, count, out, dims, type);
+}
+
+const Model& BatchingModel::model() const { return impl_->model; }
+
+const BatchingOptions& BatchingModel::options() const { return impl_->options; }
+
+BatchingStats BatchingModel::stats() const {
+    BatchingStats stats;
+    stats.examples = impl_->examples.load(std::memory_order_relaxed);
+    stats.batches = impl_->batches.load(std::memory_order_relaxed);
+    stats.timeouts = impl_->timeouts.load(std::memory_order_relaxed);
+    return stats;
+}
+
+// namespace catboost
+} // namespace catboost
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include "catboost.hpp"
+#include "vec4.hpp"
+
+namespace catboost {
+
+namespace {
+
+// Hash of float features in the style of XXH3: 16-byte stripes are xored
+// with secret words, and every 64-bit lane accumulates the product of its
+// 32-bit halves and the other lane of the stripe. SSE multiplies both lanes
+// by one instruction, and both versions give the same hash.
+constexpr uint64_t hash_secret[8] = {
+    0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull,
+    0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull, 0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull,
+};
+constexpr uint64_t hash_prime1 = 0x9e3779b185ebca87ull;
+constexpr uint64_t hash_prime2 = 0x165667919e3779f9ull;
+
+inline uint64_t hash_avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= hash_prime2;
+    return h ^ (h >> 32);
+}
+
+#ifdef NOSSE
+
+inline void hash_stripe(uint64_t* acc, const float* x, size_t stripe) {
+    uint64_t d[2];
+    std::memcpy(d, x, sizeof(d));
+    for (size_t l = 0; l < 2; ++l) {
+        const uint64_t dk = d[l] ^ hash_secret[(2 * stripe + l) & 7];
+        acc[l] += (dk & 0xffffffffu) * (dk >> 32) + d[l ^ 1];
+    }
+}
+
+inline uint64_t hash_features(const float* x, size_t count) {
+    uint64_t acc[2] = {hash_prime1, hash_prime2};
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) hash_stripe(acc, x + i, i / 4);
+    if (i < count) {
+        float tail[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        std::copy(x + i, x + count, tail);
+        hash_stripe(acc, tail, i / 4);
+    }
+    return hash_avalanche(hash_avalanche(acc[0] + count * hash_prime1) ^ acc[1]);
+}
+
+#else
+
+inline __m128i hash_stripe(__m128i acc, const float* x, size_t stripe) {
+    const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x));
+    const __m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hash_secret + ((2 * stripe) & 7)));
+    const __m128i dk = _mm_xor_si128(d, key);
+    const __m128i product = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+    return _mm_add_epi64(acc, _mm_add_epi64(product, _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2))));
+}
+
+inline uint64_t hash_features(const float* x, size_t count) {
+    __m128i acc = _mm_set_epi64x(static_cast<int64_t>(hash_prime2), static_cast<int64_t>(hash_prime1));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) acc = hash_stripe(acc, x + i, i / 4);
+    if (i < count) {
+        float tail[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        std::copy(x + i, x + count, tail);
+        acc = hash_stripe(acc, tail, i / 4);
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+    return hash_avalanche(hash_avalanche(lanes[0] + count * hash_prime1) ^ lanes[1]);
+}
+
+// NOSSE
+#endif
+
+// Bounded cache of sums of leaf values keyed by used features of examples.
+// Slots are direct mapped by hash and every one is guarded by a sequence
+// lock: a writer makes the version odd, writes the slot and makes it even
+// again, a reader copies the slot and checks that the version did not
+// change. Readers never wait, and a writer skips a slot which is being
+// written. Slots are split into shards with their own hit and miss counters
+// on separate cache lines. Keys are compared completely, so collisions of
+// hashes give misses rather than wrong predictions.
+//
+// All words are atomic and are accessed relaxed between the fences of the
+// version, so concurrent readers and writers are race free.
+class PredictionCache {
+    // Words of a counter, so counters of shards do not share cache lines.
+    static constexpr size_t counter_words = 8;
+    static constexpr size_t max_shards = 16;
+
+    // Number of features of a key, words of a key and of a slot: version,
+    // hash, values and key packed by two features.
+    size_t key_size_ = 0;
+    size_t key_words_ = 0;
+    size_t dims_ = 0;
+    size_t slot_words_ = 0;
+    size_t shards_ = 0;
+    size_t shard_slots_ = 0;
+    std::unique_ptr<std::atomic<uint64_t>[]> slots_;
+    std::unique_ptr<std::atomic<uint64_t>[]> counters_;
+
+    std::atomic<uint64_t>* slot(uint64_t hash) const noexcept {
+        const size_t shard = (hash >> 60) % shards_;
+        return &slots_[(shard * shard_slots_ + (hash & 0xffffffffu) % shard_slots_) * slot_words_];
+    }
+
+    // Word i of the key, the last one is padded by zero.
+    uint64_t key_word(const float* key, size_t i) const noexcept {
+        uint64_t word = 0;
+        std::memcpy(&word, key + 2 * i, std::min<size_t>(2, key_size_ - 2 * i) * sizeof(float));
+        return word;
+    }
+
+    std::atomic<uint64_t>& counter(uint64_t hash, bool hit) const noexcept {
+        return counters_[(((hash >> 60) % shards_) * 2 + hit) * counter_words];
+    }
+
+public:
+    // Cache of predictions with dims values for keys of key_size features
+    // taking at most size bytes. It has no slots if the size is too small for
+    // one.
+    PredictionCache(size_t size, size_t key_size, size_t dims)
+        : key_size_{key_size}, key_words_{(key_size + 1) / 2}, dims_{dims} {
+        slot_words_ = 2 + dims + key_words_;
+        const size_t shard_words = size / sizeof(uint64_t) / max_shards;
+        shards_ = shard_words > 2 * counter_words + slot_words_ ? max_shards : 1;
+        const size_t words = size / sizeof(uint64_t) / shards_;
+        if (words <= 2 * counter_words) return;
+        shard_slots_ = (words - 2 * counter_words) / slot_words_;
+        if (!shard_slots_) return;
+        slots_.reset(new std::atomic<uint64_t>[shards_ * shard_slots_ * slot_words_]());
+        counters_.reset(new std::atomic<uint64_t>[shards_ * 2 * counter_words]());
+    }
+
+    bool empty() const noexcept { return !shard_slots_; }
+
+    // Number of slots and memory they take with counters.
+    size_t capacity() const noexcept { return shards_ * shard_slots_; }
+    size_t memory() const noexcept {
+        return (capacity() * slot_words_ + shards_ * 2 * counter_words) * sizeof(uint64_t);
+    }
+
+    uint64_t hits() const noexcept { return count(true); }
+    uint64_t misses() const noexcept { return count(false); }
+
+    uint64_t count(bool hit) const noexcept {
+        uint64_t res = 0;
+        for (size_t s = 0; s < shards_; ++s) {
+            res += counters_[(s * 2 + hit) * counter_words].load(std::memory_order_relaxed);
+        }
+        return res;
+    }
+
+    // Copy values of the key to out and return true if they are
+    // cached. Out is written on misses too.
+    bool lookup(uint64_t hash, const float* key, double* out) const noexcept {
+        const std::atomic<uint64_t>* s = slot(hash);
+        const uint64_t version = s[0].load(std::memory_order_acquire);
+        bool hit = version && !(version & 1) && s[1].load(std::memory_order_relaxed) == hash;
+        for (size_t i = 0; hit && i < key_words_; ++i) {
+            hit = s[2 + dims_ + i].load(std::memory_order_relaxed) == key_word(key, i);
+        }
+        if (hit) {
+            for (size_t d = 0; d < dims_; ++d) {
+                const uint64_t word = s[2 + d].load(std::memory_order_relaxed);
+                std::memcpy(out + d, &word, sizeof(word));
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            hit = s[0].load(std::memory_order_relaxed) == version;
+        }
+        counter(hash, hit).fetch_add(1, std::memory_order_relaxed);
+        return hit;
+    }
+
+    // Store values of the key, unless another thread writes the slot.
+    void insert(uint64_t hash, const float* key, const double* values) noexcept {
+        std::atomic<uint64_t>* s = slot(hash);
+        uint64_t version = s[0].load(std::memory_order_relaxed);
+        if ((version & 1) || !s[0].compare_exchange_strong(version, version + 1, std::memory_order_relaxed)) return;
+        std::atomic_thread_fence(std::memory_order_release);
+        s[1].store(hash, std::memory_order_relaxed);
+        for (size_t d = 0; d < dims_; ++d) {
+            uint64_t word;
+            std::memcpy(&word, values + d, sizeof(word));
+            s[2 + d].store(word, std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < key_words_; ++i) s[2 + dims_ + i].store(key_word(key, i), std::memory_order_relaxed);
+        s[0].store(version + 2, std::memory_order_release);
+    }
+};
+
+// anonymous namespace
+} // namespace
+
+// namespace catboost
+} // namespace catboost
@@ -1,39 +1,173 @@
 #include "catboost.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <random>
+#include <type_traits>
 
+#include "async.hpp"
+#include "cache.hpp"
+#include "categorical.hpp"
+#include "convert.hpp"
 #include "json.hpp"
+#include "parallel.hpp"
+#include "shap.hpp"
+#include "transform.hpp"
 #include "vec4.hpp"
 
 namespace catboost {
 
 namespace {
 
+// Reads splits of trees. Splits on categorical features are replaced with
+// splits on derived float features of CatFeatures.
+class SplitReader {
+    CatFeatures& cats_;
+    // CTR descriptions from features info and CTR data of the model.
+    const nlohmann::json* ctrs_ = nullptr;
+    const nlohmann::json* ctr_data_ = nullptr;
+    // Split indexes number binary features of the model: borders of float
+    // features, then one-hot values, then borders of CTRs. This is the
+    // index of the first CTR border.
+    size_t ctr_split_base_ = 0;
+    // Derived features of CTRs from features info, UINT32_MAX for CTRs
+    // which are not used yet.
+    std::vector<uint32_t> ctr_features_;
+
+    // Position of CTR of the split in features info. CTR is found by split
+    // index if it is consistent with the border, otherwise by the border.
+    size_t find_ctr(const nlohmann::json& split, float border) const {
+        const unsigned target = split.value("ctr_target_border_idx", 0u);
+        auto has_border = [&](const nlohmann::json& ctr, size_t i) {
+            return ctr.value("target_border_idx", 0u) == target &&
+                   static_cast<float>(ctr.at("borders").at(i).get<double>()) == border;
+        };
+
+        if (split.count("split_index")) {
+            const size_t index = split.at("split_index").get<size_t>();
+            size_t begin = ctr_split_base_;
+            for (size_t i = 0; i < ctrs_->size() && begin <= index; ++i) {
+                const auto& ctr = (*ctrs_)[i];
+                const size_t end = begin + ctr.at("borders").size();
+                if (index < end && has_border(ctr, index - begin)) return i;
+                begin = end;
+            }
+        }
+
+        size_t found = ctrs_->size();
+        for (size_t i = 0; i < ctrs_->size(); ++i) {
+            const auto& ctr = (*ctrs_)[i];
+            for (size_t j = 0; j < ctr.at("borders").size(); ++j) {
+                if (!has_border(ctr, j)) continue;
+                if (found != ctrs_->size() && found != i) {
+                    throw std::runtime_error("Invalid model: ambiguous CTR split");
+                }
+                found = i;
+            }
+        }
+        if (found == ctrs_->size()) throw std::runtime_error("Invalid model: unknown CTR split");
+        return found;
+    }
+
+    // Derived feature of CTR, which is created when it is used first.
+    uint32_t ctr_feature(size_t i) {
+        if (ctr_features_[i] == UINT32_MAX) {
+            const auto& ctr = (*ctrs_)[i];
+            const auto& id = ctr.at("identifier");
+            const auto& data = ctr_data_->at(id.is_string() ? id.get<std::string>() : id.dump());
+            ctr_features_[i] = cats_.add_ctr(CtrFeature{ctr, data, cats_.float_count, cats_.cat_count});
+        }
+        return ctr_features_[i];
+    }
+
+public:
+    SplitReader(const nlohmann::json& model, CatFeatures& cats) : cats_(cats) {
+        const auto& info = model.at("features_info");
+        cats_.float_count = info.at("float_features").size();
+        cats_.cat_count = info.count("categorical_features") ? info.at("categorical_features").size() : 0;
+
+        for (const auto& f : info.at("float_features")) {
+            if (f.count("borders")) ctr_split_base_ += f.at("borders").size();
+        }
+        if (info.count("one_hot_features")) {
+            for (const auto& f : info.at("one_hot_features")) ctr_split_base_ += f.at("values").size();
+        }
+        if (info.count("ctrs")) {
+            ctrs_ = &info.at("ctrs");
+            ctr_features_.assign(ctrs_->size(), UINT32_MAX);
+        }
+        if (model.count("ctr_data")) ctr_data_ = &model.at("ctr_data");
+    }
+
+    // Return index of float feature of the split and set its border.
+    uint32_t read(const nlohmann::json& split, float& border) {
+        const auto type = split.value("split_type", std::string{"FloatFeature"});
+
+        if (type == "FloatFeature") {
+            border = split.at("border").get<double>();
+            const uint32_t index = split.at("float_feature_index").get<unsigned>();
+            if (index >= cats_.float_count) {
+                throw std::runtime_error("Invalid model: index is greater than feature count");
+            }
+            return index;
+        }
+
+        if (type == "OneHotFeature") {
+            border = 0.5f;
+            return cats_.add_one_hot(split.at("cat_feature_index").get<unsigned>(), split.at("value").get<int32_t>());
+        }
+
+        if (type == "OnlineCtr") {
+            if (!ctrs_ || !ctr_data_) throw std::runtime_error("Invalid model: no CTR data");
+            border = split.at("border").get<double>();
+            return ctr_feature(find_ctr(split, border));
+        }
+
+        throw std::runtime_error("Invalid model: unsupported split type");
+    }
+};
+
 // Json respresentation of decision tree from CatBoost model
 struct JsonTree {
     std::vector<double> values;
     std::vector<float> borders;
     std::vector<uint32_t> indexes;
+    // Weights of training examples in every leaf, empty if the model has
+    // none. Used as covers by SHAP values.
+    std::vector<double> weights;
+    // Number of values in every leaf, they are adjacent.
+    size_t dims = 1;
+    // Position of the tree in the model.
+    uint32_t id = 0;
 
-    JsonTree(const nlohmann::json& t, size_t feature_count) {
+    JsonTree(const nlohmann::json& t, SplitReader& reader) {
         const auto& splits = t.at("splits");
         const auto& values = t.at("leaf_values");
 
-        if (splits.size() >= 32 || static_cast<size_t>(1) << splits.size() != values.size()) {
+        if (splits.size() >= 32 || values.empty() || values.size() % (static_cast<size_t>(1) << splits.size())) {
             throw std::runtime_error("Invalid model");
         }
+        dims = values.size() >> splits.size();
 
         // Loading values:
         this->values.resize(values.size());
         for (size_t i = 0; i < values.size(); ++i) this->values[i] = values[i].get<double>();
 
+        if (t.count("leaf_weights")) {
+            for (const auto& w : t.at("leaf_weights")) weights.push_back(w.get<double>());
+            if (weights.size() != values.size() / dims) throw std::runtime_error("Invalid model: wrong leaf weights");
+        }
+
         // Loading splits:
         for (const auto& split : splits) {
-            borders.push_back(split.at("border").get<double>());
-            indexes.push_back(split.at("float_feature_index").get<unsigned>());
-            if (indexes.back() >= feature_count) {
-                throw std::runtime_error("Invalid model: index is greater than feature count");
-            }
+            float border = 0.0f;
+            indexes.push_back(reader.read(split, border));
+            borders.push_back(border);
         }
     }
 
@@ -41,22 +175,321 @@ struct JsonTree {
     size_t depth() const { return borders.size(); }
 };
 
+// Json representation of non-symmetric (Depthwise or Lossguide) tree from
+// CatBoost model. Nodes are stored breadth-first, children of a node are
+// adjacent.
+struct JsonNodeTree {
+    struct Node {
+        float border = 0.0f;
+        uint32_t index = 0;
+        // Position of the left child, the right one follows it. Zero for leaves.
+        uint32_t child = 0;
+        std::vector<double> values;
+    };
+    std::vector<Node> nodes;
+    size_t depth = 0;
+    // Number of values in every leaf.
+    size_t dims = 0;
+    // Position of the tree in the model.
+    uint32_t id = 0;
+
+    JsonNodeTree(const nlohmann::json& t, SplitReader& reader) {
+        // Json nodes in breadth-first order with their levels.
+        std::vector<std::pair<const nlohmann::json*, size_t>> queue{{&t, 0}};
+        nodes.emplace_back();
+
+        for (size_t i = 0; i < queue.size(); ++i) {
+            const auto& node = *queue[i].first;
+            const size_t level = queue[i].second;
+            depth = std::max(depth, level);
+
+            if (!node.count("split")) {
+                const auto& value = node.at("value");
+                if (value.is_array()) {
+                    for (const auto& v : value) nodes[i].values.push_back(v.get<double>());
+                } else {
+                    nodes[i].values.push_back(value.get<double>());
+                }
+                if (nodes[i].values.empty() || (dims && nodes[i].values.size() != dims)) {
+                    throw std::runtime_error("Invalid model: leaves have different number of values");
+                }
+                dims = nodes[i].values.size();
+                continue;
+            }
+
+            nodes[i].index = reader.read(node.at("split"), nodes[i].border);
+            if (level >= 64) {
+                throw std::runtime_error("Invalid model: tree is too deep");
+            }
+
+            nodes[i].child = static_cast<uint32_t>(nodes.size());
+            queue.emplace_back(&node.at("left"), level + 1);
+            queue.emplace_back(&node.at("right"), level + 1);
+            nodes.resize(nodes.size() + 2);
+        }
+    }
+};
+
+// CatBoost replaces NaN values of features with nan_value_treatment AsTrue by
+// +inf, so NaN goes right in their splits. Comparison with border sends NaN
+// left, which is right for the other treatments. Compiled splits of AsTrue
+// features are marked by this bit of feature index, and only kernels of
+// trees with such splits check it, so other trees do not pay for NaN.
+static constexpr uint32_t nan_right_bit = 0x80000000u;
+
+// True if feature of split is greater than its border. NaN is greater only
+// for marked splits, kernels without them use nan = false.
+template <bool nan>
+inline bool greater(const float* f, uint32_t index, float border) {
+    if (!nan) return f[index] > border;
+    const float x = f[index & ~nan_right_bit];
+    return x > border || (index >= nan_right_bit && x != x);
+}
+
 // Model from JSON C++ representation.
 struct JsonModel {
     size_t feature_count = 0;
+    // Float features whose NaN values go right.
+    std::vector<bool> nan_right;
+    // Categorical features and features derived from them.
+    CatFeatures cat_features;
     std::vector<JsonTree> trees;
-    double bias = 0.0;
+    std::vector<JsonNodeTree> node_trees;
+    // Number of values predicted for every example.
+    size_t dims = 1;
+    std::vector<double> bias;
     double scale = 1.0;
+    // Loss function, which defines prediction types.
+    LossKind loss = LossKind::Other;
+
+    // Feature index of compiled split, marked if NaN goes right in it.
+    uint32_t split_index(uint32_t index) const {
+        return index < nan_right.size() && nan_right[index] ? index | nan_right_bit : index;
+    }
+
+    // Float features used by splits and CTRs, the most used first. Features
+    // used equally often are ordered by index.
+    std::vector<uint32_t> used_features() const {
+        std::vector<size_t> uses(feature_count, 0);
+        auto add = [&](uint32_t index) {
+            if (index < feature_count) ++uses[index];
+        };
+        for (const auto& tree : trees) {
+            for (uint32_t index : tree.indexes) add(index);
+        }
+        for (const auto& tree : node_trees) {
+            for (const auto& node : tree.nodes) {
+                if (node.child) add(node.index);
+            }
+        }
+        for (const auto& ctr : cat_features.ctrs) {
+            for (const auto& split : ctr.floats) add(split.first);
+        }
+
+        std::vector<uint32_t> used;
+        for (uint32_t f = 0; f < feature_count; ++f) {
+            if (uses[f]) used.push_back(f);
+        }
+        std::stable_sort(used.begin(), used.end(), [&](uint32_t a, uint32_t b) { return uses[a] > uses[b]; });
+        return used;
+    }
+
+    // The same model on features renumbered densely: feature used[i] of the
+    // original model is feature i. Model should have no categorical features.
+    JsonModel compact(const std::vector<uint32_t>& used) const {
+        std::vector<uint32_t> numbers(feature_count, 0);
+        for (size_t i = 0; i < used.size(); ++i) numbers[used[i]] = static_cast<uint32_t>(i);
+
+        JsonModel res = *this;
+        res.feature_count = used.size();
+        res.cat_features.float_count = used.size();
+        res.nan_right.clear();
+        for (uint32_t f : used) res.nan_right.push_back(nan_right[f]);
+        for (auto& tree : res.trees) {
+            for (auto& index : tree.indexes) index = numbers[index];
+        }
+        for (auto& tree : res.node_trees) {
+            for (auto& node : tree.nodes) {
+                if (node.child) node.index = numbers[node.index];
+            }
+        }
+        return res;
+    }
+
+    // The same model without leaf values and categorical features, which
+    // are kept by compiled trees. Weights of leaves are kept for SHAP values
+    // of specialized models, so for one-dimensional models with weights this
+    // saves only categorical features and copies of values.
+    JsonModel without_values() const {
+        JsonModel res;
+        res.feature_count = feature_count;
+        res.nan_right = nan_right;
+        res.dims = dims;
+        res.bias = bias;
+        res.scale = scale;
+        res.loss = loss;
+        for (const auto& tree : trees) {
+            res.trees.push_back(tree);
+            res.trees.back().values = std::vector<double>{};
+        }
+        for (const auto& tree : node_trees) {
+            res.node_trees.push_back(tree);
+            for (auto& node : res.node_trees.back().nodes) node.values = std::vector<double>{};
+        }
+        return res;
+    }
+
+    // The same model for examples with fixed values of some float features.
+    // Splits by them are replaced by the branches the values go to: depth of
+    // oblivious trees is reduced, non-symmetric trees are cut, and values of
+    // trees without other splits are added to bias. Trees are moved from this
+    // model.
+    // @argument fixed - true for fixed features
+    // @argument values - values of features, used for fixed ones only
+    JsonModel specialize(const std::vector<bool>& fixed, const float* values) && {
+        auto is_fixed = [&](uint32_t index) { return index < feature_count && fixed[index]; };
+        auto right = [&](uint32_t index, float border) { return greater<true>(values, split_index(index), border); };
+        auto add_bias = [](JsonModel& model, const double* leaf) {
+            for (size_t d = 0; d < model.dims; ++d) model.bias[d] += model.scale * leaf[d];
+        };
+
+        JsonModel res;
+        res.feature_count = feature_count;
+        res.nan_right = nan_right;
+        res.cat_features = std::move(cat_features);
+        res.dims = dims;
+        res.bias = bias;
+        res.scale = scale;
+        res.loss = loss;
+        res.trees.reserve(trees.size());
+
+        std::vector<uint32_t> free;
+        for (auto& tree : trees) {
+            // Leaf bits of fixed splits and positions of the other ones.
+            uint32_t fixed_bits = 0;
+            free.clear();
+            for (uint32_t i = 0; i < tree.depth(); ++i) {
+                if (!is_fixed(tree.indexes[i])) {
+                    free.push_back(i);
+                } else if (right(tree.indexes[i], tree.borders[i])) {
+                    fixed_bits |= uint32_t{1} << i;
+                }
+            }
+            if (free.empty()) {
+                add_bias(res, &tree.values[fixed_bits * dims]);
+                continue;
+            }
+            if (free.size() == tree.depth()) {
+                res.trees.push_back(std::move(tree));
+                continue;
+            }
+
+            std::vector<double> leaves;
+            std::vector<double> weights;
+            leaves.reserve((size_t{1} << free.size()) * dims);
+            for (uint32_t leaf = 0; leaf < (uint32_t{1} << free.size()); ++leaf) {
+                uint32_t old = fixed_bits;
+                for (size_t i = 0; i < free.size(); ++i) old |= ((leaf >> i) & 1) << free[i];
+                leaves.insert(leaves.end(), &tree.values[old * dims], &tree.values[(old + 1) * dims]);
+                if (!tree.weights.empty()) weights.push_back(tree.weights[old]);
+            }
+            for (size_t i = 0; i < free.size(); ++i) {
+                tree.indexes[i] = tree.indexes[free[i]];
+                tree.borders[i] = tree.borders[free[i]];
+            }
+            tree.indexes.resize(free.size());
+            tree.borders.resize(free.size());
+            tree.values = std::move(leaves);
+            tree.weights = std::move(weights);
+            res.trees.push_back(std::move(tree));
+        }
+
+        for (auto& tree : node_trees) {
+            // Node reached from node i through fixed splits.
+            auto resolve = [&](uint32_t i) {
+                while (tree.nodes[i].child && is_fixed(tree.nodes[i].index)) {
+                    const auto& node = tree.nodes[i];
+                    i = node.child + right(node.index, node.border);
+                }
+                return i;
+            };
+
+            std::vector<JsonNodeTree::Node> nodes(1);
+            size_t depth = 0;
+            std::vector<std::pair<uint32_t, size_t>> queue{{resolve(0), 0}};
+            for (size_t i = 0; i < queue.size(); ++i) {
+                auto& node = tree.nodes[queue[i].first];
+                const size_t level = queue[i].second;
+                depth = std::max(depth, level);
+                if (!node.child) {
+                    nodes[i].values = std::move(node.values);
+                    continue;
+                }
+                nodes[i].index = node.index;
+                nodes[i].border = node.border;
+                nodes[i].child = static_cast<uint32_t>(nodes.size());
+                queue.emplace_back(resolve(node.child), level + 1);
+                queue.emplace_back(resolve(node.child + 1), level + 1);
+                nodes.resize(nodes.size() + 2);
+            }
+            if (nodes.size() == 1) {
+                add_bias(res, nodes[0].values.data());
+                continue;
+            }
+            tree.nodes = std::move(nodes);
+            tree.depth = depth;
+            res.node_trees.push_back(std::move(tree));
+        }
+
+        for (size_t i = 0; i < res.trees.size(); ++i) res.trees[i].id = static_cast<uint32_t>(i);
+        for (size_t i = 0; i < res.node_trees.size(); ++i) {
+            res.node_trees[i].id = static_cast<uint32_t>(res.trees.size() + i);
+        }
+        return res;
+    }
 
     // Load model from JSON
     void load(const nlohmann::json& model) {
-        feature_count = model.at("features_info").at("float_features").size();
-        const auto& ts = model.at("oblivious_trees");
+        SplitReader reader{model, cat_features};
+        feature_count = cat_features.float_count;
         scale = 1.0;
-        bias = 0.0;
+        bias.clear();
+        loss = read_loss(model);
+
+        nan_right.clear();
+        for (const auto& f : model.at("features_info").at("float_features")) {
+            const auto treatment = f.value("nan_value_treatment", std::string{"AsIs"});
+            if (treatment != "AsIs" && treatment != "AsFalse" && treatment != "AsTrue") {
+                throw std::runtime_error("Invalid model: unknown nan_value_treatment " + treatment);
+            }
+            nan_right.push_back(treatment == "AsTrue");
+        }
+
+        // Models with non-symmetric trees may have no oblivious ones.
+        if (!model.count("trees") || model.count("oblivious_trees")) {
+            for (const auto& t : model.at("oblivious_trees")) {
+                trees.emplace_back(t, reader);
+                trees.back().id = static_cast<uint32_t>(trees.size() - 1);
+            }
+        }
+
+        if (model.count("trees")) {
+            for (const auto& t : model.at("trees")) {
+                node_trees.emplace_back(t, reader);
+                node_trees.back().id = static_cast<uint32_t>(trees.size() + node_trees.size() - 1);
+            }
+        }
 
-        for (const auto& t : ts) {
-            trees.emplace_back(t, feature_count);
+        if (!trees.empty()) {
+            dims = trees.front().dims;
+        } else if (!node_trees.empty()) {
+            dims = node_trees.front().dims;
+        }
+        for (const auto& t : trees) {
+            if (t.dims != dims) throw std::runtime_error("Invalid model: trees have different number of values");
+        }
+        for (const auto& t : node_trees) {
+            if (t.dims != dims) throw std::runtime_error("Invalid model: trees have different number of values");
         }
 
         if (model.count("scale_and_bias")) {
@@ -65,21 +498,370 @@ struct JsonModel {
                 scale = scale_and_bias.at(0).get<double>();
                 const auto& node = scale_and_bias.at(1);
                 if (node.is_number()) {
-                    bias = node.get<double>();
+                    bias.push_back(node.get<double>());
                 } else {
-                    bias = scale_and_bias.at(1).at(0).get<double>();
+                    for (const auto& b : node) bias.push_back(b.get<double>());
                 }
             }
         }
+
+        // Single bias is shared by all dimensions.
+        if (bias.size() <= 1) {
+            bias.resize(dims, bias.empty() ? 0.0 : bias.front());
+        } else if (bias.size() != dims) {
+            throw std::runtime_error("Invalid model: bias does not match number of values");
+        }
+    }
+};
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CATBOOST_PREFETCH(p) __builtin_prefetch(p)
+#elif !defined(NOSSE)
+#define CATBOOST_PREFETCH(p) _mm_prefetch(reinterpret_cast<const char*>(p), _MM_HINT_T0)
+#else
+#define CATBOOST_PREFETCH(p) ((void)(p))
+#endif
+
+// Models with leaf values larger than this do not fit into L2 cache and
+// benefit from the pipelined kernel.
+static constexpr size_t pipelined_values_size = 1024 * 1024;
+
+// Number of examples evaluated together by batch predictions by default.
+static constexpr size_t default_batch_width = 8;
+
+// Parallel predictions split examples into chunks with features of this size.
+static constexpr size_t parallel_chunk_size = 256 * 1024;
+
+// Buckets with less tree evaluations than this are not worth waking up
+// other threads.
+static constexpr size_t parallel_min_work = 1024 * 1024;
+
+// Maximum number of examples explained by one task of shap_values_parallel.
+static constexpr size_t shap_chunk_size = 64;
+
+// Number of examples of count features predicted by one task when size
+// examples are predicted by participants threads. Chunk features should fit
+// into L2 cache, and there should be several chunks per thread to balance
+// the load.
+static size_t parallel_chunk(size_t size, size_t count, size_t participants) {
+    size_t chunk = parallel_chunk_size / (sizeof(float) * std::max<size_t>(count, 1));
+    chunk = std::min(chunk, size / (4 * participants));
+    return std::max<size_t>(chunk - chunk % 16, 16);
+}
+
+Kernel resolve_kernel(Kernel kernel, size_t values_size) {
+    if (kernel != Kernel::Auto) return kernel;
+    return values_size > pipelined_values_size ? Kernel::Pipelined : Kernel::Plain;
+}
+
+// Pair of independent accumulators.
+struct Acc2 {
+#ifdef NOSSE
+    double x0 = 0.0;
+    double x1 = 0.0;
+
+    void add(double a0, double a1) {
+        x0 += a0;
+        x1 += a1;
+    }
+
+    void add_low(double a0) { x0 += a0; }
+
+    void store(double* p) const {
+        p[0] = x0;
+        p[1] = x1;
+    }
+
+    double sum() const { return x0 + x1; }
+#else
+    Vec2d v;
+
+    void add(double a0, double a1) { v += Vec2d(a1, a0); }
+
+    void add_low(double a0) { v.add_low(a0); }
+
+    void store(double* p) const { v.storeu(p); }
+
+    double sum() const { return v.sum(); }
+#endif
+};
+
+// Accumulators of N examples for batch predictions. Pairs of examples share
+// vector registers, and every example is summed in the order of trees.
+template <size_t N>
+struct BatchSum {
+    std::array<Acc2, (N + 1) / 2> acc;
+
+    // Distance between leaves in values.
+    static constexpr size_t stride() { return 1; }
+
+    // Add leaf(j) to the sum of example j.
+    template <typename F>
+    void add(F&& leaf) {
+        for (size_t j = 0; j + 1 < N; j += 2) acc[j / 2].add(*leaf(j), *leaf(j + 1));
+        if (N % 2) acc[N / 2].add_low(*leaf(N - 1));
+    }
+
+    void store(double* y) const {
+        double tmp[2 * ((N + 1) / 2)];
+        for (size_t j = 0; j < acc.size(); ++j) acc[j].store(tmp + 2 * j);
+        for (size_t j = 0; j < N; ++j) y[j] = tmp[j];
+    }
+};
+
+// Leaf values accumulator that loads values immediately. Values are added
+// to independent accumulators, so additions do not wait for each other.
+struct PlainSum {
+    Acc2 acc[2];
+    unsigned count = 0;
+
+    static constexpr size_t stride() { return 1; }
+
+    void add(const double* leaf) { acc[count++ % 2].add_low(*leaf); }
+
+    void add4(const double* l0, const double* l1, const double* l2, const double* l3) {
+        acc[0].add(*l0, *l1);
+        acc[1].add(*l2, *l3);
+    }
+
+    void prefetch(const void*) {}
+
+    double sum() const { return acc[0].sum() + acc[1].sum(); }
+};
+
+// Leaf values accumulator that prefetches leaf values and loads them only
+// after indexes of the following trees are computed, so cache misses on
+// leaves overlap with split evaluation.
+struct PipelinedSum {
+    // Number of leaf loads in flight.
+    static constexpr unsigned lookahead = 8;
+    static constexpr unsigned ring_size = 16;
+
+    const double* ring[ring_size];
+    unsigned head = 0;
+    unsigned tail = 0;
+    Acc2 acc[2];
+
+    static constexpr size_t stride() { return 1; }
+
+    void pop2() {
+        acc[head / 2 % 2].add(*ring[head % ring_size], *ring[(head + 1) % ring_size]);
+        head += 2;
+    }
+
+    void add(const double* leaf) {
+        CATBOOST_PREFETCH(leaf);
+        ring[tail++ % ring_size] = leaf;
+        if (tail - head >= lookahead + 2) pop2();
+    }
+
+    void add4(const double* l0, const double* l1, const double* l2, const double* l3) {
+        add(l0);
+        add(l1);
+        add(l2);
+        add(l3);
+    }
+
+    // Prefetch split records of the following trees.
+    void prefetch(const void* p) { CATBOOST_PREFETCH(p); }
+
+    double sum() {
+        while (tail - head >= 2) pop2();
+        if (head != tail) acc[0].add_low(*ring[head++ % ring_size]);
+        return acc[0].sum() + acc[1].sum();
+    }
+};
+
+// Leaf values accumulator that remembers leaf of every tree, so they could
+// be added in the original order of trees.
+struct OrderedSum {
+    // Original positions of compiled trees.
+    const uint32_t* ids;
+    // Leaf of every tree in the original order.
+    const double** leaves;
+    size_t count = 0;
+    size_t dims = 1;
+
+    OrderedSum(const uint32_t* i, const double** l, size_t d) : ids(i), leaves(l), dims(d) {}
+
+    size_t stride() const { return dims; }
+
+    void add(const double* leaf) { leaves[ids[count++]] = leaf; }
+
+    void add4(const double* l0, const double* l1, const double* l2, const double* l3) {
+        add(l0);
+        add(l1);
+        add(l2);
+        add(l3);
+    }
+
+    void prefetch(const void*) {}
+};
+
+// Accumulator of N examples that writes index of every leaf instead of
+// adding its values. Index of tree i for example j is written to
+// out[j * size + i - begin] if the tree is in the range from begin to end,
+// where i is the original position of the tree.
+template <typename T, size_t N>
+struct LeafIndexSum {
+    // Original positions of compiled trees.
+    const uint32_t* ids;
+    const double* values;
+    // Position of the first value of every tree by its original position
+    // for oblivious trees, and leaf numbers by node position for
+    // non-symmetric ones.
+    const size_t* offsets;
+    const uint32_t* numbers;
+    size_t dims;
+    size_t begin;
+    size_t end;
+    T* out;
+    size_t size;
+    size_t count = 0;
+
+    LeafIndexSum(const uint32_t* i, const double* v, const size_t* o, const uint32_t* n, size_t d, size_t b, size_t e,
+                 T* r, size_t s)
+        : ids(i), values(v), offsets(o), numbers(n), dims(d), begin(b), end(e), out(r), size(s) {}
+
+    size_t stride() const { return dims; }
+
+    T index(const double* leaf, uint32_t id) const {
+        const size_t pos = leaf - values;
+        if (numbers) return static_cast<T>(numbers[pos / dims]);
+        return static_cast<T>(dims == 1 ? pos - offsets[id] : (pos - offsets[id]) / dims);
+    }
+
+    void add(const double* leaf) {
+        const uint32_t id = ids[count++];
+        if (id >= begin && id < end) out[id - begin] = index(leaf, id);
+    }
+
+    void add4(const double* l0, const double* l1, const double* l2, const double* l3) {
+        add(l0);
+        add(l1);
+        add(l2);
+        add(l3);
+    }
+
+    template <typename F>
+    void add(F&& leaf) {
+        const uint32_t id = ids[count++];
+        if (id < begin || id >= end) return;
+        for (size_t j = 0; j < N; ++j) out[j * size + id - begin] = index(leaf(j), id);
+    }
+
+    void prefetch(const void*) {}
+};
+
+// Add values of a leaf with dims values to out.
+inline void add_leaf(double* out, const double* leaf, size_t dims) {
+    size_t d = 0;
+#ifndef NOSSE
+    for (; d + 2 <= dims; d += 2) {
+        Vec2d x;
+        Vec2d y;
+        x.loadu(out + d);
+        y.loadu(leaf + d);
+        (x + y).storeu(out + d);
+    }
+#endif
+    for (; d < dims; ++d) out[d] += leaf[d];
+}
+
+// Accumulator of leaves of multidimensional models. Values of a leaf are
+// adjacent, so one leaf index drives addition of all dimensions.
+struct MultiSum {
+    double* out;
+    size_t dims;
+
+    MultiSum(double* o, size_t d) : out(o), dims(d) { std::fill(out, out + dims, 0.0); }
+
+    size_t stride() const { return dims; }
+
+    void add(const double* leaf) { add_leaf(out, leaf, dims); }
+
+    // Leaves of four trees are added together, so out is updated once.
+    void add4(const double* l0, const double* l1, const double* l2, const double* l3) {
+        size_t d = 0;
+#ifndef NOSSE
+        for (; d + 2 <= dims; d += 2) {
+            Vec2d x0;
+            Vec2d x1;
+            Vec2d x2;
+            Vec2d x3;
+            Vec2d y;
+            x0.loadu(l0 + d);
+            x1.loadu(l1 + d);
+            x2.loadu(l2 + d);
+            x3.loadu(l3 + d);
+            y.loadu(out + d);
+            (y + ((x0 + x1) + (x2 + x3))).storeu(out + d);
+        }
+#endif
+        for (; d < dims; ++d) out[d] += (l0[d] + l1[d]) + (l2[d] + l3[d]);
+    }
+
+    void prefetch(const void*) {}
+};
+
+// Accumulator of N examples of multidimensional models. Example j is summed
+// into out[j * dims] ... out[j * dims + dims - 1].
+template <size_t N>
+struct MultiBatchSum {
+    double* out;
+    size_t dims;
+
+    MultiBatchSum(double* o, size_t d) : out(o), dims(d) { std::fill(out, out + N * dims, 0.0); }
+
+    size_t stride() const { return dims; }
+
+    template <typename F>
+    void add(F&& leaf) {
+        for (size_t j = 0; j < N; ++j) add_leaf(out + j * dims, leaf(j), dims);
     }
 };
 
+// Contiguous range of compiled trees. Begin and end are positions in
+// compiled splits, offset is position of the first leaf value.
+struct TreeRange {
+    size_t begin = 0;
+    size_t end = 0;
+    size_t offset = 0;
+    // Relative cost of range evaluation.
+    size_t cost = 0;
+    // Position of the first tree of the range in compiled order.
+    size_t tree = 0;
+};
+
+// Join groups of trees into `count` contiguous ranges of similar cost.
+std::vector<TreeRange> partition(const std::vector<TreeRange>& groups, size_t count) {
+    size_t total = 0;
+    for (const auto& g : groups) total += g.cost;
+
+    std::vector<TreeRange> res;
+    size_t cost = 0;
+    for (const auto& g : groups) {
+        if (res.empty() || (cost >= total * res.size() / count && res.size() < count)) {
+            res.push_back(g);
+            res.back().cost = 0;
+        }
+        res.back().end = g.end;
+        res.back().cost += g.cost;
+        cost += g.cost;
+    }
+
+    return res;
+}
+
 // anonymous namespace
 } // namespace
 
 #ifdef NOSSE
 
-struct Model::Impl {
+namespace {
+
+// Compiled oblivious trees.
+struct ObliviousTrees {
     // Split represents one level of a decision tree.
     struct Split {
         float border = 0.0f;
@@ -90,67 +872,123 @@ struct Model::Impl {
 
         // Apply tree to features and return one if feature at corresponding
         // index is greater than border.
+        template <bool nan = false>
         uint32_t apply(const float* f, uint32_t one) const {
-            if (f[index] > border) return one;
+            if (greater<nan>(f, index, border)) return one;
             return 0;
         }
     };
     std::vector<Split> splits;
     std::vector<double> values;
+    // Every tree is a group here.
+    std::vector<TreeRange> groups;
+    // Original positions of trees in the compiled order.
+    std::vector<uint32_t> tree_ids;
+    // Position of the first leaf value of every tree by its original position.
+    std::vector<size_t> tree_offsets;
+    // True if some splits send NaN right. Splits are not grouped here, so
+    // all of them are evaluated by NaN-aware kernel then.
+    bool nan_right = false;
 
-    size_t feature_count = 0;
-
-    Impl(const JsonModel& model) {
-        feature_count = model.feature_count;
+    explicit ObliviousTrees(const JsonModel& model) {
         splits.reserve(model.trees.size() * 6);
         values.reserve(model.trees.size() * 64);
         for (const auto& tree : model.trees) {
+            TreeRange group{splits.size(), 0, values.size(), tree.depth() + 1, tree_ids.size()};
             for (size_t i = 0; i < tree.borders.size(); i++) {
-                splits.emplace_back(tree.borders[i], tree.indexes[i], 0);
+                splits.emplace_back(tree.borders[i], model.split_index(tree.indexes[i]), 0);
+                nan_right |= splits.back().index >= nan_right_bit;
             }
             splits.back().count = tree.values.size();
+            tree_offsets.push_back(values.size());
             values.insert(values.end(), tree.values.begin(), tree.values.end());
+            group.end = splits.size();
+            groups.push_back(group);
+            tree_ids.push_back(tree.id);
         }
     }
 
+    // Range of all trees.
+    TreeRange all() const { return TreeRange{0, splits.size(), 0, 0}; }
+
     // Single prediction
+    template <typename Sum>
     double predict(const float* f) const noexcept {
-        double res = 0.0;
+        return predict<Sum>(f, all());
+    }
+
+    // Single prediction using range of trees.
+    template <typename Sum>
+    double predict(const float* f, const TreeRange& range) const noexcept {
+        Sum sum;
+        accumulate(f, range, sum);
+        return sum.sum();
+    }
+
+    // Pass leaves of trees in range to accumulator.
+    template <typename Sum>
+    void accumulate(const float* f, const TreeRange& range, Sum& sum) const noexcept {
+        if (nan_right) {
+            accumulate<true>(f, range, sum);
+        } else {
+            accumulate<false>(f, range, sum);
+        }
+    }
+
+    template <bool nan, typename Sum>
+    void accumulate(const float* f, const TreeRange& range, Sum& sum) const noexcept {
+        // Distance in splits to prefetch ahead (two trees of depth 6).
+        static constexpr size_t split_lookahead = 12;
         uint32_t idx = 0;
-        size_t off = 0;
+        size_t off = range.offset;
         uint32_t one = 1;
 
-        for (const auto& split : splits) {
-            idx |= split.apply(f, one);
+        for (size_t i = range.begin; i < range.end; ++i) {
+            const Split& split = splits[i];
+            idx |= split.apply<nan>(f, one);
             one <<= 1;
             if (split.count) {
-                res += values[off + idx];
+                sum.add(&values[off + idx * sum.stride()]);
+                sum.prefetch(&splits[std::min(i + split_lookahead, splits.size() - 1)]);
                 off += split.count;
                 one = 1;
                 idx = 0;
             }
         }
-
-        return res;
     }
 
     // Multiple predictions.
     template <size_t N>
     void predict_n(const float* const* f, double* y) const noexcept {
-        for (size_t i = 0; i < N; ++i) y[i] = 0.0;
+        BatchSum<N> sum;
+        accumulate_n<N>(f, all(), sum);
+        sum.store(y);
+    }
+
+    // Pass leaves of N examples for trees in range to accumulator.
+    template <size_t N, typename Sum>
+    void accumulate_n(const float* const* f, const TreeRange& range, Sum& sum) const noexcept {
+        if (nan_right) {
+            accumulate_n<N, true>(f, range, sum);
+        } else {
+            accumulate_n<N, false>(f, range, sum);
+        }
+    }
+
+    template <size_t N, bool nan, typename Sum>
+    void accumulate_n(const float* const* f, const TreeRange& range, Sum& sum) const noexcept {
         std::array<uint32_t, N> idx;
         idx.fill(0);
 
-        size_t off = 0;
+        size_t off = range.offset;
         uint32_t one = 1;
 
-        for (const auto& split : splits) {
-            for (size_t i = 0; i < N; ++i) idx[i] |= split.apply(f[i], one);
+        for (size_t s = range.begin; s < range.end; ++s) {
+            const Split& split = splits[s];
+            for (size_t i = 0; i < N; ++i) idx[i] |= split.apply<nan>(f[i], one);
             one <<= 1;
             if (split.count) {
-                for (size_t i = 0; i < N; ++i) {
-                    y[i] += values[off + idx[i]];
-                }
+                sum.add([&](size_t i) { return &values[off + idx[i] * sum.stride()]; });
 
                 off += split.count;
                 one = 1;
@@ -161,6 +999,9 @@ struct Model::Impl {
     }
 };
 
+// anonymous namespace
+} // namespace
+
 // NOSSE
 #else
 
@@ -231,16 +1072,23 @@ public:
         const T* read() {
             return reinterpret_cast<const T*>(read(sizeof(T)));
         }
+
+        // Get pointer to data sz bytes ahead without changing position.
+        const void* ahead(size_t sz) const { return sz < static_cast<size_t>(end - pos) ? pos + sz : pos; }
     };
 
     // Get iterator at the beginning of data.
     Iterator iter() const { return Iterator(data_.data(), data_.data() + data_.size()); }
-};
 
-// anonymous namespace
-} // namespace
+    // Get iterator over data from begin to end byte.
+    Iterator iter(size_t begin, size_t end) const { return Iterator(data_.data() + begin, data_.data() + end); }
 
-struct Model::Impl {
+    // Size of data in bytes.
+    size_t size() const { return data_.size(); }
+};
+
+// Compiled oblivious trees.
+struct ObliviousTrees {
     enum SplitType {
         SPLIT_SIMPLE,
         SPLIT4_MULTI_TREE,
@@ -251,6 +1099,8 @@ struct Model::Impl {
     struct SplitInfo {
         uint32_t depth = 0;
         SplitType type = SPLIT_SIMPLE;
+        // Nonzero if some splits of the group send NaN right.
+        uint32_t nan = 0;
     };
 
     // Simple split.
@@ -260,8 +1110,9 @@ struct Model::Impl {
 
         Split(float b, uint32_t i) : border(b), index(i) {}
 
+        template <bool nan = false>
         uint32_t apply(const float* f, uint32_t one) const {
-            if (f[index] > border) return one;
+            if (greater<nan>(f, index, border)) return one;
             return 0;
         }
     };
@@ -271,21 +1122,52 @@ struct Model::Impl {
         Vec4f border{};
         uint32_t index[4] = {0, 0, 0, 0};
 
+        template <bool nan = false>
         Vec4i apply(const float* f, Vec4i one) const {
-            Vec4f x{f[index[0]], f[index[1]], f[index[2]], f[index[3]]};
-            return one & (x > border);
+            if (!nan) {
+                Vec4f x{f[index[0]], f[index[1]], f[index[2]], f[index[3]]};
+                return one & (x > border);
+            }
+
+            Vec4f x{f[index[0] & ~nan_right_bit], f[index[1] & ~nan_right_bit], f[index[2] & ~nan_right_bit],
+                    f[index[3] & ~nan_right_bit]};
+            // Lanes of marked splits are all ones after shift of their sign bit.
+            Vec4i marked = Vec4i{index[0], index[1], index[2], index[3]}.sra(31);
+            return one & ((x > border) | (x.unordered(x) & marked));
         }
     };
 
     Bin<16> splits;
     std::vector<double> values;
+    // Ranges of split records of each group.
+    std::vector<TreeRange> groups;
+    // Original positions of trees in the compiled order.
+    std::vector<uint32_t> tree_ids;
+    // Position of the first leaf value of every tree by its original position.
+    std::vector<size_t> tree_offsets;
+
+    // True if some splits of tree send NaN right.
+    static bool nan_right(const JsonTree& t) {
+        return std::any_of(t.indexes.begin(), t.indexes.end(), [](uint32_t i) { return i >= nan_right_bit; });
+    }
+
+    // Remember range of the group written since begin. Ids of its trees
+    // should be added already.
+    void add_group(size_t begin, size_t offset, size_t trees) {
+        groups.push_back(
+            TreeRange{begin, splits.size(), offset, (splits.size() - begin) / 16 + trees, tree_ids.size() - trees});
+    }
+
+    // Add 4 trees to be processed in parallel
+    void add_tree4(const JsonTree& t0, const JsonTree& t1, const JsonTree& t2, const JsonTree& t3) {
+        size_t begin = splits.size();
+        size_t offset = values.size();
 
-    // Add 4 trees to be processed in parallel
-    void add_tree4(const JsonTree& t0, const JsonTree& t1, const JsonTree& t2, const JsonTree& t3) {
         // Add meta info:
         SplitInfo info;
         info.depth = t0.depth();
         info.type = SPLIT4_MULTI_TREE;
+        info.nan = nan_right(t0) || nan_right(t1) || nan_right(t2) || nan_right(t3);
         splits.write(&info);
 
         // Now add borders and indexes:
@@ -300,18 +1182,24 @@ struct Model::Impl {
             splits.write(&s);
         }
 
-        values.insert(values.end(), t0.values.begin(), t0.values.end());
-        values.insert(values.end(), t1.values.begin(), t1.values.end());
-        values.insert(values.end(), t2.values.begin(), t2.values.end());
-        values.insert(values.end(), t3.values.begin(), t3.values.end());
+        for (const JsonTree* t : {&t0, &t1, &t2, &t3}) {
+            tree_offsets[t->id] = values.size();
+            values.insert(values.end(), t->values.begin(), t->values.end());
+        }
+        tree_ids.insert(tree_ids.end(), {t0.id, t1.id, t2.id, t3.id});
+        add_group(begin, offset, 4);
     }
 
     // Add single tree to splits.
     void add_tree(const JsonTree& t) {
+        size_t begin = splits.size();
+        size_t offset = values.size();
+
         // Add meta info:
         SplitInfo info;
         info.depth = t.depth();
         info.type = SPLIT4_SINGLE_TREE;
+        info.nan = nan_right(t);
         splits.write(&info);
 
         size_t i = 0;
@@ -333,17 +1221,17 @@ struct Model::Impl {
             splits.write(&s);
         }
 
+        tree_offsets[t.id] = values.size();
         values.insert(values.end(), t.values.begin(), t.values.end());
+        tree_ids.push_back(t.id);
+        add_group(begin, offset, 1);
     }
 
-    size_t feature_count = 0;
-
-    Impl(const JsonModel& model) {
-        feature_count = model.feature_count;
-
+    explicit ObliviousTrees(const JsonModel& model) : tree_offsets(model.trees.size()) {
         std::unordered_map<size_t, std::vector<JsonTree> > tmp;
         for (const auto& t : model.trees) {
             JsonTree xt{t};
+            for (auto& index : xt.indexes) index = model.split_index(index);
             tmp[xt.depth()].emplace_back(std::move(xt));
         }
 
@@ -363,281 +1251,2878 @@ struct Model::Impl {
         }
     }
 
+    // Range of all trees.
+    TreeRange all() const { return TreeRange{0, splits.size(), 0, 0}; }
+
     // Single prediction
+    template <typename Sum>
     double predict(const float* f) const noexcept {
-        auto iter = splits.iter();
-        double res = 0.0;
-        uint32_t offset = 0;
+        return predict<Sum>(f, all());
+    }
+
+    // Single prediction using range of trees.
+    template <typename Sum>
+    double predict(const float* f, const TreeRange& range) const noexcept {
+        Sum sum;
+        accumulate(f, range, sum);
+        return sum.sum();
+    }
+
+    // Pass leaves of trees in range to accumulator.
+    template <typename Sum>
+    void accumulate(const float* f, const TreeRange& range, Sum& sum) const noexcept {
+        // Distance in bytes to prefetch split records ahead (a bit more than
+        // one group of four trees of depth 6).
+        static constexpr size_t split_lookahead = 256;
+        auto iter = splits.iter(range.begin, range.end);
+        uint32_t offset = range.offset;
+        const uint32_t stride = static_cast<uint32_t>(sum.stride());
 
         for (const SplitInfo* info = iter.read<SplitInfo>(); info != nullptr; info = iter.read<SplitInfo>()) {
-            switch (info->type) {
-                case SPLIT_SIMPLE: {
-                    uint32_t one = 1;
-                    uint32_t idx = 0;
-                    for (uint32_t i = 0; i < info->depth; ++i) {
-                        const Split* split = iter.read<Split>();
-                        idx |= split->apply(f, one);
-                        one <<= 1;
-                    }
+            sum.prefetch(iter.ahead(split_lookahead));
+            if (info->nan) {
+                accumulate_group<true>(*info, iter, f, offset, stride, sum);
+            } else {
+                accumulate_group<false>(*info, iter, f, offset, stride, sum);
+            }
+        }
+    }
 
-                    res += values[offset + idx];
-                    offset += static_cast<uint32_t>(1) << info->depth;
-                } break;
+    // Pass leaves of trees of the group to accumulator and move iterator
+    // past its splits.
+    template <bool nan, typename Sum>
+    void accumulate_group(const SplitInfo& info, Bin<16>::Iterator& iter, const float* f, uint32_t& offset,
+                          uint32_t stride, Sum& sum) const noexcept {
+        switch (info.type) {
+            case SPLIT_SIMPLE: {
+                uint32_t one = 1;
+                uint32_t idx = 0;
+                for (uint32_t i = 0; i < info.depth; ++i) {
+                    const Split* split = iter.read<Split>();
+                    idx |= split->apply<nan>(f, one);
+                    one <<= 1;
+                }
 
-                case SPLIT4_SINGLE_TREE: {
-                    uint32_t i = 0;
-                    Vec4i one4{8, 4, 2, 1};
-                    Vec4i idx4{};
+                sum.add(&values[offset + idx * stride]);
+                offset += (static_cast<uint32_t>(1) << info.depth) * stride;
+            } break;
 
-                    for (; i + 4 <= info->depth; i += 4) {
-                        const Split4* split = iter.read<Split4>();
-                        idx4 |= split->apply(f, one4);
-                        one4 <<= 4;
-                    }
+            case SPLIT4_SINGLE_TREE: {
+                uint32_t i = 0;
+                Vec4i one4{8, 4, 2, 1};
+                Vec4i idx4{};
 
-                    uint32_t idx = idx4.sum();
-                    uint32_t one = static_cast<uint32_t>(1) << i;
+                for (; i + 4 <= info.depth; i += 4) {
+                    const Split4* split = iter.read<Split4>();
+                    idx4 |= split->apply<nan>(f, one4);
+                    one4 <<= 4;
+                }
 
-                    for (; i < info->depth; ++i) {
-                        const Split* split = iter.read<Split>();
-                        idx |= split->apply(f, one);
-                        one <<= 1;
-                    }
+                uint32_t idx = idx4.sum();
+                uint32_t one = static_cast<uint32_t>(1) << i;
 
-                    res += values[offset + idx];
-                    offset += static_cast<uint32_t>(1) << info->depth;
-                } break;
+                for (; i < info.depth; ++i) {
+                    const Split* split = iter.read<Split>();
+                    idx |= split->apply<nan>(f, one);
+                    one <<= 1;
+                }
 
-                case SPLIT4_MULTI_TREE: {
-                    Vec4i idx{};
-                    Vec4i one{1, 1, 1, 1};
+                sum.add(&values[offset + idx * stride]);
+                offset += (static_cast<uint32_t>(1) << info.depth) * stride;
+            } break;
 
-                    for (uint32_t i = 0; i < info->depth; ++i) {
-                        const Split4* split = iter.read<Split4>();
-                        idx |= split->apply(f, one);
-                        one <<= 1;
-                    }
+            case SPLIT4_MULTI_TREE: {
+                Vec4i idx{};
+                Vec4i one{1, 1, 1, 1};
+
+                for (uint32_t i = 0; i < info.depth; ++i) {
+                    const Split4* split = iter.read<Split4>();
+                    idx |= split->apply<nan>(f, one);
+                    one <<= 1;
+                }
 
-                    alignas(16) uint32_t index[4];
-                    idx.store(index);
+                alignas(16) uint32_t index[4];
+                idx.store(index);
 
-                    res += values[offset + index[3]];
-                    offset += static_cast<uint32_t>(1) << info->depth;
-                    res += values[offset + index[2]];
-                    offset += static_cast<uint32_t>(1) << info->depth;
-                    res += values[offset + index[1]];
-                    offset += static_cast<uint32_t>(1) << info->depth;
-                    res += values[offset + index[0]];
-                    offset += static_cast<uint32_t>(1) << info->depth;
-                } break;
-                    // switch (info->type)
-            }
+                const uint32_t size = static_cast<uint32_t>(1) << info.depth;
+                sum.add4(&values[offset + index[3] * stride], &values[offset + (size + index[2]) * stride],
+                         &values[offset + (2 * size + index[1]) * stride],
+                         &values[offset + (3 * size + index[0]) * stride]);
+                offset += 4 * size * stride;
+            } break;
+                // switch (info.type)
         }
-
-        return res;
     }
 
     // Multiple predictions:
     template <size_t N>
     void predict_n(const float* const* f, double* y) const noexcept {
-        for (size_t i = 0; i < N; ++i) {
-            y[i] = 0.0;
-        }
+        BatchSum<N> sum;
+        accumulate_n<N>(f, all(), sum);
+        sum.store(y);
+    }
 
-        auto iter = splits.iter();
-        uint32_t offset = 0;
+    // Pass leaves of N examples for trees in range to accumulator.
+    template <size_t N, typename Sum>
+    void accumulate_n(const float* const* f, const TreeRange& range, Sum& sum) const noexcept {
+        auto iter = splits.iter(range.begin, range.end);
+        uint32_t offset = range.offset;
+        const uint32_t stride = static_cast<uint32_t>(sum.stride());
 
         for (const SplitInfo* info = iter.read<SplitInfo>(); info != nullptr; info = iter.read<SplitInfo>()) {
-            switch (info->type) {
-                case SPLIT_SIMPLE:
-                    // This situation is impossible, but it could be used for
-                    // debugging sometime.
-                    {
-                        uint32_t one = 1;
-                        std::array<uint32_t, N> idx;
-                        idx.fill(0);
-                        for (uint32_t i = 0; i < info->depth; ++i) {
-                            const Split* split = iter.read<Split>();
-                            for (size_t j = 0; j < N; ++j) {
-                                idx[j] |= split->apply(f[j], one);
-                            }
-                            one <<= 1;
-                        }
-
-                        for (size_t j = 0; j < N; ++j) {
-                            y[j] += values[offset + idx[j]];
-                        }
-                        offset += static_cast<uint32_t>(1) << info->depth;
-                    }
-                    break;
-
-                case SPLIT4_SINGLE_TREE: {
-                    uint32_t i = 0;
-                    Vec4i one4{8, 4, 2, 1};
-                    std::array<Vec4i, N> idx4;
-
-                    for (; i + 4 <= info->depth; i += 4) {
-                        const Split4* split = iter.read<Split4>();
-                        for (size_t j = 0; j < N; ++j) {
-                            idx4[j] |= split->apply(f[j], one4);
-                        }
-                        one4 <<= 4;
-                    }
+            if (info->nan) {
+                accumulate_group_n<N, true>(*info, iter, f, offset, stride, sum);
+            } else {
+                accumulate_group_n<N, false>(*info, iter, f, offset, stride, sum);
+            }
+        }
+    }
 
+    // Pass leaves of N examples for trees of the group to accumulator.
+    template <size_t N, bool nan, typename Sum>
+    void accumulate_group_n(const SplitInfo& info, Bin<16>::Iterator& iter, const float* const* f, uint32_t& offset,
+                            uint32_t stride, Sum& sum) const noexcept {
+        switch (info.type) {
+            case SPLIT_SIMPLE:
+                // This situation is impossible, but it could be used for
+                // debugging sometime.
+                {
+                    uint32_t one = 1;
                     std::array<uint32_t, N> idx;
-                    for (size_t j = 0; j < N; ++j) idx[j] = idx4[j].sum();
-                    uint32_t one = static_cast<uint32_t>(1) << i;
-
-                    for (; i < info->depth; ++i) {
+                    idx.fill(0);
+                    for (uint32_t i = 0; i < info.depth; ++i) {
                         const Split* split = iter.read<Split>();
                         for (size_t j = 0; j < N; ++j) {
-                            idx[j] |= split->apply(f[j], one);
+                            idx[j] |= split->apply<nan>(f[j], one);
                         }
                         one <<= 1;
                     }
 
-                    for (size_t j = 0; j < N; ++j) {
-                        y[j] += values[offset + idx[j]];
-                    }
-                    offset += static_cast<uint32_t>(1) << info->depth;
-                } break;
+                    sum.add([&](size_t j) { return &values[offset + idx[j] * stride]; });
+                    offset += (static_cast<uint32_t>(1) << info.depth) * stride;
+                }
+                break;
 
-                case SPLIT4_MULTI_TREE: {
-                    std::array<Vec4i, N> idx;
-                    Vec4i one{1, 1, 1, 1};
+            case SPLIT4_SINGLE_TREE: {
+                uint32_t i = 0;
+                Vec4i one4{8, 4, 2, 1};
+                std::array<Vec4i, N> idx4;
 
-                    for (uint32_t i = 0; i < info->depth; ++i) {
-                        const Split4* split = iter.read<Split4>();
-                        for (size_t j = 0; j < N; ++j) {
-                            idx[j] |= split->apply(f[j], one);
-                        }
-                        one <<= 1;
+                for (; i + 4 <= info.depth; i += 4) {
+                    const Split4* split = iter.read<Split4>();
+                    for (size_t j = 0; j < N; ++j) {
+                        idx4[j] |= split->apply<nan>(f[j], one4);
                     }
+                    one4 <<= 4;
+                }
 
-                    alignas(16) uint32_t index[4 * N];
+                std::array<uint32_t, N> idx;
+                for (size_t j = 0; j < N; ++j) idx[j] = idx4[j].sum();
+                uint32_t one = static_cast<uint32_t>(1) << i;
 
+                for (; i < info.depth; ++i) {
+                    const Split* split = iter.read<Split>();
                     for (size_t j = 0; j < N; ++j) {
-                        idx[j].store(index + j * 4);
+                        idx[j] |= split->apply<nan>(f[j], one);
                     }
+                    one <<= 1;
+                }
 
+                sum.add([&](size_t j) { return &values[offset + idx[j] * stride]; });
+                offset += (static_cast<uint32_t>(1) << info.depth) * stride;
+            } break;
+
+            case SPLIT4_MULTI_TREE: {
+                std::array<Vec4i, N> idx;
+                Vec4i one{1, 1, 1, 1};
+
+                for (uint32_t i = 0; i < info.depth; ++i) {
+                    const Split4* split = iter.read<Split4>();
                     for (size_t j = 0; j < N; ++j) {
-                        y[j] += values[offset + index[j * 4 + 3]];
-                    }
-                    offset += static_cast<uint32_t>(1) << info->depth;
-                    for (size_t j = 0; j < N; ++j) {
-                        y[j] += values[offset + index[j * 4 + 2]];
-                    }
-                    offset += static_cast<uint32_t>(1) << info->depth;
-                    for (size_t j = 0; j < N; ++j) {
-                        y[j] += values[offset + index[j * 4 + 1]];
-                    }
-                    offset += static_cast<uint32_t>(1) << info->depth;
-                    for (size_t j = 0; j < N; ++j) {
-                        y[j] += values[offset + index[j * 4]];
+                        idx[j] |= split->apply<nan>(f[j], one);
                     }
-                    offset += static_cast<uint32_t>(1) << info->depth;
-                } break;
-                    // switch (info->type)
-            }
+                    one <<= 1;
+                }
+
+                alignas(16) uint32_t index[4 * N];
+
+                for (size_t j = 0; j < N; ++j) {
+                    idx[j].store(index + j * 4);
+                }
+
+                sum.add([&](size_t j) { return &values[offset + index[j * 4 + 3] * stride]; });
+                offset += (static_cast<uint32_t>(1) << info.depth) * stride;
+                sum.add([&](size_t j) { return &values[offset + index[j * 4 + 2] * stride]; });
+                offset += (static_cast<uint32_t>(1) << info.depth) * stride;
+                sum.add([&](size_t j) { return &values[offset + index[j * 4 + 1] * stride]; });
+                offset += (static_cast<uint32_t>(1) << info.depth) * stride;
+                sum.add([&](size_t j) { return &values[offset + index[j * 4] * stride]; });
+                offset += (static_cast<uint32_t>(1) << info.depth) * stride;
+            } break;
+                // switch (info.type)
         }
     }
 };
+
+// anonymous namespace
+} // namespace
+
 // NOSSE
 #endif
 
-Model::Model() {}
+namespace {
 
-Model::Model(const std::string& filename) { load(filename); }
+// Compiled non-symmetric trees. Nodes of all trees are stored in one array,
+// every tree breadth-first. Leaves point to themselves and never go right, so
+// examples make as many steps as the tree depth without checking for leaves
+// and children are chosen without branches.
+struct NodeTrees {
+    struct Node {
+        float border = 0.0f;
+        uint32_t index = 0;
+        // Position of the left child, the right one follows it.
+        uint32_t child = 0;
 
-Model::Model(std::istream& in) { load(in); }
+        Node(float b, uint32_t i, uint32_t c) : border(b), index(i), child(c) {}
 
-Model::~Model() = default;
+        // Position of the next node for features f.
+        template <bool nan = false>
+        uint32_t next(const float* f) const {
+            return child + greater<nan>(f, index, border);
+        }
+    };
 
-void Model::load(const std::string& filename) {
-    std::ifstream in{filename};
+    // Root of a tree and the number of steps to reach any of its leaves.
+    struct Tree {
+        uint32_t root = 0;
+        uint32_t depth = 0;
+    };
 
-    if (!in.good()) {
-        throw std::runtime_error("Can't open file with model");
+    std::vector<Node> nodes;
+    // Leaf values by node position, dims values per node. Zero for inner nodes.
+    std::vector<double> values;
+    // Trees are sorted by depth, so trees traversed together have similar
+    // depths.
+    std::vector<Tree> trees;
+    // Original positions of trees in the compiled order.
+    std::vector<uint32_t> tree_ids;
+    // Number of the leaf among leaves of its tree in breadth-first order by
+    // node position. Zero for inner nodes.
+    std::vector<uint32_t> leaf_numbers;
+    // True if some nodes send NaN right, then all trees are traversed by
+    // NaN-aware kernel.
+    bool nan_right = false;
+
+    explicit NodeTrees(const JsonModel& model) {
+        std::vector<const JsonNodeTree*> sorted;
+        for (const auto& t : model.node_trees) sorted.push_back(&t);
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [](const JsonNodeTree* t1, const JsonNodeTree* t2) { return t1->depth < t2->depth; });
+
+        for (const JsonNodeTree* t : sorted) {
+            const uint32_t root = static_cast<uint32_t>(nodes.size());
+            uint32_t leaves = 0;
+            for (size_t i = 0; i < t->nodes.size(); ++i) {
+                const auto& node = t->nodes[i];
+                if (node.child) {
+                    nodes.emplace_back(node.border, model.split_index(node.index), root + node.child);
+                    nan_right |= nodes.back().index >= nan_right_bit;
+                    values.resize(values.size() + model.dims, 0.0);
+                    leaf_numbers.push_back(0);
+                } else {
+                    nodes.emplace_back(std::numeric_limits<float>::infinity(), 0, root + static_cast<uint32_t>(i));
+                    values.insert(values.end(), node.values.begin(), node.values.end());
+                    leaf_numbers.push_back(leaves++);
+                }
+            }
+            trees.push_back(Tree{root, static_cast<uint32_t>(t->depth)});
+            tree_ids.push_back(t->id);
+        }
     }
 
-    load(in);
-}
+    bool empty() const { return trees.empty(); }
 
-void Model::load(std::istream& in) {
-    nlohmann::json model = nlohmann::json::parse(in);
+    // Pass leaves of all trees to accumulator. Groups of trees are traversed
+    // at once, so their node loads overlap (eight trees are ~20% faster than
+    // four on deep Lossguide trees).
+    template <typename Sum>
+    void accumulate(const float* f, Sum& sum) const noexcept {
+        if (nan_right) {
+            accumulate<true>(f, sum);
+        } else {
+            accumulate<false>(f, sum);
+        }
+    }
 
-    JsonModel jmodel;
-    jmodel.load(model);
+    template <bool nan, typename Sum>
+    void accumulate(const float* f, Sum& sum) const noexcept {
+        static constexpr size_t group = 8;
+        const size_t stride = sum.stride();
+        size_t i = 0;
 
-    impl_.reset(new Impl(jmodel));
-    scale_ = jmodel.scale;
-    bias_ = jmodel.bias;
-}
+        for (; i + group <= trees.size(); i += group) {
+            uint32_t n[group];
+            for (size_t k = 0; k < group; ++k) n[k] = trees[i + k].root;
+            for (uint32_t d = 0; d < trees[i + group - 1].depth; ++d) {
+                for (size_t k = 0; k < group; ++k) n[k] = nodes[n[k]].next<nan>(f);
+            }
+            sum.add4(&values[n[0] * stride], &values[n[1] * stride], &values[n[2] * stride], &values[n[3] * stride]);
+            sum.add4(&values[n[4] * stride], &values[n[5] * stride], &values[n[6] * stride], &values[n[7] * stride]);
+        }
 
-double Model::apply(const float* features, size_t count) const {
-    if (!impl_.get()) {
-        throw std::runtime_error("Model is not loaded");
+        for (; i < trees.size(); ++i) {
+            uint32_t n = trees[i].root;
+            for (uint32_t d = 0; d < trees[i].depth; ++d) n = nodes[n].next<nan>(f);
+            sum.add(&values[n * stride]);
+        }
     }
 
-    if (count < impl_->feature_count) {
-        throw std::runtime_error("Not enough features");
+    // Add predictions of N examples to y.
+    template <size_t N>
+    void add_n(const float* const* f, double* y) const noexcept {
+        BatchSum<N> sum;
+        accumulate_n<N>(f, sum);
+
+        double res[N];
+        sum.store(res);
+        for (size_t j = 0; j < N; ++j) y[j] += res[j];
     }
 
-    return scale_ * impl_->predict(features) + bias_;
-}
+    // Pass leaves of N examples to accumulator.
+    template <size_t N, typename Sum>
+    void accumulate_n(const float* const* f, Sum& sum) const noexcept {
+        if (nan_right) {
+            accumulate_n<N, true>(f, sum);
+        } else {
+            accumulate_n<N, false>(f, sum);
+        }
+    }
 
-void Model::apply(const float* const* features, size_t size, size_t count, double* y) const {
-    if (!impl_.get()) {
-        throw std::runtime_error("Model is not loaded");
+    template <size_t N, bool nan, typename Sum>
+    void accumulate_n(const float* const* f, Sum& sum) const noexcept {
+        std::array<uint32_t, N> n;
+
+        for (const Tree& tree : trees) {
+            n.fill(tree.root);
+            for (uint32_t d = 0; d < tree.depth; ++d) step<N, nan>(f, n.data());
+            sum.add([&](size_t j) { return &values[n[j] * sum.stride()]; });
+        }
     }
 
-    if (count < impl_->feature_count) {
-        throw std::runtime_error("Not enough features");
+    // Move N examples to the next nodes.
+    template <size_t N, bool nan>
+    void step(const float* const* f, uint32_t* n) const noexcept {
+        size_t j = 0;
+#ifndef NOSSE
+        for (; j + 4 <= N; j += 4) step4<nan>(f + j, n + j);
+#endif
+        for (; j < N; ++j) n[j] = nodes[n[j]].next<nan>(f[j]);
     }
 
-    size_t i = 0;
+#ifndef NOSSE
+    // Move four examples comparing their features at once.
+    template <bool nan>
+    void step4(const float* const* f, uint32_t* n) const noexcept {
+        const Node& a = nodes[n[0]];
+        const Node& b = nodes[n[1]];
+        const Node& c = nodes[n[2]];
+        const Node& d = nodes[n[3]];
+        Vec4f border{d.border, c.border, b.border, a.border};
+        Vec4i child{d.child, c.child, b.child, a.child};
+        if (!nan) {
+            Vec4f x{f[3][d.index], f[2][c.index], f[1][b.index], f[0][a.index]};
+            // Comparison gives minus one for examples going right.
+            (child - (x > border)).storeu(n);
+            return;
+        }
 
-    for (; i + 8 <= size; i += 8) {
-        impl_->predict_n<8>(features + i, y + i);
+        constexpr uint32_t mask = ~nan_right_bit;
+        Vec4f x{f[3][d.index & mask], f[2][c.index & mask], f[1][b.index & mask], f[0][a.index & mask]};
+        Vec4i marked = Vec4i{d.index, c.index, b.index, a.index}.sra(31);
+        (child - ((x > border) | (x.unordered(x) & marked))).storeu(n);
     }
+#endif
+};
 
-    size_t rest = size - i;
-    // We still can dispatch them as a group:
-    switch (rest) {
-        case 7:
-            impl_->predict_n<7>(features + i, y + i);
-            break;
-        case 6:
-            impl_->predict_n<6>(features + i, y + i);
-            break;
-        case 5:
-            impl_->predict_n<5>(features + i, y + i);
-            break;
-        case 4:
-            impl_->predict_n<4>(features + i, y + i);
-            break;
-        case 3:
-            impl_->predict_n<3>(features + i, y + i);
-            break;
-        case 2:
-            impl_->predict_n<2>(features + i, y + i);
-            break;
-        case 1:
-            impl_->predict_n<1>(features + i, y + i);
-            break;
+// Evaluates ranges of trees of a single example in parallel. Worker threads
+// are waiting for examples all the time the model is loaded. Partial sums are
+// added in range order, so result does not depend on timing.
+class TreeParallel {
+    struct Worker {
+        Signal start;
+        Signal done;
+        double result = 0.0;
+        std::thread thread;
+    };
+
+    const ObliviousTrees& trees_;
+    std::vector<TreeRange> ranges_;
+    std::unique_ptr<Worker[]> workers_;
+    size_t worker_count_ = 0;
+
+    // Current job. Workers read it after start signal.
+    const float* features_ = nullptr;
+    Kernel kernel_ = Kernel::Plain;
+    bool stop_ = false;
+    uint32_t job_ = 0;
+
+    // Only one prediction could use workers at a time.
+    std::atomic<bool> busy_{false};
+
+    double predict(const float* f, Kernel kernel, size_t range) const noexcept {
+        if (kernel == Kernel::Pipelined) return trees_.predict<PipelinedSum>(f, ranges_[range]);
+        return trees_.predict<PlainSum>(f, ranges_[range]);
     }
 
-    for (size_t j = 0; j < size; ++j) y[j] = scale_ * y[j] + bias_;
+    void run(size_t index) {
+        Worker& w = workers_[index];
+        uint32_t job = 0;
+        for (;;) {
+            job = w.start.wait(job);
+            if (stop_) return;
+            w.result = predict(features_, kernel_, index + 1);
+            w.done.store(job);
+        }
+    }
 
-    return;
-}
+public:
+    TreeParallel(const ObliviousTrees& trees, size_t threads) : trees_(trees) {
+        ranges_ = partition(trees.groups, threads);
+        worker_count_ = ranges_.size() - 1;
+        workers_.reset(new Worker[worker_count_]);
+        for (size_t i = 0; i < worker_count_; ++i) {
+            workers_[i].thread = std::thread([this, i] { run(i); });
+        }
+    }
 
-size_t Model::feature_count() const {
-    if (impl_.get()) {
-        return impl_->feature_count;
-    } else {
-        return 0;
+    ~TreeParallel() {
+        stop_ = true;
+        ++job_;
+        for (size_t i = 0; i < worker_count_; ++i) workers_[i].start.store(job_);
+        for (size_t i = 0; i < worker_count_; ++i) workers_[i].thread.join();
+    }
+
+    size_t threads() const { return ranges_.size(); }
+
+    // Predict using worker threads. If they are busy with another example
+    // ranges are evaluated by the calling thread in the same order.
+    double predict(const float* f, Kernel kernel) noexcept {
+        if (busy_.exchange(true, std::memory_order_acquire)) {
+            double res = predict(f, kernel, 0);
+            for (size_t i = 1; i < ranges_.size(); ++i) res += predict(f, kernel, i);
+            return res;
+        }
+
+        features_ = f;
+        kernel_ = kernel;
+        ++job_;
+        for (size_t i = 0; i < worker_count_; ++i) workers_[i].start.store(job_);
+
+        double res = predict(f, kernel, 0);
+        for (size_t i = 0; i < worker_count_; ++i) {
+            workers_[i].done.wait(job_ - 1);
+            res += workers_[i].result;
+        }
+
+        busy_.store(false, std::memory_order_release);
+        return res;
+    }
+};
+
+// Sparse examples give only features which differ from defaults. Leaves of
+// all trees for the default features are found when defaults are set (zeros
+// on load), and a prediction evaluates only splits by the given features:
+// bits of leaf indexes of oblivious trees are updated by their splits, and
+// non-symmetric trees having them are traversed. Leaves which changed
+// replace default ones in the sum of default leaves. If the given features
+// are used by many splits, dense kernels are faster, and the row of defaults
+// is passed to them with the given features written.
+class SparseTrees {
+    // Split of an oblivious tree by a feature, it sets bit of the leaf index.
+    struct Use {
+        uint32_t tree = 0;
+        uint32_t bit = 0;
+        float border = 0.0f;
+        // Feature index marked if NaN goes right.
+        uint32_t index = 0;
+    };
+
+    // Row of default features and default leaves of trees kept by the thread.
+    // Given features and changed leaves are restored after every example.
+    // Threads keep buffers of the last thread_buffers models they applied.
+    static constexpr size_t thread_buffers = 4;
+    struct Buffer {
+        uint64_t generation = 0;
+        std::vector<float> row;
+        std::vector<uint32_t> leaves;
+        // Trees having splits by the given features, with repeats.
+        std::vector<uint32_t> trees;
+    };
+
+    const NodeTrees* nodes_ = nullptr;
+    size_t dims_ = 1;
+    size_t split_count_ = 0;
+    // Leaf values of oblivious trees by their original positions.
+    std::vector<const double*> values_;
+    // Splits of oblivious trees by feature f are uses_[offsets_[f].uses,
+    // offsets_[f + 1].uses), positions in NodeTrees of non-symmetric trees
+    // split by it are node_trees_[offsets_[f].nodes, offsets_[f + 1].nodes).
+    struct Offsets {
+        uint32_t uses = 0;
+        uint32_t nodes = 0;
+    };
+    std::vector<Offsets> offsets_;
+    std::vector<Use> uses_;
+    std::vector<uint32_t> node_trees_;
+    std::vector<float> defaults_;
+    // Leaf indexes of oblivious trees followed by leaf nodes of non-symmetric
+    // ones for default features.
+    std::vector<uint32_t> default_leaves_;
+    // Their values, dims per tree, stored together to avoid cache misses.
+    std::vector<double> default_values_;
+    std::vector<double> default_sum_;
+    // Identifies defaults of all models, buffers of threads are refilled when
+    // it differs.
+    uint64_t generation_ = 0;
+
+    const double* leaf(size_t t, uint32_t leaf) const {
+        if (t < values_.size()) return values_[t] + leaf * dims_;
+        return &nodes_->values[leaf * dims_];
+    }
+
+    uint32_t traverse(size_t k, const float* f) const noexcept {
+        const auto& tree = nodes_->trees[k];
+        uint32_t n = tree.root;
+        for (uint32_t d = 0; d < tree.depth; ++d) n = nodes_->nodes[n].next<true>(f);
+        return n;
+    }
+
+    // Buffer of the thread for defaults of the model. Threads applying a few
+    // models by turns do not refill it for every example.
+    Buffer& buffer() const {
+        thread_local Buffer buffers[thread_buffers];
+        thread_local size_t next = 0;
+        for (auto& b : buffers) {
+            if (b.generation == generation_) return b;
+        }
+        Buffer& buffer = buffers[next++ % thread_buffers];
+        buffer.generation = generation_;
+        buffer.row = defaults_;
+        buffer.leaves = default_leaves_;
+        return buffer;
+    }
+
+    // Number of splits and non-symmetric trees using count features.
+    size_t work(const uint32_t* indexes, size_t count) const noexcept {
+        size_t res = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const Offsets& begin = offsets_[indexes[i]];
+            const Offsets& end = offsets_[indexes[i] + 1];
+            res += end.uses - begin.uses + end.nodes - begin.nodes;
+        }
+        return res;
+    }
+
+    // Leaf indexes of oblivious trees followed by leaf nodes of non-symmetric
+    // ones for features f.
+    void find_leaves(const float* f, std::vector<uint32_t>& leaves) const {
+        leaves.assign(values_.size(), 0);
+        for (const Use& u : uses_) {
+            if (greater<true>(f, u.index, u.border)) leaves[u.tree] |= uint32_t{1} << u.bit;
+        }
+        for (size_t k = 0; k < nodes_->trees.size(); ++k) leaves.push_back(traverse(k, f));
+    }
+
+    // Write count features to the row, unless it is null, and set bits of
+    // leaves of oblivious trees for their splits. Trees split by the features
+    // are written to trees with repeats.
+    void change(const uint32_t* indexes, const float* values, size_t count, float* row, uint32_t* leaves,
+                std::vector<uint32_t>& trees) const noexcept {
+        trees.clear();
+        for (size_t i = 0; i < count; ++i) {
+            const uint32_t f = indexes[i];
+            const float x = values[i];
+            if (row) row[f] = x;
+            for (uint32_t k = offsets_[f].uses; k < offsets_[f + 1].uses; ++k) {
+                const Use& u = uses_[k];
+                const uint32_t bit = uint32_t{1} << u.bit;
+                const bool right = x > u.border || (u.index >= nan_right_bit && x != x);
+                leaves[u.tree] = right ? leaves[u.tree] | bit : leaves[u.tree] & ~bit;
+                trees.push_back(u.tree);
+            }
+            for (uint32_t k = offsets_[f].nodes; k < offsets_[f + 1].nodes; ++k) {
+                trees.push_back(static_cast<uint32_t>(values_.size() + node_trees_[k]));
+            }
+        }
+    }
+
+    // Traverse changed non-symmetric trees using the row and prefetch
+    // changed leaves before they are added.
+    void find_changed_leaves(const std::vector<uint32_t>& trees, const float* row, uint32_t* leaves) const noexcept {
+        for (uint32_t t : trees) {
+            if (t >= values_.size()) leaves[t] = traverse(t - values_.size(), row);
+            CATBOOST_PREFETCH(leaf(t, leaves[t]));
+        }
+    }
+
+public:
+    SparseTrees(const JsonModel& model, const ObliviousTrees& trees, const NodeTrees& nodes)
+        : nodes_(&nodes), dims_(model.dims) {
+        std::vector<std::vector<Use>> uses(model.feature_count);
+        for (const auto& tree : model.trees) {
+            for (size_t i = 0; i < tree.depth(); ++i) {
+                const uint32_t index = model.split_index(tree.indexes[i]);
+                uses[tree.indexes[i]].push_back(Use{tree.id, static_cast<uint32_t>(i), tree.borders[i], index});
+            }
+            split_count_ += tree.depth();
+            values_.push_back(trees.values.data() + trees.tree_offsets[tree.id]);
+        }
+
+        std::vector<std::vector<uint32_t>> node_uses(model.feature_count);
+        for (size_t k = 0; k < nodes.trees.size(); ++k) {
+            for (const auto& node : model.node_trees[nodes.tree_ids[k] - model.trees.size()].nodes) {
+                if (!node.child) continue;
+                auto& u = node_uses[node.index];
+                if (u.empty() || u.back() != k) u.push_back(static_cast<uint32_t>(k));
+                ++split_count_;
+            }
+        }
+
+        offsets_.emplace_back();
+        for (size_t f = 0; f < model.feature_count; ++f) {
+            uses_.insert(uses_.end(), uses[f].begin(), uses[f].end());
+            node_trees_.insert(node_trees_.end(), node_uses[f].begin(), node_uses[f].end());
+            offsets_.push_back(Offsets{static_cast<uint32_t>(uses_.size()), static_cast<uint32_t>(node_trees_.size())});
+        }
+
+        set_defaults(std::vector<float>(model.feature_count, 0.0f).data());
+    }
+
+    const std::vector<float>& defaults() const { return defaults_; }
+
+    // Set default features and find leaves of all trees for them.
+    void set_defaults(const float* defaults) {
+        static std::atomic<uint64_t> generations{0};
+        defaults_.assign(defaults, defaults + offsets_.size() - 1);
+        find_leaves(defaults_.data(), default_leaves_);
+
+        default_values_.clear();
+        default_sum_.assign(dims_, 0.0);
+        for (size_t t = 0; t < default_leaves_.size(); ++t) {
+            const double* values = leaf(t, default_leaves_[t]);
+            default_values_.insert(default_values_.end(), values, values + dims_);
+            for (size_t d = 0; d < dims_; ++d) default_sum_[d] += values[d];
+        }
+        generation_ = ++generations;
+    }
+
+    // Sums of leaves of an example with count features different from
+    // defaults, dims values are written to out. If the features are used by
+    // many splits the row with them is passed to dense(row, out) instead.
+    template <typename F>
+    void predict(const uint32_t* indexes, const float* values, size_t count, double* out, F&& dense) const {
+        Buffer& b = buffer();
+        float* row = b.row.data();
+
+        // Updates of leaf indexes miss cache for every tree, while dense
+        // kernels stream through trees: they are faster if given features
+        // are used by more than about 1/32 of splits.
+        if (32 * work(indexes, count) > split_count_) {
+            for (size_t i = 0; i < count; ++i) row[indexes[i]] = values[i];
+            dense(row, out);
+            for (size_t i = 0; i < count; ++i) row[indexes[i]] = defaults_[indexes[i]];
+            return;
+        }
+
+        // Only non-symmetric trees are traversed using the row.
+        const bool nodes = !node_trees_.empty();
+        uint32_t* leaves = b.leaves.data();
+        change(indexes, values, count, nodes ? row : nullptr, leaves, b.trees);
+        find_changed_leaves(b.trees, row, leaves);
+
+        // Changed leaves are restored when added, so repeated trees are
+        // added once.
+        std::copy(default_sum_.begin(), default_sum_.end(), out);
+        for (uint32_t t : b.trees) {
+            if (leaves[t] == default_leaves_[t]) continue;
+            const double* l = leaf(t, leaves[t]);
+            const double* d = &default_values_[t * dims_];
+            for (size_t k = 0; k < dims_; ++k) out[k] += l[k] - d[k];
+            leaves[t] = default_leaves_[t];
+        }
+        if (nodes) {
+            for (size_t i = 0; i < count; ++i) row[indexes[i]] = defaults_[indexes[i]];
+        }
+    }
+
+    // Features of an example kept by a scorer, leaves of all trees for them
+    // and sums of leaf values.
+    struct State {
+        std::vector<float> row;
+        std::vector<uint32_t> leaves;
+        // Leaves whose values are added to sum.
+        std::vector<uint32_t> added;
+        std::vector<double> sum;
+        // Trees having splits by changed features, with repeats.
+        std::vector<uint32_t> trees;
+        // Incremental updates of sum since it was added from leaves.
+        size_t updates = 0;
+    };
+
+    // Number of incremental updates after which the sum is added from
+    // leaves again, so rounding errors of differences do not accumulate.
+    static constexpr size_t max_updates = 64;
+
+    // Add values of added leaves of all trees to the sum.
+    void add_leaves(State& s) const {
+        s.sum.assign(dims_, 0.0);
+        for (size_t t = 0; t < s.added.size(); ++t) {
+            const double* l = leaf(t, s.added[t]);
+            for (size_t d = 0; d < dims_; ++d) s.sum[d] += l[d];
+        }
+        s.updates = 0;
+    }
+
+    // Set features of the state and add leaves of all trees for them.
+    void reset(State& s, const float* features) const {
+        s.row.assign(features, features + offsets_.size() - 1);
+        find_leaves(s.row.data(), s.leaves);
+        s.added = s.leaves;
+        add_leaves(s);
+    }
+
+    // Change count features of the state. Values of changed leaves replace
+    // added ones in the sum, other trees are not evaluated. If the features
+    // are used by many splits leaves of all trees are found again. Every
+    // max_updates updates the sum is added from leaves.
+    void update(State& s, const uint32_t* indexes, const float* values, size_t count) const {
+        if (32 * work(indexes, count) > split_count_) {
+            for (size_t i = 0; i < count; ++i) s.row[indexes[i]] = values[i];
+            return reset(s, s.row.data());
+        }
+
+        change(indexes, values, count, s.row.data(), s.leaves.data(), s.trees);
+        find_changed_leaves(s.trees, s.row.data(), s.leaves.data());
+        for (uint32_t t : s.trees) {
+            if (s.leaves[t] == s.added[t]) continue;
+            const double* l = leaf(t, s.leaves[t]);
+            const double* a = leaf(t, s.added[t]);
+            for (size_t d = 0; d < dims_; ++d) s.sum[d] += l[d] - a[d];
+            s.added[t] = s.leaves[t];
+        }
+        if (++s.updates == max_updates) add_leaves(s);
+    }
+};
+
+// anonymous namespace
+} // namespace
+
+struct Model::Impl {
+    // Number of examples used to benchmark kernels.
+    static constexpr size_t tune_rows = 64;
+    // Number of benchmark runs. The best time is taken.
+    static constexpr int tune_rounds = 5;
+    // Number of examples evaluated together by batch predictions of
+    // multidimensional models.
+    static constexpr size_t multi_batch_width = 4;
+
+    ObliviousTrees trees;
+    NodeTrees node_trees;
+    size_t feature_count = 0;
+    size_t tree_count = 0;
+    size_t max_depth = 0;
+    // Number of values predicted for every example and their biases.
+    size_t dims = 1;
+    std::vector<double> bias;
+    // Categorical features. Trees use derived features following float ones.
+    CatFeatures cats;
+    // Scale, bias and transform of prediction types.
+    Transform transform;
+    // Range of borders for each feature. Used to generate examples for autotuner.
+    std::vector<std::pair<float, float>> feature_ranges;
+    // Number of leaves of every tree in the original order.
+    std::vector<size_t> leaf_counts;
+
+    Kernel kernel = Kernel::Plain;
+    size_t batch_width = default_batch_width;
+    bool autotuned = false;
+    // Sum leaves in the original order of trees.
+    bool fixed_order = false;
+    // Threads evaluating single predictions of huge models.
+    std::unique_ptr<TreeParallel> tree_parallel;
+    // SHAP values of oblivious trees. Tables are prepared once: on load if
+    // Options::shap is set, or by the first explanation.
+    ShapTrees shap;
+    std::once_flag shap_once;
+    // Reason why the model could not be explained, empty if it could.
+    std::string shap_error;
+    // Predictions of sparse examples, null for models with categorical
+    // features.
+    std::unique_ptr<SparseTrees> sparse;
+    // Float features used by the model, the most used first.
+    std::vector<uint32_t> used_features;
+    // The model without leaf values, which are taken from compiled trees to
+    // build specialized models.
+    JsonModel source;
+    // The model on used features numbered in the order of used_features.
+    // It predicts buckets packed by compact_blocks if Options::compact_features
+    // was set on load and some features are not used.
+    std::unique_ptr<Impl> compact;
+    // Cache of sums of leaf values of dense examples, null if it is disabled.
+    // Keys are used features in ascending order.
+    std::unique_ptr<PredictionCache> cache;
+    std::vector<uint32_t> key_features;
+    // Predict identical examples of a bucket once.
+    bool dedupe_rows = false;
+    // Queue of apply_async. It is the last member, so it waits for tasks
+    // using the model before the model is destroyed.
+    std::unique_ptr<AsyncQueue> async;
+
+    explicit Impl(const JsonModel& model) : trees(model), node_trees(model) {
+        feature_count = model.feature_count;
+        tree_count = model.trees.size() + model.node_trees.size();
+        dims = model.dims;
+        bias = model.bias;
+        cats = model.cat_features;
+        transform = Transform{model.loss, dims, model.scale, bias};
+        feature_ranges.resize(cats.width(), {0.0f, 0.0f});
+        used_features = model.used_features();
+        key_features = used_features;
+        std::sort(key_features.begin(), key_features.end());
+        std::vector<bool> seen(cats.width(), false);
+
+        auto add_border = [&](uint32_t index, float border) {
+            auto& range = feature_ranges[index];
+            if (!seen[index]) {
+                range = {border, border};
+                seen[index] = true;
+            }
+            range.first = std::min(range.first, border);
+            range.second = std::max(range.second, border);
+        };
+
+        for (const auto& tree : model.trees) {
+            max_depth = std::max(max_depth, tree.depth());
+            for (size_t i = 0; i < tree.depth(); ++i) add_border(tree.indexes[i], tree.borders[i]);
+            leaf_counts.push_back(tree.values.size() / dims);
+        }
+
+        for (const auto& tree : model.node_trees) {
+            max_depth = std::max(max_depth, tree.depth);
+            leaf_counts.push_back(0);
+            for (const auto& node : tree.nodes) {
+                if (node.child) {
+                    add_border(node.index, node.border);
+                } else {
+                    ++leaf_counts.back();
+                }
+            }
+        }
+
+        if (!cats.used()) sparse.reset(new SparseTrees{model, trees, node_trees});
+        source = model.without_values();
+
+        if (!model.node_trees.empty()) {
+            shap_error = "SHAP values are supported for oblivious trees only";
+        } else if (std::any_of(model.trees.begin(), model.trees.end(),
+                               [](const JsonTree& t) { return t.weights.empty(); })) {
+            shap_error = "Model has no leaf weights, SHAP values are not available";
+        }
+    }
+
+    // Size of leaf values in bytes.
+    size_t values_size() const { return (trees.values.size() + node_trees.values.size()) * sizeof(double); }
+
+    // Single prediction.
+    double predict(const float* f) const noexcept {
+        if (fixed_order) return predict_ordered(f);
+        if (tree_parallel) {
+            double res = tree_parallel->predict(f, kernel);
+            if (!node_trees.empty()) res += predict_nodes(f);
+            return res;
+        }
+        if (kernel == Kernel::Pipelined) return predict<PipelinedSum>(f);
+        return predict<PlainSum>(f);
+    }
+
+    // Single prediction using accumulator Sum.
+    template <typename Sum>
+    double predict(const float* f) const noexcept {
+        Sum sum;
+        trees.accumulate(f, trees.all(), sum);
+        node_trees.accumulate(f, sum);
+        return sum.sum();
+    }
+
+    // Single prediction of non-symmetric trees only.
+    double predict_nodes(const float* f) const noexcept {
+        if (kernel == Kernel::Pipelined) {
+            PipelinedSum sum;
+            node_trees.accumulate(f, sum);
+            return sum.sum();
+        }
+        PlainSum sum;
+        node_trees.accumulate(f, sum);
+        return sum.sum();
+    }
+
+    // Single prediction with leaves added one by one in the original order
+    // of trees, so the result is the same for every build and kernel. Writes
+    // dims values to out.
+    void predict_ordered(const float* f, double* out) const noexcept {
+        thread_local std::vector<const double*> leaves;
+        leaves.resize(tree_count);
+        OrderedSum sum{trees.tree_ids.data(), leaves.data(), dims};
+        trees.accumulate(f, trees.all(), sum);
+        OrderedSum node_sum{node_trees.tree_ids.data(), leaves.data(), dims};
+        node_trees.accumulate(f, node_sum);
+
+        std::fill(out, out + dims, 0.0);
+        for (const double* leaf : leaves) {
+            for (size_t d = 0; d < dims; ++d) out[d] += leaf[d];
+        }
+    }
+
+    double predict_ordered(const float* f) const noexcept {
+        double res = 0.0;
+        predict_ordered(f, &res);
+        return res;
+    }
+
+    // Single prediction of multidimensional model. Writes dims values to out.
+    void predict_multi(const float* f, double* out) const noexcept {
+        if (dims == 1) {
+            *out = predict(f);
+            return;
+        }
+        if (fixed_order) return predict_ordered(f, out);
+        MultiSum sum{out, dims};
+        trees.accumulate(f, trees.all(), sum);
+        node_trees.accumulate(f, sum);
+    }
+
+    // Multiple predictions of multidimensional model. Writes dims values of
+    // every example to out.
+    void predict_multi(const float* const* f, size_t size, double* out) const noexcept {
+        if (dims == 1) return predict(f, size, out);
+        if (compact) {
+            compact_blocks(f, size, [&](const float* const* x, size_t n, size_t offset) {
+                compact->predict_multi(x, n, out + offset * dims);
+            });
+            return;
+        }
+        size_t i = 0;
+        if (!fixed_order) {
+            for (; i + multi_batch_width <= size; i += multi_batch_width) {
+                predict_multi_n<multi_batch_width>(f + i, out + i * dims);
+            }
+        }
+        for (; i < size; ++i) predict_multi(f[i], out + i * dims);
+    }
+
+    template <size_t N>
+    void predict_multi_n(const float* const* f, double* out) const noexcept {
+        MultiBatchSum<N> sum{out, dims};
+        trees.accumulate_n<N>(f, trees.all(), sum);
+        node_trees.accumulate_n<N>(f, sum);
+    }
+
+    // Multiple predictions using groups of batch_width examples.
+    void predict(const float* const* f, size_t size, double* y) const noexcept {
+        if (compact) {
+            compact_blocks(f, size,
+                           [&](const float* const* x, size_t n, size_t offset) { compact->predict(x, n, y + offset); });
+            return;
+        }
+        if (fixed_order) {
+            for (size_t i = 0; i < size; ++i) y[i] = predict_ordered(f[i]);
+            return;
+        }
+        predict(f, size, y, batch_width);
+    }
+
+    void predict(const float* const* f, size_t size, double* y, size_t width) const noexcept {
+        switch (width) {
+            case 1:
+                predict_batch<1>(f, size, y);
+                break;
+            case 2:
+                predict_batch<2>(f, size, y);
+                break;
+            case 4:
+                predict_batch<4>(f, size, y);
+                break;
+            case 16:
+                predict_batch<16>(f, size, y);
+                break;
+            default:
+                predict_batch<8>(f, size, y);
+                break;
+        }
+    }
+
+    // Predict N examples.
+    template <size_t N>
+    void predict_n(const float* const* f, double* y) const noexcept {
+        trees.predict_n<N>(f, y);
+        if (!node_trees.empty()) node_trees.add_n<N>(f, y);
+    }
+
+    template <size_t N>
+    void predict_batch(const float* const* f, size_t size, double* y) const noexcept {
+        size_t i = 0;
+
+        for (; i + N <= size; i += N) {
+            predict_n<N>(f + i, y + i);
+        }
+
+        predict_rest(f + i, size - i, y + i);
+    }
+
+    // Predict less than 16 examples. We still can dispatch them as a group.
+    void predict_rest(const float* const* f, size_t rest, double* y) const noexcept {
+        switch (rest) {
+            case 15:
+                predict_n<15>(f, y);
+                break;
+            case 14:
+                predict_n<14>(f, y);
+                break;
+            case 13:
+                predict_n<13>(f, y);
+                break;
+            case 12:
+                predict_n<12>(f, y);
+                break;
+            case 11:
+                predict_n<11>(f, y);
+                break;
+            case 10:
+                predict_n<10>(f, y);
+                break;
+            case 9:
+                predict_n<9>(f, y);
+                break;
+            case 8:
+                predict_n<8>(f, y);
+                break;
+            case 7:
+                predict_n<7>(f, y);
+                break;
+            case 6:
+                predict_n<6>(f, y);
+                break;
+            case 5:
+                predict_n<5>(f, y);
+                break;
+            case 4:
+                predict_n<4>(f, y);
+                break;
+            case 3:
+                predict_n<3>(f, y);
+                break;
+            case 2:
+                predict_n<2>(f, y);
+                break;
+            case 1:
+                predict_n<1>(f, y);
+                break;
+        }
+    }
+
+    // Compiled ranges of oblivious trees containing all trees from begin to
+    // end in the original order. Adjacent groups are joined, and groups may
+    // contain other trees too.
+    void tree_ranges(size_t begin, size_t end, std::vector<TreeRange>& out) const {
+        out.clear();
+        const size_t count = trees.tree_ids.size();
+        if (begin >= std::min(end, count)) return;
+        if (begin == 0 && end >= count) {
+            out.push_back(trees.all());
+            return;
+        }
+
+        for (size_t g = 0; g < trees.groups.size(); ++g) {
+            const TreeRange& group = trees.groups[g];
+            const size_t last = g + 1 < trees.groups.size() ? trees.groups[g + 1].tree : count;
+            if (std::none_of(trees.tree_ids.data() + group.tree, trees.tree_ids.data() + last,
+                             [&](uint32_t id) { return id >= begin && id < end; })) {
+                continue;
+            }
+            if (!out.empty() && out.back().end == group.begin) {
+                out.back().end = group.end;
+            } else {
+                out.push_back(group);
+            }
+        }
+    }
+
+    // Leaf indexes of trees from begin to end in the original order for size
+    // examples, indexes of example j start at out[j * (end - begin)]. Leaves
+    // are found by the same kernels as predictions, groups of examples by
+    // batch ones.
+    template <typename T>
+    void leaf_indexes(const float* const* f, size_t size, size_t begin, size_t end, T* out) const noexcept {
+        static constexpr size_t width = default_batch_width;
+        thread_local std::vector<TreeRange> ranges;
+        tree_ranges(begin, end, ranges);
+        const bool nodes = end > trees.tree_ids.size();
+        const size_t stride = end - begin;
+
+        size_t i = 0;
+        for (; i + width <= size; i += width) {
+            T* row = out + i * stride;
+            LeafIndexSum<T, width> sum{trees.tree_ids.data(), trees.values.data(), trees.tree_offsets.data(), nullptr,
+                                       dims, begin, end, row, stride};
+            for (const auto& range : ranges) {
+                sum.count = range.tree;
+                trees.accumulate_n<width>(f + i, range, sum);
+            }
+            if (nodes) {
+                LeafIndexSum<T, width> node_sum{node_trees.tree_ids.data(), node_trees.values.data(), nullptr,
+                                                node_trees.leaf_numbers.data(), dims, begin, end, row, stride};
+                node_trees.accumulate_n<width>(f + i, node_sum);
+            }
+        }
+
+        for (; i < size; ++i) {
+            T* row = out + i * stride;
+            LeafIndexSum<T, 1> sum{trees.tree_ids.data(), trees.values.data(), trees.tree_offsets.data(), nullptr,
+                                   dims, begin, end, row, stride};
+            for (const auto& range : ranges) {
+                sum.count = range.tree;
+                trees.accumulate(f[i], range, sum);
+            }
+            if (nodes) {
+                LeafIndexSum<T, 1> node_sum{node_trees.tree_ids.data(), node_trees.values.data(), nullptr,
+                                            node_trees.leaf_numbers.data(), dims, begin, end, row, stride};
+                node_trees.accumulate(f[i], node_sum);
+            }
+        }
+    }
+
+    // Check arguments of Model::calc_leaf_indexes and compute them.
+    template <typename T>
+    void calc_leaf_indexes(const float* const* f, size_t size, size_t count, T* out, size_t out_size, size_t begin,
+                           size_t end) const {
+        if (count < feature_count) {
+            throw std::runtime_error("Not enough features");
+        }
+
+        if (cats.used()) {
+            throw std::runtime_error("Model has categorical features, leaf indexes are not supported");
+        }
+
+        if (!end) end = tree_count;
+        if (begin > end || end > tree_count) {
+            throw std::runtime_error("Wrong range of trees");
+        }
+
+        if (out_size != end - begin) {
+            throw std::runtime_error("Wrong number of leaf indexes");
+        }
+
+        const size_t max_leaves = static_cast<size_t>(std::numeric_limits<T>::max()) + 1;
+        if (std::any_of(leaf_counts.begin() + begin, leaf_counts.begin() + end,
+                        [&](size_t leaves) { return leaves > max_leaves; })) {
+            throw std::runtime_error("Trees have too many leaves for the type of leaf indexes");
+        }
+
+        leaf_indexes(f, size, begin, end, out);
+    }
+
+    // SHAP tables of trees, which are prepared by the first call from splits
+    // and weights of the source model. Trees are prepared in parallel, and
+    // their expected values are added in order.
+    const ShapTrees& shap_trees() {
+        if (!shap_error.empty()) throw std::runtime_error(shap_error);
+        std::call_once(shap_once, [this] {
+            shap = ShapTrees{cats, dims};
+            for (const auto& tree : source.trees) {
+                shap.add_tree(tree.indexes, tree.weights, trees.values.data() + trees.tree_offsets[tree.id]);
+            }
+            std::vector<double> expected(shap.tree_count() * dims, 0.0);
+            parallel_for(default_executor(), shap.tree_count(),
+                         [&](size_t i) { shap.prepare(i, &expected[i * dims]); });
+            shap.finish(expected);
+        });
+        return shap;
+    }
+
+    // SHAP values of an example with float and derived features f, see
+    // Model::shap_values for the layout of out.
+    void shap_values(const ShapTrees& tables, const float* f, double scale, double* out) const {
+        thread_local std::vector<uint32_t> leaves;
+        thread_local std::vector<double> phi;
+        leaves.resize(tables.tree_count());
+        leaf_indexes(&f, 1, 0, tables.tree_count(), leaves.data());
+        phi.assign(tables.class_count() * dims, 0.0);
+        tables.explain(leaves.data(), phi.data());
+
+        const size_t features = feature_count + cats.cat_count;
+        tables.distribute(phi.data(), features, scale, out);
+        for (size_t d = 0; d < dims; ++d) out[d * (features + 1) + features] = scale * tables.expected()[d] + bias[d];
+    }
+
+    // Buffer for float and derived features of examples with categorical
+    // features. It is allocated only when the thread needs a larger one.
+    static float* features_buffer(size_t size) {
+        thread_local std::vector<float> buffer;
+        if (buffer.size() < size) buffer.resize(size);
+        return buffer.data();
+    }
+
+    // Single prediction of model with categorical features.
+    double predict(const float* f, const int32_t* cat) const noexcept {
+        float* x = features_buffer(cats.width());
+        cats.compute(f, cat, x);
+        return predict(x);
+    }
+
+    void predict_multi(const float* f, const int32_t* cat, double* out) const noexcept {
+        float* x = features_buffer(cats.width());
+        cats.compute(f, cat, x);
+        predict_multi(x, out);
+    }
+
+    // Buffer for sums of leaf values of prediction types with fewer values
+    // than the model predicts.
+    static double* values_buffer(size_t size) {
+        thread_local std::vector<double> buffer;
+        if (buffer.size() < size) buffer.resize(size);
+        return buffer.data();
+    }
+
+    // Buffers of predict_cached for keys of examples of a bucket, their
+    // hashes, the first identical example of every one, examples to predict
+    // and their sums, and the hash table of keys.
+    struct DedupeBuffers {
+        std::vector<float> features;
+        std::vector<const float*> keys;
+        std::vector<uint64_t> hashes;
+        std::vector<uint32_t> first;
+        std::vector<const float*> rows;
+        std::vector<uint32_t> unique;
+        std::vector<double> values;
+        std::vector<uint32_t> table;
+    };
+
+    static DedupeBuffers& dedupe_buffers() {
+        thread_local DedupeBuffers buffers;
+        return buffers;
+    }
+
+    // Key of an example for the cache: used features in ascending order of
+    // indexes. They are copied to key unless all features are used.
+    const float* cache_key(const float* f, float* key) const noexcept {
+        if (key_features.size() == feature_count) return f;
+        for (size_t j = 0; j < key_features.size(); ++j) key[j] = f[key_features[j]];
+        return key;
+    }
+
+    // Sums of leaf values of a dense example, looked up in the cache first.
+    void predict_cached(const float* f, double* out) const noexcept {
+        if (!cache) return predict_multi(f, out);
+        std::vector<float>& buffer = dedupe_buffers().features;
+        buffer.resize(key_features.size());
+        const float* key = cache_key(f, buffer.data());
+        const uint64_t hash = hash_features(key, key_features.size());
+        if (cache->lookup(hash, key, out)) return;
+        predict_multi(f, out);
+        cache->insert(hash, key, out);
+    }
+
+    // Sums of leaf values of dense examples. Identical examples of the bucket
+    // are found by a hash table of their keys, and only the first of them is
+    // looked up in the cache and predicted if it is not cached. Keys are
+    // compared bitwise, so -0 and 0 are different keys.
+    void predict_cached(const float* const* f, size_t size, double* out) const noexcept {
+        if (!dedupe_rows || size < 2) {
+            if (size == 1) return predict_cached(f[0], out);
+            return predict_multi(f, size, out);
+        }
+
+        static constexpr uint32_t no_row = std::numeric_limits<uint32_t>::max();
+        const size_t width = key_features.size();
+        DedupeBuffers& buf = dedupe_buffers();
+        buf.features.resize(size * width);
+        buf.keys.resize(size);
+        buf.hashes.resize(size);
+        buf.first.resize(size);
+        buf.rows.clear();
+        buf.unique.clear();
+        size_t mask = 1;
+        while (mask < 2 * size) mask <<= 1;
+        buf.table.assign(mask--, no_row);
+
+        for (size_t i = 0; i < size; ++i) {
+            const float* key = cache_key(f[i], &buf.features[i * width]);
+            const uint64_t hash = hash_features(key, width);
+            buf.keys[i] = key;
+            buf.hashes[i] = hash;
+            buf.first[i] = static_cast<uint32_t>(i);
+
+            size_t pos = hash & mask;
+            for (; buf.table[pos] != no_row; pos = (pos + 1) & mask) {
+                const uint32_t j = buf.table[pos];
+                if (buf.hashes[j] == hash && !std::memcmp(buf.keys[j], key, width * sizeof(float))) {
+                    buf.first[i] = j;
+                    break;
+                }
+            }
+            if (buf.first[i] != i) continue;
+            buf.table[pos] = static_cast<uint32_t>(i);
+            if (cache && cache->lookup(hash, key, out + i * dims)) continue;
+            buf.rows.push_back(f[i]);
+            buf.unique.push_back(static_cast<uint32_t>(i));
+        }
+
+        buf.values.resize(buf.rows.size() * dims);
+        predict_multi(buf.rows.data(), buf.rows.size(), buf.values.data());
+        for (size_t k = 0; k < buf.unique.size(); ++k) {
+            const size_t i = buf.unique[k];
+            const double* values = &buf.values[k * dims];
+            std::copy(values, values + dims, out + i * dims);
+            if (cache) cache->insert(buf.hashes[i], buf.keys[i], values);
+        }
+        for (size_t i = 0; i < size; ++i) {
+            const size_t j = buf.first[i];
+            if (j != i) std::copy(out + j * dims, out + (j + 1) * dims, out + i * dims);
+        }
+    }
+
+    // Predictions of type for size examples. Sums of leaf values are written
+    // by predict_raw(values) and transformed in the same pass which applies
+    // scale and bias: in place, or from a buffer if the type has fewer values.
+    template <typename F>
+    void predict_type(PredictionType type, size_t size, double* out, F&& predict_raw) const {
+        if (transform.dimension(type) == dims) {
+            predict_raw(out);
+            transform.apply(type, out, size, out);
+            return;
+        }
+        double* values = values_buffer(size * dims);
+        predict_raw(values);
+        transform.apply(type, values, size, out);
+    }
+
+    // Multiple predictions of model with categorical features. Features of
+    // blocks of examples are computed together and every block is passed
+    // to predict_block(x, n, offset) as a bucket.
+    template <typename F>
+    void predict_blocks(const float* const* f, const int32_t* const* cat, size_t size, F&& predict_block) const {
+        static constexpr size_t block = CatFeatures::max_block;
+        const size_t width = cats.width();
+        float* buffer = features_buffer(block * width);
+        float* rows[block];
+        for (size_t j = 0; j < block; ++j) rows[j] = buffer + j * width;
+
+        for (size_t i = 0; i < size; i += block) {
+            const size_t n = std::min(block, size - i);
+            cats.compute(f + i, cat + i, n, rows);
+            predict_block(rows, n, i);
+        }
+    }
+
+    // Check sparse examples, features of size examples are indexes[offsets[0],
+    // offsets[size]).
+    void check_sparse(const size_t* offsets, size_t size, const uint32_t* indexes) const {
+        if (!sparse) {
+            throw std::runtime_error("Sparse examples are not supported for models with categorical features");
+        }
+
+        for (size_t i = 0; i < size; ++i) {
+            if (offsets[i] > offsets[i + 1]) throw std::runtime_error("Wrong offsets of sparse examples");
+        }
+
+        for (size_t i = offsets[0]; i < offsets[size]; ++i) {
+            if (indexes[i] >= feature_count) throw std::runtime_error("Wrong feature index");
+        }
+    }
+
+    // Sums of leaf values of a sparse example, dims values are written to out.
+    void predict_sparse(const uint32_t* indexes, const float* values, size_t count, double* out) const noexcept {
+        sparse->predict(indexes, values, count, out, [&](const float* f, double* res) { predict_multi(f, res); });
+    }
+
+    // Sums of leaf values of size sparse examples in CSR format.
+    void predict_sparse(const size_t* offsets, size_t size, const uint32_t* indexes, const float* values,
+                        double* out) const noexcept {
+        for (size_t i = 0; i < size; ++i) {
+            const size_t begin = offsets[i];
+            predict_sparse(indexes + begin, values + begin, offsets[i + 1] - begin, out + i * dims);
+        }
+    }
+
+    // Multiple predictions of features of another type. Features used by the
+    // model are converted to float by blocks of examples and every block is
+    // passed to predict_block(x, n, offset) as a bucket.
+    template <typename T, typename F>
+    void convert_blocks(const T* const* f, size_t size, F&& predict_block) const {
+        static constexpr size_t block = CatFeatures::max_block;
+        float* buffer = features_buffer(block * feature_count);
+        float* rows[block];
+        for (size_t j = 0; j < block; ++j) rows[j] = buffer + j * feature_count;
+
+        for (size_t i = 0; i < size; i += block) {
+            const size_t n = std::min(block, size - i);
+            for (size_t j = 0; j < n; ++j) convert(f[i + j], feature_count, rows[j]);
+            predict_block(rows, n, i);
+        }
+    }
+
+    // Multiple predictions of a strided matrix of examples. Used features of
+    // blocks of examples are gathered column by column to float rows and
+    // every block is passed to predict_block(x, n, offset) as a bucket.
+    template <typename T, typename F>
+    void strided_blocks(const T* f, size_t size, ptrdiff_t row_stride, ptrdiff_t column_stride,
+                        F&& predict_block) const {
+        static constexpr size_t block = CatFeatures::max_block;
+        float* buffer = features_buffer(block * feature_count);
+        float* rows[block];
+        for (size_t j = 0; j < block; ++j) rows[j] = buffer + j * feature_count;
+
+        for (size_t i = 0; i < size; i += block) {
+            const size_t n = std::min(block, size - i);
+            for (uint32_t k : key_features) {
+                const T* x = f + static_cast<ptrdiff_t>(i) * row_stride + static_cast<ptrdiff_t>(k) * column_stride;
+                for (size_t j = 0; j < n; ++j) {
+                    rows[j][k] = static_cast<float>(x[static_cast<ptrdiff_t>(j) * row_stride]);
+                }
+            }
+            predict_block(rows, n, i);
+        }
+    }
+
+    // The model with leaf values of compiled trees.
+    JsonModel json_model() const {
+        JsonModel res = source;
+        res.cat_features = cats;
+        for (auto& tree : res.trees) {
+            const double* values = trees.values.data() + trees.tree_offsets[tree.id];
+            tree.values.assign(values, values + (size_t{1} << tree.depth()) * dims);
+        }
+        for (size_t k = 0; k < node_trees.trees.size(); ++k) {
+            auto& tree = res.node_trees[node_trees.tree_ids[k] - res.trees.size()];
+            const uint32_t root = node_trees.trees[k].root;
+            for (size_t i = 0; i < tree.nodes.size(); ++i) {
+                if (tree.nodes[i].child) continue;
+                const double* values = &node_trees.values[(root + i) * dims];
+                tree.nodes[i].values.assign(values, values + dims);
+            }
+        }
+        return res;
+    }
+
+    // Buffer for used features of examples packed by compact_blocks.
+    static float* compact_buffer(size_t size) {
+        thread_local std::vector<float> buffer;
+        if (buffer.size() < size) buffer.resize(size);
+        return buffer.data();
+    }
+
+    // Multiple predictions by the compact model. Used features of blocks of
+    // examples are packed into short adjacent rows, so kernels read a few
+    // cache lines of every example instead of scattered ones, and every block
+    // is passed to predict_block(x, n, offset) as a bucket.
+    template <typename F>
+    void compact_blocks(const float* const* f, size_t size, F&& predict_block) const {
+        static constexpr size_t block = CatFeatures::max_block;
+        const size_t width = used_features.size();
+        const uint32_t* used = used_features.data();
+        float* buffer = compact_buffer(block * width);
+        float* rows[block];
+        for (size_t j = 0; j < block; ++j) rows[j] = buffer + j * width;
+
+        for (size_t i = 0; i < size; i += block) {
+            const size_t n = std::min(block, size - i);
+            for (size_t j = 0; j < n; ++j) {
+                const float* x = f[i + j];
+                float* row = rows[j];
+                for (size_t k = 0; k < width; ++k) row[k] = x[used[k]];
+            }
+            predict_block(rows, n, i);
+        }
+    }
+
+    // Compile the compact model if the model has unused float features.
+    void compact_features(const JsonModel& model) {
+        if (cats.used() || used_features.empty() || used_features.size() == feature_count) return;
+        compact.reset(new Impl(model.compact(used_features)));
+    }
+
+    // Choose kernel and batch width. Values that are not set explicitly are
+    // chosen by autotuner if it is enabled.
+    void configure(const Options& options) {
+        async.reset();
+        kernel = options.kernel;
+        batch_width = options.batch_width;
+        fixed_order = options.fixed_order;
+        autotuned = false;
+        transform.set_accuracy(options.accuracy);
+
+        // Kernels and tree threads are used by one-dimensional models only.
+        if (options.autotune && dims == 1 && (kernel == Kernel::Auto || batch_width == 0)) {
+            autotune(kernel == Kernel::Auto, batch_width == 0);
+        }
+
+        kernel = resolve_kernel(kernel, values_size());
+        if (batch_width == 0) batch_width = default_batch_width;
+
+        size_t threads = std::min(options.tree_threads, trees.groups.size());
+        if (threads > 1 && tree_count >= options.tree_parallel_min_trees && !fixed_order && dims == 1) {
+            if (!tree_parallel || tree_parallel->threads() != threads) {
+                tree_parallel.reset(new TreeParallel(trees, threads));
+            }
+        } else {
+            tree_parallel.reset();
+        }
+
+        if (options.shap && shap_error.empty()) shap_trees();
+
+        // Cached values depend on the kernel, so the cache is dropped with
+        // every change of options.
+        dedupe_rows = options.dedupe_rows || options.cache_size;
+        cache.reset();
+        if (options.cache_size && !cats.used()) {
+            cache.reset(new PredictionCache{options.cache_size, key_features.size(), dims});
+            if (cache->empty()) cache.reset();
+        }
+
+        async.reset(new AsyncQueue{options.executor, feature_count,
+                                   [this](const float* const* f, size_t size, PredictionType type, double* out) {
+                                       predict_type(type, size, out,
+                                                    [&](double* values) { predict_cached(f, size, values); });
+                                   }});
+
+        // The compact model is compiled on load, later options could only
+        // drop it.
+        if (!options.compact_features) compact.reset();
+        if (compact) {
+            Options compact_options = options;
+            compact_options.tree_threads = 1;
+            compact_options.shap = false;
+            compact_options.cache_size = 0;
+            compact_options.dedupe_rows = false;
+            compact->configure(compact_options);
+        }
+    }
+
+    // Run the function several times and return the best time in seconds.
+    template <typename F>
+    static double best_time(F&& f) {
+        double best = 0.0;
+        for (int round = 0; round < tune_rounds; ++round) {
+            auto begin = std::chrono::steady_clock::now();
+            f();
+            std::chrono::duration<double> time = std::chrono::steady_clock::now() - begin;
+            if (round == 0 || time.count() < best) best = time.count();
+        }
+        return best;
+    }
+
+    // Benchmark kernels on random examples with features distributed over
+    // the range of model borders.
+    void autotune(bool tune_kernel, bool tune_width) {
+        std::mt19937 gen{42};
+        std::vector<float> data(tune_rows * std::max<size_t>(cats.width(), 1));
+        std::vector<const float*> rows(tune_rows);
+        std::vector<double> y(tune_rows);
+        const size_t stride = data.size() / tune_rows;
+
+        for (size_t i = 0; i < tune_rows; ++i) {
+            rows[i] = data.data() + i * stride;
+            for (size_t j = 0; j < cats.width(); ++j) {
+                const auto& range = feature_ranges[j];
+                std::uniform_real_distribution<float> x{range.first - 1.0f, range.second + 1.0f};
+                data[i * stride + j] = x(gen);
+            }
+        }
+
+        if (tune_kernel) {
+            double plain = best_time([&] {
+                for (size_t i = 0; i < tune_rows; ++i) y[i] = predict<PlainSum>(rows[i]);
+            });
+            double pipelined = best_time([&] {
+                for (size_t i = 0; i < tune_rows; ++i) y[i] = predict<PipelinedSum>(rows[i]);
+            });
+            kernel = pipelined < plain ? Kernel::Pipelined : Kernel::Plain;
+        }
+
+        if (tune_width) {
+            double best = 0.0;
+            for (size_t width : {1, 2, 4, 8, 16}) {
+                double time = best_time([&] { predict(rows.data(), tune_rows, y.data(), width); });
+                if (batch_width == 0 || time < best) {
+                    batch_width = width;
+                    best = time;
+                }
+            }
+        }
+
+        autotuned = true;
+    }
+
+    ModelStats stats() const {
+        ModelStats stats;
+        stats.tree_count = tree_count;
+        stats.feature_count = feature_count;
+        stats.max_depth = max_depth;
+        stats.values_size = values_size();
+        stats.nonsymmetric_tree_count = node_trees.trees.size();
+        stats.dimension = dims;
+        stats.cat_feature_count = cats.cat_count;
+        stats.ctr_count = cats.ctrs.size();
+        stats.used_feature_count = used_features.size();
+        stats.compact_features = compact != nullptr;
+        stats.kernel = kernel;
+        stats.batch_width = batch_width;
+        stats.autotuned = autotuned;
+        stats.tree_threads = tree_parallel ? tree_parallel->threads() : 1;
+        return stats;
+    }
+};
+
+static void check_options(const Options& options) {
+    switch (options.batch_width) {
+        case 0:
+        case 1:
+        case 2:
+        case 4:
+        case 8:
+        case 16:
+            break;
+        default:
+            throw std::runtime_error("Invalid batch width");
+    }
+}
+
+Model::Model() {}
+
+Model::Model(const std::string& filename) { load(filename); }
+
+Model::Model(std::istream& in) { load(in); }
+
+Model::Model(const std::string& filename, const Options& options) { load(filename, options); }
+
+Model::Model(std::istream& in, const Options& options) { load(in, options); }
+
+Model::~Model() = default;
+
+void Model::load(const std::string& filename) {
+    std::ifstream in{filename};
+
+    if (!in.good()) {
+        throw std::runtime_error("Can't open file with model");
+    }
+
+    load(in);
+}
+
+void Model::load(std::istream& in) {
+    nlohmann::json model = nlohmann::json::parse(in);
+
+    JsonModel jmodel;
+    jmodel.load(model);
+
+    impl_.reset(new Impl(jmodel));
+    if (options_.compact_features) impl_->compact_features(jmodel);
+    impl_->configure(options_);
+    scale_ = jmodel.scale;
+    bias_ = jmodel.bias.front();
+}
+
+void Model::load(const std::string& filename, const Options& options) {
+    check_options(options);
+    options_ = options;
+    load(filename);
+}
+
+void Model::load(std::istream& in, const Options& options) {
+    check_options(options);
+    options_ = options;
+    load(in);
+}
+
+double Model::apply(const float* features, size_t count, PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    if (impl_->cats.used()) {
+        throw std::runtime_error("Model has categorical features, use apply with cat_features");
+    }
+
+    if (impl_->transform.dimension(type) != 1) {
+        throw std::runtime_error("Model predicts several values, use apply with dims");
+    }
+
+    if (type == PredictionType::RawFormulaVal && !impl_->cache) return scale_ * impl_->predict(features) + bias_;
+
+    double y = 0.0;
+    impl_->predict_type(type, 1, &y, [&](double* values) { impl_->predict_cached(features, values); });
+    return y;
+}
+
+void Model::apply(const float* features, size_t count, double* out, size_t dims, PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    if (impl_->cats.used()) {
+        throw std::runtime_error("Model has categorical features, use apply with cat_features");
+    }
+
+    if (dims != impl_->transform.dimension(type)) {
+        throw std::runtime_error("Wrong number of model dimensions");
+    }
+
+    impl_->predict_type(type, 1, out, [&](double* values) { impl_->predict_cached(features, values); });
+}
+
+void Model::apply(const float* const* features, size_t size, size_t count, double* y, PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    if (impl_->cats.used()) {
+        throw std::runtime_error("Model has categorical features, use apply with cat_features");
+    }
+
+    if (impl_->transform.dimension(type) != 1) {
+        throw std::runtime_error("Model predicts several values, use apply with dims");
+    }
+
+    impl_->predict_type(type, size, y, [&](double* values) { impl_->predict_cached(features, size, values); });
+}
+
+void Model::apply(const float* const* features, size_t size, size_t count, double* out, size_t dims,
+                  PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    if (impl_->cats.used()) {
+        throw std::runtime_error("Model has categorical features, use apply with cat_features");
+    }
+
+    if (dims != impl_->transform.dimension(type)) {
+        throw std::runtime_error("Wrong number of model dimensions");
+    }
+
+    impl_->predict_type(type, size, out, [&](double* values) { impl_->predict_cached(features, size, values); });
+}
+
+void Model::set_default_features(const float* defaults, size_t count) {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (!impl_->sparse) {
+        throw std::runtime_error("Sparse examples are not supported for models with categorical features");
+    }
+
+    if (count < impl_->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    impl_->sparse->set_defaults(defaults);
+}
+
+double Model::apply_sparse(const uint32_t* indexes, const float* values, size_t count, PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    const size_t offsets[] = {0, count};
+    impl_->check_sparse(offsets, 1, indexes);
+
+    if (impl_->transform.dimension(type) != 1) {
+        throw std::runtime_error("Model predicts several values, use apply_sparse with dims");
+    }
+
+    double y = 0.0;
+    impl_->predict_type(type, 1, &y, [&](double* out) { impl_->predict_sparse(indexes, values, count, out); });
+    return y;
+}
+
+void Model::apply_sparse(const uint32_t* indexes, const float* values, size_t count, double* out, size_t dims,
+                         PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    const size_t offsets[] = {0, count};
+    impl_->check_sparse(offsets, 1, indexes);
+
+    if (dims != impl_->transform.dimension(type)) {
+        throw std::runtime_error("Wrong number of model dimensions");
+    }
+
+    impl_->predict_type(type, 1, out, [&](double* res) { impl_->predict_sparse(indexes, values, count, res); });
+}
+
+void Model::apply_sparse(const size_t* offsets, size_t size, const uint32_t* indexes, const float* values, double* y,
+                         PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    impl_->check_sparse(offsets, size, indexes);
+
+    if (impl_->transform.dimension(type) != 1) {
+        throw std::runtime_error("Model predicts several values, use apply_sparse with dims");
+    }
+
+    impl_->predict_type(type, size, y,
+                        [&](double* res) { impl_->predict_sparse(offsets, size, indexes, values, res); });
+}
+
+void Model::apply_sparse(const size_t* offsets, size_t size, const uint32_t* indexes, const float* values, double* out,
+                         size_t dims, PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    impl_->check_sparse(offsets, size, indexes);
+
+    if (dims != impl_->transform.dimension(type)) {
+        throw std::runtime_error("Wrong number of model dimensions");
+    }
+
+    impl_->predict_type(type, size, out,
+                        [&](double* res) { impl_->predict_sparse(offsets, size, indexes, values, res); });
+}
+
+struct Scorer::Impl {
+    const Model::Impl* model = nullptr;
+    SparseTrees::State state;
+};
+
+Scorer::Scorer(const Model& model) : impl_(new Impl) {
+    if (!model.impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (!model.impl_->sparse) {
+        throw std::runtime_error("Scorer does not support models with categorical features");
+    }
+
+    impl_->model = model.impl_.get();
+    impl_->model->sparse->reset(impl_->state, impl_->model->sparse->defaults().data());
+}
+
+Scorer::Scorer(Scorer&&) noexcept = default;
+
+Scorer& Scorer::operator=(Scorer&&) noexcept = default;
+
+Scorer::~Scorer() = default;
+
+void Scorer::reset(const float* features, size_t count) {
+    if (count < impl_->model->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    impl_->model->sparse->reset(impl_->state, features);
+}
+
+void Scorer::update(const uint32_t* indexes, const float* values, size_t count) {
+    const size_t offsets[] = {0, count};
+    impl_->model->check_sparse(offsets, 1, indexes);
+    impl_->model->sparse->update(impl_->state, indexes, values, count);
+}
+
+double Scorer::apply(PredictionType type) const {
+    const Model::Impl& model = *impl_->model;
+    if (model.transform.dimension(type) != 1) {
+        throw std::runtime_error("Model predicts several values, use apply with dims");
+    }
+
+    double y = 0.0;
+    model.predict_type(type, 1, &y, [&](double* out) { *out = impl_->state.sum[0]; });
+    return y;
+}
+
+void Scorer::apply(double* out, size_t dims, PredictionType type) const {
+    const Model::Impl& model = *impl_->model;
+    if (dims != model.transform.dimension(type)) {
+        throw std::runtime_error("Wrong number of model dimensions");
+    }
+
+    const auto& sum = impl_->state.sum;
+    model.predict_type(type, 1, out, [&](double* res) { std::copy(sum.begin(), sum.end(), res); });
+}
+
+// Features of other types are converted into the buffer of the thread, then
+// float versions check and predict them.
+template <typename T>
+double Model::apply(const T* features, size_t count, PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    float* x = Impl::features_buffer(impl_->feature_count);
+    convert(features, impl_->feature_count, x);
+    return apply(x, impl_->feature_count, type);
+}
+
+template <typename T>
+void Model::apply(const T* features, size_t count, double* out, size_t dims, PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    float* x = Impl::features_buffer(impl_->feature_count);
+    convert(features, impl_->feature_count, x);
+    apply(x, impl_->feature_count, out, dims, type);
+}
+
+template <typename T>
+void Model::apply(const T* const* features, size_t size, size_t count, double* y, PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    impl_->convert_blocks(features, size, [&](const float* const* x, size_t n, size_t offset) {
+        apply(x, n, impl_->feature_count, y + offset, type);
+    });
+}
+
+template <typename T>
+void Model::apply(const T* const* features, size_t size, size_t count, double* out, size_t dims,
+                  PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    impl_->convert_blocks(features, size, [&](const float* const* x, size_t n, size_t offset) {
+        apply(x, n, impl_->feature_count, out + offset * dims, dims, type);
+    });
+}
+
+template <typename T>
+void Model::apply_strided(const T* features, size_t size, size_t count, ptrdiff_t row_stride,
+                          ptrdiff_t column_stride, double* out, size_t dims, PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    // Rows of float matrices are passed by chunks of pointers.
+    if (std::is_same<T, float>::value && column_stride == 1) {
+        static constexpr size_t block = 256;
+        const float* rows[block];
+        for (size_t i = 0; i < size; i += block) {
+            const size_t n = std::min(block, size - i);
+            for (size_t j = 0; j < n; ++j) {
+                rows[j] = reinterpret_cast<const float*>(features) + static_cast<ptrdiff_t>(i + j) * row_stride;
+            }
+            apply(rows, n, count, out + i * dims, dims, type);
+        }
+        return;
+    }
+
+    impl_->strided_blocks(features, size, row_stride, column_stride,
+                          [&](const float* const* x, size_t n, size_t offset) {
+                              apply(x, n, impl_->feature_count, out + offset * dims, dims, type);
+                          });
+}
+
+template void Model::apply_strided<float>(const float*, size_t, size_t, ptrdiff_t, ptrdiff_t, double*, size_t,
+                                          PredictionType) const;
+template void Model::apply_strided<double>(const double*, size_t, size_t, ptrdiff_t, ptrdiff_t, double*, size_t,
+                                           PredictionType) const;
+
+#define CATBOOST_INSTANTIATE_APPLY(T)                                                                                  \
+    template double Model::apply<T>(const T*, size_t, PredictionType) const;                                           \
+    template void Model::apply<T>(const T*, size_t, double*, size_t, PredictionType) const;                            \
+    template void Model::apply<T>(const T* const*, size_t, size_t, double*, PredictionType) const;                     \
+    template void Model::apply<T>(const T* const*, size_t, size_t, double*, size_t, PredictionType) const;
+
+CATBOOST_INSTANTIATE_APPLY(double)
+CATBOOST_INSTANTIATE_APPLY(int32_t)
+CATBOOST_INSTANTIATE_APPLY(Float16)
+CATBOOST_INSTANTIATE_APPLY(BFloat16)
+
+#undef CATBOOST_INSTANTIATE_APPLY
+
+void Model::apply_parallel(const float* const* features, size_t size, size_t count, double* y, Executor* executor,
+                           PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (impl_->transform.dimension(type) != 1) {
+        throw std::runtime_error("Model predicts several values, use apply with dims");
+    }
+
+    if (impl_->cats.used()) {
+        throw std::runtime_error("Model has categorical features, use apply with cat_features");
+    }
+
+    if (!executor) executor = &default_executor();
+    size_t participants = executor->concurrency() + 1;
+    size_t min_rows = options_.parallel_min_rows;
+    if (!min_rows) min_rows = parallel_min_work / std::max<size_t>(impl_->tree_count, 1);
+
+    if (participants == 1 || size < min_rows) {
+        apply(features, size, count, y, type);
+        return;
+    }
+
+    if (count < impl_->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    size_t chunk = parallel_chunk(size, count, participants);
+    size_t chunks = (size + chunk - 1) / chunk;
+
+    parallel_for(*executor, chunks, [&](size_t c) {
+        size_t begin = c * chunk;
+        size_t n = std::min(chunk, size - begin);
+        impl_->predict_type(type, n, y + begin,
+                            [&](double* values) { impl_->predict_cached(features + begin, n, values); });
+    });
+}
+
+void Model::apply(const FeatureMatrix& matrix, double* out, size_t dims, PredictionType type) const {
+    apply_strided(matrix.data(), matrix.rows(), matrix.features(), matrix.row_stride(), matrix.column_stride(), out,
+                  dims, type);
+}
+
+void Model::apply_parallel(const FeatureMatrix& matrix, double* out, size_t dims, Executor* executor,
+                           PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (!executor) executor = &default_executor();
+    const size_t size = matrix.rows();
+    const size_t count = matrix.features();
+    size_t participants = executor->concurrency() + 1;
+    size_t min_rows = options_.parallel_min_rows;
+    if (!min_rows) min_rows = parallel_min_work / std::max<size_t>(impl_->tree_count, 1);
+
+    if (participants == 1 || size < min_rows) {
+        apply(matrix, out, dims, type);
+        return;
+    }
+
+    if (count < impl_->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    if (dims != impl_->transform.dimension(type)) {
+        throw std::runtime_error("Wrong number of model dimensions");
+    }
+
+    if (impl_->cats.used()) {
+        throw std::runtime_error("Model has categorical features, use apply with cat_features");
+    }
+
+    size_t chunk = parallel_chunk(size, count, participants);
+    size_t chunks = (size + chunk - 1) / chunk;
+
+    parallel_for(*executor, chunks, [&](size_t c) {
+        size_t begin = c * chunk;
+        size_t n = std::min(chunk, size - begin);
+        apply_strided(matrix.data() + static_cast<ptrdiff_t>(begin) * matrix.row_stride(), n, count,
+                      matrix.row_stride(), matrix.column_stride(), out + begin * dims, dims, type);
+    });
+}
+
+std::future<double> Model::apply_async(const float* features, size_t count, PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (impl_->transform.dimension(type) != 1) {
+        throw std::runtime_error("Model predicts several values, use apply_async with dims");
+    }
+
+    struct State {
+        std::promise<double> promise;
+        double value = 0.0;
+    };
+    auto state = std::make_shared<State>();
+    std::future<double> res = state->promise.get_future();
+    apply_async(features, count, &state->value, 1, [state] { state->promise.set_value(state->value); }, type);
+    return res;
+}
+
+void Model::apply_async(const float* features, size_t count, double* out, size_t dims, std::function<void()> done,
+                        PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    if (impl_->cats.used()) {
+        throw std::runtime_error("Model has categorical features, use apply with cat_features");
+    }
+
+    if (dims != impl_->transform.dimension(type)) {
+        throw std::runtime_error("Wrong number of model dimensions");
+    }
+
+    impl_->async->submit(features, AsyncQueue::Request{type, out, dims, std::move(done)});
+}
+
+double Model::apply(const float* features, size_t count, const int32_t* cat_features, size_t cat_count,
+                    PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count || cat_count < impl_->cats.cat_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    if (impl_->transform.dimension(type) != 1) {
+        throw std::runtime_error("Model predicts several values, use apply with dims");
+    }
+
+    if (type == PredictionType::RawFormulaVal) return scale_ * impl_->predict(features, cat_features) + bias_;
+
+    double y = 0.0;
+    impl_->predict_type(type, 1, &y, [&](double* values) { impl_->predict_multi(features, cat_features, values); });
+    return y;
+}
+
+void Model::apply(const float* features, size_t count, const int32_t* cat_features, size_t cat_count, double* out,
+                  size_t dims, PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count || cat_count < impl_->cats.cat_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    if (dims != impl_->transform.dimension(type)) {
+        throw std::runtime_error("Wrong number of model dimensions");
+    }
+
+    impl_->predict_type(type, 1, out, [&](double* values) { impl_->predict_multi(features, cat_features, values); });
+}
+
+void Model::apply(const float* const* features, size_t size, size_t count, const int32_t* const* cat_features,
+                  size_t cat_count, double* y, PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count || cat_count < impl_->cats.cat_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    if (impl_->transform.dimension(type) != 1) {
+        throw std::runtime_error("Model predicts several values, use apply with dims");
+    }
+
+    const size_t dims = impl_->dims;
+    impl_->predict_type(type, size, y, [&](double* values) {
+        impl_->predict_blocks(features, cat_features, size, [&](const float* const* x, size_t n, size_t offset) {
+            impl_->predict_multi(x, n, values + offset * dims);
+        });
+    });
+}
+
+void Model::apply(const float* const* features, size_t size, size_t count, const int32_t* const* cat_features,
+                  size_t cat_count, double* out, size_t dims, PredictionType type) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count || cat_count < impl_->cats.cat_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    if (dims != impl_->transform.dimension(type)) {
+        throw std::runtime_error("Wrong number of model dimensions");
+    }
+
+    const size_t model_dims = impl_->dims;
+    impl_->predict_type(type, size, out, [&](double* values) {
+        impl_->predict_blocks(features, cat_features, size, [&](const float* const* x, size_t n, size_t offset) {
+            impl_->predict_multi(x, n, values + offset * model_dims);
+        });
+    });
+}
+
+double Model::apply(const std::vector<float>& features, const std::vector<std::string>& cat_features,
+                    PredictionType type) const {
+    thread_local std::vector<int32_t> hashes;
+    hashes.resize(cat_features.size());
+    hash_cat_features(cat_features.data(), cat_features.size(), hashes.data());
+    return apply(features.data(), features.size(), hashes.data(), hashes.size(), type);
+}
+
+void Model::apply(const std::vector<std::vector<float>>& features,
+                  const std::vector<std::vector<std::string>>& cat_features, std::vector<double>& y,
+                  PredictionType type) const {
+    if (features.size() != cat_features.size()) {
+        throw std::runtime_error("Different number of examples with float and categorical features");
+    }
+
+    const size_t fcount = feature_count();
+    const size_t ccount = cat_feature_count();
+    const size_t size = features.size();
+    std::vector<int32_t> hashes(size * ccount);
+    std::vector<const float*> rows(size);
+    std::vector<const int32_t*> cat_rows(size);
+
+    for (size_t i = 0; i < size; ++i) {
+        if (features[i].size() < fcount || cat_features[i].size() < ccount) {
+            throw std::runtime_error("Not enough features");
+        }
+        rows[i] = features[i].data();
+        cat_rows[i] = hashes.data() + i * ccount;
+        hash_cat_features(cat_features[i].data(), ccount, hashes.data() + i * ccount);
+    }
+
+    y.resize(size);
+    apply(rows.data(), size, fcount, cat_rows.data(), ccount, y.data(), type);
+}
+
+size_t Model::shap_size() const {
+    if (impl_.get()) {
+        return (impl_->feature_count + impl_->cats.cat_count + 1) * impl_->dims;
+    } else {
+        return 0;
+    }
+}
+
+void Model::shap_values(const float* features, size_t count, double* out, size_t out_size) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    if (impl_->cats.used()) {
+        throw std::runtime_error("Model has categorical features, use shap_values with cat_features");
+    }
+
+    if (out_size != shap_size()) {
+        throw std::runtime_error("Wrong number of SHAP values");
+    }
+
+    impl_->shap_values(impl_->shap_trees(), features, scale_, out);
+}
+
+void Model::shap_values(const float* features, size_t count, const int32_t* cat_features, size_t cat_count,
+                        double* out, size_t out_size) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count || cat_count < impl_->cats.cat_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    if (out_size != shap_size()) {
+        throw std::runtime_error("Wrong number of SHAP values");
+    }
+
+    const ShapTrees& tables = impl_->shap_trees();
+    float* x = Impl::features_buffer(impl_->cats.width());
+    impl_->cats.compute(features, cat_features, x);
+    impl_->shap_values(tables, x, scale_, out);
+}
+
+void Model::shap_values(const float* const* features, size_t size, size_t count, double* out,
+                        size_t out_size) const {
+    for (size_t i = 0; i < size; ++i) shap_values(features[i], count, out + i * out_size, out_size);
+}
+
+void Model::shap_values(const float* const* features, size_t size, size_t count, const int32_t* const* cat_features,
+                        size_t cat_count, double* out, size_t out_size) const {
+    for (size_t i = 0; i < size; ++i) {
+        shap_values(features[i], count, cat_features[i], cat_count, out + i * out_size, out_size);
+    }
+}
+
+void Model::shap_values_parallel(const float* const* features, size_t size, size_t count, double* out,
+                                 size_t out_size, Executor* executor) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    // Arguments are checked by the calling thread before tasks are
+    // submitted.
+    if (count < impl_->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    if (impl_->cats.used()) {
+        throw std::runtime_error("Model has categorical features, use shap_values with cat_features");
+    }
+
+    if (out_size != shap_size()) {
+        throw std::runtime_error("Wrong number of SHAP values");
+    }
+
+    // Tables are prepared by the calling thread before tasks are submitted.
+    impl_->shap_trees();
+
+    if (!executor) executor = &default_executor();
+    const size_t participants = executor->concurrency() + 1;
+    size_t chunk = std::max<size_t>(size / (4 * participants), 1);
+    chunk = std::min(chunk, shap_chunk_size);
+    const size_t chunks = (size + chunk - 1) / chunk;
+
+    if (participants == 1 || chunks == 1) {
+        shap_values(features, size, count, out, out_size);
+        return;
+    }
+
+    parallel_for(*executor, chunks, [&](size_t c) {
+        const size_t begin = c * chunk;
+        const size_t n = std::min(chunk, size - begin);
+        shap_values(features + begin, n, count, out + begin * out_size, out_size);
+    });
+}
+
+size_t Model::tree_count() const {
+    if (impl_.get()) {
+        return impl_->tree_count;
+    } else {
+        return 0;
+    }
+}
+
+void Model::calc_leaf_indexes(const float* features, size_t count, uint8_t* out, size_t out_size, size_t begin,
+                              size_t end) const {
+    calc_leaf_indexes(&features, 1, count, out, out_size, begin, end);
+}
+
+void Model::calc_leaf_indexes(const float* features, size_t count, uint16_t* out, size_t out_size, size_t begin,
+                              size_t end) const {
+    calc_leaf_indexes(&features, 1, count, out, out_size, begin, end);
+}
+
+void Model::calc_leaf_indexes(const float* const* features, size_t size, size_t count, uint8_t* out,
+                              size_t out_size, size_t begin, size_t end) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    impl_->calc_leaf_indexes(features, size, count, out, out_size, begin, end);
+}
+
+void Model::calc_leaf_indexes(const float* const* features, size_t size, size_t count, uint16_t* out,
+                              size_t out_size, size_t begin, size_t end) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    impl_->calc_leaf_indexes(features, size, count, out, out_size, begin, end);
+}
+
+size_t Model::feature_count() const {
+    if (impl_.get()) {
+        return impl_->feature_count;
+    } else {
+        return 0;
+    }
+}
+
+size_t Model::cat_feature_count() const {
+    if (impl_.get()) {
+        return impl_->cats.cat_count;
+    } else {
+        return 0;
+    }
+}
+
+void Model::specialize(const uint32_t* indexes, const float* values, size_t count, Model& out) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    std::vector<bool> fixed(impl_->feature_count, false);
+    std::vector<float> row(impl_->feature_count, 0.0f);
+    for (size_t i = 0; i < count; ++i) {
+        if (indexes[i] >= impl_->feature_count) throw std::runtime_error("Wrong feature index");
+        fixed[indexes[i]] = true;
+        row[indexes[i]] = values[i];
+    }
+    const JsonModel jmodel = impl_->json_model().specialize(fixed, row.data());
+
+    // Specialized models are built often, so kernels are not tuned again,
+    // tree threads are not started and the cache is not allocated.
+    Options options = options_;
+    if (options.autotune) {
+        options.kernel = impl_->kernel;
+        options.batch_width = impl_->batch_width;
+        options.autotune = false;
+    }
+    options.tree_threads = 1;
+    options.shap = false;
+    options.cache_size = 0;
+
+    out.options_ = options;
+    out.impl_.reset(new Impl(jmodel));
+    if (options.compact_features) out.impl_->compact_features(jmodel);
+    out.impl_->configure(options);
+    out.scale_ = jmodel.scale;
+    out.bias_ = jmodel.bias.front();
+}
+
+std::vector<uint32_t> Model::used_features() const {
+    if (impl_.get()) {
+        return impl_->used_features;
+    } else {
+        return {};
+    }
+}
+
+size_t Model::dimension() const {
+    if (impl_.get()) {
+        return impl_->dims;
+    } else {
+        return 0;
+    }
+}
+
+size_t Model::dimension(PredictionType type) const {
+    if (impl_.get()) {
+        return impl_->transform.dimension(type);
+    } else {
+        return 0;
+    }
+}
+
+void Model::set_options(const Options& options) {
+    check_options(options);
+    options_ = options;
+    if (impl_.get()) {
+        impl_->configure(options_);
+    }
+}
+
+void Model::set_kernel(Kernel kernel) {
+    Options options = options_;
+    options.kernel = kernel;
+    set_options(options);
+}
+
+Kernel Model::kernel() const {
+    if (impl_.get()) {
+        return impl_->kernel;
+    } else {
+        return options_.kernel;
+    }
+}
+
+ModelStats Model::stats() const {
+    if (impl_.get()) return impl_->stats();
+
+    ModelStats stats;
+    stats.kernel = options_.kernel;
+    stats.batch_width = options_.batch_width;
+    return stats;
+}
+
+CacheStats Model::cache_stats() const {
+    CacheStats stats;
+    if (impl_.get() && impl_->cache) {
+        stats.hits = impl_->cache->hits();
+        stats.misses = impl_->cache->misses();
+        stats.capacity = impl_->cache->capacity();
+        stats.size = impl_->cache->memory();
+    }
+    return stats;
+}
+
+namespace {
+
+// Trees of a model set used by the same models, compiled into one model.
+// Value d of the part is added to value outputs[d] of the set.
+struct JsonModelPart {
+    JsonModel model;
+    std::vector<size_t> outputs;
+};
+
+// Split trees of several models into parts by models using them. Values of
+// model m are values from offsets[m] to offsets[m + 1] of the set. Oblivious
+// trees with the same splits are joined, even within one model, so they are
+// evaluated once and their leaves have values of every model having them.
+// Non-symmetric trees are added to the part of their model. Scale and bias of
+// models are not applied.
+std::vector<JsonModelPart> split_models(const std::vector<JsonModel>& models, std::vector<size_t>& offsets) {
+    JsonModel common;
+    offsets.assign(1, 0);
+    for (const auto& model : models) {
+        if (model.cat_features.used()) {
+            throw std::runtime_error("Models with categorical features could not be combined");
+        }
+        common.feature_count = std::max(common.feature_count, model.feature_count);
+        offsets.push_back(offsets.back() + model.dims);
+
+        for (size_t f = 0; f < model.nan_right.size(); ++f) {
+            if (f < common.nan_right.size() && common.nan_right[f] != model.nan_right[f]) {
+                throw std::runtime_error("Models treat NaN values of a feature differently");
+            }
+        }
+        if (model.nan_right.size() > common.nan_right.size()) common.nan_right = model.nan_right;
+    }
+    common.cat_features.float_count = common.feature_count;
+
+    // Distinct trees with values of all models and models using them.
+    struct SharedTree {
+        const JsonTree* tree;
+        std::vector<double> values;
+        std::vector<bool> models;
+    };
+    const size_t dims = offsets.back();
+    std::vector<SharedTree> shared;
+    std::map<std::pair<std::vector<uint32_t>, std::vector<float>>, size_t> known;
+    for (size_t m = 0; m < models.size(); ++m) {
+        const size_t model_dims = models[m].dims;
+        for (const auto& tree : models[m].trees) {
+            auto it = known.emplace(std::make_pair(tree.indexes, tree.borders), shared.size()).first;
+            if (it->second == shared.size()) {
+                shared.push_back(SharedTree{&tree, std::vector<double>(tree.values.size() / model_dims * dims, 0.0),
+                                            std::vector<bool>(models.size(), false)});
+            }
+
+            SharedTree& t = shared[it->second];
+            t.models[m] = true;
+            for (size_t leaf = 0; leaf < t.values.size() / dims; ++leaf) {
+                for (size_t d = 0; d < model_dims; ++d) {
+                    t.values[leaf * dims + offsets[m] + d] += tree.values[leaf * model_dims + d];
+                }
+            }
+        }
+    }
+
+    std::vector<JsonModelPart> parts;
+    std::map<std::vector<bool>, size_t> part_index;
+    auto part = [&](const std::vector<bool>& used) -> JsonModelPart& {
+        auto it = part_index.emplace(used, parts.size()).first;
+        if (it->second == parts.size()) {
+            parts.push_back(JsonModelPart{common, {}});
+            for (size_t m = 0; m < models.size(); ++m) {
+                for (size_t d = offsets[m]; used[m] && d < offsets[m + 1]; ++d) parts.back().outputs.push_back(d);
+            }
+            parts.back().model.dims = parts.back().outputs.size();
+            parts.back().model.bias.assign(parts.back().outputs.size(), 0.0);
+        }
+        return parts[it->second];
+    };
+
+    for (const auto& t : shared) {
+        JsonModelPart& p = part(t.models);
+        p.model.trees.push_back(*t.tree);
+        JsonTree& tree = p.model.trees.back();
+        tree.id = static_cast<uint32_t>(p.model.trees.size() - 1);
+        tree.dims = p.outputs.size();
+        tree.weights.clear();
+        tree.values.clear();
+        for (size_t leaf = 0; leaf < t.values.size() / dims; ++leaf) {
+            for (size_t d : p.outputs) tree.values.push_back(t.values[leaf * dims + d]);
+        }
+    }
+
+    for (size_t m = 0; m < models.size(); ++m) {
+        if (models[m].node_trees.empty()) continue;
+        std::vector<bool> used(models.size(), false);
+        used[m] = true;
+        JsonModelPart& p = part(used);
+        p.model.node_trees.insert(p.model.node_trees.end(), models[m].node_trees.begin(), models[m].node_trees.end());
+    }
+
+    // Non-symmetric trees follow oblivious ones.
+    for (auto& p : parts) {
+        for (size_t i = 0; i < p.model.node_trees.size(); ++i) {
+            p.model.node_trees[i].id = static_cast<uint32_t>(p.model.trees.size() + i);
+        }
+    }
+
+    return parts;
+}
+
+// anonymous namespace
+} // namespace
+
+struct ModelSet::Impl {
+    struct Part {
+        std::unique_ptr<Model::Impl> model;
+        // Position of every value of the part in values of the set.
+        std::vector<size_t> outputs;
+    };
+    std::vector<Part> parts;
+    size_t feature_count = 0;
+    // Position of the first value of every model and dimension() at the end.
+    std::vector<size_t> offsets;
+    // Scale and bias of every value.
+    std::vector<double> scale;
+    std::vector<double> bias;
+    std::vector<double> weights;
+
+    Impl(const std::vector<JsonModel>& models, const Options& options) {
+        // Parts are not applied by Model, so they have no cache.
+        Options part_options = options;
+        part_options.cache_size = 0;
+        part_options.dedupe_rows = false;
+        for (auto& p : split_models(models, offsets)) {
+            parts.emplace_back();
+            parts.back().model.reset(new Model::Impl(p.model));
+            parts.back().model->configure(part_options);
+            parts.back().outputs = std::move(p.outputs);
+        }
+        for (size_t m = 0; m < models.size(); ++m) {
+            feature_count = std::max(feature_count, models[m].feature_count);
+            scale.resize(offsets[m + 1], models[m].scale);
+            bias.insert(bias.end(), models[m].bias.begin(), models[m].bias.end());
+        }
+        weights.assign(models.size(), 1.0 / models.size());
+    }
+
+    // Buffer for values of parts.
+    static double* part_buffer(size_t size) {
+        thread_local std::vector<double> buffer;
+        if (buffer.size() < size) buffer.resize(size);
+        return buffer.data();
+    }
+
+    // Values of all models for size examples. Every part is evaluated by
+    // kernels of its dimension, one-dimensional ones by the fastest.
+    void predict(const float* const* f, size_t size, double* out) const noexcept {
+        const size_t dims = bias.size();
+        for (size_t i = 0; i < size; ++i) std::copy(bias.begin(), bias.end(), out + i * dims);
+
+        for (const auto& part : parts) {
+            const size_t part_dims = part.outputs.size();
+            double* values = part_buffer(size * part_dims);
+            if (size == 1) {
+                part.model->predict_multi(*f, values);
+            } else {
+                part.model->predict_multi(f, size, values);
+            }
+            for (size_t i = 0; i < size; ++i) {
+                for (size_t d = 0; d < part_dims; ++d) {
+                    const size_t k = part.outputs[d];
+                    out[i * dims + k] += scale[k] * values[i * part_dims + d];
+                }
+            }
+        }
+    }
+
+    // Weighted sum of values of one-dimensional models.
+    double blend(const double* values) const noexcept {
+        double res = 0.0;
+        for (size_t m = 0; m < weights.size(); ++m) res += weights[m] * values[m];
+        return res;
+    }
+};
+
+ModelSet::ModelSet() {}
+
+ModelSet::ModelSet(const std::vector<std::string>& filenames, const Options& options) { load(filenames, options); }
+
+ModelSet::~ModelSet() {}
+
+void ModelSet::load(const std::vector<std::string>& filenames, const Options& options) {
+    std::vector<std::unique_ptr<std::ifstream>> files;
+    std::vector<std::istream*> models;
+    for (const auto& filename : filenames) {
+        files.emplace_back(new std::ifstream{filename});
+        if (!files.back()->good()) {
+            throw std::runtime_error("Can't open file with model");
+        }
+        models.push_back(files.back().get());
+    }
+
+    load(models, options);
+}
+
+void ModelSet::load(const std::vector<std::istream*>& models, const Options& options) {
+    check_options(options);
+    if (models.empty()) {
+        throw std::runtime_error("Model set is empty");
+    }
+
+    std::vector<JsonModel> jmodels(models.size());
+    for (size_t i = 0; i < models.size(); ++i) jmodels[i].load(nlohmann::json::parse(*models[i]));
+
+    impl_.reset(new Impl(jmodels, options));
+}
+
+size_t ModelSet::size() const { return impl_.get() ? impl_->weights.size() : 0; }
+
+size_t ModelSet::dimension() const { return impl_.get() ? impl_->offsets.back() : 0; }
+
+size_t ModelSet::offset(size_t index) const {
+    if (index > size()) {
+        throw std::runtime_error("Wrong model index");
+    }
+
+    return impl_->offsets[index];
+}
+
+void ModelSet::set_weights(const std::vector<double>& weights) {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (weights.size() != size()) {
+        throw std::runtime_error("Wrong number of weights");
+    }
+
+    impl_->weights = weights;
+}
+
+const std::vector<double>& ModelSet::weights() const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    return impl_->weights;
+}
+
+void ModelSet::apply(const float* features, size_t count, double* out, size_t out_size) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    if (out_size != dimension()) {
+        throw std::runtime_error("Wrong number of model dimensions");
+    }
+
+    impl_->predict(&features, 1, out);
+}
+
+void ModelSet::apply(const float* const* features, size_t size, size_t count, double* out, size_t out_size) const {
+    if (!impl_.get()) {
+        throw std::runtime_error("Model is not loaded");
+    }
+
+    if (count < impl_->feature_count) {
+        throw std::runtime_error("Not enough features");
+    }
+
+    if (out_size != dimension()) {
+        throw std::runtime_error("Wrong number of model dimensions");
+    }
+
+    impl_->predict(features, size, out);
+}
+
+double ModelSet::blend(const float* features, size_t count) const {
+    if (dimension() != size()) {
+        throw std::runtime_error("Models predict several values, blend is not available");
+    }
+
+    double* values = Model::Impl::values_buffer(size());
+    apply(features, count, values, size());
+    return impl_->blend(values);
+}
+
+void ModelSet::blend(const float* const* features, size_t size, size_t count, double* y) const {
+    const size_t dims = dimension();
+    if (dims != this->size()) {
+        throw std::runtime_error("Models predict several values, blend is not available");
+    }
+
+    double* values = Model::Impl::values_buffer(size * dims);
+    apply(features, size, count, values, dims);
+    for (size_t i = 0; i < size; ++i) y[i] = impl_->blend(values + i * dims);
+}
+
+size_t ModelSet::feature_count() const { return impl_.get() ? impl_->feature_count : 0; }
+
+ModelStats ModelSet::stats() const {
+    ModelStats stats;
+    if (!impl_.get()) return stats;
+
+    // Kernels are the ones of the first part, sizes are summed over parts.
+    if (!impl_->parts.empty()) stats = impl_->parts.front().model->stats();
+    for (size_t i = 1; i < impl_->parts.size(); ++i) {
+        const ModelStats part = impl_->parts[i].model->stats();
+        stats.tree_count += part.tree_count;
+        stats.max_depth = std::max(stats.max_depth, part.max_depth);
+        stats.values_size += part.values_size;
+        stats.nonsymmetric_tree_count += part.nonsymmetric_tree_count;
+    }
+    stats.feature_count = impl_->feature_count;
+    stats.dimension = dimension();
+    return stats;
+}
+
+std::ostream& operator<<(std::ostream& out, Kernel kernel) {
+    switch (kernel) {
+        case Kernel::Auto:
+            return out << "auto";
+        case Kernel::Plain:
+            return out << "plain";
+        case Kernel::Pipelined:
+            return out << "pipelined";
+    }
+    return out;
+}
+
+std::ostream& operator<<(std::ostream& out, const ModelStats& stats) {
+    out << "trees: " << stats.tree_count << ", features: " << stats.feature_count;
+    if (stats.used_feature_count != stats.feature_count) {
+        out << " (used: " << stats.used_feature_count << (stats.compact_features ? ", compact)" : ")");
+    }
+    out << ", max depth: " << stats.max_depth << ", values: " << stats.values_size << " bytes"
+        << ", kernel: " << stats.kernel << ", batch width: " << stats.batch_width;
+    if (stats.autotuned) out << " (autotuned)";
+    out << ", tree threads: " << stats.tree_threads;
+    if (stats.nonsymmetric_tree_count) out << ", non-symmetric trees: " << stats.nonsymmetric_tree_count;
+    if (stats.dimension > 1) out << ", dimension: " << stats.dimension;
+    if (stats.cat_feature_count) {
+        out << ", categorical features: " << stats.cat_feature_count << ", CTRs: " << stats.ctr_count;
     }
+    return out;
 }
 
 // namespace catboost
@@ -0,0 +1,175 @@
+#include "catboost.hpp"
+
+#include <cstring>
+#include <utility>
+
+#include "categorical.hpp"
+
+namespace catboost {
+
+namespace {
+
+// CityHash64 from CityHash 1.0, the version CatBoost hashes categorical
+// features with. Later versions of CityHash give different hashes.
+
+constexpr uint64_t k0 = 0xc3a5c85c97cb3127ull;
+constexpr uint64_t k1 = 0xb492b66fbe98f273ull;
+constexpr uint64_t k2 = 0x9ae16a3b2f90404full;
+constexpr uint64_t k3 = 0xc949d7c7509e6557ull;
+
+inline uint64_t fetch64(const char* p) {
+    uint64_t x;
+    std::memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+inline uint32_t fetch32(const char* p) {
+    uint32_t x;
+    std::memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+inline uint64_t rotate(uint64_t x, int shift) { return shift == 0 ? x : ((x >> shift) | (x << (64 - shift))); }
+
+inline uint64_t rotate_by_at_least1(uint64_t x, int shift) { return (x >> shift) | (x << (64 - shift)); }
+
+inline uint64_t shift_mix(uint64_t x) { return x ^ (x >> 47); }
+
+inline uint64_t hash_len16(uint64_t u, uint64_t v) {
+    constexpr uint64_t mul = 0x9ddfea08eb382d69ull;
+    uint64_t a = (u ^ v) * mul;
+    a ^= (a >> 47);
+    uint64_t b = (v ^ a) * mul;
+    b ^= (b >> 47);
+    return b * mul;
+}
+
+uint64_t hash_len0to16(const char* s, size_t len) {
+    if (len > 8) {
+        uint64_t a = fetch64(s);
+        uint64_t b = fetch64(s + len - 8);
+        return hash_len16(a, rotate_by_at_least1(b + len, static_cast<int>(len))) ^ b;
+    }
+    if (len >= 4) {
+        uint64_t a = fetch32(s);
+        return hash_len16(len + (a << 3), fetch32(s + len - 4));
+    }
+    if (len > 0) {
+        uint8_t a = s[0];
+        uint8_t b = s[len >> 1];
+        uint8_t c = s[len - 1];
+        uint32_t y = static_cast<uint32_t>(a) + (static_cast<uint32_t>(b) << 8);
+        uint32_t z = static_cast<uint32_t>(len) + (static_cast<uint32_t>(c) << 2);
+        return shift_mix(y * k2 ^ z * k3) * k2;
+    }
+    return k2;
+}
+
+uint64_t hash_len17to32(const char* s, size_t len) {
+    uint64_t a = fetch64(s) * k1;
+    uint64_t b = fetch64(s + 8);
+    uint64_t c = fetch64(s + len - 8) * k2;
+    uint64_t d = fetch64(s + len - 16) * k0;
+    return hash_len16(rotate(a - b, 43) + rotate(c, 30) + d, a + rotate(b ^ k3, 20) - c + len);
+}
+
+std::pair<uint64_t, uint64_t> weak_hash_len32_with_seeds(const char* s, uint64_t a, uint64_t b) {
+    uint64_t w = fetch64(s);
+    uint64_t x = fetch64(s + 8);
+    uint64_t y = fetch64(s + 16);
+    uint64_t z = fetch64(s + 24);
+    a += w;
+    b = rotate(b + a + z, 21);
+    uint64_t c = a;
+    a += x;
+    a += y;
+    b += rotate(a, 44);
+    return {a + z, b + c};
+}
+
+uint64_t hash_len33to64(const char* s, size_t len) {
+    uint64_t z = fetch64(s + 24);
+    uint64_t a = fetch64(s) + (len + fetch64(s + len - 16)) * k0;
+    uint64_t b = rotate(a + z, 52);
+    uint64_t c = rotate(a, 37);
+    a += fetch64(s + 8);
+    c += rotate(a, 7);
+    a += fetch64(s + 16);
+    uint64_t vf = a + z;
+    uint64_t vs = b + rotate(a, 31) + c;
+    a = fetch64(s + 16) + fetch64(s + len - 32);
+    z = fetch64(s + len - 8);
+    b = rotate(a + z, 52);
+    c = rotate(a, 37);
+    a += fetch64(s + len - 24);
+    c += rotate(a, 7);
+    a += fetch64(s + len - 16);
+    uint64_t wf = a + z;
+    uint64_t ws = b + rotate(a, 31) + c;
+    uint64_t r = shift_mix((vf + ws) * k2 + (wf + vs) * k0);
+    return shift_mix(r * k0 + vs) * k2;
+}
+
+// anonymous namespace
+} // namespace
+
+uint64_t city_hash64(const char* s, size_t len) {
+    if (len <= 32) {
+        return len <= 16 ? hash_len0to16(s, len) : hash_len17to32(s, len);
+    } else if (len <= 64) {
+        return hash_len33to64(s, len);
+    }
+
+    // Strings longer than 64 bytes: hash the end first, then 64-byte chunks
+    // keeping 56 bytes of state.
+    uint64_t x = fetch64(s);
+    uint64_t y = fetch64(s + len - 16) ^ k1;
+    uint64_t z = fetch64(s + len - 56) ^ k0;
+    auto v = weak_hash_len32_with_seeds(s + len - 64, len, y);
+    auto w = weak_hash_len32_with_seeds(s + len - 32, len * k1, k0);
+    z += shift_mix(v.second) * k1;
+    x = rotate(z + x, 39) * k1;
+    y = rotate(y, 33) * k1;
+
+    len = (len - 1) & ~static_cast<size_t>(63);
+    do {
+        x = rotate(x + y + v.first + fetch64(s + 16), 37) * k1;
+        y = rotate(y + v.second + fetch64(s + 48), 42) * k1;
+        x ^= w.second;
+        y ^= v.first;
+        z = rotate(z ^ w.first, 33);
+        v = weak_hash_len32_with_seeds(s, v.second * k1, x + w.first);
+        w = weak_hash_len32_with_seeds(s + 32, z + w.second, y);
+        std::swap(z, x);
+        s += 64;
+        len -= 64;
+    } while (len != 0);
+    return hash_len16(hash_len16(v.first, w.first) + shift_mix(y) * k1 + z, hash_len16(v.second, w.second) + x);
+}
+
+int32_t hash_cat_feature(const char* value, size_t size) {
+    return static_cast<int32_t>(static_cast<uint32_t>(city_hash64(value, size)));
+}
+
+int32_t hash_cat_feature(int64_t value) {
+    // Decimal representation without allocations.
+    char buf[24];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+    uint64_t u = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    do {
+        *--p = static_cast<char>('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (value < 0) *--p = '-';
+    return hash_cat_feature(p, static_cast<size_t>(end - p));
+}
+
+void hash_cat_features(const std::string* values, size_t size, int32_t* out) {
+    // Hashes of different values do not depend on each other, so CPU
+    // overlaps their computation.
+    for (size_t i = 0; i < size; ++i) out[i] = hash_cat_feature(values[i].data(), values[i].size());
+}
+
+// namespace catboost
+} // namespace catboost
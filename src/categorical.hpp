@@ -0,0 +1,272 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+namespace catboost {
+
+/// CityHash64 (version 1.0) used by CatBoost to hash categorical features.
+uint64_t city_hash64(const char* s, size_t len);
+
+namespace {
+
+// Hash of a combination of categorical values, the same as CatBoost uses
+// for CTR tables.
+inline uint64_t calc_hash(uint64_t a, uint64_t b) {
+    static constexpr uint64_t magic = 0x4906ba494954cb65ull;
+    return magic * (a + magic * b);
+}
+
+// Precomputed values of a CTR feature in open addressing hash table with
+// linear probing. The table is at most half full, so probe sequences are
+// short, and lookups do not allocate.
+class CtrTable {
+    struct Slot {
+        uint64_t key = 0;
+        float value = 0.0f;
+        uint32_t used = 0;
+    };
+
+    std::vector<Slot> slots_;
+    size_t mask_ = 0;
+    unsigned shift_ = 63;
+    // Value of unknown categories.
+    float default_ = 0.0f;
+
+    // CTR hashes are products, so their low bits are weak. Take the high
+    // bits of Fibonacci hash instead.
+    size_t slot(uint64_t key) const { return static_cast<size_t>((key * 0x9e3779b97f4a7c15ull) >> shift_); }
+
+public:
+    void build(const std::vector<std::pair<uint64_t, float>>& items, float default_value) {
+        size_t capacity = 2;
+        shift_ = 63;
+        while (capacity < 2 * items.size()) {
+            capacity *= 2;
+            --shift_;
+        }
+        slots_.assign(capacity, Slot{});
+        mask_ = capacity - 1;
+        default_ = default_value;
+
+        for (const auto& item : items) {
+            size_t i = slot(item.first);
+            while (slots_[i].used && slots_[i].key != item.first) i = (i + 1) & mask_;
+            slots_[i] = Slot{item.first, item.second, 1};
+        }
+    }
+
+    void prefetch(uint64_t key) const {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(&slots_[slot(key)]);
+#else
+        (void)key;
+#endif
+    }
+
+    float find(uint64_t key) const noexcept {
+        for (size_t i = slot(key);; i = (i + 1) & mask_) {
+            const Slot& s = slots_[i];
+            if (!s.used) return default_;
+            if (s.key == key) return s.value;
+        }
+    }
+
+    size_t size() const { return slots_.size(); }
+};
+
+// CTR (counter) feature: statistics of target for a combination of
+// categorical features, binarized float features and one-hot values.
+struct CtrFeature {
+    // Indexes of categorical features.
+    std::vector<uint32_t> cats;
+    // Float features compared with borders.
+    std::vector<std::pair<uint32_t, float>> floats;
+    // Categorical features compared with values.
+    std::vector<std::pair<uint32_t, int32_t>> values;
+    CtrTable table;
+    // Index of derived feature.
+    uint32_t index = 0;
+
+    // Hash of combination for an example. Components are hashed in the
+    // same order as CatBoost does: categories, float splits, one-hot values.
+    uint64_t hash(const float* f, const int32_t* cat) const noexcept {
+        uint64_t h = 0;
+        for (uint32_t c : cats) h = calc_hash(h, static_cast<uint64_t>(static_cast<int64_t>(cat[c])));
+        for (const auto& s : floats) h = calc_hash(h, f[s.first] > s.second);
+        for (const auto& v : values) h = calc_hash(h, cat[v.first] == v.second);
+        return h;
+    }
+
+    // Load CTR from its description and CTR data of the model.
+    // @argument ctr - description with combination elements, type, prior,
+    // shift and scale
+    // @argument data - CTR data table: "hash_map" with hash followed by
+    // hash_stride - 1 counters for every combination, and "counter_denominator"
+    CtrFeature(const nlohmann::json& ctr, const nlohmann::json& data, size_t float_count, size_t cat_count) {
+        for (const auto& e : ctr.at("elements")) {
+            const auto type = e.at("combination_element").get<std::string>();
+            if (type == "cat_feature_value") {
+                cats.push_back(e.at("cat_feature_index").get<unsigned>());
+                if (cats.back() >= cat_count) throw std::runtime_error("Invalid model: wrong categorical feature");
+            } else if (type == "float_feature") {
+                floats.emplace_back(e.at("float_feature_index").get<unsigned>(), e.at("border").get<double>());
+                if (floats.back().first >= float_count) throw std::runtime_error("Invalid model: wrong float feature");
+            } else if (type == "cat_feature_exact_value") {
+                values.emplace_back(e.at("cat_feature_index").get<unsigned>(), e.at("value").get<int32_t>());
+                if (values.back().first >= cat_count) {
+                    throw std::runtime_error("Invalid model: wrong categorical feature");
+                }
+            } else {
+                throw std::runtime_error("Invalid model: unsupported CTR element " + type);
+            }
+        }
+
+        const auto type = ctr.at("ctr_type").get<std::string>();
+        const size_t border = ctr.value("target_border_idx", 0u);
+        const float prior_num = ctr.value("prior_numerator", 0.0);
+        const float prior_denom = ctr.value("prior_denomerator", 1.0);
+        const float shift = ctr.value("shift", 0.0);
+        const float scale = ctr.value("scale", 1.0);
+        const float denominator = data.value("counter_denominator", 0.0);
+        const auto& hash_map = data.at("hash_map");
+        const size_t stride = data.at("hash_stride").get<size_t>();
+
+        if (stride < 2 || hash_map.size() % stride) throw std::runtime_error("Invalid model: wrong CTR data");
+        if ((type == "Borders" || type == "Buckets") && border + 1 >= stride) {
+            throw std::runtime_error("Invalid model: wrong CTR target border");
+        }
+
+        // CTR value from counters of combination or zero counters for
+        // unknown combinations. Arithmetic is float as in CatBoost.
+        auto calc = [&](const nlohmann::json* counters) {
+            auto counter = [&](size_t i) { return counters ? counters[i].get<double>() : 0.0; };
+            float good = 0.0f;
+            float total = 0.0f;
+            if (type == "Borders") {
+                for (size_t i = 0; i + 1 < stride; ++i) {
+                    if (i > border) good += counter(i);
+                    total += counter(i);
+                }
+            } else if (type == "Buckets") {
+                for (size_t i = 0; i + 1 < stride; ++i) total += counter(i);
+                good = counter(border);
+            } else if (type == "Counter" || type == "FeatureFreq") {
+                good = counter(0);
+                total = denominator;
+            } else if (type == "BinarizedTargetMeanValue" || type == "FloatTargetMeanValue") {
+                if (stride != 3) throw std::runtime_error("Invalid model: wrong CTR data");
+                good = counter(0);
+                total = counter(1);
+            } else {
+                throw std::runtime_error("Invalid model: unsupported CTR type " + type);
+            }
+            float value = (good + prior_num) / (total + prior_denom);
+            return (value + shift) * scale;
+        };
+
+        std::vector<std::pair<uint64_t, float>> items;
+        items.reserve(hash_map.size() / stride);
+        for (size_t i = 0; i < hash_map.size(); i += stride) {
+            const auto& key = hash_map[i];
+            uint64_t hash = key.is_string() ? std::stoull(key.get<std::string>()) : key.get<uint64_t>();
+            items.emplace_back(hash, calc(&hash_map[i + 1]));
+        }
+        table.build(items, calc(nullptr));
+    }
+};
+
+// Categorical features of a model. Splits on them are replaced with splits
+// on derived float features, which follow float features of the model:
+// one-hot features are 1 if category is equal to the value and 0 otherwise,
+// CTR features are precomputed CTR values. So trees are evaluated by the
+// same kernels as for float features.
+class CatFeatures {
+public:
+    // Number of examples computed together by batch compute.
+    static constexpr size_t max_block = 16;
+
+    struct OneHot {
+        uint32_t cat;
+        int32_t value;
+        // Index of derived feature.
+        uint32_t index;
+    };
+
+    size_t float_count = 0;
+    size_t cat_count = 0;
+    std::vector<OneHot> one_hots;
+    std::vector<CtrFeature> ctrs;
+
+    // Number of float and derived features.
+    size_t width() const { return float_count + one_hots.size() + ctrs.size(); }
+
+    // True if the model has splits on categorical features.
+    bool used() const { return width() != float_count; }
+
+    // Index of derived one-hot feature, which is added if it is new.
+    uint32_t add_one_hot(uint32_t cat, int32_t value) {
+        if (cat >= cat_count) throw std::runtime_error("Invalid model: wrong categorical feature");
+        for (const auto& h : one_hots) {
+            if (h.cat == cat && h.value == value) return h.index;
+        }
+        one_hots.push_back({cat, value, static_cast<uint32_t>(width())});
+        return one_hots.back().index;
+    }
+
+    // Index of derived CTR feature.
+    uint32_t add_ctr(CtrFeature&& ctr) {
+        ctr.index = static_cast<uint32_t>(width());
+        ctrs.push_back(std::move(ctr));
+        return ctrs.back().index;
+    }
+
+    // Write float and derived features of an example to out.
+    // @argument f - float features
+    // @argument cat - hashes of categorical features
+    void compute(const float* f, const int32_t* cat, float* out) const noexcept {
+        std::copy(f, f + float_count, out);
+        for (const auto& h : one_hots) out[h.index] = cat[h.cat] == h.value ? 1.0f : 0.0f;
+
+        // Table slots of several CTRs are prefetched before lookups.
+        uint64_t hashes[max_block];
+        for (size_t i = 0; i < ctrs.size(); i += max_block) {
+            const size_t n = std::min(ctrs.size() - i, size_t{max_block});
+            for (size_t j = 0; j < n; ++j) {
+                hashes[j] = ctrs[i + j].hash(f, cat);
+                ctrs[i + j].table.prefetch(hashes[j]);
+            }
+            for (size_t j = 0; j < n; ++j) out[ctrs[i + j].index] = ctrs[i + j].table.find(hashes[j]);
+        }
+    }
+
+    // Compute features of size examples (at most max_block). Hashes of a
+    // CTR are computed for all examples first and their table slots are
+    // prefetched, so cache misses on large tables overlap.
+    void compute(const float* const* f, const int32_t* const* cat, size_t size, float* const* out) const noexcept {
+        for (size_t i = 0; i < size; ++i) {
+            std::copy(f[i], f[i] + float_count, out[i]);
+            for (const auto& h : one_hots) out[i][h.index] = cat[i][h.cat] == h.value ? 1.0f : 0.0f;
+        }
+
+        uint64_t hashes[max_block];
+        for (const auto& c : ctrs) {
+            for (size_t i = 0; i < size; ++i) {
+                hashes[i] = c.hash(f[i], cat[i]);
+                c.table.prefetch(hashes[i]);
+            }
+            for (size_t i = 0; i < size; ++i) out[i][c.index] = c.table.find(hashes[i]);
+        }
+    }
+};
+
+// anonymous namespace
+} // namespace
+
+// namespace catboost
+} // namespace catboost
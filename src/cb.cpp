@@ -1,7 +1,11 @@
 #include <cb.h>
 #include <catboost.hpp>
+#include <algorithm>
+#include <functional>
 #include <limits>
+#include <memory>
 #include <sstream>
+#include <stdexcept>
 
 // Implementation of the C interface
 
@@ -9,6 +13,25 @@ struct catboost_model_info_st {
     catboost::Model model;
 };
 
+struct catboost_model_set_st {
+    catboost::ModelSet set;
+};
+
+struct catboost_scorer_st {
+    catboost::Scorer scorer;
+};
+
+struct catboost_batching_model_st {
+    catboost::BatchingModel batching;
+
+    catboost_batching_model_st(const catboost::Model& model, const catboost::BatchingOptions& options)
+        : batching(model, options) {}
+};
+
+struct catboost_matrix_st {
+    catboost::FeatureMatrix matrix;
+};
+
 static thread_local std::string cb_last_error;
 
 #define CB_BEGIN try
@@ -59,12 +82,502 @@ extern "C" int cb_model_apply_many(const catboost_model_info_t* model, const flo
     } CB_END(-1);
 }
 
+namespace {
+
+// Executor that runs tasks using C callbacks.
+class CExecutor : public catboost::Executor {
+    const catboost_executor_t* executor_;
+
+    static void run(void* arg) {
+        std::unique_ptr<std::function<void()>> task{static_cast<std::function<void()>*>(arg)};
+        (*task)();
+    }
+
+public:
+    explicit CExecutor(const catboost_executor_t* executor) : executor_(executor) {}
+
+    size_t concurrency() const override { return executor_->concurrency; }
+
+    void submit(std::function<void()> task) override {
+        executor_->submit(executor_->ctx, &CExecutor::run, new std::function<void()>(std::move(task)));
+    }
+};
+
+// Prediction type of C API value.
+catboost::PredictionType prediction_type(catboost_prediction_type_t type) {
+    if (type < CB_RAW_FORMULA_VAL || type > CB_LOG_PROBABILITY) {
+        throw std::runtime_error("Invalid prediction type");
+    }
+    return static_cast<catboost::PredictionType>(type);
+}
+
+// anonymous namespace
+} // namespace
+
+extern "C" int cb_model_apply_parallel(const catboost_model_info_t* model, const float* const* features, size_t size,
+                                       size_t count, double* y, const catboost_executor_t* executor) {
+    CB_BEGIN {
+        if (executor) {
+            CExecutor ex{executor};
+            model->model.apply_parallel(features, size, count, y, &ex);
+        } else {
+            model->model.apply_parallel(features, size, count, y);
+        }
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_apply_multi(const catboost_model_info_t* model, const float* features, size_t count,
+                                    double* out, size_t dims) {
+    CB_BEGIN {
+        model->model.apply(features, count, out, dims);
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_apply_multi_many(const catboost_model_info_t* model, const float* const* features, size_t size,
+                                         size_t count, double* out, size_t dims) {
+    CB_BEGIN {
+        model->model.apply(features, size, count, out, dims);
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_apply_typed(const catboost_model_info_t* model, const float* features, size_t count,
+                                    catboost_prediction_type_t type, double* out, size_t dims) {
+    CB_BEGIN {
+        model->model.apply(features, count, out, dims, prediction_type(type));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_apply_typed_many(const catboost_model_info_t* model, const float* const* features, size_t size,
+                                         size_t count, catboost_prediction_type_t type, double* out, size_t dims) {
+    CB_BEGIN {
+        model->model.apply(features, size, count, out, dims, prediction_type(type));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_apply_double(const catboost_model_info_t* model, const double* features, size_t count,
+                                     catboost_prediction_type_t type, double* out, size_t dims) {
+    CB_BEGIN {
+        model->model.apply(features, count, out, dims, prediction_type(type));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_apply_double_many(const catboost_model_info_t* model, const double* const* features,
+                                          size_t size, size_t count, catboost_prediction_type_t type, double* out,
+                                          size_t dims) {
+    CB_BEGIN {
+        model->model.apply(features, size, count, out, dims, prediction_type(type));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_apply_int32(const catboost_model_info_t* model, const int32_t* features, size_t count,
+                                    catboost_prediction_type_t type, double* out, size_t dims) {
+    CB_BEGIN {
+        model->model.apply(features, count, out, dims, prediction_type(type));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_apply_int32_many(const catboost_model_info_t* model, const int32_t* const* features,
+                                         size_t size, size_t count, catboost_prediction_type_t type, double* out,
+                                         size_t dims) {
+    CB_BEGIN {
+        model->model.apply(features, size, count, out, dims, prediction_type(type));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_apply_fp16(const catboost_model_info_t* model, const uint16_t* features, size_t count,
+                                   catboost_prediction_type_t type, double* out, size_t dims) {
+    CB_BEGIN {
+        auto x = reinterpret_cast<const catboost::Float16*>(features);
+        model->model.apply(x, count, out, dims, prediction_type(type));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_apply_fp16_many(const catboost_model_info_t* model, const uint16_t* const* features,
+                                        size_t size, size_t count, catboost_prediction_type_t type, double* out,
+                                        size_t dims) {
+    CB_BEGIN {
+        auto x = reinterpret_cast<const catboost::Float16* const*>(features);
+        model->model.apply(x, size, count, out, dims, prediction_type(type));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_apply_bf16(const catboost_model_info_t* model, const uint16_t* features, size_t count,
+                                   catboost_prediction_type_t type, double* out, size_t dims) {
+    CB_BEGIN {
+        auto x = reinterpret_cast<const catboost::BFloat16*>(features);
+        model->model.apply(x, count, out, dims, prediction_type(type));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_apply_bf16_many(const catboost_model_info_t* model, const uint16_t* const* features,
+                                        size_t size, size_t count, catboost_prediction_type_t type, double* out,
+                                        size_t dims) {
+    CB_BEGIN {
+        auto x = reinterpret_cast<const catboost::BFloat16* const*>(features);
+        model->model.apply(x, size, count, out, dims, prediction_type(type));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_apply_strided(const catboost_model_info_t* model, const float* features, size_t size,
+                                      size_t count, ptrdiff_t row_stride, ptrdiff_t column_stride,
+                                      catboost_prediction_type_t type, double* out, size_t dims) {
+    CB_BEGIN {
+        model->model.apply_strided(features, size, count, row_stride, column_stride, out, dims, prediction_type(type));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_apply_double_strided(const catboost_model_info_t* model, const double* features,
+                                             size_t size, size_t count, ptrdiff_t row_stride,
+                                             ptrdiff_t column_stride, catboost_prediction_type_t type, double* out,
+                                             size_t dims) {
+    CB_BEGIN {
+        model->model.apply_strided(features, size, count, row_stride, column_stride, out, dims, prediction_type(type));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_set_default_features(catboost_model_info_t* model, const float* defaults, size_t count) {
+    CB_BEGIN {
+        model->model.set_default_features(defaults, count);
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_apply_sparse(const catboost_model_info_t* model, const uint32_t* indexes, const float* values,
+                                     size_t count, catboost_prediction_type_t type, double* out, size_t dims) {
+    CB_BEGIN {
+        model->model.apply_sparse(indexes, values, count, out, dims, prediction_type(type));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_apply_sparse_csr(const catboost_model_info_t* model, const size_t* offsets, size_t size,
+                                         const uint32_t* indexes, const float* values, catboost_prediction_type_t type,
+                                         double* out, size_t dims) {
+    CB_BEGIN {
+        model->model.apply_sparse(offsets, size, indexes, values, out, dims, prediction_type(type));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" catboost_scorer_t* cb_scorer_create(const catboost_model_info_t* model) {
+    CB_BEGIN {
+        return new catboost_scorer_t{catboost::Scorer{model->model}};
+    } CB_END(nullptr)
+}
+
+extern "C" void cb_scorer_free(catboost_scorer_t* scorer) {
+    CB_BEGIN {
+        delete scorer;
+    } CB_END()
+}
+
+extern "C" int cb_scorer_reset(catboost_scorer_t* scorer, const float* features, size_t count) {
+    CB_BEGIN {
+        scorer->scorer.reset(features, count);
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_scorer_update(catboost_scorer_t* scorer, const uint32_t* indexes, const float* values,
+                                size_t count) {
+    CB_BEGIN {
+        scorer->scorer.update(indexes, values, count);
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_scorer_apply(const catboost_scorer_t* scorer, catboost_prediction_type_t type, double* out,
+                               size_t dims) {
+    CB_BEGIN {
+        scorer->scorer.apply(out, dims, prediction_type(type));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int32_t cb_hash_cat_feature(const char* value, size_t size) {
+    return catboost::hash_cat_feature(value, size);
+}
+
+extern "C" double cb_model_apply_cat(const catboost_model_info_t* model, const float* features, size_t count,
+                                     const int32_t* cat_features, size_t cat_count) {
+    CB_BEGIN {
+        return model->model.apply(features, count, cat_features, cat_count);
+    } CB_END(std::numeric_limits<double>::quiet_NaN())
+}
+
+extern "C" int cb_model_apply_cat_many(const catboost_model_info_t* model, const float* const* features, size_t size,
+                                       size_t count, const int32_t* const* cat_features, size_t cat_count, double* y) {
+    CB_BEGIN {
+        model->model.apply(features, size, count, cat_features, cat_count, y);
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" size_t cb_model_cat_feature_count(const catboost_model_info_t* model) {
+    CB_BEGIN {
+        return model->model.cat_feature_count();
+    } CB_END(0)
+}
+
+extern "C" size_t cb_model_dimension(const catboost_model_info_t* model) {
+    CB_BEGIN {
+        return model->model.dimension();
+    } CB_END(0)
+}
+
+extern "C" size_t cb_model_prediction_dimension(const catboost_model_info_t* model, catboost_prediction_type_t type) {
+    CB_BEGIN {
+        return model->model.dimension(prediction_type(type));
+    } CB_END(0)
+}
+
+extern "C" size_t cb_model_shap_size(const catboost_model_info_t* model) {
+    CB_BEGIN {
+        return model->model.shap_size();
+    } CB_END(0)
+}
+
+extern "C" int cb_model_shap_values(const catboost_model_info_t* model, const float* features, size_t count,
+                                    double* out, size_t out_size) {
+    CB_BEGIN {
+        model->model.shap_values(features, count, out, out_size);
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_shap_values_many(const catboost_model_info_t* model, const float* const* features, size_t size,
+                                         size_t count, double* out, size_t out_size) {
+    CB_BEGIN {
+        model->model.shap_values(features, size, count, out, out_size);
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_shap_values_parallel(const catboost_model_info_t* model, const float* const* features,
+                                             size_t size, size_t count, double* out, size_t out_size,
+                                             const catboost_executor_t* executor) {
+    CB_BEGIN {
+        if (executor) {
+            CExecutor ex{executor};
+            model->model.shap_values_parallel(features, size, count, out, out_size, &ex);
+        } else {
+            model->model.shap_values_parallel(features, size, count, out, out_size);
+        }
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_shap_values_cat(const catboost_model_info_t* model, const float* features, size_t count,
+                                        const int32_t* cat_features, size_t cat_count, double* out, size_t out_size) {
+    CB_BEGIN {
+        model->model.shap_values(features, count, cat_features, cat_count, out, out_size);
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" size_t cb_model_tree_count(const catboost_model_info_t* model) {
+    CB_BEGIN {
+        return model->model.tree_count();
+    } CB_END(0)
+}
+
+extern "C" int cb_model_calc_leaf_indexes(const catboost_model_info_t* model, const float* features, size_t count,
+                                          uint16_t* out, size_t out_size, size_t begin, size_t end) {
+    CB_BEGIN {
+        model->model.calc_leaf_indexes(features, count, out, out_size, begin, end);
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_calc_leaf_indexes_many(const catboost_model_info_t* model, const float* const* features,
+                                               size_t size, size_t count, uint16_t* out, size_t out_size,
+                                               size_t begin, size_t end) {
+    CB_BEGIN {
+        model->model.calc_leaf_indexes(features, size, count, out, out_size, begin, end);
+        return 0;
+    } CB_END(-1);
+}
+
 extern "C" size_t cb_model_feature_count(const catboost_model_info_t* model) {
     CB_BEGIN {
         return model->model.feature_count();
     } CB_END(0)
 }
 
+extern "C" catboost_model_info_t* cb_model_specialize(const catboost_model_info_t* model, const uint32_t* indexes,
+                                                      const float* values, size_t count) {
+    CB_BEGIN {
+        auto res = std::make_unique<catboost_model_info_t>();
+        model->model.specialize(indexes, values, count, res->model);
+        return res.release();
+    } CB_END(nullptr)
+}
+
+extern "C" size_t cb_model_used_features(const catboost_model_info_t* model, uint32_t* out, size_t size) {
+    CB_BEGIN {
+        const auto used = model->model.used_features();
+        std::copy(used.begin(), used.begin() + std::min(size, used.size()), out);
+        return used.size();
+    } CB_END(0)
+}
+
+extern "C" int cb_model_set_cache(catboost_model_info_t* model, size_t size, int dedupe_rows) {
+    CB_BEGIN {
+        catboost::Options options = model->model.options();
+        options.cache_size = size;
+        options.dedupe_rows = dedupe_rows != 0;
+        model->model.set_options(options);
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_cache_stats(const catboost_model_info_t* model, uint64_t* hits, uint64_t* misses) {
+    CB_BEGIN {
+        const catboost::CacheStats stats = model->model.cache_stats();
+        if (hits) *hits = stats.hits;
+        if (misses) *misses = stats.misses;
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_submit(const catboost_model_info_t* model, const float* features, size_t count,
+                               catboost_prediction_type_t type, double* out, size_t dims, void (*done)(void* cookie),
+                               void* cookie) {
+    CB_BEGIN {
+        model->model.apply_async(features, count, out, dims, [done, cookie] { done(cookie); }, prediction_type(type));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" catboost_batching_model_t* cb_batching_model_create(const catboost_model_info_t* model, size_t max_batch,
+                                                               size_t latency_budget_us) {
+    CB_BEGIN {
+        catboost::BatchingOptions options;
+        options.max_batch = max_batch;
+        options.latency_budget_us = latency_budget_us;
+        return new catboost_batching_model_t{model->model, options};
+    } CB_END(nullptr)
+}
+
+extern "C" void cb_batching_model_free(catboost_batching_model_t* batching) {
+    CB_BEGIN {
+        delete batching;
+    } CB_END()
+}
+
+extern "C" int cb_batching_model_apply(const catboost_batching_model_t* batching, const float* features,
+                                       size_t count, catboost_prediction_type_t type, double* out, size_t dims) {
+    CB_BEGIN {
+        batching->batching.apply(features, count, out, dims, prediction_type(type));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" catboost_matrix_t* cb_matrix_load(const char* filename) {
+    CB_BEGIN {
+        auto matrix = std::make_unique<catboost_matrix_t>();
+        matrix->matrix.load(filename);
+        return matrix.release();
+    } CB_END(nullptr)
+}
+
+extern "C" void cb_matrix_free(catboost_matrix_t* matrix) {
+    CB_BEGIN {
+        delete matrix;
+    } CB_END()
+}
+
+extern "C" size_t cb_matrix_rows(const catboost_matrix_t* matrix) { return matrix->matrix.rows(); }
+
+extern "C" size_t cb_matrix_features(const catboost_matrix_t* matrix) { return matrix->matrix.features(); }
+
+extern "C" const float* cb_matrix_data(const catboost_matrix_t* matrix, ptrdiff_t* row_stride,
+                                       ptrdiff_t* column_stride) {
+    if (row_stride) *row_stride = matrix->matrix.row_stride();
+    if (column_stride) *column_stride = matrix->matrix.column_stride();
+    return matrix->matrix.data();
+}
+
+extern "C" const double* cb_matrix_label(const catboost_matrix_t* matrix) { return matrix->matrix.label(); }
+
+extern "C" int cb_model_apply_matrix(const catboost_model_info_t* model, const catboost_matrix_t* matrix,
+                                     catboost_prediction_type_t type, double* out, size_t dims,
+                                     const catboost_executor_t* executor) {
+    CB_BEGIN {
+        if (executor) {
+            CExecutor ex{executor};
+            model->model.apply_parallel(matrix->matrix, out, dims, &ex, prediction_type(type));
+        } else {
+            model->model.apply_parallel(matrix->matrix, out, dims, nullptr, prediction_type(type));
+        }
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" catboost_model_set_t* cb_model_set_load(const char* const* filenames, size_t count) {
+    CB_BEGIN {
+        auto set = std::make_unique<catboost_model_set_t>();
+        set->set.load(std::vector<std::string>(filenames, filenames + count));
+        return set.release();
+    } CB_END(nullptr)
+}
+
+extern "C" void cb_model_set_free(catboost_model_set_t* set) {
+    CB_BEGIN {
+        delete set;
+    } CB_END()
+}
+
+extern "C" size_t cb_model_set_dimension(const catboost_model_set_t* set) {
+    CB_BEGIN {
+        return set->set.dimension();
+    } CB_END(0)
+}
+
+extern "C" int cb_model_set_apply(const catboost_model_set_t* set, const float* features, size_t count, double* out,
+                                  size_t out_size) {
+    CB_BEGIN {
+        set->set.apply(features, count, out, out_size);
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_set_apply_many(const catboost_model_set_t* set, const float* const* features, size_t size,
+                                       size_t count, double* out, size_t out_size) {
+    CB_BEGIN {
+        set->set.apply(features, size, count, out, out_size);
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" int cb_model_set_weights(catboost_model_set_t* set, const double* weights, size_t count) {
+    CB_BEGIN {
+        set->set.set_weights(std::vector<double>(weights, weights + count));
+        return 0;
+    } CB_END(-1);
+}
+
+extern "C" double cb_model_set_blend(const catboost_model_set_t* set, const float* features, size_t count) {
+    CB_BEGIN {
+        return set->set.blend(features, count);
+    } CB_END(std::numeric_limits<double>::quiet_NaN())
+}
+
 const char* cb_model_last_error(void) {
     return cb_last_error.c_str();
 }
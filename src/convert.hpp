@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "catboost.hpp"
+#include "vec4.hpp"
+
+#if !defined(NOSSE) && defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace catboost {
+
+namespace {
+
+// Conversion of features of other types to float. Values are rounded as by
+// static_cast: double and int32_t values which are not representable are
+// rounded to nearest with ties to even, half and bfloat16 values are exact.
+// Vector versions give the same results as scalar ones.
+
+inline float float_from_bits(uint32_t bits) {
+    float x;
+    std::memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+inline uint32_t float_bits(float x) {
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+// Exponent and mantissa of a half are moved to their places in float and the
+// exponent is rebiased by multiplication by 2^112, which is exact for normal
+// and subnormal halves. Infinities and NaN get the exponent of all ones, and
+// NaN are made quiet as by F16C.
+constexpr uint32_t half_rebias = 0x77800000; // 2^112
+constexpr uint32_t half_inf = 0x7c00;
+
+inline float to_float(double x) { return static_cast<float>(x); }
+
+inline float to_float(int32_t x) { return static_cast<float>(x); }
+
+inline float to_float(BFloat16 x) { return float_from_bits(uint32_t{x.bits} << 16); }
+
+inline float to_float(Float16 x) {
+    const uint32_t em = x.bits & 0x7fffu;
+    uint32_t bits = em << 13;
+    if (em > half_inf) {
+        bits |= 0x7fc00000u;
+    } else if (em == half_inf) {
+        bits |= 0x7f800000u;
+    } else {
+        bits = float_bits(float_from_bits(bits) * float_from_bits(half_rebias));
+    }
+    return float_from_bits(bits | (uint32_t{x.bits} & 0x8000u) << 16);
+}
+
+#ifdef NOSSE
+
+template <typename T>
+void convert(const T* in, size_t count, float* out) {
+    for (size_t i = 0; i < count; ++i) out[i] = to_float(in[i]);
+}
+
+#else
+
+// Four values of every type are converted by one vector operation, the rest
+// one by one.
+inline __m128 convert4(const double* in) {
+    return _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(in)), _mm_cvtpd_ps(_mm_loadu_pd(in + 2)));
+}
+
+inline __m128 convert4(const int32_t* in) {
+    return _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)));
+}
+
+inline __m128 convert4(const BFloat16* in) {
+    __m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in));
+    return _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), x));
+}
+
+inline __m128 convert4(const Float16* in) {
+    __m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in));
+#ifdef __F16C__
+    return _mm_cvtph_ps(x);
+#else
+    x = _mm_cvtepu16_epi32(x);
+    __m128i em = _mm_and_si128(x, _mm_set1_epi32(0x7fff));
+    __m128i sign = _mm_slli_epi32(_mm_xor_si128(x, em), 16);
+    __m128i bits = _mm_slli_epi32(em, 13);
+    __m128 normal = _mm_mul_ps(_mm_castsi128_ps(bits), _mm_castsi128_ps(_mm_set1_epi32(half_rebias)));
+    __m128i quiet = _mm_and_si128(_mm_cmpgt_epi32(em, _mm_set1_epi32(half_inf)), _mm_set1_epi32(0x00400000));
+    __m128 special = _mm_castsi128_ps(_mm_or_si128(_mm_or_si128(bits, quiet), _mm_set1_epi32(0x7f800000)));
+    __m128 mask = _mm_castsi128_ps(_mm_cmpgt_epi32(em, _mm_set1_epi32(half_inf - 1)));
+    return _mm_or_ps(_mm_blendv_ps(normal, special, mask), _mm_castsi128_ps(sign));
+#endif
+}
+
+template <typename T>
+void convert(const T* in, size_t count, float* out) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) _mm_storeu_ps(out + i, convert4(in + i));
+    for (; i < count; ++i) out[i] = to_float(in[i]);
+}
+
+// NOSSE
+#endif
+
+// anonymous namespace
+} // namespace
+
+// namespace catboost
+} // namespace catboost
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CATBOOST_MMAP
+#endif
+
+namespace catboost {
+
+namespace {
+
+// Read-only contents of a whole file. The file is mapped into memory where
+// mmap is available and read into a buffer aligned for doubles otherwise.
+// Files read by one pass could be mapped with the sequential hint.
+class MappedFile {
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef CATBOOST_MMAP
+    bool mapped_ = false;
+#endif
+    std::unique_ptr<double[]> buffer_;
+
+public:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    explicit MappedFile(const std::string& filename, bool sequential = false) {
+#ifdef CATBOOST_MMAP
+        const int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) throw std::runtime_error("Can't open " + filename + ": " + std::strerror(errno));
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Can't stat " + filename + ": " + std::strerror(errno));
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0) {
+            void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Can't map " + filename + ": " + std::strerror(errno));
+            }
+            if (sequential) madvise(p, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<const char*>(p);
+            mapped_ = true;
+        }
+        ::close(fd);
+#else
+        (void)sequential;
+        std::ifstream in{filename, std::ios::binary | std::ios::ate};
+        if (!in) throw std::runtime_error("Can't open " + filename);
+        size_ = static_cast<size_t>(in.tellg());
+        buffer_.reset(new double[(size_ + sizeof(double) - 1) / sizeof(double)]);
+        in.seekg(0);
+        if (!in.read(reinterpret_cast<char*>(buffer_.get()), static_cast<std::streamsize>(size_))) {
+            throw std::runtime_error("Can't read " + filename);
+        }
+        data_ = reinterpret_cast<const char*>(buffer_.get());
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef CATBOOST_MMAP
+        if (mapped_) munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+};
+
+// anonymous namespace
+} // namespace
+
+} // namespace catboost
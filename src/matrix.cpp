@@ -0,0 +1,183 @@
+#include "catboost.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+namespace catboost {
+
+namespace {
+
+constexpr char matrix_magic[8] = {'C', 'B', 'M', 'A', 'T', 'R', 'I', 'X'};
+constexpr uint32_t matrix_version = 1;
+// Columns are padded to this number of values.
+constexpr uint64_t matrix_alignment = 64 / sizeof(float);
+
+uint64_t round_up(uint64_t x, uint64_t to) { return (x + to - 1) / to * to; }
+
+} // namespace
+
+struct FeatureMatrix::Impl {
+    MatrixHeader header;
+    std::unique_ptr<MappedFile> file;
+    const char* base = nullptr;
+    size_t size = 0;
+
+    void open(const std::string& filename) {
+        file.reset(new MappedFile{filename});
+        base = file->data();
+        size = file->size();
+        if (size < sizeof(MatrixHeader)) throw std::runtime_error("Invalid feature matrix: file is too short");
+        std::memcpy(&header, base, sizeof(header));
+        validate();
+    }
+
+    void validate() const {
+        if (std::memcmp(header.magic, matrix_magic, sizeof(matrix_magic)) != 0) {
+            throw std::runtime_error("Invalid feature matrix: wrong magic");
+        }
+
+        if (header.version != matrix_version) {
+            throw std::runtime_error("Invalid feature matrix: unsupported version " + std::to_string(header.version));
+        }
+
+        if (header.layout > static_cast<uint32_t>(MatrixLayout::Rows)) {
+            throw std::runtime_error("Invalid feature matrix: unknown layout");
+        }
+
+        if (header.rows > size || header.features > size ||
+            (header.rows && header.features > size / header.rows)) {
+            throw std::runtime_error("Invalid feature matrix: dimensions do not fit the file");
+        }
+
+        const MatrixHeader expected = FeatureMatrix::header(header.rows, header.features,
+                                                            static_cast<MatrixLayout>(header.layout),
+                                                            header.label_offset != 0);
+        if (header.stride != expected.stride || header.label_offset != expected.label_offset ||
+            header.size != expected.size || header.size != size) {
+            throw std::runtime_error("Invalid feature matrix: wrong size");
+        }
+    }
+};
+
+FeatureMatrix::FeatureMatrix() {}
+
+FeatureMatrix::FeatureMatrix(const std::string& filename) { load(filename); }
+
+FeatureMatrix::FeatureMatrix(FeatureMatrix&& other) noexcept : impl_(std::move(other.impl_)) {}
+
+FeatureMatrix& FeatureMatrix::operator=(FeatureMatrix&& other) noexcept {
+    impl_ = std::move(other.impl_);
+    return *this;
+}
+
+FeatureMatrix::~FeatureMatrix() {}
+
+void FeatureMatrix::load(const std::string& filename) {
+    std::unique_ptr<Impl> impl{new Impl};
+    impl->open(filename);
+    impl_ = std::move(impl);
+}
+
+size_t FeatureMatrix::rows() const { return impl_ ? static_cast<size_t>(impl_->header.rows) : 0; }
+
+size_t FeatureMatrix::features() const { return impl_ ? static_cast<size_t>(impl_->header.features) : 0; }
+
+MatrixLayout FeatureMatrix::layout() const {
+    return impl_ ? static_cast<MatrixLayout>(impl_->header.layout) : MatrixLayout::Columns;
+}
+
+const float* FeatureMatrix::data() const {
+    return impl_ ? reinterpret_cast<const float*>(impl_->base + sizeof(MatrixHeader)) : nullptr;
+}
+
+ptrdiff_t FeatureMatrix::row_stride() const {
+    return layout() == MatrixLayout::Rows ? static_cast<ptrdiff_t>(impl_->header.stride) : 1;
+}
+
+ptrdiff_t FeatureMatrix::column_stride() const {
+    return layout() == MatrixLayout::Columns && impl_ ? static_cast<ptrdiff_t>(impl_->header.stride) : 1;
+}
+
+const float* FeatureMatrix::row(size_t i) const {
+    if (layout() != MatrixLayout::Rows) {
+        throw std::runtime_error("Feature matrix is stored by columns");
+    }
+
+    return data() + i * row_stride();
+}
+
+const float* FeatureMatrix::column(size_t j) const {
+    if (layout() != MatrixLayout::Columns) {
+        throw std::runtime_error("Feature matrix is stored by rows");
+    }
+
+    return data() + j * column_stride();
+}
+
+const double* FeatureMatrix::label() const {
+    if (!impl_ || !impl_->header.label_offset) return nullptr;
+    return reinterpret_cast<const double*>(impl_->base + impl_->header.label_offset);
+}
+
+MatrixHeader FeatureMatrix::header(size_t rows, size_t features, MatrixLayout layout, bool has_label) {
+    MatrixHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, matrix_magic, sizeof(matrix_magic));
+    h.version = matrix_version;
+    h.layout = static_cast<uint32_t>(layout);
+    h.rows = rows;
+    h.features = features;
+
+    uint64_t lines = 0;
+    if (layout == MatrixLayout::Columns) {
+        h.stride = round_up(rows, matrix_alignment);
+        lines = features;
+    } else {
+        h.stride = features;
+        lines = rows;
+    }
+
+    h.size = sizeof(MatrixHeader) + lines * h.stride * sizeof(float);
+    if (has_label) {
+        h.label_offset = round_up(h.size, 64);
+        h.size = h.label_offset + rows * sizeof(double);
+    }
+    return h;
+}
+
+void FeatureMatrix::write(const std::string& filename, const float* features, size_t rows, size_t count,
+                          ptrdiff_t row_stride, ptrdiff_t column_stride, const double* label, MatrixLayout layout) {
+    const MatrixHeader h = header(rows, count, layout, label != nullptr);
+    std::ofstream out{filename, std::ios::binary | std::ios::trunc};
+    if (!out) throw std::runtime_error("Can't open " + filename);
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+    // Lines are written one by one, padding is zero.
+    const size_t lines = layout == MatrixLayout::Columns ? count : rows;
+    const size_t length = layout == MatrixLayout::Columns ? rows : count;
+    const ptrdiff_t line_step = layout == MatrixLayout::Columns ? column_stride : row_stride;
+    const ptrdiff_t value_step = layout == MatrixLayout::Columns ? row_stride : column_stride;
+    std::vector<float> line(h.stride, 0.0f);
+    for (size_t l = 0; l < lines; ++l) {
+        const float* p = features + static_cast<ptrdiff_t>(l) * line_step;
+        for (size_t k = 0; k < length; ++k) line[k] = p[static_cast<ptrdiff_t>(k) * value_step];
+        out.write(reinterpret_cast<const char*>(line.data()), static_cast<std::streamsize>(h.stride * sizeof(float)));
+    }
+
+    if (label) {
+        const uint64_t padding = h.label_offset - (sizeof(h) + lines * h.stride * sizeof(float));
+        const char zeros[64] = {};
+        out.write(zeros, static_cast<std::streamsize>(padding));
+        out.write(reinterpret_cast<const char*>(label), static_cast<std::streamsize>(rows * sizeof(double)));
+    }
+
+    out.close();
+    if (!out) throw std::runtime_error("Can't write " + filename);
+}
+
+} // namespace catboost
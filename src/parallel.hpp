@@ -0,0 +1,244 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "catboost.hpp"
+
+namespace catboost {
+
+/// Number of CPUs available to the process. Respects CPU affinity and
+/// cgroup CPU quota.
+size_t available_cpus();
+
+namespace {
+
+// Work stealing loop over [0, count). Each participant owns a range of
+// indexes and takes them from the front. When its range is empty it steals
+// the back half of a range of another participant. The first exception of
+// the body is kept, and indexes not taken yet are abandoned.
+class ParallelFor {
+    // Range is packed into one word: begin in the low half and end in the
+    // high half. Padding puts ranges into different cache lines.
+    struct Range {
+        std::atomic<uint64_t> range{0};
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    static uint64_t pack(uint64_t begin, uint64_t end) { return begin | (end << 32); }
+    static uint64_t begin(uint64_t r) { return r & 0xffffffffu; }
+    static uint64_t end(uint64_t r) { return r >> 32; }
+
+    std::unique_ptr<Range[]> ranges_;
+    size_t participants_;
+    size_t count_;
+    std::function<void(size_t)> body_;
+
+    std::atomic<size_t> done_{0};
+    std::atomic<bool> failed_{false};
+    std::exception_ptr error_;
+    std::mutex mutex_;
+    std::condition_variable finished_;
+
+    // Count n indexes as processed.
+    void finish(size_t n) {
+        if (done_.fetch_add(n, std::memory_order_acq_rel) + n == count_) {
+            std::lock_guard<std::mutex> lock{mutex_};
+            finished_.notify_all();
+        }
+    }
+
+    // Keep the first error and abandon indexes left in ranges. Indexes
+    // already moved by thieves are skipped when they are taken.
+    void fail(std::exception_ptr error) {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            if (!error_) error_ = error;
+        }
+        failed_.store(true);
+
+        size_t abandoned = 0;
+        for (size_t i = 0; i < participants_; ++i) {
+            auto& range = ranges_[i].range;
+            uint64_t r = range.load(std::memory_order_acquire);
+            while (begin(r) < end(r)) {
+                if (range.compare_exchange_weak(r, pack(end(r), end(r)), std::memory_order_acq_rel)) {
+                    abandoned += end(r) - begin(r);
+                    break;
+                }
+            }
+        }
+        finish(abandoned);
+    }
+
+    // Take one index from the front of own range.
+    bool pop(size_t self, size_t& index) {
+        auto& range = ranges_[self].range;
+        uint64_t r = range.load(std::memory_order_acquire);
+        while (begin(r) < end(r)) {
+            if (range.compare_exchange_weak(r, pack(begin(r) + 1, end(r)), std::memory_order_acq_rel)) {
+                index = begin(r);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Move the back half of some other range into own (empty) range.
+    bool steal(size_t self) {
+        for (size_t i = 1; i < participants_; ++i) {
+            auto& victim = ranges_[(self + i) % participants_].range;
+            uint64_t r = victim.load(std::memory_order_acquire);
+            while (begin(r) < end(r)) {
+                uint64_t middle = begin(r) + (end(r) - begin(r)) / 2;
+                if (victim.compare_exchange_weak(r, pack(begin(r), middle), std::memory_order_acq_rel)) {
+                    ranges_[self].range.store(pack(middle, end(r)), std::memory_order_release);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+public:
+    ParallelFor(size_t participants, size_t count, std::function<void(size_t)> body)
+        : ranges_(new Range[participants]), participants_(participants), count_(count), body_(std::move(body)) {
+        for (size_t i = 0; i < participants; ++i) {
+            ranges_[i].range.store(pack(count * i / participants, count * (i + 1) / participants));
+        }
+    }
+
+    // Process indexes until there is nothing to steal.
+    void work(size_t self) {
+        size_t index = 0;
+        for (;;) {
+            while (pop(self, index)) {
+                if (!failed_.load(std::memory_order_relaxed)) {
+                    try {
+                        body_(index);
+                    } catch (...) {
+                        fail(std::current_exception());
+                    }
+                }
+                finish(1);
+            }
+
+            if (!steal(self)) return;
+        }
+    }
+
+    // Wait until all indexes are processed or abandoned and rethrow the
+    // first error of the body.
+    void wait() {
+        std::unique_lock<std::mutex> lock{mutex_};
+        finished_.wait(lock, [this] { return done_.load(std::memory_order_acquire) == count_; });
+        if (error_) std::rethrow_exception(error_);
+    }
+};
+
+// Hint CPU that we are spinning.
+inline void cpu_relax() {
+#ifdef __SSE2__
+    _mm_pause();
+#endif
+}
+
+// Sleep while value is equal to expected. Could return spuriously.
+inline void futex_wait(std::atomic<uint32_t>& value, uint32_t expected) {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&value), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+    (void)value;
+    (void)expected;
+    std::this_thread::yield();
+#endif
+}
+
+// Wake all threads sleeping in futex_wait on value.
+inline void futex_wake(std::atomic<uint32_t>& value) {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&value), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#else
+    (void)value;
+#endif
+}
+
+// Value that could be waited for. Waiting thread spins for a while and then
+// sleeps, so short waits do not pay for system calls, and notification costs
+// a system call only when somebody sleeps.
+class Signal {
+    // Number of spins before sleeping.
+    static constexpr int spin_count = 4000;
+
+    std::atomic<uint32_t> value_{0};
+    std::atomic<uint32_t> sleepers_{0};
+
+public:
+    uint32_t load() const { return value_.load(std::memory_order_acquire); }
+
+    // Set new value and wake waiting threads.
+    void store(uint32_t value) {
+        value_.store(value);
+        if (sleepers_.load()) futex_wake(value_);
+    }
+
+    // Wait until value differs from old and return it.
+    uint32_t wait(uint32_t old) {
+        for (int i = 0; i < spin_count; ++i) {
+            uint32_t v = load();
+            if (v != old) return v;
+            cpu_relax();
+        }
+
+        for (;;) {
+            sleepers_.fetch_add(1);
+            if (value_.load() == old) futex_wait(value_, old);
+            sleepers_.fetch_sub(1);
+            uint32_t v = load();
+            if (v != old) return v;
+        }
+    }
+};
+
+// Run body(i) for i in [0, count) on the calling thread and executor threads.
+// Returns when all calls are finished. If the body throws, indexes not taken
+// yet are skipped and the first exception is rethrown by the calling thread.
+inline void parallel_for(Executor& executor, size_t count, std::function<void(size_t)> body) {
+    size_t participants = std::min(executor.concurrency() + 1, count);
+    if (participants <= 1) {
+        for (size_t i = 0; i < count; ++i) body(i);
+        return;
+    }
+
+    // Helpers could start after all work is done, so they share the state.
+    auto state = std::make_shared<ParallelFor>(participants, count, std::move(body));
+    for (size_t i = 1; i < participants; ++i) {
+        executor.submit([state, i] { state->work(i); });
+    }
+
+    state->work(0);
+    state->wait();
+}
+
+// anonymous namespace
+} // namespace
+
+// namespace catboost
+} // namespace catboost
@@ -0,0 +1,422 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include "categorical.hpp"
+
+namespace catboost {
+
+namespace {
+
+// SHAP values of oblivious trees computed by path-dependent TreeSHAP, which
+// uses leaf weights as covers. All nodes of a level of an oblivious tree
+// split by the same feature, so SHAP values of an example depend on its leaf
+// only. They are precomputed for every leaf of trees up to table_depth, and
+// explanation adds table rows of the leaves of the example.
+//
+// Players of the game are classes of features rather than derived features:
+// float features, categorical features of one-hot splits and combinations of
+// features of CTRs. Derived features with the same set of original features
+// are one class, and contribution of a class is shared equally by its
+// features, as CatBoost does.
+class ShapTrees {
+public:
+    // Trees deeper than this are explained without tables: a table has
+    // 2^depth rows and takes about 3^depth steps per row to compute.
+    static constexpr size_t table_depth = 8;
+    // Distance in trees to prefetch table rows ahead.
+    static constexpr size_t row_lookahead = 8;
+
+private:
+    struct Tree {
+        uint32_t depth = 0;
+        // Classes of features of the tree and levels of every class as a
+        // bit mask. Level i is split i of the tree, bit i of leaf index.
+        std::vector<uint32_t> classes;
+        std::vector<uint32_t> levels;
+        // Leaf weights, which are dropped when the tree is prepared.
+        std::vector<double> weights;
+        // Leaf values, dims values per leaf.
+        const double* values = nullptr;
+        // Products of cover fractions of levels of every class on the path to
+        // every leaf: zeros[leaf * classes + j]. Kept for trees without table.
+        std::vector<double> zeros;
+        // SHAP values of classes for every leaf: table[(leaf * classes + j) * dims + d].
+        // It is moved to the flat array of tables when all trees are prepared.
+        std::vector<double> table;
+        bool tabled = false;
+    };
+
+    // Position of table and classes of a tree in flat arrays, so they are
+    // read sequentially by explanations.
+    struct Slice {
+        // Position of the table, no_table for trees without one.
+        size_t table = 0;
+        // Position and number of classes.
+        uint32_t classes = 0;
+        uint32_t count = 0;
+    };
+    static constexpr size_t no_table = SIZE_MAX;
+
+    size_t dims_ = 1;
+    // Original features (float ones followed by categorical ones) of every class.
+    std::vector<std::vector<uint32_t>> members_;
+    // Class of every derived feature.
+    std::vector<uint32_t> feature_classes_;
+    std::vector<Tree> trees_;
+    std::vector<Slice> slices_;
+    std::vector<uint32_t> classes_;
+    std::vector<double> tables_;
+    // Sum of expected values of trees.
+    std::vector<double> expected_;
+
+    // Fractions of covers of nodes on the path to every leaf and the expected
+    // value of the tree. CatBoost evaluates the last split of an oblivious
+    // tree first, so the root splits by the high bit of leaf index, and node
+    // of depth t on the path to leaf b has prefix b >> (depth - t).
+    void prepare_zeros(Tree& t, double* expected) const {
+        const size_t leaves = size_t{1} << t.depth;
+        const size_t k = t.classes.size();
+
+        // Covers of nodes in heap order: node of depth t with prefix p is at
+        // (1 << t) - 1 + p.
+        std::vector<double> covers(2 * leaves - 1);
+        std::copy(t.weights.begin(), t.weights.end(), covers.begin() + (leaves - 1));
+        for (size_t node = leaves - 1; node-- > 0;) covers[node] = covers[2 * node + 1] + covers[2 * node + 2];
+
+        t.zeros.assign(leaves * k, 1.0);
+        for (size_t b = 0; b < leaves; ++b) {
+            double* z = &t.zeros[b * k];
+            for (uint32_t l = 0; l < t.depth; ++l) {
+                const size_t level = t.depth - 1 - l;
+                const double parent = covers[(size_t{1} << level) - 1 + (b >> (l + 1))];
+                const double child = covers[(size_t{1} << (level + 1)) - 1 + (b >> l)];
+                // Subtrees without training examples are never reached by
+                // expectations, any fraction keeps SHAP values consistent.
+                const double fraction = parent > 0.0 ? child / parent : 0.5;
+                for (size_t j = 0; j < k; ++j) {
+                    if (t.levels[j] >> l & 1) z[j] *= fraction;
+                }
+            }
+
+            double p = 1.0;
+            for (size_t j = 0; j < k; ++j) p *= z[j];
+            for (size_t d = 0; d < dims_; ++d) expected[d] += p * t.values[b * dims_ + d];
+        }
+    }
+
+    // Shapley weights s! (k - s - 1)! / k! for subsets of s of k classes.
+    // Weight of the full set is zero, it has no class to add.
+    static void shapley_weights(size_t k, double* weight) {
+        for (size_t s = 0; s < k; ++s) {
+            weight[s] = 1.0 / k;
+            for (size_t i = 1; i <= s; ++i) weight[s] *= static_cast<double>(i) / (k - s - 1 + i);
+        }
+        weight[k] = 0.0;
+    }
+
+    // Number of classes of every subset.
+    static void subset_sizes(size_t subsets, std::vector<uint8_t>& size) {
+        size.resize(subsets);
+        size[0] = 0;
+        for (size_t s = 1; s < subsets; ++s) size[s] = static_cast<uint8_t>(size[s >> 1] + (s & 1));
+    }
+
+    // SHAP values of classes of the tree for an example in leaf a. The value
+    // of a set S of known classes is the sum over leaves b which agree with a
+    // on levels of S, weighted by cover fractions of levels of other classes.
+    // Values of all subsets are accumulated by one pass over leaves: subsets
+    // of classes agreeing with b are enumerated by doubling.
+    void leaf_shap(const Tree& t, uint32_t a, double* phi) const {
+        const size_t leaves = size_t{1} << t.depth;
+        const size_t k = t.classes.size();
+        const size_t subsets = size_t{1} << k;
+
+        thread_local std::vector<double> value;
+        thread_local std::vector<double> product;
+        thread_local std::vector<uint32_t> mask;
+        value.assign(subsets * dims_, 0.0);
+        product.resize(subsets);
+        mask.resize(subsets);
+
+        for (size_t b = 0; b < leaves; ++b) {
+            const uint32_t diff = a ^ static_cast<uint32_t>(b);
+            const double* z = &t.zeros[b * k];
+            const double* v = t.values + b * dims_;
+
+            product[0] = 1.0;
+            mask[0] = 0;
+            size_t n = 1;
+            for (size_t j = 0; j < k; ++j) {
+                if (t.levels[j] & diff) {
+                    // Leaf b is reached only if class j is unknown.
+                    for (size_t i = 0; i < n; ++i) product[i] *= z[j];
+                    continue;
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    product[n + i] = product[i];
+                    mask[n + i] = mask[i] | (uint32_t{1} << j);
+                    product[i] *= z[j];
+                }
+                n *= 2;
+            }
+
+            for (size_t i = 0; i < n; ++i) {
+                double* out = &value[mask[i] * dims_];
+                for (size_t d = 0; d < dims_; ++d) out[d] += product[i] * v[d];
+            }
+        }
+
+        double weight[33];
+        shapley_weights(k, weight);
+        thread_local std::vector<uint8_t> size;
+        subset_sizes(subsets, size);
+
+        std::fill(phi, phi + k * dims_, 0.0);
+        for (size_t s = 0; s < subsets; ++s) {
+            const double w = weight[size[s]];
+            for (size_t j = 0; j < k; ++j) {
+                if (s >> j & 1) continue;
+                const double* with = &value[(s | size_t{1} << j) * dims_];
+                const double* without = &value[s * dims_];
+                for (size_t d = 0; d < dims_; ++d) phi[j * dims_ + d] += w * (with[d] - without[d]);
+            }
+        }
+    }
+
+    // Table of SHAP values of all leaves of the tree. The value of a set S
+    // of known classes for leaf a depends only on bits of a at levels of S,
+    // so values of all subsets are accumulated once for every pattern of
+    // these bits: in one pass over leaves b, whose weights for all subsets
+    // are enumerated by doubling. Then SHAP values of every leaf are sums of
+    // its values of subsets with Shapley weights.
+    void prepare_table(Tree& t) const {
+        const size_t leaves = size_t{1} << t.depth;
+        const size_t k = t.classes.size();
+        const size_t subsets = size_t{1} << k;
+
+        // Levels of classes of every subset.
+        std::vector<uint32_t> levels(subsets, 0);
+        for (size_t j = 0; j < k; ++j) {
+            for (size_t s = 0; s < size_t{1} << j; ++s) levels[s | size_t{1} << j] = levels[s] | t.levels[j];
+        }
+
+        thread_local std::vector<double> value;
+        thread_local std::vector<double> product;
+        value.assign(subsets * leaves * dims_, 0.0);
+        product.resize(subsets);
+        for (size_t b = 0; b < leaves; ++b) {
+            // Product of cover fractions of classes which are not in subset.
+            const double* z = &t.zeros[b * k];
+            product[0] = 1.0;
+            for (size_t j = 0; j < k; ++j) {
+                const size_t n = size_t{1} << j;
+                for (size_t i = 0; i < n; ++i) {
+                    product[n + i] = product[i];
+                    product[i] *= z[j];
+                }
+            }
+
+            const double* v = t.values + b * dims_;
+            for (size_t s = 0; s < subsets; ++s) {
+                double* out = &value[(s * leaves + (b & levels[s])) * dims_];
+                for (size_t d = 0; d < dims_; ++d) out[d] += product[s] * v[d];
+            }
+        }
+
+        double weight[33];
+        shapley_weights(k, weight);
+        thread_local std::vector<uint8_t> size;
+        subset_sizes(subsets, size);
+
+        // Value of a subset is added to SHAP values of classes it lacks and
+        // subtracted from its own ones, which join it from smaller subsets.
+        thread_local std::vector<double> coef;
+        coef.resize(subsets * k);
+        for (size_t s = 0; s < subsets; ++s) {
+            for (size_t j = 0; j < k; ++j) coef[s * k + j] = s >> j & 1 ? weight[size[s] - 1] : -weight[size[s]];
+        }
+
+        t.table.assign(leaves * k * dims_, 0.0);
+        for (size_t a = 0; a < leaves; ++a) {
+            double* row = t.table.data() + a * k * dims_;
+            for (size_t s = 0; s < subsets; ++s) {
+                const double* v = &value[(s * leaves + (a & levels[s])) * dims_];
+                const double* c = &coef[s * k];
+                if (dims_ == 1) {
+                    for (size_t j = 0; j < k; ++j) row[j] += c[j] * v[0];
+                    continue;
+                }
+                for (size_t j = 0; j < k; ++j) {
+                    for (size_t d = 0; d < dims_; ++d) row[j * dims_ + d] += c[j] * v[d];
+                }
+            }
+        }
+    }
+
+public:
+    ShapTrees() = default;
+
+    // Classes of derived features of the model.
+    ShapTrees(const CatFeatures& cats, size_t dims) : dims_(dims), expected_(dims, 0.0) {
+        std::map<std::vector<uint32_t>, uint32_t> ids;
+        feature_classes_.resize(cats.width());
+
+        auto add = [&](uint32_t index, std::vector<uint32_t> features) {
+            std::sort(features.begin(), features.end());
+            features.erase(std::unique(features.begin(), features.end()), features.end());
+            auto it = ids.emplace(features, static_cast<uint32_t>(members_.size())).first;
+            if (it->second == members_.size()) members_.push_back(std::move(features));
+            feature_classes_[index] = it->second;
+        };
+
+        const uint32_t float_count = static_cast<uint32_t>(cats.float_count);
+        for (uint32_t f = 0; f < float_count; ++f) add(f, {f});
+        for (const auto& h : cats.one_hots) add(h.index, {float_count + h.cat});
+        for (const auto& c : cats.ctrs) {
+            std::vector<uint32_t> features;
+            for (uint32_t cat : c.cats) features.push_back(float_count + cat);
+            for (const auto& s : c.floats) features.push_back(s.first);
+            for (const auto& v : c.values) features.push_back(float_count + v.first);
+            add(c.index, features);
+        }
+    }
+
+    // Add oblivious tree. Trees are added in the original order.
+    // @argument indexes - derived features of splits
+    // @argument weights - leaf weights of training examples
+    // @argument values - leaf values, which should live as long as this
+    void add_tree(const std::vector<uint32_t>& indexes, const std::vector<double>& weights, const double* values) {
+        Tree t;
+        t.depth = static_cast<uint32_t>(indexes.size());
+        if (weights.size() != size_t{1} << t.depth) throw std::runtime_error("Invalid model: wrong leaf weights");
+        for (uint32_t l = 0; l < t.depth; ++l) {
+            const uint32_t c = feature_classes_.at(indexes[l]);
+            auto it = std::find(t.classes.begin(), t.classes.end(), c);
+            if (it == t.classes.end()) {
+                t.classes.push_back(c);
+                t.levels.push_back(0);
+                it = t.classes.end() - 1;
+            }
+            t.levels[it - t.classes.begin()] |= uint32_t{1} << l;
+        }
+        t.weights = weights;
+        t.values = values;
+        trees_.push_back(std::move(t));
+    }
+
+    // Compute expected value of tree i and table of its leaves if the tree
+    // is not too deep. Trees could be prepared in parallel, expected values
+    // are summed later.
+    void prepare(size_t i, double* expected) {
+        Tree& t = trees_[i];
+        prepare_zeros(t, expected);
+        t.weights = std::vector<double>{};
+        if (t.depth > table_depth) return;
+
+        prepare_table(t);
+        t.zeros = std::vector<double>{};
+        t.tabled = true;
+    }
+
+    // Join tables and classes of prepared trees into flat arrays and set
+    // expected value of the model from expected values of trees (dims values
+    // per tree), which are added in the original order.
+    void finish(const std::vector<double>& expected) {
+        std::fill(expected_.begin(), expected_.end(), 0.0);
+        for (size_t i = 0; i < expected.size(); ++i) expected_[i % dims_] += expected[i];
+
+        size_t size = 0;
+        for (const auto& t : trees_) size += t.table.size();
+        tables_.reserve(size);
+        slices_.clear();
+        classes_.clear();
+        for (auto& t : trees_) {
+            Slice slice;
+            slice.table = t.tabled ? tables_.size() : no_table;
+            slice.classes = static_cast<uint32_t>(classes_.size());
+            slice.count = static_cast<uint32_t>(t.classes.size());
+            slices_.push_back(slice);
+            classes_.insert(classes_.end(), t.classes.begin(), t.classes.end());
+            tables_.insert(tables_.end(), t.table.begin(), t.table.end());
+            t.table = std::vector<double>{};
+        }
+    }
+
+    size_t tree_count() const { return trees_.size(); }
+
+    size_t class_count() const { return members_.size(); }
+
+    // Expected value of the sum of leaves.
+    const std::vector<double>& expected() const { return expected_; }
+
+    // Add SHAP values of classes to phi[c * dims + d].
+    // @argument leaves - leaf index of every tree
+    void explain(const uint32_t* leaves, double* phi) const {
+        thread_local std::vector<double> row;
+        for (size_t i = 0; i < slices_.size(); ++i) {
+            // Rows of tables of large models are mostly cache misses.
+            if (i + row_lookahead < slices_.size()) prefetch_row(i + row_lookahead, leaves[i + row_lookahead]);
+
+            const Slice& slice = slices_[i];
+            const size_t k = slice.count;
+            const double* r = nullptr;
+            if (slice.table != no_table) {
+                r = tables_.data() + slice.table + leaves[i] * k * dims_;
+            } else {
+                row.resize(k * dims_);
+                leaf_shap(trees_[i], leaves[i], row.data());
+                r = row.data();
+            }
+            const uint32_t* classes = classes_.data() + slice.classes;
+            if (dims_ == 1) {
+                for (size_t j = 0; j < k; ++j) phi[classes[j]] += r[j];
+                continue;
+            }
+            for (size_t j = 0; j < k; ++j) {
+                double* out = phi + classes[j] * dims_;
+                for (size_t d = 0; d < dims_; ++d) out[d] += r[j * dims_ + d];
+            }
+        }
+    }
+
+    void prefetch_row(size_t i, uint32_t leaf) const {
+#if defined(__GNUC__) || defined(__clang__)
+        const Slice& slice = slices_[i];
+        if (slice.table == no_table || !slice.count) return;
+        const size_t size = slice.count * dims_;
+        const double* r = tables_.data() + slice.table + leaf * size;
+        __builtin_prefetch(r);
+        __builtin_prefetch(r + size - 1);
+#else
+        (void)i;
+        (void)leaf;
+#endif
+    }
+
+    // Share SHAP values of classes among their features. Writes values of
+    // dimension d and original feature f to out[d * (features + 1) + f],
+    // expected values are not written.
+    void distribute(const double* phi, size_t features, double scale, double* out) const {
+        for (size_t d = 0; d < dims_; ++d) {
+            std::fill(out + d * (features + 1), out + d * (features + 1) + features, 0.0);
+        }
+        for (size_t c = 0; c < members_.size(); ++c) {
+            const auto& m = members_[c];
+            const double share = scale / m.size();
+            for (uint32_t f : m) {
+                for (size_t d = 0; d < dims_; ++d) out[d * (features + 1) + f] += share * phi[c * dims_ + d];
+            }
+        }
+    }
+};
+
+// anonymous namespace
+} // namespace
+
+// namespace catboost
+} // namespace catboost
@@ -0,0 +1,170 @@
+#include "catboost.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "parallel.hpp"
+
+namespace catboost {
+
+namespace {
+
+#ifdef __linux__
+// CPUs allowed by cgroup v2 file cpu.max of "<quota> <period>" or
+// "max <period>", zero if there is no limit. Returns false if there is no
+// file.
+bool read_cpu_max(const std::string& filename, double& cpus) {
+    std::ifstream in{filename};
+    if (!in.good()) return false;
+    std::string quota;
+    double period = 0.0;
+    cpus = 0.0;
+    if (in >> quota >> period && quota != "max" && period > 0.0) cpus = std::stod(quota) / period;
+    return true;
+}
+
+// Path of cgroup v2 of the process below /sys/fs/cgroup from the "0::<path>"
+// line of /proc/self/cgroup, empty if it is not known.
+std::string cgroup_path() {
+    std::ifstream in{"/proc/self/cgroup"};
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 3, "0::") == 0) return line.substr(3);
+    }
+    return std::string();
+}
+
+// CPU limit from cgroup quota or zero if there is no limit.
+size_t cgroup_cpus() {
+    double cpus = 0.0;
+    bool v2 = false;
+
+    // cgroup v2: limits of the cgroup of the process and of its ancestors
+    // apply. The root file is the cgroup of a container with its own cgroup
+    // namespace.
+    std::string path = cgroup_path();
+    for (;;) {
+        while (!path.empty() && path.back() == '/') path.pop_back();
+        double limit = 0.0;
+        if (read_cpu_max("/sys/fs/cgroup" + path + "/cpu.max", limit)) {
+            v2 = true;
+            if (limit > 0.0 && (cpus <= 0.0 || limit < cpus)) cpus = limit;
+        }
+        if (path.empty()) break;
+        const size_t slash = path.rfind('/');
+        path.erase(slash == std::string::npos ? 0 : slash);
+    }
+
+    if (!v2) {
+        // cgroup v1: quota is -1 if there is no limit
+        double quota = -1.0;
+        double period = 0.0;
+        std::ifstream q{"/sys/fs/cgroup/cpu/cpu.cfs_quota_us"};
+        std::ifstream p{"/sys/fs/cgroup/cpu/cpu.cfs_period_us"};
+        if ((q >> quota) && (p >> period) && quota > 0.0 && period > 0.0) cpus = quota / period;
+    }
+
+    if (cpus <= 0.0) return 0;
+    return std::max<size_t>(1, static_cast<size_t>(cpus + 0.5));
+}
+#endif
+
+// anonymous namespace
+} // namespace
+
+size_t available_cpus() {
+    size_t cpus = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        cpus = std::max(1, CPU_COUNT(&set));
+    }
+
+    size_t limit = cgroup_cpus();
+    if (limit) cpus = std::min(cpus, limit);
+#endif
+
+    return cpus;
+}
+
+struct ThreadPool::Impl {
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable ready;
+    bool stop = false;
+
+    explicit Impl(size_t count) {
+        threads.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            threads.emplace_back([this] { run(); });
+        }
+    }
+
+    ~Impl() {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stop = true;
+        }
+        ready.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+    void run() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                ready.wait(lock, [this] { return stop || !tasks.empty(); });
+                if (tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            // Tasks should report their errors, as parallel_for does. Other
+            // errors are dropped, so they do not stop the thread.
+            try {
+                task();
+            } catch (...) {
+            }
+        }
+    }
+};
+
+ThreadPool::ThreadPool() : ThreadPool(available_cpus() - 1) {}
+
+ThreadPool::ThreadPool(size_t threads) : impl_(new Impl(threads)) {}
+
+ThreadPool::~ThreadPool() = default;
+
+size_t ThreadPool::concurrency() const { return impl_->threads.size(); }
+
+void ThreadPool::submit(std::function<void()> task) {
+    if (impl_->threads.empty()) {
+        task();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{impl_->mutex};
+        impl_->tasks.emplace_back(std::move(task));
+    }
+    impl_->ready.notify_one();
+}
+
+Executor& default_executor() {
+    static ThreadPool pool;
+    return pool;
+}
+
+// namespace catboost
+} // namespace catboost
@@ -0,0 +1,482 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "catboost.hpp"
+#include "json.hpp"
+#include "vec4.hpp"
+
+namespace catboost {
+
+namespace {
+
+// Exp and log by polynomials. Arguments are reduced the usual way:
+// exp(x) = 2^k * exp(r) with |r| <= ln(2) / 2 and log(x) = k * ln(2) + log(m)
+// with m in [sqrt(1/2), sqrt(2)). Scalar versions below perform the same
+// operations as vector ones, so SSE and non-SSE builds give the same results.
+
+constexpr double ln2_hi = 6.93147180369123816490e-01;
+constexpr double ln2_lo = 1.90821492927058770002e-10;
+constexpr double log2e = 1.44269504088896338700e+00;
+constexpr double sqrt2 = 1.41421356237309504880e+00;
+// Arguments of exp are clamped to this range, so 2^k is a normal number.
+constexpr double exp_min = -708.0;
+constexpr double exp_max = 709.0;
+
+// Taylor coefficients of exp(r).
+constexpr double exp_coef[] = {1.0,
+                               1.0,
+                               1.0 / 2,
+                               1.0 / 6,
+                               1.0 / 24,
+                               1.0 / 120,
+                               1.0 / 720,
+                               1.0 / 5040,
+                               1.0 / 40320,
+                               1.0 / 362880,
+                               1.0 / 3628800,
+                               1.0 / 39916800,
+                               1.0 / 479001600};
+
+// log(m) = 2 * s * (1 + z / 3 + z^2 / 5 + ...) with s = (m - 1) / (m + 1),
+// z = s^2 <= 0.0295.
+constexpr double log_coef[] = {1.0,       1.0 / 3,  1.0 / 5,  1.0 / 7,  1.0 / 9,
+                               1.0 / 11, 1.0 / 13, 1.0 / 15, 1.0 / 17, 1.0 / 19};
+
+// Scalar counterparts of Vec2d operations.
+inline double vmin(double a, double b) { return a < b ? a : b; }
+
+inline double vmax(double a, double b) { return a > b ? a : b; }
+
+inline double vabs(double a) { return std::fabs(a); }
+
+inline double vround(double a) { return std::nearbyint(a); }
+
+inline double select(bool mask, double a, double b) { return mask ? a : b; }
+
+inline double pow2(double k) {
+    if (k != k) return k;
+    const uint64_t bits = static_cast<uint64_t>(static_cast<int64_t>(k) + 1023) << 52;
+    double res;
+    std::memcpy(&res, &bits, sizeof(res));
+    return res;
+}
+
+inline double exponent(double x) {
+    uint64_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    return static_cast<double>(static_cast<int32_t>(bits >> 52)) - 1023.0;
+}
+
+inline double mantissa(double x) {
+    uint64_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    bits = (bits & 0x000fffffffffffffull) | 0x3ff0000000000000ull;
+    std::memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+#ifndef NOSSE
+inline Vec2d vmin(Vec2d a, Vec2d b) { return a.min(b); }
+
+inline Vec2d vmax(Vec2d a, Vec2d b) { return a.max(b); }
+
+inline Vec2d vabs(Vec2d a) { return a.abs(); }
+
+inline Vec2d vround(Vec2d a) { return a.round(); }
+
+inline Vec2d select(Vec2d mask, Vec2d a, Vec2d b) { return Vec2d::select(mask, a, b); }
+
+inline Vec2d pow2(Vec2d k) { return Vec2d::pow2(k); }
+
+inline Vec2d exponent(Vec2d x) { return x.exponent(); }
+
+inline Vec2d mantissa(Vec2d x) { return x.mantissa(); }
+#endif
+
+// c[i] + c[i + s] * y + c[i + 2 * s] * y^2 + ... with coefficients up to c[n]
+// by Horner's scheme unrolled at compile time: compilers keep loops over
+// coefficients rolled.
+template <size_t i, size_t n, size_t s, bool last = (i + s > n)>
+struct Horner {
+    template <typename V>
+    static V eval(V y, const double* c) {
+        return Horner<i + s, n, s>::eval(y, c) * y + V(c[i]);
+    }
+};
+
+template <size_t i, size_t n, size_t s>
+struct Horner<i, n, s, true> {
+    template <typename V>
+    static V eval(V, const double* c) {
+        return V(c[i]);
+    }
+};
+
+// Polynomial c[0] + c[1] * x + ... + c[n] * x^n. Four Horner chains on x^4
+// are independent, so their latencies overlap: the chain of one Horner's
+// scheme is the bottleneck of the whole transform.
+template <size_t n, typename V>
+inline V poly(V x, const double* c) {
+    static_assert(n >= 3, "Polynomial degree is too small");
+    const V x2 = x * x;
+    const V x4 = x2 * x2;
+    return (Horner<0, n, 4>::eval(x4, c) + x * Horner<1, n, 4>::eval(x4, c)) +
+           x2 * (Horner<2, n, 4>::eval(x4, c) + x * Horner<3, n, 4>::eval(x4, c));
+}
+
+// Exp by polynomial of the given degree. NaN gives NaN.
+template <size_t degree, typename V>
+inline V exp_poly(V x) {
+    x = vmin(V(exp_max), vmax(V(exp_min), x));
+    const V k = vround(x * V(log2e));
+    const V r = (x - k * V(ln2_hi)) - k * V(ln2_lo);
+    return poly<degree>(r, exp_coef) * pow2(k);
+}
+
+// Log of positive normal numbers by polynomial with the given number of terms.
+template <size_t terms, typename V>
+inline V log_poly(V x) {
+    V e = exponent(x);
+    V m = mantissa(x);
+    const auto big = m > V(sqrt2);
+    m = select(big, m * V(0.5), m);
+    e = select(big, e + V(1.0), e);
+
+    const V s = (m - V(1.0)) / (m + V(1.0));
+    const V z = s * s;
+    const V p = poly<terms - 1>(z, log_coef);
+    return e * V(ln2_hi) + (e * V(ln2_lo) + V(2.0) * s * p);
+}
+
+// log(1 + x) for x in [0, 1]. Multiplication by x / (u - 1) compensates
+// rounding of u = 1 + x, tiny x that are lost in u are returned as is.
+template <size_t terms, typename V>
+inline V log1p_poly(V x) {
+    const V u = V(1.0) + x;
+    const V d = u - V(1.0);
+    return select(d == V(0.0), x, log_poly<terms>(u) * x / d);
+}
+
+// Standard library functions (Accuracy::Exact).
+struct ExactMath {
+    static double exp(double x) { return std::exp(x); }
+
+    static double log(double x) { return std::log(x); }
+
+    static double log1p(double x) { return std::log1p(x); }
+
+#ifndef NOSSE
+    template <double (*f)(double)>
+    static Vec2d lanes(Vec2d x) {
+        double a[2];
+        x.storeu(a);
+        return Vec2d(f(a[1]), f(a[0]));
+    }
+
+    static Vec2d exp(Vec2d x) { return lanes<exp>(x); }
+
+    static Vec2d log1p(Vec2d x) { return lanes<log1p>(x); }
+#endif
+};
+
+// Polynomial approximations with the given degree of exp and number of
+// terms of log.
+template <size_t exp_degree, size_t log_terms>
+struct PolyMath {
+    template <typename V>
+    static V exp(V x) {
+        return exp_poly<exp_degree>(x);
+    }
+
+    template <typename V>
+    static V log(V x) {
+        return log_poly<log_terms>(x);
+    }
+
+    template <typename V>
+    static V log1p(V x) {
+        return log1p_poly<log_terms>(x);
+    }
+};
+
+// Relative error is about 1e-15 (Accuracy::High) and below 1e-8
+// (Accuracy::Fast), see Accuracy.
+using HighMath = PolyMath<12, 10>;
+using FastMath = PolyMath<7, 5>;
+
+// Element-wise transforms of scaled and biased raw values.
+struct RawOp {
+    template <typename Math, typename V>
+    static V apply(V x) {
+        return x;
+    }
+};
+
+struct ExpOp {
+    template <typename Math, typename V>
+    static V apply(V x) {
+        return Math::exp(x);
+    }
+};
+
+struct SigmoidOp {
+    template <typename Math, typename V>
+    static V apply(V x) {
+        return V(1.0) / (V(1.0) + Math::exp(V(0.0) - x));
+    }
+};
+
+// log(sigmoid(x)) = min(x, 0) - log(1 + exp(-|x|)) does not overflow.
+struct LogSigmoidOp {
+    template <typename Math, typename V>
+    static V apply(V x) {
+        return vmin(x, V(0.0)) - Math::log1p(Math::exp(V(0.0) - vabs(x)));
+    }
+};
+
+// Loss function of the model, which defines meaning of prediction types.
+enum class LossKind {
+    // Regression, ranking or unknown loss: only raw values and exponent.
+    Other,
+    // Logloss and CrossEntropy: probability is sigmoid of raw value.
+    Binary,
+    // MultiClass: probabilities are softmax of raw values.
+    MultiClass,
+    // MultiClassOneVsAll: probability of every class is its sigmoid.
+    OneVsAll,
+    // MultiLogloss and MultiCrossEntropy: probability of every label is its
+    // sigmoid.
+    MultiLabel,
+};
+
+// Loss function from "model_info" of the model. Parameters are stored as an
+// object or, by some CatBoost versions, as a string with JSON.
+inline LossKind read_loss(const nlohmann::json& model) {
+    if (!model.count("model_info") || !model.at("model_info").count("params")) return LossKind::Other;
+
+    const auto& params = model.at("model_info").at("params");
+    nlohmann::json parsed;
+    if (params.is_string()) parsed = nlohmann::json::parse(params.get<std::string>(), nullptr, false);
+    const auto& p = params.is_string() ? parsed : params;
+    if (!p.is_object() || !p.count("loss_function")) return LossKind::Other;
+
+    const auto& loss = p.at("loss_function");
+    std::string name = loss.is_string() ? loss.get<std::string>() : loss.value("type", std::string{});
+    // Loss could be written with parameters, like "Logloss:border=0.5".
+    name = name.substr(0, name.find(':'));
+
+    if (name == "Logloss" || name == "CrossEntropy") return LossKind::Binary;
+    if (name == "MultiClass") return LossKind::MultiClass;
+    if (name == "MultiClassOneVsAll") return LossKind::OneVsAll;
+    if (name == "MultiLogloss" || name == "MultiCrossEntropy") return LossKind::MultiLabel;
+    return LossKind::Other;
+}
+
+// Turns sums of leaf values into predictions of the requested type. Scale
+// and bias are applied in the same pass as the transform, two values at once
+// in SSE build.
+class Transform {
+    LossKind loss_ = LossKind::Other;
+    size_t dims_ = 1;
+    double scale_ = 1.0;
+    std::vector<double> bias_;
+    Accuracy accuracy_ = Accuracy::High;
+
+    // Apply Op to scale * in + bias, in and out could be the same array.
+    template <typename Op, typename Math>
+    void map(const double* in, size_t size, double* out) const noexcept {
+        if (dims_ == 1) {
+            size_t j = 0;
+#ifndef NOSSE
+            const Vec2d scale{scale_};
+            const Vec2d bias{bias_[0]};
+            for (; j + 2 <= size; j += 2) {
+                Vec2d x;
+                x.loadu(in + j);
+                Op::template apply<Math>(x * scale + bias).storeu(out + j);
+            }
+#endif
+            for (; j < size; ++j) out[j] = Op::template apply<Math>(scale_ * in[j] + bias_[0]);
+            return;
+        }
+
+        for (size_t i = 0; i < size; ++i) {
+            const double* x = in + i * dims_;
+            double* y = out + i * dims_;
+            size_t d = 0;
+#ifndef NOSSE
+            const Vec2d scale{scale_};
+            for (; d + 2 <= dims_; d += 2) {
+                Vec2d a;
+                Vec2d b;
+                a.loadu(x + d);
+                b.loadu(bias_.data() + d);
+                Op::template apply<Math>(a * scale + b).storeu(y + d);
+            }
+#endif
+            for (; d < dims_; ++d) y[d] = Op::template apply<Math>(scale_ * x[d] + bias_[d]);
+        }
+    }
+
+    template <typename Op>
+    void map(const double* in, size_t size, double* out) const noexcept {
+        switch (accuracy_) {
+            case Accuracy::Exact:
+                map<Op, ExactMath>(in, size, out);
+                break;
+            case Accuracy::Fast:
+                map<Op, FastMath>(in, size, out);
+                break;
+            default:
+                map<Op, HighMath>(in, size, out);
+                break;
+        }
+    }
+
+    // Softmax or its log over values of every example. Values are shifted by
+    // their maximum, so exp does not overflow.
+    template <typename Math>
+    void softmax(const double* in, size_t size, bool log, double* out) const {
+        thread_local std::vector<double> exps;
+        exps.resize(dims_);
+        for (size_t i = 0; i < size; ++i) {
+            const double* x = in + i * dims_;
+            double* y = out + i * dims_;
+            double max = scale_ * x[0] + bias_[0];
+            for (size_t d = 0; d < dims_; ++d) {
+                y[d] = scale_ * x[d] + bias_[d];
+                max = std::max(max, y[d]);
+            }
+
+            size_t d = 0;
+#ifndef NOSSE
+            for (; d + 2 <= dims_; d += 2) {
+                Vec2d v;
+                v.loadu(y + d);
+                Math::exp(v - Vec2d(max)).storeu(exps.data() + d);
+            }
+#endif
+            for (; d < dims_; ++d) exps[d] = Math::exp(y[d] - max);
+
+            double sum = 0.0;
+            for (d = 0; d < dims_; ++d) sum += exps[d];
+            if (log) {
+                const double shift = max + Math::log(sum);
+                for (d = 0; d < dims_; ++d) y[d] -= shift;
+            } else {
+                const double norm = 1.0 / sum;
+                for (d = 0; d < dims_; ++d) y[d] = exps[d] * norm;
+            }
+        }
+    }
+
+    void softmax(const double* in, size_t size, bool log, double* out) const {
+        switch (accuracy_) {
+            case Accuracy::Exact:
+                softmax<ExactMath>(in, size, log, out);
+                break;
+            case Accuracy::Fast:
+                softmax<FastMath>(in, size, log, out);
+                break;
+            default:
+                softmax<HighMath>(in, size, log, out);
+                break;
+        }
+    }
+
+public:
+    Transform() = default;
+
+    Transform(LossKind loss, size_t dims, double scale, const std::vector<double>& bias)
+        : loss_(loss), dims_(dims), scale_(scale), bias_(bias) {
+        if ((loss == LossKind::Binary && dims != 1) || (loss == LossKind::MultiClass && dims < 2)) {
+            throw std::runtime_error("Invalid model: loss function does not match number of values");
+        }
+    }
+
+    void set_accuracy(Accuracy accuracy) { accuracy_ = accuracy; }
+
+    // Number of values of every example for prediction type. Throws if
+    // the model does not support it.
+    size_t dimension(PredictionType type) const {
+        const bool classifier = loss_ != LossKind::Other;
+        switch (type) {
+            case PredictionType::RawFormulaVal:
+            case PredictionType::Exponent:
+                return dims_;
+            case PredictionType::Probability:
+            case PredictionType::LogProbability:
+                if (!classifier) break;
+                return dims_;
+            case PredictionType::Class:
+                if (!classifier) break;
+                return loss_ == LossKind::MultiClass || loss_ == LossKind::OneVsAll ? 1 : dims_;
+            default:
+                throw std::runtime_error("Invalid prediction type");
+        }
+        throw std::runtime_error("Prediction type is supported by classification models only");
+    }
+
+    // Turn sums of leaf values of size examples (dims values per example)
+    // into predictions of type (dimension(type) values per example). Arrays
+    // could be the same.
+    void apply(PredictionType type, const double* in, size_t size, double* out) const {
+        const size_t out_dims = dimension(type);
+        const bool softmax_loss = loss_ == LossKind::MultiClass;
+        switch (type) {
+            case PredictionType::RawFormulaVal:
+                map<RawOp>(in, size, out);
+                break;
+            case PredictionType::Exponent:
+                map<ExpOp>(in, size, out);
+                break;
+            case PredictionType::Probability:
+                if (softmax_loss) {
+                    softmax(in, size, false, out);
+                } else {
+                    map<SigmoidOp>(in, size, out);
+                }
+                break;
+            case PredictionType::LogProbability:
+                if (softmax_loss) {
+                    softmax(in, size, true, out);
+                } else {
+                    map<LogSigmoidOp>(in, size, out);
+                }
+                break;
+            case PredictionType::Class:
+                if (out_dims != dims_) {
+                    // Index of the largest value, the first one on ties.
+                    for (size_t i = 0; i < size; ++i) {
+                        size_t best = 0;
+                        double best_value = 0.0;
+                        for (size_t d = 0; d < dims_; ++d) {
+                            const double value = scale_ * in[i * dims_ + d] + bias_[d];
+                            if (d == 0 || value > best_value) {
+                                best = d;
+                                best_value = value;
+                            }
+                        }
+                        out[i] = static_cast<double>(best);
+                    }
+                } else {
+                    for (size_t j = 0; j < size * dims_; ++j) out[j] = scale_ * in[j] + bias_[j % dims_] > 0.0;
+                }
+                break;
+            default:
+                throw std::runtime_error("Invalid prediction type");
+        }
+    }
+};
+
+// anonymous namespace
+} // namespace
+
+// namespace catboost
+} // namespace catboost
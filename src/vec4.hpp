@@ -86,6 +86,9 @@ struct Vec4i {
 
     Vec4i operator>>(uint32_t s) const { return Vec4i(_mm_srli_epi32(v, s)); }
 
+    // Shift right copying the sign bit.
+    Vec4i sra(uint32_t s) const { return Vec4i(_mm_srai_epi32(v, s)); }
+
     uint32_t sum() const {
         // Let's allow optimizer to do it for us:
         alignas(16) uint32_t x[4];
@@ -126,6 +129,9 @@ struct Vec4f {
 
     Vec4i operator!=(Vec4f x) { return Vec4i(_mm_cmpneq_ps(v, x.v)); }
 
+    // All ones where either value is NaN.
+    Vec4i unordered(Vec4f x) const { return Vec4i(_mm_cmpunord_ps(v, x.v)); }
+
     Vec4f& operator+=(Vec4f x) {
         v = _mm_add_ps(v, x.v);
         return *this;
@@ -155,6 +161,95 @@ struct Vec4f {
     Vec4f operator/(Vec4f x) const { return Vec4f(_mm_div_ps(v, x.v)); }
 };
 
+struct Vec2d {
+    __m128d v;
+    Vec2d() : v(_mm_setzero_pd()) {}
+    explicit Vec2d(__m128d x) : v(x) {}
+    explicit Vec2d(double x0, double x1) : v(_mm_set_pd(x0, x1)) {}
+    explicit Vec2d(double x) : v(_mm_set1_pd(x)) {}
+    Vec2d(const Vec2d&) = default;
+    Vec2d(Vec2d&&) = default;
+    Vec2d& operator=(const Vec2d&) = default;
+    Vec2d& operator=(Vec2d&&) = default;
+    ~Vec2d() = default;
+
+    void load(const double* f) { v = _mm_load_pd(f); }
+
+    void loadu(const double* f) { v = _mm_loadu_pd(f); }
+
+    void store(double* f) const { _mm_store_pd(f, v); }
+
+    void storeu(double* f) const { _mm_storeu_pd(f, v); }
+
+    Vec2d& operator+=(Vec2d x) {
+        v = _mm_add_pd(v, x.v);
+        return *this;
+    }
+
+    Vec2d operator+(Vec2d x) const { return Vec2d(_mm_add_pd(v, x.v)); }
+
+    Vec2d& operator-=(Vec2d x) {
+        v = _mm_sub_pd(v, x.v);
+        return *this;
+    }
+
+    Vec2d operator-(Vec2d x) const { return Vec2d(_mm_sub_pd(v, x.v)); }
+
+    Vec2d& operator*=(Vec2d x) {
+        v = _mm_mul_pd(v, x.v);
+        return *this;
+    }
+
+    Vec2d operator*(Vec2d x) const { return Vec2d(_mm_mul_pd(v, x.v)); }
+
+    Vec2d& operator/=(Vec2d x) {
+        v = _mm_div_pd(v, x.v);
+        return *this;
+    }
+
+    Vec2d operator/(Vec2d x) const { return Vec2d(_mm_div_pd(v, x.v)); }
+
+    // Minimum and maximum return x if either element is NaN.
+    Vec2d min(Vec2d x) const { return Vec2d(_mm_min_pd(v, x.v)); }
+
+    Vec2d max(Vec2d x) const { return Vec2d(_mm_max_pd(v, x.v)); }
+
+    Vec2d abs() const { return Vec2d(_mm_andnot_pd(_mm_set1_pd(-0.0), v)); }
+
+    // Round to the nearest integer, ties to even.
+    Vec2d round() const { return Vec2d(_mm_round_pd(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)); }
+
+    // Comparisons give all ones where true.
+    Vec2d operator>(Vec2d x) const { return Vec2d(_mm_cmpgt_pd(v, x.v)); }
+
+    Vec2d operator==(Vec2d x) const { return Vec2d(_mm_cmpeq_pd(v, x.v)); }
+
+    // Elements of a where mask is set and of b otherwise.
+    static Vec2d select(Vec2d mask, Vec2d a, Vec2d b) { return Vec2d(_mm_blendv_pd(b.v, a.v, mask.v)); }
+
+    // 2^k for integers k in the range of normal numbers.
+    static Vec2d pow2(Vec2d k) {
+        __m128i e = _mm_add_epi32(_mm_cvtpd_epi32(k.v), _mm_set1_epi32(1023));
+        return Vec2d(_mm_castsi128_pd(_mm_slli_epi64(_mm_cvtepi32_epi64(e), 52)));
+    }
+
+    // Exponent and mantissa in [1, 2) of positive normal numbers.
+    Vec2d exponent() const {
+        __m128i e = _mm_shuffle_epi32(_mm_srli_epi64(_mm_castpd_si128(v), 52), _MM_SHUFFLE(3, 1, 2, 0));
+        return Vec2d(_mm_cvtepi32_pd(e)) - Vec2d(1023.0);
+    }
+
+    Vec2d mantissa() const {
+        __m128i m = _mm_and_si128(_mm_castpd_si128(v), _mm_set1_epi64x(0x000fffffffffffffll));
+        return Vec2d(_mm_castsi128_pd(_mm_or_si128(m, _mm_set1_epi64x(0x3ff0000000000000ll))));
+    }
+
+    // Add x to the lowest element only.
+    void add_low(double x) { v = _mm_add_sd(v, _mm_set_sd(x)); }
+
+    double sum() const { return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v))); }
+};
+
 // namespace catboost
 } // namespace catboost
 
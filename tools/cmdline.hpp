@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Simple command line parser used by performance tests and tools.
+class CmdLine {
+    struct HelpMessage {
+        std::vector<std::string> names;
+        std::string help;
+        bool flag = true;
+        std::function<void(const char*)> action;
+
+        bool match(const char* s) const {
+            for (const auto& nm : names) {
+                if (nm == s) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+    std::vector<HelpMessage> args;
+    std::string description;
+
+public:
+    explicit CmdLine(const std::string& descr) : description(descr) {}
+
+    void print_usage(const std::string& prog) const {
+        std::cout << "Usage:" << std::endl;
+        std::cout << prog;
+        for (const auto& msg : args) {
+            std::cout << " [" << msg.names[0];
+            if (!msg.flag) {
+                std::cout << " <val>";
+            }
+            std::cout << "]";
+        }
+        std::cout << std::endl;
+        std::cout << "    " << description << std::endl;
+
+        std::cout << "Arguments:" << std::endl;
+        for (const auto& msg : args) {
+            for (size_t i = 0; i < msg.names.size(); ++i) {
+                if (i) std::cout << ", ";
+                std::cout << msg.names[i];
+            }
+            if (!msg.flag) std::cout << " <value>";
+            std::cout << std::endl;
+            std::cout << "    " << msg.help << std::endl;
+        }
+    }
+
+    CmdLine& flag(const std::string& f, bool& var, const std::string& help) {
+        args.emplace_back();
+        args.back().names.push_back(f);
+        args.back().flag = true;
+        args.back().help = help;
+        args.back().action = [&var](const char* v) { var = (v[0] == '1'); };
+
+        return *this;
+    }
+
+    CmdLine& synonym(const std::string& f) {
+        args.back().names.push_back(f);
+        return *this;
+    }
+
+    // synonym, but better :)
+    CmdLine& aka(const std::string& f) {
+        args.back().names.push_back(f);
+        return *this;
+    }
+
+    CmdLine& arg(const std::string& f, std::string& var, const std::string& help) {
+        args.emplace_back();
+        args.back().names.push_back(f);
+        args.back().flag = false;
+        args.back().help = help;
+        args.back().action = [&var](const char* v) { var = v; };
+
+        return *this;
+    }
+
+    template <typename F>
+    CmdLine& action(const std::string& f, F&& func, const std::string& help) {
+        args.emplace_back();
+        args.back().names.push_back(f);
+        args.back().flag = false;
+        args.back().help = help;
+        args.back().action = std::forward<F>(func);
+
+        return *this;
+    }
+
+    bool parse(int argc, const char* argv[]) {
+        int argidx = 1;
+        while (argidx < argc) {
+            if (!std::strcmp(argv[argidx], "-h") || !std::strcmp(argv[argidx], "--help")) {
+                print_usage(argv[0]);
+                return false;
+            }
+
+            bool matched = false;
+            for (const auto& arg : args) {
+                if (arg.match(argv[argidx])) {
+                    matched = true;
+                    if (arg.flag) {
+                        arg.action("1");
+                    } else {
+                        if (argidx + 1 < argc) {
+                            arg.action(argv[++argidx]);
+                        } else {
+                            std::cerr << "Error: option " << argv[argidx] << " needs argument!" << std::endl;
+                            return false;
+                        }
+                    }
+                    ++argidx;
+                }
+
+                if (matched) break;
+            }
+
+            if (!matched) {
+                std::cerr << "Error: unknown argument: " << argv[argidx] << std::endl;
+                print_usage(argv[0]);
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
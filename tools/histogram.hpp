@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+
+// Histogram of latencies in nanoseconds. Values below 16 have own buckets,
+// larger ones are split into 8 buckets per power of two, so percentiles are
+// accurate within 12.5%. Counters are relaxed atomics, so threads could add
+// values without locks.
+class LatencyHistogram {
+    static constexpr size_t linear = 16;
+    static constexpr size_t sub_buckets = 8;
+    static constexpr size_t buckets = linear + (64 - 4) * sub_buckets;
+
+    std::atomic<uint64_t> counts_[buckets] = {};
+    std::atomic<uint64_t> total_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+
+    static size_t bucket(uint64_t v) {
+        if (v < linear) return static_cast<size_t>(v);
+        const unsigned e = 63 - static_cast<unsigned>(__builtin_clzll(v));
+        return linear + (e - 4) * sub_buckets + static_cast<size_t>((v >> (e - 3)) & (sub_buckets - 1));
+    }
+
+    // The smallest value of bucket b.
+    static uint64_t lower_bound(size_t b) {
+        if (b < linear) return b;
+        const size_t e = (b - linear) / sub_buckets + 4;
+        return (uint64_t(sub_buckets) + (b - linear) % sub_buckets) << (e - 3);
+    }
+
+public:
+    void add(uint64_t ns) {
+        counts_[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        total_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        while (ns > max && !max_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t count() const { return total_.load(std::memory_order_relaxed); }
+
+    // Approximate value of quantile q in [0, 1].
+    uint64_t quantile(double q) const {
+        const uint64_t total = count();
+        if (total == 0) return 0;
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * static_cast<double>(total) + 0.5));
+        uint64_t seen = 0;
+        for (size_t b = 0; b < buckets; ++b) {
+            seen += counts_[b].load(std::memory_order_relaxed);
+            if (seen >= rank) return std::min(lower_bound(b), max_.load(std::memory_order_relaxed));
+        }
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    // One line summary in microseconds.
+    void print(std::ostream& out) const {
+        const uint64_t total = count();
+        const auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+        const auto flags = out.flags();
+        const auto precision = out.precision();
+        out << std::fixed << std::setprecision(1) << "count " << total << " mean "
+            << (total ? us(sum_.load(std::memory_order_relaxed) / total) : 0.0) << " us, p50 " << us(quantile(0.5))
+            << " p90 " << us(quantile(0.9)) << " p99 " << us(quantile(0.99)) << " p99.9 " << us(quantile(0.999))
+            << " max " << us(max_.load(std::memory_order_relaxed)) << " us";
+        out.flags(flags);
+        out.precision(precision);
+    }
+};
@@ -0,0 +1,302 @@
+// Load generator for the scoring server. Every connection is served by its
+// own thread which keeps --pipeline requests in flight and measures latency
+// from sending a request to receiving its response.
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "cmdline.hpp"
+#include "histogram.hpp"
+#include "protocol.hpp"
+
+namespace {
+
+using namespace catboost::protocol;
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000u + uint64_t(ts.tv_nsec);
+}
+
+[[noreturn]] void fail(const std::string& what) {
+    throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+int connect_to(const std::string& tcp, const std::string& unix_path) {
+    if (!unix_path.empty()) {
+        struct sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (unix_path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("Unix socket path is too long");
+        std::memcpy(addr.sun_path, unix_path.data(), unix_path.size());
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) fail("socket");
+        if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+            close(fd);
+            fail("Can not connect to " + unix_path);
+        }
+        return fd;
+    }
+
+    const size_t colon = tcp.rfind(':');
+    if (colon == std::string::npos) throw std::runtime_error("TCP address should be host:port");
+    std::string host = tcp.substr(0, colon);
+    if (host.size() > 1 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* res = nullptr;
+    const int rv = getaddrinfo(host.c_str(), tcp.substr(colon + 1).c_str(), &hints, &res);
+    if (rv != 0) throw std::runtime_error("Can not resolve " + tcp + ": " + gai_strerror(rv));
+    const int fd = socket(res->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        freeaddrinfo(res);
+        fail("socket");
+    }
+    const bool ok = connect(fd, res->ai_addr, res->ai_addrlen) == 0;
+    freeaddrinfo(res);
+    if (!ok) {
+        close(fd);
+        fail("Can not connect to " + tcp);
+    }
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+void send_all(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        const ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fail("send");
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+void recv_all(int fd, void* data, size_t size) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        const ssize_t n = recv(fd, p, size, 0);
+        if (n == 0) throw std::runtime_error("Connection closed by server");
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fail("recv");
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+// Send a request without features and return payload of its response.
+std::string call(int fd, Op op, uint16_t model) {
+    const RequestHeader h{0, model, op, 0, 0, 0};
+    send_all(fd, &h, sizeof(h));
+    ResponseHeader r;
+    recv_all(fd, &r, sizeof(r));
+    std::string payload(r.size, '\0');
+    recv_all(fd, &payload[0], payload.size());
+    if (r.status != Ok) throw std::runtime_error(payload);
+    return payload;
+}
+
+// Examples from a TSV file with the label in the first column, as in perftest.
+std::vector<std::vector<float>> read_tsv(const std::string& path) {
+    std::ifstream in{path};
+    if (!in) throw std::runtime_error("Can not open " + path);
+    std::vector<std::vector<float>> rows;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ss{line};
+        std::vector<float> row;
+        float v;
+        ss >> v;
+        while (ss >> v) row.push_back(v);
+        if (!row.empty()) rows.push_back(std::move(row));
+    }
+    return rows;
+}
+
+struct Totals {
+    LatencyHistogram latency;
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> errors{0};
+};
+
+// Closed loop of one connection: keep depth requests in flight until deadline.
+void run_connection(const std::string& tcp, const std::string& unix_path, uint16_t model, uint8_t type,
+                    size_t rows, size_t depth, const std::vector<std::vector<float>>& data, size_t features,
+                    uint64_t deadline, size_t seed, Totals& totals) {
+    const int fd = connect_to(tcp, unix_path);
+
+    // Requests are prepared in advance from consecutive examples.
+    static constexpr size_t prepared = 64;
+    std::vector<std::vector<char>> requests(prepared);
+    size_t next = seed * rows;
+    for (auto& r : requests) {
+        r.resize(sizeof(RequestHeader) + rows * features * sizeof(float));
+        float* x = reinterpret_cast<float*>(r.data() + sizeof(RequestHeader));
+        for (size_t i = 0; i < rows; ++i, ++next) {
+            const auto& row = data[next % data.size()];
+            std::memcpy(x + i * features, row.data(), features * sizeof(float));
+        }
+    }
+
+    std::unordered_map<uint32_t, uint64_t> sent;
+    uint32_t id = 0;
+    const auto send_next = [&] {
+        auto& r = requests[id % prepared];
+        const RequestHeader h{id, model, Predict, type, static_cast<uint32_t>(rows), static_cast<uint32_t>(features)};
+        std::memcpy(r.data(), &h, sizeof(h));
+        sent[id++] = now_ns();
+        send_all(fd, r.data(), r.size());
+    };
+
+    for (size_t i = 0; i < depth; ++i) send_next();
+    std::string payload;
+    while (!sent.empty()) {
+        ResponseHeader r;
+        recv_all(fd, &r, sizeof(r));
+        payload.resize(r.size);
+        recv_all(fd, &payload[0], payload.size());
+        const uint64_t now = now_ns();
+
+        auto it = sent.find(r.id);
+        if (it != sent.end()) {
+            totals.latency.add(now - it->second);
+            sent.erase(it);
+        }
+        totals.requests.fetch_add(1, std::memory_order_relaxed);
+        if (r.status != Ok && totals.errors.fetch_add(1, std::memory_order_relaxed) == 0) {
+            std::cerr << "Error: " << payload << std::endl;
+        }
+        if (now < deadline) send_next();
+    }
+    close(fd);
+}
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    std::string tcp;
+    std::string unix_path;
+    std::string model = "0";
+    std::string type = "0";
+    std::string connections = "16";
+    std::string pipeline = "1";
+    std::string rows = "1";
+    std::string duration = "10";
+    std::string data_path;
+    bool server_stats = false;
+
+    CmdLine args{"generate load for the scoring server."};
+    args.arg("-t", tcp, "connect to TCP address host:port")
+        .aka("--tcp")
+        .arg("-u", unix_path, "connect to Unix socket path")
+        .aka("--unix")
+        .arg("-m", model, "index of the model (default: 0)")
+        .aka("--model")
+        .arg("--type", type, "prediction type as number of catboost::PredictionType (default: 0, raw values)")
+        .arg("-c", connections, "number of connections, each served by a thread (default: 16)")
+        .aka("--connections")
+        .arg("-p", pipeline, "requests in flight on every connection (default: 1)")
+        .aka("--pipeline")
+        .arg("-r", rows, "examples in every request (default: 1)")
+        .aka("--rows")
+        .arg("-d", duration, "duration of the test in seconds (default: 10)")
+        .aka("--duration")
+        .arg("--data", data_path, "TSV file of examples with labels in the first column (default: random examples)")
+        .flag("--stats", server_stats, "print statistics of the server after the test");
+
+    if (!args.parse(argc, argv)) {
+        return 1;
+    }
+
+    if (tcp.empty() == unix_path.empty()) {
+        std::cerr << "Error: either TCP address or Unix socket should be given" << std::endl;
+        return 1;
+    }
+
+    try {
+        const auto model_index = static_cast<uint16_t>(std::stoul(model));
+        const int fd = connect_to(tcp, unix_path);
+        const std::string info = call(fd, Info, model_index);
+        uint32_t model_info[2];
+        std::memcpy(model_info, info.data(), sizeof(model_info));
+        const size_t features = model_info[0];
+
+        std::vector<std::vector<float>> data;
+        if (!data_path.empty()) {
+            data = read_tsv(data_path);
+        } else {
+            std::mt19937 rng{42};
+            std::uniform_real_distribution<float> uniform{0.0f, 1.0f};
+            data.resize(1024);
+            for (auto& row : data) {
+                row.resize(features);
+                for (auto& v : row) v = uniform(rng);
+            }
+        }
+        for (auto& row : data) {
+            if (row.size() < features) throw std::runtime_error("Not enough features in data");
+        }
+        if (data.empty()) throw std::runtime_error("No examples in data");
+
+        const size_t n = std::stoul(connections);
+        const size_t r = std::max<size_t>(1, std::stoul(rows));
+        Totals totals;
+        const uint64_t start = now_ns();
+        const uint64_t deadline = start + uint64_t(std::stod(duration) * 1e9);
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < n; ++i) {
+            threads.emplace_back([&, i] {
+                try {
+                    run_connection(tcp, unix_path, model_index, static_cast<uint8_t>(std::stoul(type)), r,
+                                   std::max<size_t>(1, std::stoul(pipeline)), data, features, deadline, i, totals);
+                } catch (const std::exception& e) {
+                    std::cerr << "Error: " << e.what() << std::endl;
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+        const double seconds = double(now_ns() - start) / 1e9;
+
+        const uint64_t requests = totals.requests.load();
+        std::cout << requests << " requests (" << requests * r << " rows) in " << seconds << " seconds, "
+                  << double(requests) / seconds << " requests/sec, " << double(requests * r) / seconds
+                  << " rows/sec, " << totals.errors.load() << " errors" << std::endl;
+        std::cout << "latency: ";
+        totals.latency.print(std::cout);
+        std::cout << std::endl;
+
+        if (server_stats) std::cout << "server:" << std::endl << call(fd, Stats, 0);
+        close(fd);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
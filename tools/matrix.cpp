@@ -0,0 +1,227 @@
+// Convert a delimited text file of examples into a feature matrix (see
+// catboost::FeatureMatrix). The input is split into chunks at line
+// boundaries, threads count lines of every chunk and then parse chunks
+// straight into the mapped output file, so memory is taken only by pages of
+// the files.
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catboost.hpp"
+#include "cmdline.hpp"
+#include "tsv.hpp"
+
+namespace {
+
+// Writable mapping of a new file of the given size. The file is removed if
+// it is not committed.
+class OutputFile {
+    std::string path_;
+    int fd_ = -1;
+    char* data_ = nullptr;
+    size_t size_ = 0;
+
+public:
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    OutputFile(const std::string& path, size_t size) : path_(path), size_(size) {
+        fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd_ < 0) throw std::runtime_error("Can not open " + path + ": " + std::strerror(errno));
+        if (ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+            close(fd_);
+            unlink(path.c_str());
+            throw std::runtime_error("Can not resize " + path + ": " + std::strerror(errno));
+        }
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) {
+            close(fd_);
+            unlink(path.c_str());
+            throw std::runtime_error("Can not map " + path + ": " + std::strerror(errno));
+        }
+        data_ = static_cast<char*>(p);
+    }
+
+    ~OutputFile() {
+        if (data_) munmap(data_, size_);
+        if (fd_ >= 0) {
+            close(fd_);
+            unlink(path_.c_str());
+        }
+    }
+
+    char* data() { return data_; }
+
+    // Write pages to the file and close it.
+    void commit() {
+        const bool synced = msync(data_, size_, MS_SYNC) == 0;
+        munmap(data_, size_);
+        data_ = nullptr;
+        const bool closed = close(fd_) == 0;
+        fd_ = -1;
+        if (!synced || !closed) {
+            const std::string error = std::strerror(errno);
+            unlink(path_.c_str());
+            throw std::runtime_error("Can not write " + path_ + ": " + error);
+        }
+    }
+};
+
+// Run f(i) for i in [0, count) by threads, the first error is rethrown.
+void run_parallel(size_t threads, size_t count, const std::function<void(size_t)>& f) {
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    std::string error;
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < std::min(threads, count); ++t) {
+        workers.emplace_back([&] {
+            for (size_t i; (i = next.fetch_add(1)) < count;) {
+                try {
+                    f(i);
+                } catch (const std::exception& e) {
+                    std::lock_guard<std::mutex> lock{mutex};
+                    if (error.empty()) error = e.what();
+                    next.store(count);
+                }
+            }
+        });
+    }
+    for (auto& w : workers) w.join();
+    if (!error.empty()) throw std::runtime_error(error);
+}
+
+// Number of fields of the first non-empty line.
+size_t field_count(const char* begin, const char* end, char delimiter) {
+    size_t fields = 0;
+    for_each_line(begin, end, [&](const char* line, const char* line_end) {
+        fields = 1 + static_cast<size_t>(std::count(line, line_end, delimiter));
+        return false;
+    });
+    return fields;
+}
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    std::string input;
+    std::string output;
+    std::string delimiter = "\\t";
+    std::string layout = "columns";
+    std::string threads = "0";
+    bool label = false;
+    bool header = false;
+
+    CmdLine args{"convert a delimited text file of examples into a binary feature matrix."};
+    args.arg("-i", input, "input file, one example per line")
+        .aka("--input")
+        .arg("-o", output, "output feature matrix")
+        .aka("--output")
+        .flag("--label", label, "the first column is the label, as in perftest datasets")
+        .flag("--header", header, "skip the first line")
+        .arg("-d", delimiter, "column delimiter, one character or \\t (default: \\t)")
+        .aka("--delimiter")
+        .arg("--layout", layout, "columns or rows (default: columns)")
+        .arg("-j", threads, "number of threads (default: number of available CPUs)")
+        .aka("--threads");
+
+    if (!args.parse(argc, argv)) {
+        return 1;
+    }
+
+    if (input.empty() || output.empty()) {
+        std::cerr << "Error: input and output should be given" << std::endl;
+        return 1;
+    }
+
+    try {
+        if (delimiter == "\\t") delimiter = "\t";
+        if (delimiter.size() != 1 || delimiter[0] == '\n' || delimiter[0] == '\r') {
+            throw std::runtime_error("Delimiter should be one character");
+        }
+        const char delim = delimiter[0];
+        if (layout != "columns" && layout != "rows") throw std::runtime_error("Layout should be columns or rows");
+        const auto matrix_layout = layout == "rows" ? catboost::MatrixLayout::Rows : catboost::MatrixLayout::Columns;
+        size_t count = std::stoul(threads);
+        if (count == 0) count = catboost::default_executor().concurrency() + 1;
+
+        const auto start = std::chrono::steady_clock::now();
+        const catboost::MappedFile file{input, true};
+        const char* begin = file.data();
+        const char* end = begin + file.size();
+        if (header && begin < end) begin = std::min(end, find_newline(begin, end) + 1);
+
+        const size_t fields = field_count(begin, end, delim);
+        if (label && fields == 0) throw std::runtime_error("No examples in " + input);
+        const size_t features = label ? fields - 1 : fields;
+
+        // Rows are numbered by lines counted in every chunk.
+        const auto chunks = split_lines(begin, end, size_t(4) << 20);
+        std::vector<size_t> first_row(chunks.size() + 1, 0);
+        run_parallel(count, chunks.size(), [&](size_t i) {
+            size_t n = 0;
+            for_each_line(chunks[i].first, chunks[i].second, [&n](const char*, const char*) {
+                ++n;
+                return true;
+            });
+            first_row[i + 1] = n;
+        });
+        for (size_t i = 0; i < chunks.size(); ++i) first_row[i + 1] += first_row[i];
+        const size_t rows = first_row.back();
+
+        const catboost::MatrixHeader h = catboost::FeatureMatrix::header(rows, features, matrix_layout, label);
+        OutputFile out{output, static_cast<size_t>(h.size)};
+        std::memcpy(out.data(), &h, sizeof(h));
+        float* data = reinterpret_cast<float*>(out.data() + sizeof(h));
+        double* labels = label ? reinterpret_cast<double*>(out.data() + h.label_offset) : nullptr;
+        const size_t row_stride = matrix_layout == catboost::MatrixLayout::Rows ? h.stride : 1;
+        const size_t column_stride = matrix_layout == catboost::MatrixLayout::Columns ? h.stride : 1;
+
+        run_parallel(count, chunks.size(), [&](size_t i) {
+            std::vector<float> x(features);
+            size_t row = first_row[i];
+            for_each_line(chunks[i].first, chunks[i].second, [&](const char* line, const char* line_end) {
+                const char* p = line;
+                if (label) {
+                    double y = 0.0;
+                    p = parse_number(p, line_end, delim, y);
+                    if (p && p < line_end && *p == delim) {
+                        ++p;
+                    } else if (p && features > 0) {
+                        p = nullptr;
+                    }
+                    if (p) labels[row] = y;
+                }
+                if (!p || !parse_line(p, line_end, delim, 0, features, x.data())) {
+                    const size_t number = 1 + static_cast<size_t>(std::count(file.data(), line, '\n'));
+                    throw std::runtime_error("line " + std::to_string(number) + ": expected " +
+                                             std::to_string(fields) + " numbers");
+                }
+                for (size_t j = 0; j < features; ++j) data[row * row_stride + j * column_stride] = x[j];
+                ++row;
+                return true;
+            });
+        });
+        out.commit();
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cerr << "Converted " << rows << " examples of " << features << " features" << (label ? " and labels" : "")
+                  << " in " << seconds << " seconds" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
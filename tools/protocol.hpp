@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+// Binary protocol of the scoring server. A client sends requests and the
+// server sends one response to every request. Responses are matched to
+// requests by id and could come in any order: Info, Stats and errors are
+// answered at once, predictions when their batch is predicted. All values
+// are in little-endian byte order.
+//
+// Request: RequestHeader followed by rows * features float32 values of
+// examples, row by row.
+// Response: ResponseHeader followed by size bytes:
+//  - Predict: rows * dims float64 values, dims = size / rows / 8;
+//  - Info: two uint32 values, number of features and dimension of the model;
+//  - Stats: text with latency histograms of all models;
+//  - error status: text of the error.
+namespace catboost {
+namespace protocol {
+
+enum Op : uint8_t {
+    Predict = 0,
+    Info = 1,
+    Stats = 2,
+};
+
+enum Status : int32_t {
+    Ok = 0,
+    Error = 1,
+};
+
+struct RequestHeader {
+    // Returned in the response.
+    uint32_t id;
+    // Index of the model in the order of server arguments.
+    uint16_t model;
+    // Op of the request.
+    uint8_t op;
+    // catboost::PredictionType of predicted values.
+    uint8_t type;
+    uint32_t rows;
+    uint32_t features;
+};
+
+struct ResponseHeader {
+    uint32_t id;
+    int32_t status;
+    uint32_t rows;
+    uint32_t size;
+};
+
+static_assert(sizeof(RequestHeader) == 16, "Unexpected size of request header");
+static_assert(sizeof(ResponseHeader) == 16, "Unexpected size of response header");
+
+// Requests with more payload are rejected and their connections closed.
+static constexpr uint32_t max_payload = 64u << 20;
+
+} // namespace protocol
+} // namespace catboost
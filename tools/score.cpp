@@ -0,0 +1,314 @@
+// Score a delimited text file or a feature matrix of examples by a model.
+// The input is mapped into memory and split into chunks at line boundaries
+// or by rows. Worker threads take chunks in order, parse them and predict
+// every block of rows by the bucket kernels, and the main thread writes
+// predictions of finished chunks in the order of the input while the next
+// ones are scored.
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catboost.hpp"
+#include "cmdline.hpp"
+#include "tsv.hpp"
+
+namespace {
+
+struct Config {
+    char delimiter = '\t';
+    size_t skip = 0;
+    size_t block = 4096;
+    int precision = 17;
+    catboost::PredictionType type = catboost::PredictionType::RawFormulaVal;
+};
+
+// Part of the input predicted by one worker: lines of text or rows of a
+// matrix.
+struct Chunk {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    size_t first_row = 0;
+    size_t rows = 0;
+    std::string out;
+    std::string error;
+    bool done = false;
+};
+
+// Chunks and the state shared by workers and the writer.
+struct Job {
+    const catboost::Model& model;
+    const Config& config;
+    const char* data;
+    const catboost::FeatureMatrix* matrix = nullptr;
+    std::vector<Chunk> chunks;
+    size_t in_flight;
+
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::mutex mutex;
+    std::condition_variable chunk_done;
+    std::condition_variable chunk_written;
+    size_t written = 0;
+
+    Job(const catboost::Model& m, const Config& c, const char* d) : model(m), config(c), data(d) {}
+};
+
+void append(std::string& out, const double* values, size_t dims, const Config& config) {
+    char buffer[32];
+    for (size_t i = 0; i < dims; ++i) {
+        if (i) out += config.delimiter;
+        const int n = std::snprintf(buffer, sizeof(buffer), "%.*g", config.precision, values[i]);
+        out.append(buffer, static_cast<size_t>(n));
+    }
+    out += '\n';
+}
+
+// Parse and predict the chunk by blocks of rows.
+void score(Job& job, Chunk& chunk) {
+    const Config& config = job.config;
+    const size_t count = job.model.feature_count();
+    const size_t dims = job.model.dimension(config.type);
+
+    if (job.matrix) {
+        const catboost::FeatureMatrix& m = *job.matrix;
+        std::vector<double> values(chunk.rows * dims);
+        job.model.apply_strided(m.data() + static_cast<ptrdiff_t>(chunk.first_row) * m.row_stride(), chunk.rows,
+                                m.features(), m.row_stride(), m.column_stride(), values.data(), dims, config.type);
+        for (size_t i = 0; i < chunk.rows; ++i) append(chunk.out, &values[i * dims], dims, config);
+        return;
+    }
+
+    std::vector<float> features(config.block * count);
+    std::vector<const float*> rows(config.block);
+    for (size_t i = 0; i < config.block; ++i) rows[i] = &features[i * count];
+    std::vector<double> values(config.block * dims);
+
+    size_t n = 0;
+    const auto flush = [&] {
+        job.model.apply(rows.data(), n, count, values.data(), dims, config.type);
+        for (size_t i = 0; i < n; ++i) append(chunk.out, &values[i * dims], dims, config);
+        n = 0;
+    };
+    for_each_line(chunk.begin, chunk.end, [&](const char* line, const char* line_end) {
+        if (!parse_line(line, line_end, config.delimiter, config.skip, count, &features[n * count])) {
+            const size_t number = 1 + static_cast<size_t>(std::count(job.data, line, '\n'));
+            chunk.error = "line " + std::to_string(number) + ": expected " + std::to_string(count) +
+                          " numbers after " + std::to_string(config.skip) + " skipped columns";
+            return false;
+        }
+        if (++n == config.block) flush();
+        return true;
+    });
+    if (chunk.error.empty() && n > 0) flush();
+}
+
+void work(Job& job) {
+    for (;;) {
+        const size_t i = job.next.fetch_add(1);
+        if (i >= job.chunks.size()) return;
+        {
+            // Keep output of a bounded number of chunks in memory.
+            std::unique_lock<std::mutex> lock{job.mutex};
+            job.chunk_written.wait(lock, [&] { return i < job.written + job.in_flight || job.failed.load(); });
+        }
+        if (job.failed.load()) return;
+
+        Chunk& chunk = job.chunks[i];
+        try {
+            score(job, chunk);
+        } catch (const std::exception& e) {
+            chunk.error = e.what();
+        }
+
+        std::lock_guard<std::mutex> lock{job.mutex};
+        chunk.done = true;
+        job.chunk_done.notify_all();
+    }
+}
+
+void write_all(int fd, const char* p, size_t size) {
+    while (size > 0) {
+        const ssize_t n = ::write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("Can not write predictions: ") + std::strerror(errno));
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+catboost::PredictionType parse_type(const std::string& s) {
+    static const char* const names[] = {"RawFormulaVal", "Probability", "Class", "Exponent", "LogProbability"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (s == names[i] || s == std::to_string(i)) return static_cast<catboost::PredictionType>(i);
+    }
+    throw std::runtime_error("Unknown prediction type " + s);
+}
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    std::string model_path;
+    std::string input;
+    std::string output;
+    std::string type = "RawFormulaVal";
+    std::string delimiter = "\\t";
+    std::string skip = "0";
+    std::string threads = "0";
+    std::string chunk_mb = "4";
+    std::string precision = "17";
+    bool header = false;
+    bool quiet = false;
+    catboost::Options options;
+
+    CmdLine args{"score a delimited text file of features, one prediction line per example in input order."};
+    args.arg("-m", model_path, "path to the model")
+        .aka("--model")
+        .arg("-i", input, "input file, one example per line, or feature matrix written by catboost-matrix")
+        .aka("--input")
+        .arg("-o", output, "output file (default: standard output)")
+        .aka("--output")
+        .arg("--type", type,
+             "prediction type: RawFormulaVal, Probability, Class, Exponent, LogProbability or its number "
+             "(default: RawFormulaVal)")
+        .arg("-d", delimiter, "column delimiter, one character or \\t (default: \\t)")
+        .aka("--delimiter")
+        .arg("--skip-columns", skip, "columns before features, for example labels (default: 0)")
+        .flag("--header", header, "skip the first line")
+        .arg("-j", threads, "number of scoring threads (default: number of available CPUs)")
+        .aka("--threads")
+        .arg("--chunk-mb", chunk_mb, "megabytes of input scored by a thread at once (default: 4)")
+        .arg("--precision", precision, "significant digits of predictions (default: 17)")
+        .flag("--autotune", options.autotune, "choose kernels by benchmark on load")
+        .flag("--fixed-order", options.fixed_order, "bit-identical predictions of every build and kernel")
+        .flag("-q", quiet, "do not print throughput")
+        .aka("--quiet");
+
+    if (!args.parse(argc, argv)) {
+        return 1;
+    }
+
+    if (model_path.empty() || input.empty()) {
+        std::cerr << "Error: model and input should be given" << std::endl;
+        return 1;
+    }
+
+    int fd = -1;
+    try {
+        Config config;
+        if (delimiter == "\\t") delimiter = "\t";
+        if (delimiter.size() != 1 || delimiter[0] == '\n' || delimiter[0] == '\r') {
+            throw std::runtime_error("Delimiter should be one character");
+        }
+        config.delimiter = delimiter[0];
+        config.skip = std::stoul(skip);
+        config.precision = std::min(17, std::max(1, std::stoi(precision)));
+        config.type = parse_type(type);
+
+        catboost::Model model{model_path, options};
+        if (model.cat_feature_count() > 0) {
+            throw std::runtime_error("Models with categorical features are not supported");
+        }
+        if (model.dimension(config.type) == 0) {
+            throw std::runtime_error("Prediction type is not supported by the model");
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        const catboost::MappedFile file{input, true};
+        const char* begin = file.data();
+        const char* end = begin + file.size();
+        const size_t chunk_size = std::max<size_t>(1, std::stoul(chunk_mb)) << 20;
+
+        size_t count = std::stoul(threads);
+        if (count == 0) count = catboost::default_executor().concurrency() + 1;
+
+        Job job{model, config, file.data()};
+        job.in_flight = 2 * count;
+        catboost::FeatureMatrix matrix;
+        if (file.size() >= sizeof(catboost::MatrixHeader) && std::memcmp(begin, "CBMATRIX", 8) == 0) {
+            matrix.load(input);
+            job.matrix = &matrix;
+            const size_t row_size = sizeof(float) * std::max<size_t>(1, matrix.features());
+            const size_t step = std::max<size_t>(1, chunk_size / row_size);
+            for (size_t row = 0; row < matrix.rows(); row += step) {
+                job.chunks.emplace_back();
+                job.chunks.back().first_row = row;
+                job.chunks.back().rows = std::min(step, matrix.rows() - row);
+            }
+        } else {
+            if (header && begin < end) begin = std::min(end, find_newline(begin, end) + 1);
+            for (const auto& part : split_lines(begin, end, chunk_size)) {
+                job.chunks.emplace_back();
+                job.chunks.back().begin = part.first;
+                job.chunks.back().end = part.second;
+            }
+        }
+
+        fd = output.empty() ? STDOUT_FILENO : open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) throw std::runtime_error("Can not open " + output + ": " + std::strerror(errno));
+
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < count; ++i) workers.emplace_back([&job] { work(job); });
+
+        std::string error;
+        for (size_t i = 0; i < job.chunks.size() && error.empty(); ++i) {
+            Chunk& chunk = job.chunks[i];
+            {
+                std::unique_lock<std::mutex> lock{job.mutex};
+                job.chunk_done.wait(lock, [&] { return chunk.done; });
+            }
+            if (!chunk.error.empty()) {
+                error = chunk.error;
+                break;
+            }
+            try {
+                write_all(fd, chunk.out.data(), chunk.out.size());
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+            std::string().swap(chunk.out);
+
+            std::lock_guard<std::mutex> lock{job.mutex};
+            ++job.written;
+            job.chunk_written.notify_all();
+        }
+        if (!error.empty()) {
+            std::lock_guard<std::mutex> lock{job.mutex};
+            job.failed.store(true);
+            job.chunk_written.notify_all();
+        }
+        for (auto& t : workers) t.join();
+        if (!error.empty()) throw std::runtime_error(error);
+
+        if (fd != STDOUT_FILENO && close(fd) != 0) {
+            fd = -1;
+            throw std::runtime_error("Can not write " + output + ": " + std::strerror(errno));
+        }
+        fd = -1;
+
+        if (!quiet) {
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cerr << "Scored " << file.size() / 1048576.0 << " MB in " << seconds << " seconds, "
+                      << file.size() / 1048576.0 / seconds << " MB/s by " << count << " threads" << std::endl;
+        }
+    } catch (const std::exception& e) {
+        if (fd >= 0 && fd != STDOUT_FILENO) close(fd);
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
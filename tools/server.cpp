@@ -0,0 +1,661 @@
+// Scoring server: serves predictions of models over TCP and Unix sockets by
+// the binary protocol of protocol.hpp.
+//
+// Every worker thread has its own epoll instance, all of them wait on the
+// listening sockets (EPOLLEXCLUSIVE) and a connection is served by the
+// worker which accepted it, so workers share nothing but models. Examples
+// of requests read by a worker are collected into a pending batch of every
+// model, which is predicted as one bucket when it has --batch rows or when
+// its oldest example has waited --max-wait-us microseconds.
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "catboost.hpp"
+#include "cmdline.hpp"
+#include "histogram.hpp"
+#include "protocol.hpp"
+
+namespace {
+
+using namespace catboost::protocol;
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000u + uint64_t(ts.tv_nsec);
+}
+
+[[noreturn]] void fail(const std::string& what) {
+    throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+struct ServedModel {
+    std::string name;
+    catboost::Model model;
+    size_t features = 0;
+    LatencyHistogram latency;
+    std::atomic<uint64_t> rows{0};
+    std::atomic<uint64_t> batches{0};
+
+    ServedModel(const std::string& n, const std::string& path, const catboost::Options& options)
+        : name(n), model(path, options), features(model.feature_count()) {}
+};
+
+// Requests of a connection are not read while it has more unsent responses,
+// so a client which does not read them can not take all memory.
+static constexpr size_t max_pending_output = 16u << 20;
+
+struct Config {
+    size_t batch = 64;
+    uint64_t max_wait_ns = 200000;
+    size_t threads = 0;
+};
+
+class Server;
+
+// Worker thread serving its own connections.
+class Worker {
+    struct Connection {
+        int fd = -1;
+        uint64_t serial = 0;
+        std::vector<char> in;
+        size_t in_used = 0;
+        std::vector<char> out;
+        size_t out_sent = 0;
+        uint32_t events = EPOLLIN | EPOLLRDHUP;
+    };
+
+    // Request waiting in a pending batch. Its rows start at row first.
+    struct Item {
+        int fd;
+        uint64_t serial;
+        uint32_t id;
+        uint32_t rows;
+        size_t first;
+        catboost::PredictionType type;
+        uint64_t received;
+    };
+
+    struct Pending {
+        std::vector<float> features;
+        std::vector<Item> items;
+        size_t rows = 0;
+        uint64_t oldest = 0;
+    };
+
+    Server& server_;
+    int epoll_ = -1;
+    int timer_ = -1;
+    int wakeup_ = -1;
+    uint64_t serial_ = 0;
+    uint64_t deadline_ = 0;
+    std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+    std::vector<Pending> pending_;
+    std::vector<int> dirty_;
+    // Buffers of flush.
+    std::vector<const float*> rows_;
+    std::vector<double> values_;
+    std::vector<bool> done_;
+
+    void watch(int fd, uint32_t events, int op = EPOLL_CTL_ADD) {
+        struct epoll_event ev;
+        std::memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.fd = fd;
+        if (epoll_ctl(epoll_, op, fd, &ev) != 0) fail("epoll_ctl");
+    }
+
+    void accept_connection(int listener);
+    void close_connection(int fd);
+    void read_connection(Connection& c);
+    void write_connection(Connection& c);
+    void update_events(Connection& c);
+    void process(Connection& c, const RequestHeader& h, const float* x, uint64_t received);
+    void reply(int fd, uint64_t serial, uint32_t id, int32_t status, uint32_t rows, const void* data, size_t size);
+    void reply_error(Connection& c, uint32_t id, const std::string& message) {
+        reply(c.fd, c.serial, id, Error, 0, message.data(), message.size());
+    }
+    void flush(size_t model);
+    void flush_expired(uint64_t now);
+    void arm_timer();
+
+public:
+    explicit Worker(Server& server);
+    ~Worker();
+
+    void run();
+    void stop();
+};
+
+class Server {
+public:
+    Config config;
+    std::vector<std::unique_ptr<ServedModel>> models;
+    std::vector<int> listeners;
+    std::atomic<bool> stopping{false};
+
+    std::string stats() const {
+        std::ostringstream out;
+        for (size_t i = 0; i < models.size(); ++i) {
+            const ServedModel& m = *models[i];
+            const uint64_t batches = m.batches.load(std::memory_order_relaxed);
+            const uint64_t rows = m.rows.load(std::memory_order_relaxed);
+            out << std::fixed << std::setprecision(1) << i << " " << m.name << ": rows " << rows << ", batches " << batches << ", rows per batch "
+                << (batches ? double(rows) / double(batches) : 0.0) << ", latency ";
+            m.latency.print(out);
+            out << "\n";
+        }
+        return out.str();
+    }
+};
+
+Worker::Worker(Server& server) : server_(server), pending_(server.models.size()) {
+    epoll_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_ < 0) fail("epoll_create1");
+    timer_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_ < 0) fail("timerfd_create");
+    wakeup_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_ < 0) fail("eventfd");
+
+    watch(timer_, EPOLLIN);
+    watch(wakeup_, EPOLLIN);
+    for (int fd : server_.listeners) watch(fd, EPOLLIN | EPOLLEXCLUSIVE);
+}
+
+Worker::~Worker() {
+    for (auto& c : connections_) close(c.first);
+    close(wakeup_);
+    close(timer_);
+    close(epoll_);
+}
+
+void Worker::stop() {
+    const uint64_t one = 1;
+    if (write(wakeup_, &one, sizeof(one)) < 0) {
+        // The counter could not overflow, so the worker is woken anyway.
+    }
+}
+
+void Worker::accept_connection(int listener) {
+    // One connection per wakeup, so that other workers get the next ones.
+    const int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) return;
+
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    auto c = std::make_unique<Connection>();
+    c->fd = fd;
+    c->serial = ++serial_;
+    c->in.resize(64 * 1024);
+    watch(fd, EPOLLIN | EPOLLRDHUP);
+    connections_[fd] = std::move(c);
+}
+
+void Worker::close_connection(int fd) {
+    epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections_.erase(fd);
+}
+
+void Worker::read_connection(Connection& c) {
+    const int fd = c.fd;
+    for (;;) {
+        if (c.out.size() - c.out_sent > max_pending_output) {
+            update_events(c);
+            return;
+        }
+        if (c.in_used == c.in.size()) c.in.resize(c.in.size() * 2);
+        const ssize_t n = recv(fd, c.in.data() + c.in_used, c.in.size() - c.in_used, 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            close_connection(fd);
+            return;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        c.in_used += static_cast<size_t>(n);
+
+        const uint64_t received = now_ns();
+        size_t pos = 0;
+        while (c.in_used - pos >= sizeof(RequestHeader)) {
+            RequestHeader h;
+            std::memcpy(&h, c.in.data() + pos, sizeof(h));
+            const uint64_t payload = uint64_t(h.rows) * h.features * sizeof(float);
+            if (payload > max_payload) {
+                close_connection(fd);
+                return;
+            }
+            const size_t size = sizeof(h) + static_cast<size_t>(payload);
+            if (c.in_used - pos < size) {
+                if (c.in.size() < size) c.in.resize(size);
+                break;
+            }
+            process(c, h, reinterpret_cast<const float*>(c.in.data() + pos + sizeof(h)), received);
+            pos += size;
+        }
+        if (pos > 0) {
+            std::memmove(c.in.data(), c.in.data() + pos, c.in_used - pos);
+            c.in_used -= pos;
+        }
+    }
+}
+
+void Worker::process(Connection& c, const RequestHeader& h, const float* x, uint64_t received) {
+    if (h.op == Stats) {
+        const std::string text = server_.stats();
+        reply(c.fd, c.serial, h.id, Ok, 0, text.data(), text.size());
+        return;
+    }
+
+    if (h.model >= server_.models.size()) {
+        reply_error(c, h.id, "Unknown model " + std::to_string(h.model));
+        return;
+    }
+    ServedModel& m = *server_.models[h.model];
+
+    if (h.op == Info) {
+        const uint32_t info[2] = {static_cast<uint32_t>(m.features), static_cast<uint32_t>(m.model.dimension())};
+        reply(c.fd, c.serial, h.id, Ok, 0, info, sizeof(info));
+        return;
+    }
+
+    if (h.op != Predict) {
+        reply_error(c, h.id, "Unknown operation " + std::to_string(h.op));
+        return;
+    }
+
+    const auto type = static_cast<catboost::PredictionType>(h.type);
+    size_t dims = 0;
+    try {
+        dims = m.model.dimension(type);
+    } catch (const std::exception& e) {
+        reply_error(c, h.id, e.what());
+        return;
+    }
+    if (dims == 0) {
+        reply_error(c, h.id, "Prediction type is not supported by the model");
+        return;
+    }
+    if (h.features < m.features) {
+        reply_error(c, h.id, "Not enough features");
+        return;
+    }
+    if (h.rows == 0) {
+        reply(c.fd, c.serial, h.id, Ok, 0, nullptr, 0);
+        return;
+    }
+
+    // Only features used by the model are copied, rows of the batch are dense.
+    Pending& p = pending_[h.model];
+    if (p.items.empty()) p.oldest = received;
+    p.items.push_back(Item{c.fd, c.serial, h.id, h.rows, p.rows, type, received});
+    const size_t offset = p.features.size();
+    p.features.resize(offset + size_t(h.rows) * m.features);
+    for (uint32_t i = 0; i < h.rows; ++i) {
+        std::memcpy(&p.features[offset + i * m.features], x + size_t(i) * h.features, m.features * sizeof(float));
+    }
+    p.rows += h.rows;
+    if (p.rows >= server_.config.batch) flush(h.model);
+}
+
+void Worker::reply(int fd, uint64_t serial, uint32_t id, int32_t status, uint32_t rows, const void* data,
+                   size_t size) {
+    auto it = connections_.find(fd);
+    if (it == connections_.end() || it->second->serial != serial) return;
+    Connection& c = *it->second;
+
+    const ResponseHeader h{id, status, rows, static_cast<uint32_t>(size)};
+    const size_t offset = c.out.size();
+    c.out.resize(offset + sizeof(h) + size);
+    std::memcpy(c.out.data() + offset, &h, sizeof(h));
+    if (size) std::memcpy(c.out.data() + offset + sizeof(h), data, size);
+    if (offset == c.out_sent) dirty_.push_back(fd);
+}
+
+void Worker::write_connection(Connection& c) {
+    while (c.out_sent < c.out.size()) {
+        const ssize_t n = send(c.fd, c.out.data() + c.out_sent, c.out.size() - c.out_sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            close_connection(c.fd);
+            return;
+        }
+        c.out_sent += static_cast<size_t>(n);
+    }
+
+    if (c.out_sent == c.out.size()) {
+        c.out.clear();
+        c.out_sent = 0;
+    }
+    update_events(c);
+}
+
+// Wait for the socket to be writable while there are unsent responses, and
+// stop reading requests while there are too many of them.
+void Worker::update_events(Connection& c) {
+    const size_t unsent = c.out.size() - c.out_sent;
+    const uint32_t events = (unsent > 0 ? EPOLLOUT : 0u) | (unsent > max_pending_output ? 0u : EPOLLIN | EPOLLRDHUP);
+    if (events != c.events) {
+        c.events = events;
+        watch(c.fd, events, EPOLL_CTL_MOD);
+    }
+}
+
+// Predict the pending batch of the model. Examples of every prediction type
+// are predicted by one bucket.
+void Worker::flush(size_t model) {
+    Pending& p = pending_[model];
+    if (p.items.empty()) return;
+    ServedModel& m = *server_.models[model];
+    const std::vector<Item>& items = p.items;
+
+    done_.assign(items.size(), false);
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (done_[i]) continue;
+        const catboost::PredictionType type = items[i].type;
+        rows_.clear();
+        for (size_t j = i; j < items.size(); ++j) {
+            if (items[j].type != type) continue;
+            for (uint32_t r = 0; r < items[j].rows; ++r) {
+                rows_.push_back(&p.features[(items[j].first + r) * m.features]);
+            }
+        }
+
+        const size_t dims = m.model.dimension(type);
+        values_.resize(rows_.size() * dims);
+        std::string error;
+        try {
+            m.model.apply(rows_.data(), rows_.size(), m.features, values_.data(), dims, type);
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        m.rows.fetch_add(rows_.size(), std::memory_order_relaxed);
+        m.batches.fetch_add(1, std::memory_order_relaxed);
+
+        const uint64_t now = now_ns();
+        size_t row = 0;
+        for (size_t j = i; j < items.size(); ++j) {
+            const Item& item = items[j];
+            if (item.type != type) continue;
+            done_[j] = true;
+            if (error.empty()) {
+                reply(item.fd, item.serial, item.id, Ok, item.rows, &values_[row * dims],
+                      item.rows * dims * sizeof(double));
+            } else {
+                reply(item.fd, item.serial, item.id, Error, 0, error.data(), error.size());
+            }
+            row += item.rows;
+            m.latency.add(now - item.received);
+        }
+    }
+
+    p.features.clear();
+    p.items.clear();
+    p.rows = 0;
+}
+
+void Worker::flush_expired(uint64_t now) {
+    for (size_t i = 0; i < pending_.size(); ++i) {
+        if (!pending_[i].items.empty() && now - pending_[i].oldest >= server_.config.max_wait_ns) flush(i);
+    }
+}
+
+// Wake up when the oldest pending example has waited max_wait.
+void Worker::arm_timer() {
+    uint64_t deadline = 0;
+    for (const auto& p : pending_) {
+        if (p.items.empty()) continue;
+        const uint64_t d = p.oldest + server_.config.max_wait_ns;
+        if (deadline == 0 || d < deadline) deadline = d;
+    }
+    if (deadline == deadline_) return;
+    deadline_ = deadline;
+
+    struct itimerspec spec;
+    std::memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = static_cast<time_t>(deadline / 1000000000u);
+    spec.it_value.tv_nsec = static_cast<long>(deadline % 1000000000u);
+    timerfd_settime(timer_, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void Worker::run() {
+    static constexpr int max_events = 256;
+    struct epoll_event events[max_events];
+    while (!server_.stopping.load()) {
+        const int n = epoll_wait(epoll_, events, max_events, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fail("epoll_wait");
+        }
+
+        for (int i = 0; i < n; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == timer_) {
+                uint64_t expirations;
+                if (read(timer_, &expirations, sizeof(expirations)) < 0) {
+                    // Timer was re-armed after it had expired.
+                }
+                deadline_ = 0;
+                continue;
+            }
+            if (fd == wakeup_) continue;
+            if (std::find(server_.listeners.begin(), server_.listeners.end(), fd) != server_.listeners.end()) {
+                accept_connection(fd);
+                continue;
+            }
+
+            auto it = connections_.find(fd);
+            if (it == connections_.end()) continue;
+            Connection& c = *it->second;
+            if (events[i].events & EPOLLOUT) {
+                write_connection(c);
+                if (connections_.find(fd) == connections_.end()) continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) read_connection(c);
+        }
+
+        flush_expired(now_ns());
+        for (int fd : dirty_) {
+            auto it = connections_.find(fd);
+            if (it != connections_.end()) write_connection(*it->second);
+        }
+        dirty_.clear();
+        arm_timer();
+    }
+}
+
+int listen_tcp(const std::string& address) {
+    const size_t colon = address.rfind(':');
+    if (colon == std::string::npos) throw std::runtime_error("TCP address should be host:port");
+    std::string host = address.substr(0, colon);
+    const std::string port = address.substr(colon + 1);
+    if (host.size() > 1 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    struct addrinfo* res = nullptr;
+    const int rv = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &res);
+    if (rv != 0) throw std::runtime_error("Can not resolve " + address + ": " + gai_strerror(rv));
+
+    const int fd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        freeaddrinfo(res);
+        fail("socket");
+    }
+    const int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    const bool ok = bind(fd, res->ai_addr, res->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0;
+    freeaddrinfo(res);
+    if (!ok) fail("Can not listen on " + address);
+    return fd;
+}
+
+int listen_unix(const std::string& path) {
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("Unix socket path is too long: " + path);
+    std::memcpy(addr.sun_path, path.data(), path.size());
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) fail("socket");
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        fail("Can not listen on " + path);
+    }
+    return fd;
+}
+
+// CPUs the process could run on, workers are pinned to them one by one.
+std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int i = 0; i < CPU_SETSIZE; ++i) {
+            if (CPU_ISSET(i, &set)) cpus.push_back(i);
+        }
+    }
+    return cpus;
+}
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    std::vector<std::string> model_args;
+    std::vector<std::string> tcp;
+    std::vector<std::string> unix_paths;
+    std::string batch = "64";
+    std::string max_wait = "200";
+    std::string threads = "0";
+    catboost::Options options;
+
+    CmdLine args{"serve predictions of models over TCP and Unix sockets."};
+    args.action("-m", [&](const char* v) { model_args.emplace_back(v); },
+                "model to serve as path or name=path, models are numbered in the order of arguments")
+        .aka("--model")
+        .action("-t", [&](const char* v) { tcp.emplace_back(v); }, "listen on TCP address host:port")
+        .aka("--tcp")
+        .action("-u", [&](const char* v) { unix_paths.emplace_back(v); }, "listen on Unix socket path")
+        .aka("--unix")
+        .arg("-b", batch, "rows predicted together by a worker (default: 64)")
+        .aka("--batch")
+        .arg("-w", max_wait, "longest wait of a row for others in microseconds (default: 200)")
+        .aka("--max-wait-us")
+        .arg("-j", threads, "number of worker threads (default: number of CPUs)")
+        .aka("--threads")
+        .flag("--autotune", options.autotune, "choose kernels by benchmark on load");
+
+    if (!args.parse(argc, argv)) {
+        return 1;
+    }
+
+    if (model_args.empty() || (tcp.empty() && unix_paths.empty())) {
+        std::cerr << "Error: at least one model and one address should be given" << std::endl;
+        return 1;
+    }
+
+    // Signals are handled by the main thread, workers inherit the mask.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    Server server;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> worker_threads;
+    try {
+        server.config.batch = std::max<size_t>(1, std::stoul(batch));
+        server.config.max_wait_ns = std::stoull(max_wait) * 1000;
+        server.config.threads = std::stoul(threads);
+
+        for (const auto& arg : model_args) {
+            const size_t eq = arg.find('=');
+            const std::string name = eq == std::string::npos ? arg : arg.substr(0, eq);
+            const std::string path = eq == std::string::npos ? arg : arg.substr(eq + 1);
+            server.models.push_back(std::make_unique<ServedModel>(name, path, options));
+            std::cerr << server.models.size() - 1 << " " << name << ": " << server.models.back()->model.stats()
+                      << std::endl;
+        }
+        for (const auto& a : tcp) server.listeners.push_back(listen_tcp(a));
+        for (const auto& p : unix_paths) server.listeners.push_back(listen_unix(p));
+
+        const std::vector<int> cpus = allowed_cpus();
+        size_t count = server.config.threads;
+        if (count == 0) count = cpus.empty() ? std::max(1u, std::thread::hardware_concurrency()) : cpus.size();
+        for (size_t i = 0; i < count; ++i) workers.push_back(std::make_unique<Worker>(server));
+        for (size_t i = 0; i < count; ++i) {
+            worker_threads.emplace_back([&workers, i] {
+                try {
+                    workers[i]->run();
+                } catch (const std::exception& e) {
+                    std::cerr << "Error: " << e.what() << std::endl;
+                    std::exit(1);
+                }
+            });
+            if (count <= cpus.size()) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpus[i], &set);
+                pthread_setaffinity_np(worker_threads.back().native_handle(), sizeof(set), &set);
+            }
+        }
+        std::cerr << "Serving " << server.models.size() << " models by " << count << " workers" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    for (;;) {
+        int sig = 0;
+        if (sigwait(&signals, &sig) != 0) continue;
+        if (sig == SIGUSR1) {
+            std::cerr << server.stats() << std::flush;
+            continue;
+        }
+        break;
+    }
+
+    server.stopping.store(true);
+    for (auto& w : workers) w->stop();
+    for (auto& t : worker_threads) t.join();
+    workers.clear();
+    for (int fd : server.listeners) close(fd);
+    for (const auto& p : unix_paths) unlink(p.c_str());
+    std::cerr << server.stats() << std::flush;
+    return 0;
+}
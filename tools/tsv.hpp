@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) && !defined(NOSSE)
+#include <emmintrin.h>
+#endif
+
+#include "../src/mapped_file.hpp"
+
+// Fast parsing of delimited text files of numbers, used by tools. Input
+// files are read by catboost::MappedFile with the sequential hint.
+
+// Position of the first '\n' in [p, end) or end. Looks at 16 bytes at once.
+inline const char* find_newline(const char* p, const char* end) {
+#if defined(__SSE2__) && !defined(NOSSE)
+    const __m128i nl = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        if (mask) return p + __builtin_ctz(static_cast<unsigned>(mask));
+        p += 16;
+    }
+#endif
+    const void* found = std::memchr(p, '\n', static_cast<size_t>(end - p));
+    return found ? static_cast<const char*>(found) : end;
+}
+
+// Split [begin, end) into parts of about size bytes ending after '\n'.
+inline std::vector<std::pair<const char*, const char*>> split_lines(const char* begin, const char* end, size_t size) {
+    std::vector<std::pair<const char*, const char*>> parts;
+    while (begin < end) {
+        const char* last = static_cast<size_t>(end - begin) > size ? find_newline(begin + size, end) : end;
+        if (last < end) ++last;
+        parts.emplace_back(begin, last);
+        begin = last;
+    }
+    return parts;
+}
+
+// Call f(line, line_end) for every non-empty line of [begin, end) without
+// the line break until it returns false.
+template <typename F>
+inline void for_each_line(const char* begin, const char* end, F&& f) {
+    while (begin < end) {
+        const char* eol = find_newline(begin, end);
+        const char* line_end = eol > begin && eol[-1] == '\r' ? eol - 1 : eol;
+        if (line_end > begin && !f(begin, line_end)) return;
+        begin = eol < end ? eol + 1 : eol;
+    }
+}
+
+// Parse a number of a field ending at delimiter, '\r', '\n' or end. Returns
+// position after the number or nullptr if the field is not a number.
+// Decimal numbers with up to 19 significant digits and exponent within 22
+// are computed by one exact operation on doubles, so they are correctly
+// rounded, other ones are parsed by strtod. The result is the same as of
+// strtod in both cases.
+inline const char* parse_number(const char* p, const char* end, char delimiter, double& out) {
+    static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const char* s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+')) negative = *s++ == '-';
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    for (; s < end && static_cast<unsigned>(*s - '0') < 10; ++s) {
+        any = true;
+        if (mantissa || *s != '0') {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + static_cast<unsigned>(*s - '0');
+            } else {
+                ++exponent;
+            }
+            ++digits;
+        }
+    }
+    if (s < end && *s == '.') {
+        for (++s; s < end && static_cast<unsigned>(*s - '0') < 10; ++s) {
+            any = true;
+            if (mantissa || *s != '0') {
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + static_cast<unsigned>(*s - '0');
+                    --exponent;
+                }
+                ++digits;
+            } else {
+                --exponent;
+            }
+        }
+    }
+    if (any && s < end && (*s == 'e' || *s == 'E')) {
+        const char* e = s + 1;
+        bool exp_negative = false;
+        if (e < end && (*e == '-' || *e == '+')) exp_negative = *e++ == '-';
+        int value = 0;
+        bool exp_any = false;
+        for (; e < end && static_cast<unsigned>(*e - '0') < 10; ++e) {
+            exp_any = true;
+            if (value < 100000) value = value * 10 + (*e - '0');
+        }
+        if (exp_any) {
+            exponent += exp_negative ? -value : value;
+            s = e;
+        }
+    }
+
+    const bool terminated = s == end || *s == delimiter || *s == '\n' || *s == '\r';
+    if (any && terminated && digits <= 19 && mantissa <= (uint64_t(1) << 53) && exponent >= -22 &&
+        exponent <= 22) {
+        double v = static_cast<double>(mantissa);
+        v = exponent < 0 ? v / powers[-exponent] : v * powers[exponent];
+        out = negative ? -v : v;
+        return s;
+    }
+
+    // Slow path: copy the field to terminate it for strtod.
+    const char* field_end = p;
+    while (field_end < end && *field_end != delimiter && *field_end != '\n' && *field_end != '\r') ++field_end;
+    char buffer[128];
+    const size_t size = static_cast<size_t>(field_end - p);
+    if (size == 0 || size >= sizeof(buffer)) return nullptr;
+    std::memcpy(buffer, p, size);
+    buffer[size] = '\0';
+    char* parsed = nullptr;
+    out = std::strtod(buffer, &parsed);
+    if (parsed != buffer + size) return nullptr;
+    return field_end;
+}
+
+// Parse count numbers of a line after skipping skip fields. Other fields of
+// the line are ignored. Returns false if the line has fewer numbers.
+inline bool parse_line(const char* p, const char* end, char delimiter, size_t skip, size_t count, float* out) {
+    for (size_t i = 0; i < skip; ++i) {
+        while (p < end && *p != delimiter) ++p;
+        if (p == end) return false;
+        ++p;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        double v;
+        p = parse_number(p, end, delimiter, v);
+        if (!p) return false;
+        out[i] = static_cast<float>(v);
+        if (i + 1 < count) {
+            if (p == end || *p != delimiter) return false;
+            ++p;
+        }
+    }
+    return true;
+}
@@ -1,13 +1,26 @@
 #include "catboost.hpp"
 #include "cb.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <iterator>
+#include <random>
+#include <set>
+#include <sstream>
 #include <string>
+#include <thread>
 
 #include "../src/json.hpp"
+#include "../src/parallel.hpp"
+#include "../tools/tsv.hpp"
 
 namespace {
 std::string root_path = ".";
@@ -72,6 +85,15 @@ static bool one_test(const std::string& name) {
             CHECK_FEQ(p, data.y[i], 0.001);
         }
 
+        for (auto kernel : {catboost::Kernel::Plain, catboost::Kernel::Pipelined}) {
+            model.set_kernel(kernel);
+            CHECK(model.kernel() == kernel);
+            for (size_t i = 0; i < data.x.size() && i < data.y.size(); ++i) {
+                float p = model.apply(data.x[i]);
+                CHECK_FEQ(p, data.y[i], 0.001);
+            }
+        }
+
         std::vector<double> y;
         model.apply(data.x, y);
 
@@ -79,6 +101,59 @@ static bool one_test(const std::string& name) {
         for (size_t i = 0; i < data.x.size() && i < data.y.size(); ++i) {
             CHECK_FEQ(y[i], data.y[i], 0.001);
         }
+
+        // One-dimensional models could be applied as multidimensional ones:
+        CHECK(model.dimension() == 1);
+        for (size_t i = 0; i < data.x.size(); ++i) {
+            double out = 0.0;
+            model.apply(data.x[i], &out, 1);
+            CHECK(out == model.apply(data.x[i]));
+        }
+
+        for (size_t width : {1, 2, 4, 8, 16}) {
+            catboost::Options options;
+            options.batch_width = width;
+            model.set_options(options);
+            CHECK(model.stats().batch_width == width);
+            model.apply(data.x, y);
+            for (size_t i = 0; i < data.x.size() && i < data.y.size(); ++i) {
+                CHECK_FEQ(y[i], data.y[i], 0.001);
+            }
+        }
+    }
+
+    {
+        catboost::Options options;
+        options.autotune = true;
+        catboost::Model model{path_to("testdata/" + name + "-model.json"), options};
+        auto stats = model.stats();
+        CHECK(stats.autotuned);
+        CHECK(stats.kernel != catboost::Kernel::Auto);
+        CHECK(stats.batch_width != 0);
+
+        std::vector<double> y;
+        model.apply(data.x, y);
+        for (size_t i = 0; i < data.x.size() && i < data.y.size(); ++i) {
+            CHECK_FEQ(model.apply(data.x[i]), data.y[i], 0.001);
+            CHECK_FEQ(y[i], data.y[i], 0.001);
+        }
+
+        // Explicit values are not tuned:
+        options.kernel = catboost::Kernel::Pipelined;
+        options.batch_width = 2;
+        model.set_options(options);
+        CHECK(model.stats().kernel == catboost::Kernel::Pipelined);
+        CHECK(model.stats().batch_width == 2);
+        CHECK(!model.stats().autotuned);
+
+        bool thrown = false;
+        try {
+            options.batch_width = 3;
+            model.set_options(options);
+        } catch (const std::exception&) {
+            thrown = true;
+        }
+        CHECK(thrown);
     }
 
     {
@@ -106,11 +181,2591 @@ static bool one_test(const std::string& name) {
     return true;
 }
 
+// Executor that counts submitted tasks and runs them on new threads.
+struct CountingExecutor : catboost::Executor {
+    std::vector<std::thread> threads;
+    size_t submitted = 0;
+
+    ~CountingExecutor() override {
+        for (auto& t : threads) t.join();
+    }
+
+    size_t concurrency() const override { return 3; }
+
+    void submit(std::function<void()> task) override {
+        ++submitted;
+        threads.emplace_back(std::move(task));
+    }
+};
+
+static void c_submit(void* ctx, void (*task)(void*), void* arg) {
+    static_cast<CountingExecutor*>(ctx)->submit([task, arg] { task(arg); });
+}
+
+// Errors of parallel loops are rethrown by the calling thread after all
+// started calls finish, and pool threads survive throwing tasks.
+static bool parallel_error_test() {
+    catboost::ThreadPool pool{3};
+    for (size_t bad : {size_t(0), size_t(5000), size_t(9999)}) {
+        std::atomic<size_t> calls{0};
+        bool thrown = false;
+        try {
+            catboost::parallel_for(pool, 10000, [&](size_t i) {
+                calls.fetch_add(1);
+                if (i == bad) throw std::runtime_error("bad index");
+            });
+        } catch (const std::runtime_error& e) {
+            thrown = std::string(e.what()) == "bad index";
+        }
+        CHECK(thrown);
+        CHECK(calls.load() >= 1 && calls.load() <= 10000);
+    }
+
+    for (size_t i = 0; i < 3; ++i) pool.submit([] { throw std::runtime_error("task"); });
+    std::atomic<size_t> calls{0};
+    catboost::parallel_for(pool, 10000, [&](size_t) { calls.fetch_add(1); });
+    CHECK(calls.load() == 10000);
+    return true;
+}
+
+static bool parallel_test(const std::string& name) {
+    std::vector<std::vector<float>> x;
+    {
+        std::ifstream f{path_to("testdata/" + name + ".json")};
+        nlohmann::json value = nlohmann::json::parse(f);
+        // Make bucket large enough to be split into many chunks:
+        for (size_t i = 0; i < 100; ++i) {
+            for (const auto& row : value.at("x")) {
+                std::vector<float> v;
+                for (const auto& a : row) {
+                    v.push_back(a.get<double>());
+                }
+                x.push_back(v);
+            }
+        }
+    }
+
+    std::vector<const float*> xx;
+    for (const auto& row : x) xx.push_back(row.data());
+
+    catboost::Options options;
+    options.parallel_min_rows = 1;
+    catboost::Model model{path_to("testdata/" + name + "-model.json"), options};
+    std::vector<double> expected;
+    model.apply(x, expected);
+
+    {
+        catboost::ThreadPool pool{3};
+        CHECK(pool.concurrency() == 3);
+        std::vector<double> y(x.size());
+        model.apply_parallel(xx.data(), xx.size(), x[0].size(), y.data(), &pool);
+        CHECK(y == expected);
+
+        y.assign(x.size(), 0.0);
+        model.apply_parallel(xx.data(), xx.size(), x[0].size(), y.data());
+        CHECK(y == expected);
+    }
+
+    {
+        CountingExecutor executor;
+        std::vector<double> y(x.size());
+        model.apply_parallel(xx.data(), xx.size(), x[0].size(), y.data(), &executor);
+        CHECK(executor.submitted == 3);
+        CHECK(y == expected);
+
+        // Small buckets stay at the calling thread:
+        options.parallel_min_rows = x.size() + 1;
+        model.set_options(options);
+        model.apply_parallel(xx.data(), xx.size(), x[0].size(), y.data(), &executor);
+        CHECK(executor.submitted == 3);
+    }
+
+    {
+        CountingExecutor executor;
+        catboost_executor_t cexecutor{executor.concurrency(), c_submit, &executor};
+        catboost_model_info_t* cmodel = cb_model_load(path_to("testdata/" + name + "-model.json").c_str());
+        CHECK(cmodel != nullptr);
+        std::vector<double> y(x.size());
+        CHECK(cb_model_apply_parallel(cmodel, xx.data(), xx.size(), x[0].size(), y.data(), &cexecutor) == 0);
+        CHECK(cb_model_apply_parallel(cmodel, xx.data(), xx.size(), x[0].size(), y.data(), nullptr) == 0);
+        cb_model_free(cmodel);
+        CHECK(y == expected);
+    }
+
+    return true;
+}
+
+static bool tree_parallel_test(const std::string& name) {
+    Test data;
+    {
+        std::ifstream f{path_to("testdata/" + name + ".json")};
+        nlohmann::json value = nlohmann::json::parse(f);
+        for (const auto& x : value.at("x")) {
+            std::vector<float> v;
+            for (const auto& a : x) {
+                v.push_back(a.get<double>());
+            }
+            data.x.push_back(v);
+        }
+    }
+
+    catboost::Model model{path_to("testdata/" + name + "-model.json")};
+    std::vector<double> expected;
+    for (const auto& x : data.x) expected.push_back(model.apply(x));
+
+    // Small models are evaluated by one thread:
+    catboost::Options options;
+    options.tree_threads = 3;
+    model.set_options(options);
+    CHECK(model.stats().tree_threads == 1);
+
+    options.tree_parallel_min_trees = 1;
+    model.set_options(options);
+    CHECK(model.stats().tree_threads == 3);
+
+    std::vector<double> first;
+    for (const auto& x : data.x) first.push_back(model.apply(x));
+    for (size_t i = 0; i < data.x.size(); ++i) {
+        CHECK_FEQ(first[i], expected[i], 1e-9);
+    }
+
+    // Concurrent predictions give the same results:
+    std::vector<std::thread> threads;
+    std::atomic<size_t> mismatches{0};
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (size_t iter = 0; iter < 100; ++iter) {
+                for (size_t i = 0; i < data.x.size(); ++i) {
+                    if (model.apply(data.x[i]) != first[i]) ++mismatches;
+                }
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    CHECK(mismatches == 0);
+
+    options.tree_threads = 1;
+    model.set_options(options);
+    CHECK(model.stats().tree_threads == 1);
+
+    return true;
+}
+
+// Sum leaves of the model in the order of trees without any optimizations.
+static double reference_apply(const nlohmann::json& model, const std::vector<float>& x) {
+    double res = 0.0;
+    for (const auto& tree : model.value("oblivious_trees", nlohmann::json::array())) {
+        size_t idx = 0;
+        size_t one = 1;
+        for (const auto& split : tree.at("splits")) {
+            float border = split.at("border").get<double>();
+            if (x[split.at("float_feature_index").get<size_t>()] > border) idx |= one;
+            one <<= 1;
+        }
+        res += tree.at("leaf_values").at(idx).get<double>();
+    }
+
+    for (const auto& tree : model.value("trees", nlohmann::json::array())) {
+        const nlohmann::json* node = &tree;
+        while (node->count("split")) {
+            const auto& split = node->at("split");
+            float border = split.at("border").get<double>();
+            bool right = x[split.at("float_feature_index").get<size_t>()] > border;
+            node = &node->at(right ? "right" : "left");
+        }
+        res += node->at("value").get<double>();
+    }
+
+    double scale = 1.0;
+    double bias = 0.0;
+    if (model.count("scale_and_bias")) {
+        const auto& scale_and_bias = model.at("scale_and_bias");
+        scale = scale_and_bias.at(0).get<double>();
+        const auto& node = scale_and_bias.at(1);
+        bias = node.is_number() ? node.get<double>() : node.at(0).get<double>();
+    }
+    return scale * res + bias;
+}
+
+static bool fixed_order_test(const std::string& name) {
+    Test data;
+    nlohmann::json json_model;
+    {
+        std::ifstream f{path_to("testdata/" + name + ".json")};
+        nlohmann::json value = nlohmann::json::parse(f);
+        for (const auto& x : value.at("x")) {
+            std::vector<float> v;
+            for (const auto& a : x) {
+                v.push_back(a.get<double>());
+            }
+            data.x.push_back(v);
+        }
+        std::ifstream m{path_to("testdata/" + name + "-model.json")};
+        json_model = nlohmann::json::parse(m);
+    }
+
+    catboost::Options options;
+    options.fixed_order = true;
+    options.tree_threads = 3;
+    options.tree_parallel_min_trees = 1;
+
+    // Results are exactly the same as plain sum in the order of trees for
+    // every kernel and batch width:
+    for (auto kernel : {catboost::Kernel::Plain, catboost::Kernel::Pipelined}) {
+        options.kernel = kernel;
+        catboost::Model model{path_to("testdata/" + name + "-model.json"), options};
+        CHECK(model.stats().tree_threads == 1);
+
+        std::vector<double> expected;
+        for (const auto& x : data.x) expected.push_back(reference_apply(json_model, x));
+
+        std::vector<double> y;
+        for (const auto& x : data.x) y.push_back(model.apply(x));
+        CHECK(y == expected);
+
+        for (size_t width : {1, 4, 16}) {
+            options.batch_width = width;
+            model.set_options(options);
+            model.apply(data.x, y);
+            CHECK(y == expected);
+        }
+        options.batch_width = 0;
+    }
+
+    return true;
+}
+
+static bool multi_test(const std::string& name, size_t dims) {
+    Test data;
+    std::vector<std::vector<double>> expected;
+    {
+        std::ifstream f{path_to("testdata/" + name + ".json")};
+        nlohmann::json value = nlohmann::json::parse(f);
+        for (const auto& x : value.at("x")) {
+            std::vector<float> v;
+            for (const auto& a : x) {
+                v.push_back(a.get<double>());
+            }
+            data.x.push_back(v);
+        }
+        for (const auto& y : value.at("y")) expected.push_back(y.get<std::vector<double>>());
+    }
+
+    catboost::Model model{path_to("testdata/" + name + "-model.json")};
+    CHECK(model.dimension() == dims);
+    CHECK(model.stats().dimension == dims);
+
+    bool thrown = false;
+    try {
+        model.apply(data.x[0]);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    std::vector<double> out(dims + 1);
+    thrown = false;
+    try {
+        model.apply(data.x[0], out.data(), dims + 1);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    for (size_t i = 0; i < data.x.size(); ++i) {
+        model.apply(data.x[i], out.data(), dims);
+        for (size_t d = 0; d < dims; ++d) CHECK_FEQ(out[d], expected[i][d], 1e-9);
+    }
+
+    std::vector<const float*> xx;
+    for (const auto& x : data.x) xx.push_back(x.data());
+    std::vector<double> y(xx.size() * dims);
+
+    for (bool fixed_order : {false, true}) {
+        catboost::Options options;
+        options.fixed_order = fixed_order;
+        model.set_options(options);
+
+        // Batches of every size give the same results as single predictions:
+        for (size_t size = 1; size <= xx.size(); ++size) {
+            model.apply(xx.data(), size, data.x[0].size(), y.data(), dims);
+            for (size_t i = 0; i < size; ++i) {
+                model.apply(data.x[i], out.data(), dims);
+                for (size_t d = 0; d < dims; ++d) {
+                    CHECK_FEQ(y[i * dims + d], expected[i][d], 1e-9);
+                    if (fixed_order) CHECK(y[i * dims + d] == out[d]);
+                }
+            }
+        }
+    }
+
+    std::ifstream f{path_to("testdata/" + name + "-model.json")};
+    std::string json{std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>()};
+    catboost_model_info_t* cmodel = cb_model_load_from_string(json.data(), json.size());
+    CHECK(cmodel != nullptr);
+    CHECK(cb_model_dimension(cmodel) == dims);
+    CHECK(cb_model_apply_multi(cmodel, data.x[0].data(), data.x[0].size(), out.data(), dims) == 0);
+    for (size_t d = 0; d < dims; ++d) CHECK_FEQ(out[d], expected[0][d], 1e-9);
+    CHECK(cb_model_apply_multi(cmodel, data.x[0].data(), data.x[0].size(), out.data(), dims + 1) == -1);
+    CHECK(cb_model_apply_multi_many(cmodel, xx.data(), xx.size(), data.x[0].size(), y.data(), dims) == 0);
+    for (size_t i = 0; i < xx.size(); ++i) {
+        for (size_t d = 0; d < dims; ++d) CHECK_FEQ(y[i * dims + d], expected[i][d], 1e-9);
+    }
+    cb_model_free(cmodel);
+
+    return true;
+}
+
+static bool cat_test(const std::string& name) {
+    Test data;
+    std::vector<double> expected;
+    std::vector<std::vector<std::string>> cats;
+    std::vector<std::vector<int32_t>> hashes;
+    {
+        std::ifstream f{path_to("testdata/" + name + ".json")};
+        nlohmann::json value = nlohmann::json::parse(f);
+        for (const auto& x : value.at("x")) data.x.push_back(x.get<std::vector<float>>());
+        for (const auto& y : value.at("y")) expected.push_back(y.get<double>());
+        for (const auto& c : value.at("cat")) cats.push_back(c.get<std::vector<std::string>>());
+        for (const auto& h : value.at("hash")) hashes.push_back(h.get<std::vector<int32_t>>());
+    }
+
+    for (size_t i = 0; i < cats.size(); ++i) {
+        for (size_t j = 0; j < cats[i].size(); ++j) CHECK(catboost::hash_cat_feature(cats[i][j]) == hashes[i][j]);
+    }
+    CHECK(catboost::hash_cat_feature(int64_t{-7}) == catboost::hash_cat_feature("-7"));
+    CHECK(catboost::hash_cat_feature(int64_t{42}) == catboost::hash_cat_feature("42"));
+
+    catboost::Model model{path_to("testdata/" + name + "-model.json")};
+    const size_t cat_count = cats[0].size();
+    CHECK(model.cat_feature_count() == cat_count);
+    CHECK(model.stats().ctr_count == 5);
+
+    bool thrown = false;
+    try {
+        model.apply(data.x[0]);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    std::vector<const float*> xx;
+    std::vector<const int32_t*> hh;
+    for (size_t i = 0; i < data.x.size(); ++i) {
+        xx.push_back(data.x[i].data());
+        hh.push_back(hashes[i].data());
+    }
+    std::vector<double> y(xx.size());
+
+    for (bool fixed_order : {false, true}) {
+        catboost::Options options;
+        options.fixed_order = fixed_order;
+        model.set_options(options);
+
+        for (size_t i = 0; i < data.x.size(); ++i) {
+            CHECK_FEQ(model.apply(data.x[i], cats[i]), expected[i], 1e-9);
+            double out = 0.0;
+            model.apply(xx[i], data.x[i].size(), hh[i], cat_count, &out, 1);
+            CHECK_FEQ(out, expected[i], 1e-9);
+        }
+
+        // Batches of every size give the same results as single predictions:
+        for (size_t size = 1; size <= xx.size(); ++size) {
+            model.apply(xx.data(), size, data.x[0].size(), hh.data(), cat_count, y.data());
+            for (size_t i = 0; i < size; ++i) CHECK_FEQ(y[i], expected[i], 1e-9);
+        }
+
+        model.apply(data.x, cats, y);
+        for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], expected[i], 1e-9);
+    }
+
+    std::ifstream f{path_to("testdata/" + name + "-model.json")};
+    std::string json{std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>()};
+    catboost_model_info_t* cmodel = cb_model_load_from_string(json.data(), json.size());
+    CHECK(cmodel != nullptr);
+    CHECK(cb_model_cat_feature_count(cmodel) == cat_count);
+    CHECK(cb_hash_cat_feature(cats[0][0].data(), cats[0][0].size()) == hashes[0][0]);
+    CHECK_FEQ(cb_model_apply_cat(cmodel, xx[0], data.x[0].size(), hh[0], cat_count), expected[0], 1e-9);
+    CHECK(std::isnan(cb_model_apply_cat(cmodel, xx[0], data.x[0].size(), hh[0], cat_count - 1)));
+    CHECK(cb_model_apply_cat_many(cmodel, xx.data(), xx.size(), data.x[0].size(), hh.data(), cat_count, y.data()) == 0);
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], expected[i], 1e-9);
+    cb_model_free(cmodel);
+
+    return true;
+}
+
+static bool nan_test(const std::string& name) {
+    Test data;
+    std::vector<double> expected;
+    {
+        std::ifstream f{path_to("testdata/" + name + ".json")};
+        nlohmann::json value = nlohmann::json::parse(f);
+        // NaN values are written as null.
+        for (const auto& x : value.at("x")) {
+            std::vector<float> v;
+            for (const auto& a : x) v.push_back(a.is_null() ? std::nanf("") : a.get<double>());
+            data.x.push_back(v);
+        }
+        for (const auto& y : value.at("y")) expected.push_back(y.get<double>());
+    }
+
+    std::vector<const float*> xx;
+    for (const auto& x : data.x) xx.push_back(x.data());
+    std::vector<double> y(xx.size());
+
+    for (bool fixed_order : {false, true}) {
+        for (auto kernel : {catboost::Kernel::Plain, catboost::Kernel::Pipelined}) {
+            catboost::Options options;
+            options.fixed_order = fixed_order;
+            options.kernel = kernel;
+            options.tree_threads = 2;
+            options.tree_parallel_min_trees = 1;
+            catboost::Model model{path_to("testdata/" + name + "-model.json"), options};
+
+            for (size_t i = 0; i < data.x.size(); ++i) CHECK_FEQ(model.apply(data.x[i]), expected[i], 1e-9);
+
+            // Batches of every size give the same results as single predictions:
+            for (size_t size = 1; size <= xx.size(); ++size) {
+                model.apply(xx.data(), size, data.x[0].size(), y.data());
+                for (size_t i = 0; i < size; ++i) CHECK_FEQ(y[i], expected[i], 1e-9);
+            }
+        }
+    }
+
+    catboost_model_info_t* cmodel = cb_model_load(path_to("testdata/" + name + "-model.json").c_str());
+    CHECK(cmodel != nullptr);
+    CHECK(cb_model_apply_many(cmodel, xx.data(), xx.size(), data.x[0].size(), y.data()) == 0);
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], expected[i], 1e-9);
+    cb_model_free(cmodel);
+
+    return true;
+}
+
+// Model JSON with loss function set in model info.
+static std::string with_loss(const std::string& name, const std::string& loss) {
+    std::ifstream f{path_to("testdata/" + name + "-model.json")};
+    nlohmann::json model = nlohmann::json::parse(f);
+    model["model_info"]["params"]["loss_function"] = {{"type", loss}, {"params", nlohmann::json::object()}};
+    return model.dump();
+}
+
+static void load_json(catboost::Model& model, const std::string& json, const catboost::Options& options = {}) {
+    std::istringstream in{json};
+    model.load(in, options);
+}
+
+static std::vector<std::vector<float>> read_x(const std::string& name) {
+    std::vector<std::vector<float>> x;
+    std::ifstream f{path_to("testdata/" + name + ".json")};
+    nlohmann::json value = nlohmann::json::parse(f);
+    for (const auto& row : value.at("x")) {
+        std::vector<float> v;
+        // NaN values are written as null.
+        for (const auto& a : row) v.push_back(a.is_null() ? std::nanf("") : a.get<double>());
+        x.push_back(v);
+    }
+    return x;
+}
+
+// Model of testdata with its examples and their predictions by buckets.
+struct TestModel {
+    std::vector<std::vector<float>> x;
+    std::vector<const float*> xx;
+    std::string path;
+    catboost::Model model;
+    size_t n;
+    size_t dims;
+    size_t size;
+    std::vector<double> expected;
+
+    explicit TestModel(const std::string& name)
+        : x(read_x(name)),
+          path(path_to("testdata/" + name + "-model.json")),
+          model(path),
+          n(model.feature_count()),
+          dims(model.dimension()),
+          size(x.size()) {
+        for (const auto& row : x) xx.push_back(row.data());
+        expected.resize(size * dims);
+        model.apply(xx.data(), size, n, expected.data(), dims);
+    }
+};
+
+// Examples in C order with a padding column of -1 after features.
+static std::vector<float> padded_rows(const TestModel& test) {
+    const size_t width = test.n + 1;
+    std::vector<float> c(test.size * width, -1.0f);
+    for (size_t i = 0; i < test.size; ++i) std::copy(test.x[i].begin(), test.x[i].begin() + test.n, &c[i * width]);
+    return c;
+}
+
+static double sigmoid(double x) { return 1.0 / (1.0 + std::exp(-x)); }
+
+static double log_sigmoid(double x) { return std::min(x, 0.0) - std::log1p(std::exp(-std::fabs(x))); }
+
+static bool transform_test(const std::string& binary, const std::string& multi, size_t dims) {
+    using catboost::PredictionType;
+
+    {
+        // Regression model supports raw values and exponent only.
+        catboost::Model model{path_to("testdata/" + binary + "-model.json")};
+        auto x = read_x(binary);
+        CHECK(model.dimension(PredictionType::Exponent) == 1);
+        const double expected = std::exp(model.apply(x[0]));
+        CHECK_FEQ(model.apply(x[0], PredictionType::Exponent), expected, 1e-14 * expected);
+        for (auto type : {PredictionType::Probability, PredictionType::Class, PredictionType::LogProbability}) {
+            bool thrown = false;
+            try {
+                model.apply(x[0], type);
+            } catch (const std::runtime_error&) {
+                thrown = true;
+            }
+            CHECK(thrown);
+        }
+    }
+
+    {
+        // Binary classification: probability of class one is sigmoid of the raw value.
+        const std::string json = with_loss(binary, "Logloss");
+        catboost::Model model;
+        load_json(model, json);
+        auto x = read_x(binary);
+        std::vector<const float*> xx;
+        for (const auto& row : x) xx.push_back(row.data());
+        std::vector<double> raw(x.size());
+        model.apply(xx.data(), xx.size(), x[0].size(), raw.data());
+        CHECK(model.dimension(PredictionType::Probability) == 1);
+        CHECK(model.dimension(PredictionType::Class) == 1);
+
+        for (auto accuracy : {catboost::Accuracy::Exact, catboost::Accuracy::High, catboost::Accuracy::Fast}) {
+            catboost::Options options;
+            options.accuracy = accuracy;
+            model.set_options(options);
+            const double eps = accuracy == catboost::Accuracy::Fast ? 1e-7 : 1e-14;
+            std::vector<double> y(x.size());
+
+            for (auto type : {PredictionType::RawFormulaVal, PredictionType::Probability, PredictionType::Class,
+                              PredictionType::Exponent, PredictionType::LogProbability}) {
+                model.apply(xx.data(), xx.size(), x[0].size(), y.data(), type);
+                for (size_t i = 0; i < x.size(); ++i) {
+                    double expected = raw[i];
+                    if (type == PredictionType::Probability) expected = sigmoid(raw[i]);
+                    if (type == PredictionType::Class) expected = raw[i] > 0.0;
+                    if (type == PredictionType::Exponent) expected = std::exp(raw[i]);
+                    if (type == PredictionType::LogProbability) expected = log_sigmoid(raw[i]);
+                    CHECK_FEQ(y[i], expected, eps * std::max(1.0, std::fabs(expected)));
+                    CHECK_FEQ(model.apply(x[i], type), y[i], 1e-9 * std::max(1.0, std::fabs(expected)));
+                }
+            }
+        }
+
+        catboost_model_info_t* cmodel = cb_model_load_from_string(json.data(), json.size());
+        CHECK(cmodel != nullptr);
+        CHECK(cb_model_prediction_dimension(cmodel, CB_CLASS) == 1);
+        std::vector<double> y(x.size());
+        CHECK(cb_model_apply_typed_many(cmodel, xx.data(), xx.size(), x[0].size(), CB_PROBABILITY, y.data(), 1) == 0);
+        for (size_t i = 0; i < x.size(); ++i) CHECK_FEQ(y[i], sigmoid(raw[i]), 1e-14);
+        double out = 0.0;
+        CHECK(cb_model_apply_typed(cmodel, x[0].data(), x[0].size(), CB_CLASS, &out, 1) == 0);
+        CHECK(out == (raw[0] > 0.0));
+        CHECK(cb_model_apply_typed(cmodel, x[0].data(), x[0].size(), CB_CLASS, &out, 2) == -1);
+        CHECK(cb_model_apply_typed(cmodel, x[0].data(), x[0].size(), static_cast<catboost_prediction_type_t>(7),
+                                   &out, 1) == -1);
+        cb_model_free(cmodel);
+    }
+
+    for (const std::string loss : {"MultiClass", "MultiClassOneVsAll"}) {
+        // Probabilities are softmax of raw values for MultiClass and their
+        // sigmoids for one-vs-all, class is the index of the largest value.
+        const std::string json = with_loss(multi, loss);
+        const bool softmax = loss == "MultiClass";
+        catboost::Model model;
+        load_json(model, json);
+        auto x = read_x(multi);
+        std::vector<const float*> xx;
+        for (const auto& row : x) xx.push_back(row.data());
+        std::vector<double> raw(x.size() * dims);
+        model.apply(xx.data(), xx.size(), x[0].size(), raw.data(), dims);
+        CHECK(model.dimension(PredictionType::Probability) == dims);
+        CHECK(model.dimension(PredictionType::Class) == 1);
+
+        std::vector<double> expected_prob(raw.size());
+        std::vector<double> expected_class(x.size());
+        for (size_t i = 0; i < x.size(); ++i) {
+            const double* r = raw.data() + i * dims;
+            const size_t best = std::max_element(r, r + dims) - r;
+            expected_class[i] = static_cast<double>(best);
+            double sum = 0.0;
+            for (size_t d = 0; d < dims; ++d) sum += std::exp(r[d] - r[best]);
+            for (size_t d = 0; d < dims; ++d) {
+                expected_prob[i * dims + d] = softmax ? std::exp(r[d] - r[best]) / sum : sigmoid(r[d]);
+            }
+        }
+
+        std::vector<double> y(x.size() * dims);
+        model.apply(xx.data(), xx.size(), x[0].size(), y.data(), dims, PredictionType::Probability);
+        for (size_t j = 0; j < y.size(); ++j) CHECK_FEQ(y[j], expected_prob[j], 1e-14);
+        model.apply(xx.data(), xx.size(), x[0].size(), y.data(), dims, PredictionType::LogProbability);
+        for (size_t j = 0; j < y.size(); ++j) CHECK_FEQ(y[j], std::log(expected_prob[j]), 1e-13);
+
+        std::vector<double> classes(x.size());
+        model.apply(xx.data(), xx.size(), x[0].size(), classes.data(), PredictionType::Class);
+        CHECK(classes == expected_class);
+        for (size_t i = 0; i < x.size(); ++i) CHECK(model.apply(x[i], PredictionType::Class) == expected_class[i]);
+
+        // Parallel predictions of classes are the same as sequential ones.
+        catboost::Options options;
+        options.parallel_min_rows = 1;
+        model.set_options(options);
+        std::vector<const float*> many;
+        for (size_t i = 0; i < 100; ++i) many.insert(many.end(), xx.begin(), xx.end());
+        std::vector<double> parallel(many.size());
+        {
+            catboost::ThreadPool pool{3};
+            model.apply_parallel(many.data(), many.size(), x[0].size(), parallel.data(), &pool, PredictionType::Class);
+        }
+        for (size_t i = 0; i < many.size(); ++i) CHECK(parallel[i] == expected_class[i % x.size()]);
+
+        catboost_model_info_t* cmodel = cb_model_load_from_string(json.data(), json.size());
+        CHECK(cmodel != nullptr);
+        CHECK(cb_model_prediction_dimension(cmodel, CB_PROBABILITY) == dims);
+        CHECK(cb_model_apply_typed(cmodel, x[0].data(), x[0].size(), CB_PROBABILITY, y.data(), dims) == 0);
+        for (size_t d = 0; d < dims; ++d) CHECK_FEQ(y[d], expected_prob[d], 1e-14);
+        cb_model_free(cmodel);
+    }
+
+    {
+        // Approximations of exp and log are checked over a wide range of raw
+        // values: a tree of depth 10 has leaf values from -40 to 40.
+        const size_t depth = 10;
+        const size_t leaves = size_t{1} << depth;
+        nlohmann::json model;
+        nlohmann::json tree;
+        for (size_t k = 0; k < depth; ++k) {
+            model["features_info"]["float_features"].push_back(
+                {{"feature_index", k}, {"flat_feature_index", k}, {"borders", {0.5}}});
+            tree["splits"].push_back(
+                {{"float_feature_index", k}, {"border", 0.5}, {"split_index", k}, {"split_type", "FloatFeature"}});
+        }
+        for (size_t i = 0; i < leaves; ++i) tree["leaf_values"].push_back(-40.0 + 80.0 * i / (leaves - 1));
+        model["oblivious_trees"].push_back(tree);
+        model["model_info"]["params"]["loss_function"] = "Logloss";
+
+        std::vector<std::vector<float>> x(leaves, std::vector<float>(depth));
+        std::vector<const float*> xx;
+        for (size_t i = 0; i < leaves; ++i) {
+            for (size_t k = 0; k < depth; ++k) x[i][k] = (i >> k) & 1;
+            xx.push_back(x[i].data());
+        }
+
+        std::vector<double> raw(leaves);
+        std::vector<double> y(leaves);
+        catboost::Model exact;
+        catboost::Options options;
+        options.accuracy = catboost::Accuracy::Exact;
+        load_json(exact, model.dump(), options);
+        exact.apply(xx.data(), leaves, depth, raw.data());
+        for (size_t i = 0; i < leaves; ++i) CHECK(raw[i] == model["oblivious_trees"][0]["leaf_values"][i]);
+
+        for (auto accuracy : {catboost::Accuracy::High, catboost::Accuracy::Fast}) {
+            options.accuracy = accuracy;
+            catboost::Model approx;
+            load_json(approx, model.dump(), options);
+            const double eps = accuracy == catboost::Accuracy::Fast ? 1e-7 : 1e-15;
+            for (auto type : {PredictionType::Probability, PredictionType::Exponent, PredictionType::LogProbability}) {
+                approx.apply(xx.data(), leaves, depth, y.data(), type);
+                for (size_t i = 0; i < leaves; ++i) {
+                    double expected = std::exp(raw[i]);
+                    if (type == PredictionType::Probability) expected = sigmoid(raw[i]);
+                    if (type == PredictionType::LogProbability) expected = log_sigmoid(raw[i]);
+                    CHECK_FEQ(y[i], expected, 2 * eps * std::fabs(expected));
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+// SHAP values of oblivious trees of a model with float features by
+// definition: exact Shapley values of features for the expected value of
+// every tree, where known features follow the example and unknown ones
+// split by leaf weights. The root of a tree is its last split.
+static std::vector<double> reference_shap(const nlohmann::json& model, const std::vector<float>& x) {
+    const auto& info = model.at("features_info").at("float_features");
+    const size_t n = info.size();
+    std::vector<bool> nan_right;
+    for (const auto& f : info) nan_right.push_back(f.value("nan_value_treatment", std::string{}) == "AsTrue");
+
+    const auto& trees = model.at("oblivious_trees");
+    const size_t dims = trees[0].at("leaf_values").size() >> trees[0].at("splits").size();
+    std::vector<double> out((n + 1) * dims, 0.0);
+
+    for (const auto& tree : trees) {
+        const auto& splits = tree.at("splits");
+        const int depth = static_cast<int>(splits.size());
+        const auto values = tree.at("leaf_values").get<std::vector<double>>();
+        const auto weights = tree.at("leaf_weights").get<std::vector<double>>();
+        // Sums of weights of leaves before every leaf.
+        std::vector<double> before{0.0};
+        for (double w : weights) before.push_back(before.back() + w);
+        // Weight of node of level with leaves having the same high bits as leaf.
+        auto cover = [&](size_t leaf, int level) {
+            const size_t begin = leaf >> level << level;
+            return before[begin + (size_t{1} << level)] - before[begin];
+        };
+
+        std::vector<size_t> features;
+        for (const auto& split : splits) {
+            const size_t f = split.at("float_feature_index").get<size_t>();
+            if (std::find(features.begin(), features.end(), f) == features.end()) features.push_back(f);
+        }
+        const size_t m = features.size();
+
+        for (size_t d = 0; d < dims; ++d) {
+            // Expected value of the tree when features of mask are known.
+            std::vector<double> v(size_t{1} << m);
+            for (size_t mask = 0; mask < v.size(); ++mask) {
+                std::function<double(int, size_t)> node = [&](int level, size_t leaf) -> double {
+                    if (level < 0) return values[leaf * dims + d];
+                    const auto& split = splits[level];
+                    const size_t f = split.at("float_feature_index").get<size_t>();
+                    const size_t bit = size_t{1} << level;
+                    const size_t pos = std::find(features.begin(), features.end(), f) - features.begin();
+                    if (mask >> pos & 1) {
+                        const float border = split.at("border").get<double>();
+                        const bool right = x[f] > border || (nan_right[f] && std::isnan(x[f]));
+                        return node(level - 1, right ? leaf | bit : leaf);
+                    }
+                    const double left = cover(leaf, level);
+                    const double right = cover(leaf | bit, level);
+                    const double total = left + right;
+                    const double p = total > 0.0 ? right / total : 0.5;
+                    return (1.0 - p) * node(level - 1, leaf) + p * node(level - 1, leaf | bit);
+                };
+                v[mask] = node(depth - 1, 0);
+            }
+
+            for (size_t j = 0; j < m; ++j) {
+                double phi = 0.0;
+                for (size_t mask = 0; mask < v.size(); ++mask) {
+                    if (mask >> j & 1) continue;
+                    size_t s = 0;
+                    for (size_t i = 0; i < m; ++i) s += mask >> i & 1;
+                    double w = 1.0 / m;
+                    for (size_t i = 1; i <= s; ++i) w *= static_cast<double>(i) / (m - s - 1 + i);
+                    phi += w * (v[mask | size_t{1} << j] - v[mask]);
+                }
+                out[d * (n + 1) + features[j]] += phi;
+            }
+            out[d * (n + 1) + n] += v[0];
+        }
+    }
+
+    double scale = 1.0;
+    std::vector<double> bias(dims, 0.0);
+    if (model.count("scale_and_bias")) {
+        const auto& scale_and_bias = model.at("scale_and_bias");
+        scale = scale_and_bias.at(0).get<double>();
+        const auto& node = scale_and_bias.at(1);
+        for (size_t d = 0; d < dims; ++d) bias[d] = node.is_number() ? node.get<double>() : node.at(d).get<double>();
+    }
+    for (size_t d = 0; d < dims; ++d) {
+        for (size_t f = 0; f <= n; ++f) out[d * (n + 1) + f] *= scale;
+        out[d * (n + 1) + n] += bias[d];
+    }
+    return out;
+}
+
+static bool shap_test(const std::string& name) {
+    nlohmann::json json_model;
+    {
+        std::ifstream m{path_to("testdata/" + name + "-model.json")};
+        json_model = nlohmann::json::parse(m);
+    }
+    // SHAP values are computed for oblivious trees only.
+    json_model.erase("trees");
+    const std::string json = json_model.dump();
+    const auto x = read_x(name);
+    std::vector<const float*> xx;
+    for (const auto& row : x) xx.push_back(row.data());
+
+    catboost::Model model;
+    load_json(model, json);
+    const size_t n = model.feature_count();
+    const size_t dims = model.dimension();
+    const size_t size = model.shap_size();
+    CHECK(size == (n + 1) * dims);
+
+    // Values are equal to exact Shapley values and add up to predictions:
+    std::vector<double> out(size);
+    std::vector<double> y(dims);
+    for (size_t i = 0; i < std::min<size_t>(x.size(), 4); ++i) {
+        model.shap_values(x[i].data(), n, out.data(), size);
+        const auto expected = reference_shap(json_model, x[i]);
+        for (size_t j = 0; j < size; ++j) CHECK_FEQ(out[j], expected[j], 1e-9);
+
+        model.apply(x[i].data(), n, y.data(), dims);
+        for (size_t d = 0; d < dims; ++d) {
+            double sum = 0.0;
+            for (size_t f = 0; f <= n; ++f) sum += out[d * (n + 1) + f];
+            CHECK_FEQ(sum, y[d], 1e-9);
+        }
+    }
+
+    // Buckets, parallel calls and tables prepared on load give the same values:
+    std::vector<double> all(x.size() * size);
+    for (size_t i = 0; i < x.size(); ++i) model.shap_values(xx[i], n, all.data() + i * size, size);
+    std::vector<double> many(all.size());
+    model.shap_values(xx.data(), xx.size(), n, many.data(), size);
+    CHECK(many == all);
+
+    catboost::Options options;
+    options.shap = true;
+    catboost::Model prepared;
+    load_json(prepared, json, options);
+    std::fill(many.begin(), many.end(), 0.0);
+    prepared.shap_values_parallel(xx.data(), xx.size(), n, many.data(), size);
+    CHECK(many == all);
+
+    // Wrong arguments of parallel calls are reported on the calling thread.
+    {
+        catboost::ThreadPool pool{3};
+        std::vector<const float*> rows;
+        for (size_t i = 0; i < 1000; ++i) rows.push_back(xx[i % xx.size()]);
+        std::vector<double> values(rows.size() * (size + 1));
+        const auto parallel_throws = [&](const catboost::Model& m, size_t count, size_t out_size) {
+            try {
+                m.shap_values_parallel(rows.data(), rows.size(), count, values.data(), out_size, &pool);
+            } catch (const std::runtime_error&) {
+                return true;
+            }
+            return false;
+        };
+        CHECK(parallel_throws(model, n, size + 1));
+        CHECK(parallel_throws(model, n - 1, size));
+        catboost::Model cat{path_to("testdata/categorical-model.json")};
+        std::vector<float> zeros(cat.feature_count());
+        std::fill(rows.begin(), rows.end(), zeros.data());
+        CHECK(parallel_throws(cat, zeros.size(), cat.shap_size()));
+    }
+
+    bool thrown = false;
+    try {
+        model.shap_values(x[0].data(), n, out.data(), size - 1);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    catboost_model_info_t* cmodel = cb_model_load_from_string(json.data(), json.size());
+    CHECK(cmodel != nullptr);
+    CHECK(cb_model_shap_size(cmodel) == size);
+    CHECK(cb_model_shap_values(cmodel, xx[0], n, out.data(), size) == 0);
+    CHECK(std::equal(out.begin(), out.end(), all.begin()));
+    CHECK(cb_model_shap_values(cmodel, xx[0], n, out.data(), size + 1) == -1);
+    std::fill(many.begin(), many.end(), 0.0);
+    CHECK(cb_model_shap_values_many(cmodel, xx.data(), xx.size(), n, many.data(), size) == 0);
+    CHECK(many == all);
+
+    {
+        CountingExecutor executor;
+        catboost_executor_t cexecutor{executor.concurrency(), c_submit, &executor};
+        std::fill(many.begin(), many.end(), 0.0);
+        CHECK(cb_model_shap_values_parallel(cmodel, xx.data(), xx.size(), n, many.data(), size, &cexecutor) == 0);
+        CHECK(executor.submitted > 0);
+    }
+    CHECK(many == all);
+    cb_model_free(cmodel);
+
+    return true;
+}
+
+// Trees deeper than SHAP tables are explained by the same computation at
+// run time. Splits of the tree repeat features.
+static bool deep_shap_test(const std::string& name) {
+    std::ifstream f{path_to("testdata/" + name + "-model.json")};
+    nlohmann::json model = nlohmann::json::parse(f);
+    model.erase("trees");
+    auto& tree = model["oblivious_trees"][0];
+    const auto x = read_x(name);
+    const size_t depth = 10;
+    const size_t features = x[0].size();
+
+    std::mt19937 gen{42};
+    std::uniform_real_distribution<double> value{-1.0, 1.0};
+    std::uniform_int_distribution<int> weight{0, 3};
+    tree["splits"] = nlohmann::json::array();
+    tree["leaf_values"] = nlohmann::json::array();
+    tree["leaf_weights"] = nlohmann::json::array();
+    for (size_t l = 0; l < depth; ++l) {
+        const size_t feature = l % (features - 2);
+        tree["splits"].push_back({{"float_feature_index", feature}, {"border", x[l % x.size()][feature]}});
+    }
+    for (size_t i = 0; i < size_t{1} << depth; ++i) {
+        tree["leaf_values"].push_back(value(gen));
+        tree["leaf_weights"].push_back(weight(gen));
+    }
+
+    catboost::Model m;
+    load_json(m, model.dump());
+    std::vector<double> out(m.shap_size());
+    for (size_t i = 0; i < std::min<size_t>(x.size(), 4); ++i) {
+        m.shap_values(x[i].data(), features, out.data(), out.size());
+        const auto expected = reference_shap(model, x[i]);
+        for (size_t j = 0; j < out.size(); ++j) CHECK_FEQ(out[j], expected[j], 1e-9);
+    }
+
+    return true;
+}
+
+// SHAP values of models with categorical features add up to predictions,
+// and models without leaf weights or with non-symmetric trees are rejected.
+static bool cat_shap_test(const std::string& name) {
+    std::vector<std::vector<float>> x;
+    std::vector<std::vector<int32_t>> hashes;
+    {
+        std::ifstream f{path_to("testdata/" + name + ".json")};
+        nlohmann::json value = nlohmann::json::parse(f);
+        for (const auto& row : value.at("x")) x.push_back(row.get<std::vector<float>>());
+        for (const auto& h : value.at("hash")) hashes.push_back(h.get<std::vector<int32_t>>());
+    }
+
+    std::ifstream f{path_to("testdata/" + name + "-model.json")};
+    nlohmann::json json_model = nlohmann::json::parse(f);
+    json_model.erase("trees");
+    const std::string json = json_model.dump();
+    catboost::Model model;
+    load_json(model, json);
+    const size_t n = model.feature_count();
+    const size_t cat_count = model.cat_feature_count();
+    const size_t size = model.shap_size();
+    CHECK(size == n + cat_count + 1);
+
+    std::vector<double> out(size);
+    std::vector<double> cats(cat_count, 0.0);
+    for (size_t i = 0; i < x.size(); ++i) {
+        model.shap_values(x[i].data(), n, hashes[i].data(), cat_count, out.data(), size);
+        double sum = 0.0;
+        for (double v : out) sum += v;
+        CHECK_FEQ(sum, model.apply(x[i].data(), n, hashes[i].data(), cat_count), 1e-9);
+        for (size_t c = 0; c < cat_count; ++c) cats[c] += std::fabs(out[n + c]);
+    }
+    // Categorical features contribute through one-hot and CTR splits:
+    CHECK(std::any_of(cats.begin(), cats.end(), [](double v) { return v > 0.0; }));
+
+    catboost_model_info_t* cmodel = cb_model_load_from_string(json.data(), json.size());
+    CHECK(cmodel != nullptr);
+    std::vector<double> c_out(size);
+    CHECK(cb_model_shap_values_cat(cmodel, x.back().data(), n, hashes.back().data(), cat_count, c_out.data(),
+                                   size) == 0);
+    CHECK(c_out == out);
+    CHECK(cb_model_shap_values(cmodel, x.back().data(), n, c_out.data(), size) == -1);
+    cb_model_free(cmodel);
+
+    for (const std::string other : {"nonsymmetric", "regression"}) {
+        std::ifstream o{path_to("testdata/" + other + "-model.json")};
+        nlohmann::json other_model = nlohmann::json::parse(o);
+        for (auto& tree : other_model["oblivious_trees"]) tree.erase("leaf_weights");
+        catboost::Model m;
+        load_json(m, other_model.dump());
+        const auto row = read_x(other).front();
+        std::vector<double> values(m.shap_size());
+        bool thrown = false;
+        try {
+            m.shap_values(row.data(), row.size(), values.data(), values.size());
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+
+    return true;
+}
+
+// Leaf indexes of all trees in the order of the model file. Leaves of
+// non-symmetric trees are numbered breadth-first.
+static std::vector<size_t> reference_leaf_indexes(const nlohmann::json& model, const std::vector<float>& x) {
+    std::vector<bool> nan_right;
+    for (const auto& f : model.at("features_info").at("float_features")) {
+        nan_right.push_back(f.value("nan_value_treatment", std::string{"AsIs"}) == "AsTrue");
+    }
+    auto right = [&](const nlohmann::json& split) {
+        const size_t index = split.at("float_feature_index").get<size_t>();
+        const float border = split.at("border").get<double>();
+        return x[index] > border || (std::isnan(x[index]) && nan_right[index]);
+    };
+
+    std::vector<size_t> res;
+    for (const auto& tree : model.value("oblivious_trees", nlohmann::json::array())) {
+        size_t idx = 0;
+        size_t one = 1;
+        for (const auto& split : tree.at("splits")) {
+            if (right(split)) idx |= one;
+            one <<= 1;
+        }
+        res.push_back(idx);
+    }
+
+    for (const auto& tree : model.value("trees", nlohmann::json::array())) {
+        const nlohmann::json* leaf = &tree;
+        while (leaf->count("split")) leaf = &leaf->at(right(leaf->at("split")) ? "right" : "left");
+
+        std::vector<const nlohmann::json*> queue{&tree};
+        size_t number = 0;
+        for (size_t i = 0; i < queue.size(); ++i) {
+            if (queue[i] == leaf) break;
+            if (queue[i]->count("split")) {
+                queue.push_back(&queue[i]->at("left"));
+                queue.push_back(&queue[i]->at("right"));
+            } else {
+                ++number;
+            }
+        }
+        res.push_back(number);
+    }
+    return res;
+}
+
+static bool leaf_index_test(const std::string& name) {
+    nlohmann::json json_model;
+    {
+        std::ifstream m{path_to("testdata/" + name + "-model.json")};
+        json_model = nlohmann::json::parse(m);
+    }
+    const auto x = read_x(name);
+    std::vector<const float*> xx;
+    for (const auto& row : x) xx.push_back(row.data());
+    const size_t n = x[0].size();
+
+    catboost::Model model{path_to("testdata/" + name + "-model.json")};
+    const size_t trees = model.tree_count();
+    std::vector<uint16_t> expected;
+    for (const auto& row : x) {
+        const auto leaves = reference_leaf_indexes(json_model, row);
+        expected.insert(expected.end(), leaves.begin(), leaves.end());
+    }
+    CHECK(expected.size() == x.size() * trees);
+
+    std::vector<uint16_t> out(trees);
+    std::vector<uint8_t> out8(trees);
+    for (size_t i = 0; i < x.size(); ++i) {
+        model.calc_leaf_indexes(xx[i], n, out.data(), trees);
+        CHECK(std::equal(out.begin(), out.end(), expected.begin() + i * trees));
+        model.calc_leaf_indexes(xx[i], n, out8.data(), trees);
+        CHECK(std::equal(out8.begin(), out8.end(), expected.begin() + i * trees));
+    }
+
+    // Buckets of every size give the same indexes as single examples:
+    std::vector<uint16_t> many(expected.size());
+    for (size_t size = 1; size <= xx.size(); ++size) {
+        std::fill(many.begin(), many.end(), 0);
+        model.calc_leaf_indexes(xx.data(), size, n, many.data(), trees);
+        CHECK(std::equal(many.begin(), many.begin() + size * trees, expected.begin()));
+    }
+
+    // Ranges of trees, including ones of both kinds of trees:
+    for (auto range : std::vector<std::pair<size_t, size_t>>{{0, 1}, {3, 7}, {trees / 2, trees}, {5, trees - 1}}) {
+        const size_t count = range.second - range.first;
+        std::vector<uint8_t> part(x.size() * count);
+        model.calc_leaf_indexes(xx.data(), xx.size(), n, part.data(), count, range.first, range.second);
+        for (size_t i = 0; i < x.size(); ++i) {
+            CHECK(std::equal(part.begin() + i * count, part.begin() + (i + 1) * count,
+                             expected.begin() + i * trees + range.first));
+        }
+    }
+
+    for (auto range : std::vector<std::pair<size_t, size_t>>{{0, trees + 1}, {2, 1}}) {
+        bool thrown = false;
+        try {
+            model.calc_leaf_indexes(xx[0], n, out.data(), trees, range.first, range.second);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+
+    catboost_model_info_t* cmodel = cb_model_load(path_to("testdata/" + name + "-model.json").c_str());
+    CHECK(cmodel != nullptr);
+    CHECK(cb_model_tree_count(cmodel) == trees);
+    CHECK(cb_model_calc_leaf_indexes(cmodel, xx[0], n, out.data(), trees, 0, 0) == 0);
+    CHECK(std::equal(out.begin(), out.end(), expected.begin()));
+    CHECK(cb_model_calc_leaf_indexes(cmodel, xx[0], n, out.data(), trees - 1, 0, 0) == -1);
+    std::fill(many.begin(), many.end(), 0);
+    CHECK(cb_model_calc_leaf_indexes_many(cmodel, xx.data(), xx.size(), n, many.data(), trees, 0, 0) == 0);
+    CHECK(many == expected);
+    cb_model_free(cmodel);
+
+    return true;
+}
+
+// Trees with more than 256 leaves need 16-bit indexes.
+static bool deep_leaf_index_test(const std::string& name) {
+    std::ifstream f{path_to("testdata/" + name + "-model.json")};
+    nlohmann::json model = nlohmann::json::parse(f);
+    auto& tree = model["oblivious_trees"][1];
+    const auto x = read_x(name);
+    const size_t depth = 9;
+    tree["splits"] = nlohmann::json::array();
+    tree["leaf_values"] = nlohmann::json::array();
+    for (size_t l = 0; l < depth; ++l) {
+        const size_t feature = l % x[0].size();
+        tree["splits"].push_back({{"float_feature_index", feature}, {"border", x[l % x.size()][feature]}});
+    }
+    for (size_t i = 0; i < size_t{1} << depth; ++i) tree["leaf_values"].push_back(0.0);
+    tree.erase("leaf_weights");
+
+    catboost::Model m;
+    load_json(m, model.dump());
+    std::vector<uint16_t> out(m.tree_count());
+    std::vector<uint8_t> out8(m.tree_count());
+    for (const auto& row : x) {
+        m.calc_leaf_indexes(row.data(), row.size(), out.data(), out.size());
+        const auto expected = reference_leaf_indexes(model, row);
+        CHECK(std::equal(out.begin(), out.end(), expected.begin()));
+    }
+
+    bool thrown = false;
+    try {
+        m.calc_leaf_indexes(x[0].data(), x[0].size(), out8.data(), out8.size());
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    // Ranges without the deep tree fit into bytes:
+    m.calc_leaf_indexes(x[0].data(), x[0].size(), out8.data(), out8.size() - 2, 2, 0);
+    m.calc_leaf_indexes(x[0].data(), x[0].size(), out8.data(), 1, 0, 1);
+
+    return true;
+}
+
+// Model set gives the same values as its models applied one by one, and
+// trees shared by models are evaluated once.
+static bool model_set_test() {
+    const auto x = read_x("nonsymmetric");
+    std::vector<const float*> xx;
+    for (const auto& row : x) xx.push_back(row.data());
+    const size_t n = x[0].size();
+
+    // Shadow model has the same trees as regression one with other values.
+    nlohmann::json shadow_json;
+    {
+        std::ifstream m{path_to("testdata/regression-model.json")};
+        shadow_json = nlohmann::json::parse(m);
+    }
+    for (auto& tree : shadow_json["oblivious_trees"]) {
+        for (auto& v : tree["leaf_values"]) v = 2.0 * v.get<double>() - 0.125;
+    }
+    shadow_json["scale_and_bias"] = {2.0, {-1.0}};
+    const std::string shadow = shadow_json.dump();
+
+    std::vector<std::unique_ptr<catboost::Model>> models;
+    for (const std::string name : {"regression", "", "nonsymmetric", "xor", "multiclass"}) {
+        models.emplace_back(new catboost::Model);
+        if (name.empty()) {
+            load_json(*models.back(), shadow);
+        } else {
+            models.back()->load(path_to("testdata/" + name + "-model.json"));
+        }
+    }
+    std::vector<std::vector<double>> expected(x.size());
+    for (size_t i = 0; i < x.size(); ++i) {
+        for (const auto& model : models) {
+            std::vector<double> y(model->dimension());
+            model->apply(xx[i], n, y.data(), y.size());
+            expected[i].insert(expected[i].end(), y.begin(), y.end());
+        }
+    }
+
+    std::ifstream regression{path_to("testdata/regression-model.json")};
+    std::istringstream shadow_in{shadow};
+    std::ifstream nonsymmetric{path_to("testdata/nonsymmetric-model.json")};
+    std::ifstream xor_in{path_to("testdata/xor-model.json")};
+    std::ifstream multiclass{path_to("testdata/multiclass-model.json")};
+    catboost::ModelSet set;
+    set.load({&regression, &shadow_in, &nonsymmetric, &xor_in, &multiclass});
+    CHECK(set.size() == 5);
+    CHECK(set.dimension() == 7);
+    CHECK(set.offset(3) == 3 && set.offset(4) == 4 && set.offset(5) == 7);
+    size_t trees = 0;
+    for (size_t m = 0; m < models.size(); ++m) trees += models[m]->stats().tree_count;
+    CHECK(set.stats().tree_count + models[1]->stats().tree_count <= trees);
+
+    std::vector<double> out(set.dimension());
+    for (size_t i = 0; i < x.size(); ++i) {
+        set.apply(xx[i], n, out.data(), out.size());
+        for (size_t d = 0; d < out.size(); ++d) CHECK_FEQ(out[d], expected[i][d], 1e-9);
+    }
+
+    std::vector<double> many(x.size() * set.dimension());
+    for (size_t size = 1; size <= xx.size(); ++size) {
+        set.apply(xx.data(), size, n, many.data(), set.dimension());
+        for (size_t i = 0; i < size; ++i) {
+            for (size_t d = 0; d < out.size(); ++d) CHECK_FEQ(many[i * out.size() + d], expected[i][d], 1e-9);
+        }
+    }
+
+    bool thrown = false;
+    try {
+        set.blend(xx[0], n);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    // One-dimensional models are blended with weights:
+    const std::vector<std::string> files{path_to("testdata/regression-model.json"),
+                                         path_to("testdata/nonsymmetric-model.json"),
+                                         path_to("testdata/xor-model.json")};
+    catboost::ModelSet blended{files};
+    CHECK(blended.weights() == std::vector<double>(3, 1.0 / 3));
+    const std::vector<double> weights{0.5, 0.25, -1.0};
+    blended.set_weights(weights);
+    std::vector<double> y(x.size());
+    blended.blend(xx.data(), xx.size(), n, y.data());
+    for (size_t i = 0; i < x.size(); ++i) {
+        const double value = 0.5 * expected[i][0] + 0.25 * expected[i][2] - expected[i][3];
+        CHECK_FEQ(blended.blend(xx[i], n), value, 1e-9);
+        CHECK_FEQ(y[i], value, 1e-9);
+    }
+
+    // Models should treat NaN values of features in the same way and have no
+    // categorical features:
+    for (const std::string name : {"nan", "categorical"}) {
+        thrown = false;
+        try {
+            catboost::ModelSet wrong{{files[0], path_to("testdata/" + name + "-model.json")}};
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+
+    std::vector<const char*> cfiles;
+    for (const auto& file : files) cfiles.push_back(file.c_str());
+    catboost_model_set_t* cset = cb_model_set_load(cfiles.data(), cfiles.size());
+    CHECK(cset != nullptr);
+    CHECK(cb_model_set_dimension(cset) == 3);
+    CHECK(cb_model_set_weights(cset, weights.data(), weights.size()) == 0);
+    CHECK(cb_model_set_weights(cset, weights.data(), 2) == -1);
+    CHECK_FEQ(cb_model_set_blend(cset, xx[0], n), y[0], 1e-12);
+    CHECK(cb_model_set_apply(cset, xx[0], n, out.data(), 3) == 0);
+    CHECK(cb_model_set_apply(cset, xx[0], n, out.data(), 4) == -1);
+    CHECK(cb_model_set_apply_many(cset, xx.data(), xx.size(), n, many.data(), 3) == 0);
+    for (size_t i = 0; i < x.size(); ++i) CHECK_FEQ(many[i * 3 + 2], expected[i][3], 1e-9);
+    cb_model_set_free(cset);
+
+    return true;
+}
+
+// Half precision values with mantissas of floats truncated and their exact
+// float values.
+static uint16_t float_to_half(float x) {
+    const uint16_t sign = std::signbit(x) ? 0x8000 : 0;
+    const float a = std::fabs(x);
+    if (std::isnan(x)) return sign | 0x7e00;
+    if (a >= 65536.0f) return sign | 0x7c00;
+    if (a < std::ldexp(1.0f, -14)) return sign | static_cast<uint16_t>(std::ldexp(a, 24));
+    int e = 0;
+    const float m = std::frexp(a, &e);
+    return sign | static_cast<uint16_t>((e + 14) << 10) | static_cast<uint16_t>((2.0f * m - 1.0f) * 1024.0f);
+}
+
+static float half_to_float(uint16_t h) {
+    const int exponent = (h >> 10) & 0x1f;
+    const int mantissa = h & 0x3ff;
+    float x = 0.0f;
+    if (exponent == 0x1f) {
+        x = mantissa ? std::nanf("") : INFINITY;
+    } else if (exponent == 0) {
+        x = std::ldexp(static_cast<float>(mantissa), -24);
+    } else {
+        x = std::ldexp(static_cast<float>(mantissa | 0x400), exponent - 25);
+    }
+    return (h & 0x8000) ? -x : x;
+}
+
+// Predictions of rows of features of type T should be equal to predictions of
+// their float values.
+template <typename T>
+static bool typed_rows_test(const catboost::Model& model, const std::vector<std::vector<T>>& rows,
+                            const std::vector<std::vector<float>>& expected) {
+    const size_t dims = model.dimension();
+    const size_t n = rows[0].size();
+    std::vector<double> out(dims), ref(dims);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        model.apply(rows[i].data(), n, out.data(), dims);
+        model.apply(expected[i].data(), n, ref.data(), dims);
+        CHECK(out == ref);
+        if (dims == 1) CHECK(model.apply(rows[i].data(), n) == ref[0]);
+    }
+
+    std::vector<const T*> xx;
+    std::vector<const float*> ff;
+    for (const auto& x : rows) xx.push_back(x.data());
+    for (const auto& x : expected) ff.push_back(x.data());
+    std::vector<double> many(rows.size() * dims), many_ref(rows.size() * dims);
+    model.apply(xx.data(), xx.size(), n, many.data(), dims);
+    model.apply(ff.data(), ff.size(), n, many_ref.data(), dims);
+    CHECK(many == many_ref);
+    if (dims == 1) {
+        std::vector<double> y(rows.size());
+        model.apply(xx.data(), xx.size(), n, y.data());
+        CHECK(y == many_ref);
+    }
+
+    bool thrown = false;
+    try {
+        model.apply(rows[0].data(), n - 1, out.data(), dims);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    return true;
+}
+
+static bool typed_test(const std::string& name) {
+    // Rows are repeated to have several blocks of converted examples.
+    std::vector<std::vector<float>> x;
+    for (size_t k = 0; k < 3; ++k) {
+        for (const auto& row : read_x(name)) x.push_back(row);
+    }
+    catboost::Model model{path_to("testdata/" + name + "-model.json")};
+
+    std::vector<std::vector<double>> doubles;
+    std::vector<std::vector<int32_t>> ints;
+    std::vector<std::vector<catboost::Float16>> halves;
+    std::vector<std::vector<catboost::BFloat16>> bfloats;
+    std::vector<std::vector<float>> from_doubles, from_ints, from_halves, from_bfloats;
+    for (const auto& row : x) {
+        doubles.emplace_back();
+        ints.emplace_back();
+        halves.emplace_back();
+        bfloats.emplace_back();
+        from_doubles.emplace_back();
+        from_ints.emplace_back();
+        from_halves.emplace_back();
+        from_bfloats.emplace_back();
+        for (float a : row) {
+            // Doubles between floats and integers above 2^24 are rounded.
+            const double d = a * (1.0 + 1e-9);
+            doubles.back().push_back(d);
+            from_doubles.back().push_back(static_cast<float>(d));
+
+            const int32_t i = std::isnan(a) ? 0 : static_cast<int32_t>(std::lround(a * 16.0f)) * 1025 + (1 << 25);
+            ints.back().push_back(i);
+            from_ints.back().push_back(static_cast<float>(i));
+
+            const uint16_t h = float_to_half(a);
+            halves.back().push_back(catboost::Float16{h});
+            from_halves.back().push_back(half_to_float(h));
+
+            uint32_t bits = 0;
+            std::memcpy(&bits, &a, sizeof(bits));
+            const uint16_t b = static_cast<uint16_t>(bits >> 16);
+            bits = uint32_t{b} << 16;
+            float f = 0.0f;
+            std::memcpy(&f, &bits, sizeof(f));
+            bfloats.back().push_back(catboost::BFloat16{b});
+            from_bfloats.back().push_back(f);
+        }
+    }
+
+    CHECK(typed_rows_test(model, doubles, from_doubles));
+    CHECK(typed_rows_test(model, ints, from_ints));
+    CHECK(typed_rows_test(model, halves, from_halves));
+    CHECK(typed_rows_test(model, bfloats, from_bfloats));
+
+    // Every half value including subnormals, infinities and NaN is converted
+    // exactly: a row of 8 features has 8 consecutive values.
+    std::vector<std::vector<catboost::Float16>> all;
+    std::vector<std::vector<float>> from_all;
+    const size_t n = x[0].size();
+    for (uint32_t h = 0; h < 0x10000; h += n) {
+        all.emplace_back();
+        from_all.emplace_back();
+        for (size_t j = 0; j < n; ++j) {
+            const uint16_t v = static_cast<uint16_t>(h + j);
+            all.back().push_back(catboost::Float16{v});
+            from_all.back().push_back(half_to_float(v));
+        }
+    }
+    CHECK(typed_rows_test(model, all, from_all));
+
+    const size_t dims = model.dimension();
+    catboost_model_info_t* cmodel = cb_model_load(path_to("testdata/" + name + "-model.json").c_str());
+    CHECK(cmodel != nullptr);
+    std::vector<double> out(dims), ref(dims);
+    model.apply(from_halves[0].data(), n, ref.data(), dims);
+    const uint16_t* h = reinterpret_cast<const uint16_t*>(halves[0].data());
+    CHECK(cb_model_apply_fp16(cmodel, h, n, CB_RAW_FORMULA_VAL, out.data(), dims) == 0);
+    CHECK(out == ref);
+    CHECK(cb_model_apply_fp16(cmodel, h, n, CB_RAW_FORMULA_VAL, out.data(), dims + 1) == -1);
+    std::vector<const double*> dd;
+    for (const auto& row : doubles) dd.push_back(row.data());
+    std::vector<double> many(dd.size() * dims);
+    CHECK(cb_model_apply_double_many(cmodel, dd.data(), dd.size(), n, CB_RAW_FORMULA_VAL, many.data(), dims) == 0);
+    for (size_t i = 0; i < dd.size(); ++i) {
+        model.apply(from_doubles[i].data(), n, ref.data(), dims);
+        for (size_t d = 0; d < dims; ++d) CHECK_FEQ(many[i * dims + d], ref[d], 1e-9);
+    }
+    cb_model_free(cmodel);
+    return true;
+}
+
+static bool sparse_test(const std::string& name) {
+    const auto x = read_x(name);
+    catboost::Model model{path_to("testdata/" + name + "-model.json")};
+    const size_t dims = model.dimension();
+    const size_t n = x[0].size();
+    std::vector<double> out(dims), ref(dims);
+
+    // Nonzero features of examples, defaults are zeros after load.
+    std::vector<size_t> offsets{0};
+    std::vector<uint32_t> indexes;
+    std::vector<float> values;
+    for (const auto& row : x) {
+        for (size_t j = 0; j < n; ++j) {
+            if (row[j] == 0.0f) continue;
+            indexes.push_back(static_cast<uint32_t>(j));
+            values.push_back(row[j]);
+        }
+        offsets.push_back(indexes.size());
+    }
+
+    std::vector<double> single(x.size() * dims);
+    for (size_t i = 0; i < x.size(); ++i) {
+        const size_t begin = offsets[i];
+        model.apply_sparse(indexes.data() + begin, values.data() + begin, offsets[i + 1] - begin,
+                           single.data() + i * dims, dims);
+        model.apply(x[i].data(), n, ref.data(), dims);
+        for (size_t d = 0; d < dims; ++d) CHECK_FEQ(single[i * dims + d], ref[d], 1e-9);
+        if (dims == 1) {
+            CHECK(model.apply_sparse(indexes.data() + begin, values.data() + begin, offsets[i + 1] - begin) ==
+                  single[i]);
+        }
+    }
+
+    std::vector<double> many(x.size() * dims);
+    model.apply_sparse(offsets.data(), x.size(), indexes.data(), values.data(), many.data(), dims);
+    CHECK(many == single);
+    if (dims == 1) {
+        std::vector<double> y(x.size());
+        model.apply_sparse(offsets.data(), x.size(), indexes.data(), values.data(), y.data());
+        CHECK(y == single);
+    }
+
+    // Features of the first example are defaults, and one feature differs
+    // from them, so only trees split by it are evaluated.
+    model.set_default_features(x[0].data(), n);
+    model.apply_sparse(nullptr, nullptr, 0, out.data(), dims);
+    model.apply(x[0].data(), n, ref.data(), dims);
+    for (size_t d = 0; d < dims; ++d) CHECK_FEQ(out[d], ref[d], 1e-9);
+    for (size_t i = 1; i < x.size(); ++i) {
+        for (uint32_t j = 0; j < n; ++j) {
+            std::vector<float> row = x[0];
+            row[j] = x[i][j];
+            model.apply_sparse(&j, &x[i][j], 1, out.data(), dims);
+            model.apply(row.data(), n, ref.data(), dims);
+            for (size_t d = 0; d < dims; ++d) CHECK_FEQ(out[d], ref[d], 1e-9);
+        }
+    }
+
+    bool thrown = false;
+    try {
+        const uint32_t wrong = static_cast<uint32_t>(n);
+        model.apply_sparse(&wrong, values.data(), 1, out.data(), dims);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    thrown = false;
+    try {
+        model.set_default_features(x[0].data(), n - 1);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    catboost_model_info_t* cmodel = cb_model_load(path_to("testdata/" + name + "-model.json").c_str());
+    CHECK(cmodel != nullptr);
+    CHECK(cb_model_apply_sparse_csr(cmodel, offsets.data(), x.size(), indexes.data(), values.data(),
+                                    CB_RAW_FORMULA_VAL, many.data(), dims) == 0);
+    CHECK(many == single);
+    CHECK(cb_model_set_default_features(cmodel, x[0].data(), n) == 0);
+    CHECK(cb_model_apply_sparse(cmodel, nullptr, nullptr, 0, CB_RAW_FORMULA_VAL, out.data(), dims) == 0);
+    model.apply(x[0].data(), n, ref.data(), dims);
+    for (size_t d = 0; d < dims; ++d) CHECK_FEQ(out[d], ref[d], 1e-9);
+    CHECK(cb_model_apply_sparse(cmodel, nullptr, nullptr, 0, CB_RAW_FORMULA_VAL, out.data(), dims + 1) == -1);
+    cb_model_free(cmodel);
+
+    catboost::Model cat{path_to("testdata/categorical-model.json")};
+    thrown = false;
+    try {
+        cat.apply_sparse(nullptr, nullptr, 0);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    return true;
+}
+
+// A model with many features, where few of them are split by every tree, so
+// sparse examples and scorer updates evaluate only trees split by their
+// features instead of falling back to the dense prediction.
+static nlohmann::json wide_model(size_t features) {
+    const size_t depth = 4;
+    nlohmann::json model;
+    auto split = [](size_t f, double border) {
+        return nlohmann::json{
+            {"float_feature_index", f}, {"border", border}, {"split_index", 0}, {"split_type", "FloatFeature"}};
+    };
+    for (size_t f = 0; f < features; ++f) {
+        model["features_info"]["float_features"].push_back({{"feature_index", f}, {"flat_feature_index", f}});
+    }
+    for (size_t t = 0; t < 64; ++t) {
+        nlohmann::json tree;
+        for (size_t k = 0; k < depth; ++k) tree["splits"].push_back(split((t * 37 + k * 101) % features, 0.25 * k));
+        for (size_t i = 0; i < (size_t{1} << depth); ++i) tree["leaf_values"].push_back(0.01 * ((t * 13 + i * 7) % 23));
+        model["oblivious_trees"].push_back(tree);
+    }
+    for (size_t t = 0; t < 16; ++t) {
+        const size_t f = (t * 53) % features;
+        nlohmann::json left{{"split", split(f + 1, 0.5)}, {"left", {{"value", 0.1 * t}}}, {"right", {{"value", -0.2}}}};
+        nlohmann::json right{{"value", 0.3 + 0.01 * t}};
+        model["trees"].push_back({{"split", split(f, 0.0)}, {"left", left}, {"right", right}});
+    }
+    return model;
+}
+
+static bool wide_sparse_test() {
+    const size_t features = 512;
+    const nlohmann::json model = wide_model(features);
+    catboost::Model m;
+    load_json(m, model.dump());
+
+    std::vector<float> defaults(features);
+    for (size_t f = 0; f < features; ++f) defaults[f] = 0.1f * (f % 11) - 0.5f;
+    m.set_default_features(defaults.data(), features);
+    CHECK_FEQ(m.apply_sparse(nullptr, nullptr, 0), reference_apply(model, defaults), 1e-9);
+    for (uint32_t count = 1; count <= 8; ++count) {
+        for (uint32_t first = 0; first < features; first += 7) {
+            std::vector<float> row = defaults;
+            std::vector<uint32_t> indexes;
+            std::vector<float> values;
+            for (uint32_t j = 0; j < count; ++j) {
+                // Repeated features are allowed, the last value is used.
+                const uint32_t f = (first + j * 97) % (j == count - 1 && count > 2 ? 97 : features);
+                indexes.push_back(f);
+                values.push_back(0.25f * ((first + j) % 9) - 1.0f);
+                row[f] = values.back();
+            }
+            CHECK_FEQ(m.apply_sparse(indexes.data(), values.data(), count), reference_apply(model, row), 1e-9);
+            CHECK_FEQ(m.apply_sparse(indexes.data(), values.data(), count), m.apply(row), 1e-9);
+        }
+    }
+    // Defaults are restored after every prediction.
+    CHECK_FEQ(m.apply_sparse(nullptr, nullptr, 0), reference_apply(model, defaults), 1e-9);
+
+    // Models with different defaults applied by turns, more of them than
+    // buffers kept by the thread.
+    std::vector<std::unique_ptr<catboost::Model>> models;
+    std::vector<std::vector<float>> rows;
+    for (size_t k = 0; k < 6; ++k) {
+        models.emplace_back(new catboost::Model);
+        load_json(*models.back(), model.dump());
+        rows.emplace_back(features);
+        for (size_t f = 0; f < features; ++f) rows.back()[f] = 0.1f * ((f + k) % 13) - 0.6f;
+        models.back()->set_default_features(rows.back().data(), features);
+    }
+    for (size_t i = 0; i < 3 * models.size(); ++i) {
+        const size_t k = i % (i < models.size() ? 2 : models.size());
+        const uint32_t index = static_cast<uint32_t>(i * 31 % features);
+        const float value = 0.75f;
+        std::vector<float> row = rows[k];
+        row[index] = value;
+        CHECK_FEQ(models[k]->apply_sparse(&index, &value, 1), reference_apply(model, row), 1e-9);
+    }
+    return true;
+}
+
+// Model with features spread over wide rows: feature f of the model file is
+// feature stride * f + 1, other features are not used.
+static nlohmann::json spread_features(const std::string& name, size_t stride) {
+    std::ifstream f{path_to("testdata/" + name + "-model.json")};
+    nlohmann::json model = nlohmann::json::parse(f);
+    std::function<void(nlohmann::json&)> spread_split = [&](nlohmann::json& node) {
+        if (node.count("split")) {
+            auto& index = node["split"]["float_feature_index"];
+            index = stride * index.get<size_t>() + 1;
+            spread_split(node["left"]);
+            spread_split(node["right"]);
+        }
+    };
+    if (model.count("oblivious_trees")) {
+        for (auto& tree : model["oblivious_trees"]) {
+            for (auto& split : tree["splits"]) {
+                split["float_feature_index"] = stride * split["float_feature_index"].get<size_t>() + 1;
+            }
+        }
+    }
+    if (model.count("trees")) {
+        for (auto& tree : model["trees"]) spread_split(tree);
+    }
+
+    const auto features = model["features_info"]["float_features"];
+    auto& spread = model["features_info"]["float_features"];
+    spread = nlohmann::json::array();
+    for (size_t i = 0; i < stride * features.size(); ++i) {
+        nlohmann::json feature = i % stride == 1 ? features[i / stride] : nlohmann::json::object();
+        feature["feature_index"] = i;
+        feature["flat_feature_index"] = i;
+        spread.push_back(feature);
+    }
+    return model;
+}
+
+static bool compact_test(const std::string& name) {
+    static constexpr size_t stride = 5;
+    const auto x = read_x(name);
+    const std::string json = spread_features(name, stride).dump();
+    catboost::Model model;
+    load_json(model, json);
+    catboost::Options options;
+    options.compact_features = true;
+    catboost::Model compact;
+    load_json(compact, json, options);
+    CHECK(!model.stats().compact_features);
+    CHECK(compact.stats().compact_features);
+    const size_t n = model.feature_count();
+    const size_t dims = model.dimension();
+
+    // Used features are the spread ones, the most used first.
+    catboost::Model original{path_to("testdata/" + name + "-model.json")};
+    const auto used = compact.used_features();
+    CHECK(used.size() == original.used_features().size());
+    for (size_t i = 0; i < used.size(); ++i) CHECK(used[i] == stride * original.used_features()[i] + 1);
+    CHECK(model.used_features() == used);
+    CHECK(model.stats().used_feature_count == used.size());
+
+    // Unused features are NaN, so they would change predictions if read.
+    std::vector<std::vector<float>> rows;
+    std::vector<const float*> xx;
+    for (const auto& row : x) {
+        rows.emplace_back(n, std::nanf(""));
+        for (size_t f = 0; f < row.size(); ++f) rows.back()[stride * f + 1] = row[f];
+    }
+    for (const auto& row : rows) xx.push_back(row.data());
+
+    std::vector<double> expected(x.size() * dims);
+    std::vector<double> y(x.size() * dims);
+    model.apply(xx.data(), xx.size(), n, expected.data(), dims);
+    compact.apply(xx.data(), xx.size(), n, y.data(), dims);
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], expected[i], 1e-9);
+    for (size_t i = 0; i < x.size(); ++i) {
+        std::vector<double> ref(dims);
+        original.apply(x[i].data(), x[i].size(), ref.data(), dims);
+        for (size_t d = 0; d < dims; ++d) CHECK_FEQ(y[i * dims + d], ref[d], 1e-9);
+    }
+
+    // Features of other types are packed after conversion.
+    std::vector<std::vector<double>> doubles;
+    std::vector<const double*> dd;
+    for (const auto& row : rows) doubles.emplace_back(row.begin(), row.end());
+    for (const auto& row : doubles) dd.push_back(row.data());
+    compact.apply(dd.data(), dd.size(), n, y.data(), dims);
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], expected[i], 1e-9);
+
+    // Options without compact_features drop the compact model.
+    compact.set_options(catboost::Options{});
+    CHECK(!compact.stats().compact_features);
+    compact.apply(xx.data(), xx.size(), n, y.data(), dims);
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], expected[i], 1e-9);
+
+    // Models using all features are not compacted.
+    catboost::Model dense{path_to("testdata/" + name + "-model.json"), options};
+    CHECK(!dense.stats().compact_features);
+
+    catboost_model_info_t* cmodel = cb_model_load_from_string(json.data(), json.size());
+    CHECK(cmodel != nullptr);
+    std::vector<uint32_t> cused(used.size() + 1, 0);
+    CHECK(cb_model_used_features(cmodel, cused.data(), cused.size()) == used.size());
+    CHECK(std::equal(used.begin(), used.end(), cused.begin()));
+    CHECK(cb_model_used_features(cmodel, nullptr, 0) == used.size());
+    cb_model_free(cmodel);
+    return true;
+}
+
+static bool scorer_test(const std::string& name) {
+    const auto x = read_x(name);
+    catboost::Model model{path_to("testdata/" + name + "-model.json")};
+    const size_t dims = model.dimension();
+    const size_t n = x[0].size();
+    std::vector<double> out(dims), ref(dims);
+
+    // Scorer starts from default features.
+    catboost::Scorer scorer{model};
+    scorer.apply(out.data(), dims);
+    model.apply_sparse(nullptr, nullptr, 0, ref.data(), dims);
+    for (size_t d = 0; d < dims; ++d) CHECK_FEQ(out[d], ref[d], 1e-9);
+
+    // Every example changes a few features of the previous one.
+    std::vector<float> row = x[0];
+    scorer.reset(row.data(), n);
+    for (size_t i = 1; i < x.size(); ++i) {
+        std::vector<uint32_t> indexes;
+        std::vector<float> values;
+        for (uint32_t j = i % 3; j < n; j += 3) {
+            indexes.push_back(j);
+            values.push_back(x[i][j]);
+            row[j] = x[i][j];
+        }
+        scorer.update(indexes.data(), values.data(), indexes.size());
+        scorer.apply(out.data(), dims);
+        model.apply(row.data(), n, ref.data(), dims);
+        for (size_t d = 0; d < dims; ++d) CHECK_FEQ(out[d], ref[d], 1e-9);
+        if (dims == 1) CHECK(scorer.apply() == out[0]);
+    }
+
+    // Scorers could be moved.
+    std::vector<catboost::Scorer> scorers;
+    scorers.emplace_back(model);
+    scorers.emplace_back(std::move(scorer));
+    scorers[1].apply(ref.data(), dims);
+    CHECK(ref == out);
+
+    bool thrown = false;
+    try {
+        const uint32_t wrong = static_cast<uint32_t>(n);
+        const float value = 0.0f;
+        scorers[0].update(&wrong, &value, 1);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    thrown = false;
+    try {
+        scorers[0].reset(row.data(), n - 1);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    thrown = false;
+    try {
+        scorers[0].apply(out.data(), dims + 1);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    catboost_model_info_t* cmodel = cb_model_load(path_to("testdata/" + name + "-model.json").c_str());
+    CHECK(cmodel != nullptr);
+    catboost_scorer_t* cscorer = cb_scorer_create(cmodel);
+    CHECK(cscorer != nullptr);
+    CHECK(cb_scorer_reset(cscorer, x[0].data(), n) == 0);
+    const uint32_t first = 0;
+    CHECK(cb_scorer_update(cscorer, &first, &x[1][0], 1) == 0);
+    CHECK(cb_scorer_apply(cscorer, CB_RAW_FORMULA_VAL, out.data(), dims) == 0);
+    row = x[0];
+    row[0] = x[1][0];
+    model.apply(row.data(), n, ref.data(), dims);
+    for (size_t d = 0; d < dims; ++d) CHECK_FEQ(out[d], ref[d], 1e-9);
+    const uint32_t wrong = static_cast<uint32_t>(n);
+    CHECK(cb_scorer_update(cscorer, &wrong, &x[1][0], 1) == -1);
+    CHECK(cb_scorer_apply(cscorer, CB_RAW_FORMULA_VAL, out.data(), dims + 1) == -1);
+    cb_scorer_free(cscorer);
+    cb_model_free(cmodel);
+
+    catboost::Model cat{path_to("testdata/categorical-model.json")};
+    thrown = false;
+    try {
+        catboost::Scorer s{cat};
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    return true;
+}
+
+// Long sequences of updates of a few features evaluate only trees split by
+// them, and sums of leaves stay accurate.
+static bool wide_scorer_test() {
+    const size_t features = 512;
+    const nlohmann::json json = wide_model(features);
+    catboost::Model model;
+    load_json(model, json.dump());
+
+    std::mt19937 gen{42};
+    std::uniform_int_distribution<uint32_t> feature{0, features - 1};
+    std::uniform_int_distribution<int> count{1, 3};
+    std::uniform_real_distribution<float> value{-1.0f, 1.0f};
+    std::vector<float> row(features);
+    for (auto& v : row) v = value(gen);
+    catboost::Scorer scorer{model};
+    scorer.reset(row.data(), features);
+    CHECK_FEQ(scorer.apply(), reference_apply(json, row), 1e-9);
+    for (size_t i = 0; i < 10000; ++i) {
+        uint32_t indexes[3];
+        float values[3];
+        const int n = count(gen);
+        for (int j = 0; j < n; ++j) {
+            indexes[j] = feature(gen);
+            // NaN goes left in splits of the model.
+            values[j] = i % 100 == 0 ? std::nanf("") : value(gen);
+            row[indexes[j]] = values[j];
+        }
+        scorer.update(indexes, values, n);
+        if (i % 97 == 0) CHECK_FEQ(scorer.apply(), model.apply(row), 1e-9);
+    }
+    CHECK_FEQ(scorer.apply(), reference_apply(json, row), 1e-9);
+
+    // The sum is added from leaves again after 64 updates, so it is the same
+    // as after reset.
+    scorer.reset(row.data(), features);
+    for (size_t i = 0; i < 64; ++i) {
+        const uint32_t index = feature(gen);
+        const float v = value(gen);
+        row[index] = v;
+        scorer.update(&index, &v, 1);
+    }
+    catboost::Scorer fresh{model};
+    fresh.reset(row.data(), features);
+    CHECK(scorer.apply() == fresh.apply());
+    return true;
+}
+
+// Specialized models predict the same values for examples having the fixed
+// values of features.
+static bool specialize_test(const std::string& name) {
+    const auto x = read_x(name);
+    catboost::Model model{path_to("testdata/" + name + "-model.json")};
+    const size_t dims = model.dimension();
+    const size_t n = x[0].size();
+    std::vector<double> out(dims), ref(dims);
+
+    // Features 0 and 2 are fixed to values of the first example, or to NaN.
+    for (float fixed_value : {x[0][0], std::nanf("")}) {
+        const std::vector<uint32_t> indexes{0, 2};
+        const std::vector<float> values{fixed_value, x[0][2]};
+        catboost::Model specialized;
+        model.specialize(indexes.data(), values.data(), indexes.size(), specialized);
+        CHECK(specialized.stats().values_size < model.stats().values_size);
+        CHECK(specialized.tree_count() <= model.tree_count());
+        CHECK(specialized.feature_count() == model.feature_count());
+        for (const auto& row : x) {
+            std::vector<float> fixed = row;
+            fixed[0] = fixed_value;
+            fixed[2] = x[0][2];
+            specialized.apply(row.data(), n, out.data(), dims);
+            model.apply(fixed.data(), n, ref.data(), dims);
+            for (size_t d = 0; d < dims; ++d) CHECK_FEQ(out[d], ref[d], 1e-9);
+        }
+    }
+
+    // All trees are constant if all features are fixed.
+    std::vector<uint32_t> all(n);
+    for (uint32_t f = 0; f < n; ++f) all[f] = f;
+    catboost::Model constant;
+    model.specialize(all.data(), x[1].data(), n, constant);
+    CHECK(constant.tree_count() == 0);
+    constant.apply(x[0].data(), n, out.data(), dims);
+    model.apply(x[1].data(), n, ref.data(), dims);
+    for (size_t d = 0; d < dims; ++d) CHECK_FEQ(out[d], ref[d], 1e-9);
+
+    // Model could be specialized in place, and a specialized one again.
+    catboost::Model twice{path_to("testdata/" + name + "-model.json")};
+    const uint32_t first = 1;
+    const uint32_t second = 3;
+    twice.specialize(&first, &x[2][1], 1, twice);
+    twice.specialize(&second, &x[2][3], 1, twice);
+    for (const auto& row : x) {
+        std::vector<float> fixed = row;
+        fixed[1] = x[2][1];
+        fixed[3] = x[2][3];
+        twice.apply(row.data(), n, out.data(), dims);
+        model.apply(fixed.data(), n, ref.data(), dims);
+        for (size_t d = 0; d < dims; ++d) CHECK_FEQ(out[d], ref[d], 1e-9);
+    }
+
+    bool thrown = false;
+    try {
+        const uint32_t wrong = static_cast<uint32_t>(n);
+        model.specialize(&wrong, x[0].data(), 1, constant);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    catboost_model_info_t* cmodel = cb_model_load(path_to("testdata/" + name + "-model.json").c_str());
+    CHECK(cmodel != nullptr);
+    catboost_model_info_t* cspecialized = cb_model_specialize(cmodel, all.data(), x[1].data(), n);
+    CHECK(cspecialized != nullptr);
+    CHECK(cb_model_tree_count(cspecialized) == 0);
+    CHECK(cb_model_apply_multi(cspecialized, x[0].data(), n, out.data(), dims) == 0);
+    model.apply(x[1].data(), n, ref.data(), dims);
+    for (size_t d = 0; d < dims; ++d) CHECK_FEQ(out[d], ref[d], 1e-9);
+    const uint32_t wrong = static_cast<uint32_t>(n);
+    CHECK(cb_model_specialize(cmodel, &wrong, x[0].data(), 1) == nullptr);
+    cb_model_free(cspecialized);
+    cb_model_free(cmodel);
+    return true;
+}
+
+// Float features of models with categorical features could be fixed too,
+// CTRs still read them.
+static bool cat_specialize_test() {
+    std::vector<std::vector<float>> x;
+    std::vector<std::vector<int32_t>> hashes;
+    std::ifstream f{path_to("testdata/categorical.json")};
+    nlohmann::json value = nlohmann::json::parse(f);
+    for (const auto& row : value.at("x")) x.push_back(row.get<std::vector<float>>());
+    for (const auto& h : value.at("hash")) hashes.push_back(h.get<std::vector<int32_t>>());
+
+    catboost::Model model{path_to("testdata/categorical-model.json")};
+    const size_t n = x[0].size();
+    const size_t cat_count = hashes[0].size();
+    for (uint32_t f = 0; f < n; ++f) {
+        catboost::Model specialized;
+        model.specialize(&f, &x[0][f], 1, specialized);
+        for (size_t i = 0; i < x.size(); ++i) {
+            std::vector<float> fixed = x[i];
+            fixed[f] = x[0][f];
+            CHECK_FEQ(specialized.apply(fixed.data(), n, hashes[i].data(), cat_count),
+                      model.apply(fixed.data(), n, hashes[i].data(), cat_count), 1e-9);
+        }
+    }
+    return true;
+}
+
+static bool cache_test(const std::string& name) {
+    const auto x = read_x(name);
+    const std::string path = path_to("testdata/" + name + "-model.json");
+    catboost::Model model{path};
+    catboost::Options options;
+    options.cache_size = 1 << 20;
+    catboost::Model cached{path, options};
+    const size_t n = model.feature_count();
+    const size_t dims = model.dimension();
+    const size_t size = x.size();
+
+    // Examples are compared bitwise, NaN are equal.
+    std::set<std::vector<uint32_t>> distinct;
+    for (const auto& row : x) {
+        std::vector<uint32_t> bits(row.size());
+        std::memcpy(bits.data(), row.data(), row.size() * sizeof(float));
+        distinct.insert(bits);
+    }
+    const size_t unique = distinct.size();
+
+    // Every example is given twice in the bucket.
+    std::vector<const float*> xx;
+    for (const auto& row : x) xx.push_back(row.data());
+    for (size_t i = size; i-- > 0;) xx.push_back(x[i].data());
+    std::vector<double> expected(xx.size() * dims);
+    std::vector<double> y(xx.size() * dims);
+    model.apply(xx.data(), xx.size(), n, expected.data(), dims);
+
+    CHECK(cached.cache_stats().capacity > size);
+    CHECK(cached.cache_stats().size <= options.cache_size);
+    cached.apply(xx.data(), xx.size(), n, y.data(), dims);
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], expected[i], 1e-9);
+    CHECK(cached.cache_stats().hits == 0);
+    CHECK(cached.cache_stats().misses == unique);
+
+    // The second bucket and single examples are found in the cache.
+    std::fill(y.begin(), y.end(), 0.0);
+    cached.apply(xx.data(), xx.size(), n, y.data(), dims);
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], expected[i], 1e-9);
+    std::vector<double> out(dims);
+    for (size_t i = 0; i < size; ++i) {
+        cached.apply(x[i].data(), n, out.data(), dims);
+        for (size_t d = 0; d < dims; ++d) CHECK_FEQ(out[d], expected[i * dims + d], 1e-9);
+        if (dims == 1) CHECK_FEQ(cached.apply(x[i].data(), n), expected[i], 1e-9);
+    }
+    const size_t lookups = unique + (dims == 1 ? 2 * size : size);
+    CHECK(cached.cache_stats().hits == lookups);
+    CHECK(cached.cache_stats().misses == unique);
+
+    // Features of other types are converted before lookup.
+    std::vector<std::vector<double>> doubles;
+    std::vector<const double*> dd;
+    for (const auto& row : x) doubles.emplace_back(row.begin(), row.end());
+    for (const auto& row : doubles) dd.push_back(row.data());
+    cached.apply(dd.data(), dd.size(), n, y.data(), dims);
+    for (size_t i = 0; i < size * dims; ++i) CHECK_FEQ(y[i], expected[i], 1e-9);
+    CHECK(cached.cache_stats().hits == lookups + unique);
+
+    // Options drop the cache. Rows are deduplicated without it too.
+    catboost::Options dedupe;
+    dedupe.dedupe_rows = true;
+    cached.set_options(dedupe);
+    CHECK(cached.cache_stats().capacity == 0);
+    cached.apply(xx.data(), xx.size(), n, y.data(), dims);
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], expected[i], 1e-9);
+    CHECK(cached.cache_stats().hits == 0);
+
+    // A cache too small for a slot is not allocated.
+    catboost::Options tiny;
+    tiny.cache_size = 8;
+    cached.set_options(tiny);
+    CHECK(cached.cache_stats().capacity == 0);
+    cached.apply(xx.data(), xx.size(), n, y.data(), dims);
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], expected[i], 1e-9);
+
+    // Threads applying the model to a cache of a few slots replace entries
+    // of each other all the time.
+    catboost::Options small;
+    small.cache_size = 512;
+    cached.set_options(small);
+    CHECK(cached.cache_stats().capacity > 0);
+    CHECK(cached.cache_stats().capacity < size);
+    std::vector<std::thread> threads;
+    std::vector<int> failed(4, 0);
+    for (size_t t = 0; t < failed.size(); ++t) {
+        threads.emplace_back([&, t] {
+            std::vector<double> res(dims);
+            std::vector<double> bucket(4 * dims);
+            for (size_t round = 0; round < 50; ++round) {
+                for (size_t i = t; i < size; ++i) {
+                    cached.apply(x[i].data(), n, res.data(), dims);
+                    for (size_t d = 0; d < dims; ++d) failed[t] |= std::abs(res[d] - expected[i * dims + d]) > 1e-9;
+                }
+                for (size_t i = 0; i + 4 <= xx.size(); i += 4) {
+                    cached.apply(xx.data() + i, 4, n, bucket.data(), dims);
+                    for (size_t k = 0; k < 4 * dims; ++k) {
+                        failed[t] |= std::abs(bucket[k] - expected[i * dims + k]) > 1e-9;
+                    }
+                }
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    for (int f : failed) CHECK(!f);
+
+    catboost_model_info_t* cmodel = cb_model_load(path.c_str());
+    CHECK(cmodel != nullptr);
+    CHECK(cb_model_set_cache(cmodel, 1 << 20, 0) == 0);
+    CHECK(cb_model_apply_multi_many(cmodel, xx.data(), xx.size(), n, y.data(), dims) == 0);
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], expected[i], 1e-9);
+    uint64_t hits = 1;
+    uint64_t misses = 0;
+    CHECK(cb_model_cache_stats(cmodel, &hits, &misses) == 0);
+    CHECK(hits == 0);
+    CHECK(misses == unique);
+    cb_model_free(cmodel);
+    return true;
+}
+
+static bool strided_test(const std::string& name) {
+    TestModel test{name};
+
+    // Matrices in C order with a padding column and in Fortran order.
+    const std::vector<float> c = padded_rows(test);
+    std::vector<float> fortran(test.size * test.n);
+    std::vector<double> fortran_double(test.size * test.n);
+    for (size_t i = 0; i < test.size; ++i) {
+        for (size_t j = 0; j < test.n; ++j) {
+            fortran[j * test.size + i] = test.x[i][j];
+            fortran_double[j * test.size + i] = test.x[i][j];
+        }
+    }
+    const auto s = static_cast<ptrdiff_t>(test.size);
+    const auto w = static_cast<ptrdiff_t>(test.n + 1);
+
+    std::vector<double> y(test.size * test.dims);
+    test.model.apply_strided(c.data(), test.size, test.n, w, 1, y.data(), test.dims);
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], test.expected[i], 1e-9);
+    std::fill(y.begin(), y.end(), 0.0);
+    test.model.apply_strided(fortran.data(), test.size, test.n, 1, s, y.data(), test.dims);
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], test.expected[i], 1e-9);
+    std::fill(y.begin(), y.end(), 0.0);
+    test.model.apply_strided(fortran_double.data(), test.size, test.n, 1, s, y.data(), test.dims);
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], test.expected[i], 1e-9);
+
+    // Reversed rows by a negative stride.
+    std::fill(y.begin(), y.end(), 0.0);
+    test.model.apply_strided(&fortran[test.size - 1], test.size, test.n, -1, s, y.data(), test.dims);
+    for (size_t i = 0; i < test.size; ++i) {
+        for (size_t d = 0; d < test.dims; ++d) {
+            CHECK_FEQ(y[i * test.dims + d], test.expected[(test.size - 1 - i) * test.dims + d], 1e-9);
+        }
+    }
+
+    catboost_model_info_t* cmodel = cb_model_load(test.path.c_str());
+    CHECK(cmodel != nullptr);
+    std::fill(y.begin(), y.end(), 0.0);
+    CHECK(cb_model_apply_strided(cmodel, fortran.data(), test.size, test.n, 1, s, CB_RAW_FORMULA_VAL, y.data(),
+                                 test.dims) == 0);
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], test.expected[i], 1e-9);
+    std::fill(y.begin(), y.end(), 0.0);
+    CHECK(cb_model_apply_double_strided(cmodel, fortran_double.data(), test.size, test.n, 1, s, CB_RAW_FORMULA_VAL,
+                                        y.data(), test.dims) == 0);
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], test.expected[i], 1e-9);
+    CHECK(cb_model_apply_strided(cmodel, c.data(), test.size, test.n - 1, w, 1, CB_RAW_FORMULA_VAL, y.data(),
+                                 test.dims) == -1);
+    cb_model_free(cmodel);
+    return true;
+}
+
+static void count_done(void* cookie) { static_cast<std::atomic<size_t>*>(cookie)->fetch_add(1); }
+
+static bool async_test(const std::string& name) {
+    using catboost::PredictionType;
+
+    TestModel test{name};
+
+    // Examples of a supported type other than raw values are mixed with raw
+    // ones in the same batches.
+    PredictionType other = PredictionType::RawFormulaVal;
+    for (auto type : {PredictionType::Probability, PredictionType::Exponent}) {
+        try {
+            std::vector<double> out(test.model.dimension(type));
+            test.model.apply(test.x[0].data(), test.n, out.data(), out.size(), type);
+            other = type;
+            break;
+        } catch (const std::runtime_error&) {
+        }
+    }
+    const size_t other_dims = test.model.dimension(other);
+    std::vector<double> expected_other(test.size * other_dims);
+    test.model.apply(test.xx.data(), test.size, test.n, expected_other.data(), other_dims, other);
+
+    if (test.dims == 1) {
+        std::vector<std::future<double>> futures;
+        for (const auto& row : test.x) futures.push_back(test.model.apply_async(row.data(), test.n));
+        for (size_t i = 0; i < test.size; ++i) CHECK_FEQ(futures[i].get(), test.expected[i], 1e-9);
+    } else {
+        bool thrown = false;
+        try {
+            test.model.apply_async(test.x[0].data(), test.n);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+
+    {
+        // Continuations are called on threads of the executor, which runs
+        // at most concurrency() tasks of the queue at once.
+        CountingExecutor executor;
+        catboost::Options options;
+        options.executor = &executor;
+        catboost::Model async{test.path, options};
+        std::vector<double> y(test.size * test.dims);
+        std::vector<double> y_other(test.size * other_dims);
+        std::atomic<size_t> done{0};
+        for (size_t round = 0; round < 2; ++round) {
+            for (size_t i = 0; i < test.size; ++i) {
+                async.apply_async(test.x[i].data(), test.n, &y[i * test.dims], test.dims, [&] { ++done; });
+                async.apply_async(test.x[i].data(), test.n, &y_other[i * other_dims], other_dims, [&] { ++done; },
+                                  other);
+            }
+        }
+        while (done < 4 * test.size) std::this_thread::yield();
+        for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], test.expected[i], 1e-9);
+        for (size_t i = 0; i < y_other.size(); ++i) CHECK_FEQ(y_other[i], expected_other[i], 1e-9);
+        CHECK(executor.submitted >= 1);
+        CHECK(executor.submitted <= 4 * test.size);
+
+        // Wrong arguments are reported by the caller.
+        bool thrown = false;
+        try {
+            async.apply_async(test.x[0].data(), test.n, y.data(), test.dims + 1, [] {});
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+
+    {
+        // Many threads submit examples concurrently, and the model waits for
+        // them when it is destroyed.
+        catboost::ThreadPool pool{3};
+        std::vector<double> y(4 * test.size * test.dims);
+        std::atomic<size_t> done{0};
+        {
+            catboost::Options options;
+            options.executor = &pool;
+            catboost::Model async{test.path, options};
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < 4; ++t) {
+                threads.emplace_back([&, t] {
+                    for (size_t i = 0; i < test.size; ++i) {
+                        async.apply_async(test.x[i].data(), test.n, &y[(t * test.size + i) * test.dims], test.dims,
+                                          [&] { ++done; });
+                    }
+                });
+            }
+            for (auto& t : threads) t.join();
+        }
+        CHECK(done == 4 * test.size);
+        for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], test.expected[i % (test.size * test.dims)], 1e-9);
+    }
+
+    catboost_model_info_t* cmodel = cb_model_load(test.path.c_str());
+    CHECK(cmodel != nullptr);
+    std::vector<double> y(test.size * test.dims);
+    std::atomic<size_t> done{0};
+    for (size_t i = 0; i < test.size; ++i) {
+        CHECK(cb_model_submit(cmodel, test.x[i].data(), test.n, CB_RAW_FORMULA_VAL, &y[i * test.dims], test.dims,
+                              count_done, &done) == 0);
+    }
+    CHECK(cb_model_submit(cmodel, test.x[0].data(), test.n, CB_RAW_FORMULA_VAL, y.data(), test.dims + 1,
+                          count_done, &done) == -1);
+    cb_model_free(cmodel);
+    CHECK(done == test.size);
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], test.expected[i], 1e-9);
+    return true;
+}
+
+static bool batching_test(const std::string& name) {
+    TestModel test{name};
+
+    // A lone caller is predicted without waiting for others.
+    catboost::BatchingOptions options;
+    options.max_batch = 8;
+    options.latency_budget_us = 1000000;
+    catboost::BatchingModel batching{test.model, options};
+    std::vector<double> y(test.size * test.dims);
+    for (size_t i = 0; i < test.size; ++i) batching.apply(test.x[i].data(), test.n, &y[i * test.dims], test.dims);
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], test.expected[i], 1e-9);
+    CHECK(batching.stats().examples == test.size);
+    CHECK(batching.stats().batches == test.size);
+    if (test.dims == 1) CHECK_FEQ(batching.apply(test.x[0]), test.expected[0], 1e-9);
+
+    // Examples of many threads are predicted together.
+    static constexpr size_t threads_count = 8;
+    static constexpr size_t rounds = 20;
+    std::vector<double> yy(threads_count * test.size * test.dims);
+    {
+        catboost::BatchingModel shared{test.model};
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < threads_count; ++t) {
+            threads.emplace_back([&, t] {
+                for (size_t r = 0; r < rounds; ++r) {
+                    for (size_t i = 0; i < test.size; ++i) {
+                        shared.apply(test.x[i].data(), test.n, &yy[(t * test.size + i) * test.dims], test.dims);
+                    }
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+        const auto stats = shared.stats();
+        CHECK(stats.examples == threads_count * rounds * test.size);
+        CHECK(stats.batches >= 1);
+        CHECK(stats.batches <= stats.examples);
+    }
+    for (size_t i = 0; i < yy.size(); ++i) CHECK_FEQ(yy[i], test.expected[i % (test.size * test.dims)], 1e-9);
+
+    // Wrong arguments are reported by the caller.
+    bool thrown = false;
+    try {
+        batching.apply(test.x[0].data(), test.n, y.data(), test.dims + 1);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    thrown = false;
+    try {
+        batching.apply(test.x[0].data(), test.n - 1, y.data(), test.dims);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    catboost_model_info_t* cmodel = cb_model_load(test.path.c_str());
+    CHECK(cmodel != nullptr);
+    catboost_batching_model_t* cbatching = cb_batching_model_create(cmodel, 16, 100);
+    CHECK(cbatching != nullptr);
+    std::fill(y.begin(), y.end(), 0.0);
+    for (size_t i = 0; i < test.size; ++i) {
+        CHECK(cb_batching_model_apply(cbatching, test.x[i].data(), test.n, CB_RAW_FORMULA_VAL, &y[i * test.dims],
+                                      test.dims) == 0);
+    }
+    for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], test.expected[i], 1e-9);
+    CHECK(cb_batching_model_apply(cbatching, test.x[0].data(), test.n, CB_RAW_FORMULA_VAL, y.data(),
+                                  test.dims + 1) == -1);
+    cb_batching_model_free(cbatching);
+    cb_model_free(cmodel);
+    return true;
+}
+
+static bool matrix_test(const std::string& name) {
+    TestModel test{name};
+
+    // Rows in C order with a padding column, labels are the first predictions.
+    const std::vector<float> c = padded_rows(test);
+    std::vector<double> label(test.size);
+    for (size_t i = 0; i < test.size; ++i) label[i] = test.expected[i * test.dims];
+
+    const std::string filename = name + "-test.cbfm";
+    for (auto layout : {catboost::MatrixLayout::Columns, catboost::MatrixLayout::Rows}) {
+        catboost::FeatureMatrix::write(filename, c.data(), test.size, test.n, static_cast<ptrdiff_t>(test.n + 1), 1,
+                                       layout == catboost::MatrixLayout::Columns ? label.data() : nullptr, layout);
+        catboost::FeatureMatrix matrix{filename};
+        CHECK(matrix.rows() == test.size);
+        CHECK(matrix.features() == test.n);
+        CHECK(matrix.layout() == layout);
+        for (size_t i = 0; i < test.size; ++i) {
+            for (size_t j = 0; j < test.n; ++j) {
+                CHECK(matrix.at(i, j) == test.x[i][j] || (std::isnan(test.x[i][j]) && std::isnan(matrix.at(i, j))));
+            }
+        }
+        if (layout == catboost::MatrixLayout::Columns) {
+            CHECK(reinterpret_cast<uintptr_t>(matrix.column(test.n - 1)) % 64 == 0);
+            CHECK(matrix.label() != nullptr);
+            for (size_t i = 0; i < test.size; ++i) CHECK(matrix.label()[i] == label[i]);
+        } else {
+            CHECK(matrix.row(test.size - 1) == matrix.data() + (test.size - 1) * test.n);
+            CHECK(matrix.label() == nullptr);
+        }
+
+        std::vector<double> y(test.size * test.dims);
+        test.model.apply(matrix, y.data(), test.dims);
+        for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], test.expected[i], 1e-9);
+        std::fill(y.begin(), y.end(), 0.0);
+        test.model.apply_parallel(matrix, y.data(), test.dims);
+        for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], test.expected[i], 1e-9);
+
+        catboost_model_info_t* cmodel = cb_model_load(test.path.c_str());
+        CHECK(cmodel != nullptr);
+        catboost_matrix_t* cmatrix = cb_matrix_load(filename.c_str());
+        CHECK(cmatrix != nullptr);
+        CHECK(cb_matrix_rows(cmatrix) == test.size);
+        CHECK(cb_matrix_features(cmatrix) == test.n);
+        ptrdiff_t row_stride = 0;
+        ptrdiff_t column_stride = 0;
+        CHECK(cb_matrix_data(cmatrix, &row_stride, &column_stride) != nullptr);
+        CHECK(row_stride == matrix.row_stride() && column_stride == matrix.column_stride());
+        std::fill(y.begin(), y.end(), 0.0);
+        CHECK(cb_model_apply_matrix(cmodel, cmatrix, CB_RAW_FORMULA_VAL, y.data(), test.dims, nullptr) == 0);
+        for (size_t i = 0; i < y.size(); ++i) CHECK_FEQ(y[i], test.expected[i], 1e-9);
+        CHECK(cb_model_apply_matrix(cmodel, cmatrix, CB_RAW_FORMULA_VAL, y.data(), test.dims + 1, nullptr) == -1);
+        cb_matrix_free(cmatrix);
+        cb_model_free(cmodel);
+    }
+
+    // Truncated file is rejected.
+    {
+        std::ifstream in{filename, std::ios::binary};
+        std::string data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+        std::ofstream out{filename, std::ios::binary | std::ios::trunc};
+        out.write(data.data(), static_cast<std::streamsize>(data.size() - 1));
+    }
+    bool thrown = false;
+    try {
+        catboost::FeatureMatrix matrix{filename};
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(cb_matrix_load(filename.c_str()) == nullptr);
+
+    // Models with categorical features are rejected before tasks are
+    // submitted.
+    {
+        catboost::Options options;
+        options.parallel_min_rows = 1;
+        catboost::Model cat{path_to("testdata/categorical-model.json"), options};
+        const size_t rows = 4096;
+        std::vector<float> zeros(rows * cat.feature_count());
+        catboost::FeatureMatrix::write(filename, zeros.data(), rows, cat.feature_count(),
+                                       static_cast<ptrdiff_t>(cat.feature_count()), 1);
+        catboost::FeatureMatrix matrix{filename};
+        catboost::ThreadPool pool{3};
+        std::vector<double> y(rows * cat.dimension());
+        thrown = false;
+        try {
+            cat.apply_parallel(matrix, y.data(), cat.dimension(), &pool);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+    std::remove(filename.c_str());
+    return true;
+}
+
+// Field s followed by tail is parsed by parse_number to the same double as
+// by strtod, bit by bit.
+static bool parses_as_strtod(const std::string& s, const std::string& tail = "") {
+    const std::string text = s + tail;
+    double value = 0.0;
+    const char* end = parse_number(text.data(), text.data() + text.size(), '\t', value);
+    if (end != text.data() + s.size()) return false;
+    const double expected = std::strtod(s.c_str(), nullptr);
+    if (std::isnan(expected)) return std::isnan(value);
+    return std::memcmp(&value, &expected, sizeof(value)) == 0;
+}
+
+// Parser of text files used by tools.
+static bool tsv_test() {
+    // 19 significant digits take the exact path, 20 ones are parsed by strtod.
+    CHECK(parses_as_strtod("1234567890123456789"));
+    CHECK(parses_as_strtod("12345678901234567891"));
+    CHECK(parses_as_strtod("-9.999999999999999999e-5"));
+    CHECK(parses_as_strtod("0.12345678901234567891"));
+    // Mantissas up to 2^53 are exact doubles.
+    CHECK(parses_as_strtod("9007199254740992"));
+    CHECK(parses_as_strtod("9007199254740993"));
+    CHECK(parses_as_strtod("9007199254740993e-3"));
+    // Powers of 10 up to 1e22 are exact doubles.
+    CHECK(parses_as_strtod("1e22"));
+    CHECK(parses_as_strtod("1e-22"));
+    CHECK(parses_as_strtod("3.7e23"));
+    CHECK(parses_as_strtod("3.7e-23"));
+    CHECK(parses_as_strtod("123456789e+22"));
+    CHECK(parses_as_strtod("1e400"));
+    CHECK(parses_as_strtod("1e-400"));
+    // Leading zeros of fractions change only the exponent.
+    CHECK(parses_as_strtod("0.000000000000000000001"));
+    CHECK(parses_as_strtod("0.0000000000000000000000123456789"));
+    CHECK(parses_as_strtod("-000.000123"));
+    CHECK(parses_as_strtod("0"));
+    CHECK(parses_as_strtod("-0"));
+    CHECK(parses_as_strtod(".5"));
+    CHECK(parses_as_strtod("5."));
+    // Other forms accepted by strtod.
+    CHECK(parses_as_strtod("nan"));
+    CHECK(parses_as_strtod("-inf"));
+    CHECK(parses_as_strtod("Infinity"));
+    CHECK(parses_as_strtod("0x1.8p3"));
+    // Fields end at delimiters and line breaks.
+    CHECK(parses_as_strtod("2.5", "\t1"));
+    CHECK(parses_as_strtod("2.5", "\r\n"));
+    CHECK(parses_as_strtod("1e-23", "\n"));
+
+    // Numbers with random digits and exponents.
+    std::mt19937 gen{42};
+    std::uniform_int_distribution<int> digit{0, 9};
+    std::uniform_int_distribution<int> length{1, 22};
+    std::uniform_int_distribution<int> exponent{-30, 30};
+    for (size_t i = 0; i < 10000; ++i) {
+        std::string s;
+        const int n = length(gen);
+        const int point = std::uniform_int_distribution<int>{0, n}(gen);
+        for (int j = 0; j < n; ++j) {
+            if (j == point) s += '.';
+            s += static_cast<char>('0' + digit(gen));
+        }
+        if (i % 2) s += "e" + std::to_string(exponent(gen));
+        CHECK(parses_as_strtod(s));
+    }
+
+    // Empty fields and other text are not numbers.
+    double value = 0.0;
+    for (const std::string s : {"", "\t1", "-", "e5", "1x", "1e", "1.2.3"}) {
+        CHECK(parse_number(s.data(), s.data() + s.size(), '\t', value) == nullptr);
+    }
+
+    // Lines with skipped columns.
+    float out[3];
+    const std::string line = "label\tid\t1.5\t-2\t1e3\textra";
+    const char* end = line.data() + line.size();
+    CHECK(parse_line(line.data(), end, '\t', 2, 3, out));
+    CHECK(out[0] == 1.5f && out[1] == -2.0f && out[2] == 1000.0f);
+    CHECK(!parse_line(line.data(), end, '\t', 3, 4, out));
+    CHECK(!parse_line(line.data(), end, '\t', 6, 0, out));
+    CHECK(!parse_line(line.data(), end, '\t', 0, 1, out));
+    const std::string empty = "1\t\t3";
+    CHECK(!parse_line(empty.data(), empty.data() + empty.size(), '\t', 0, 3, out));
+    CHECK(parse_line(empty.data(), empty.data() + empty.size(), '\t', 2, 1, out) && out[0] == 3.0f);
+
+    // Lines end with \n or \r\n, empty lines are skipped, and parts of a
+    // split text end after line breaks.
+    const std::string text = "1,2\r\n\r\n3,4\n\n5,6";
+    std::vector<std::string> lines;
+    for_each_line(text.data(), text.data() + text.size(), [&](const char* b, const char* e) {
+        lines.emplace_back(b, e);
+        CHECK(parse_line(b, e, ',', 0, 2, out));
+        return true;
+    });
+    CHECK(lines == (std::vector<std::string>{"1,2", "3,4", "5,6"}));
+    for (size_t size : {1, 4, 100}) {
+        const auto parts = split_lines(text.data(), text.data() + text.size(), size);
+        CHECK(!parts.empty() && parts.front().first == text.data());
+        CHECK(parts.back().second == text.data() + text.size());
+        for (size_t i = 0; i + 1 < parts.size(); ++i) {
+            CHECK(parts[i].second[-1] == '\n' && parts[i].second == parts[i + 1].first);
+        }
+    }
+    return true;
+}
+
 void test_catboost() {
     CHECK(one_test("xor"));
     CHECK(one_test("or"));
     CHECK(one_test("and"));
     CHECK(one_test("regression"));
+    CHECK(parallel_test("regression"));
+    CHECK(parallel_error_test());
+    CHECK(tree_parallel_test("regression"));
+    CHECK(fixed_order_test("regression"));
+    CHECK(fixed_order_test("xor"));
+    CHECK(one_test("nonsymmetric"));
+    CHECK(fixed_order_test("nonsymmetric"));
+    CHECK(multi_test("multiclass", 3));
+    CHECK(cat_test("categorical"));
+    CHECK(nan_test("nan"));
+    CHECK(transform_test("regression", "multiclass", 3));
+    CHECK(shap_test("xor"));
+    CHECK(shap_test("regression"));
+    CHECK(shap_test("multiclass"));
+    CHECK(shap_test("nan"));
+    CHECK(deep_shap_test("regression"));
+    CHECK(cat_shap_test("categorical"));
+    CHECK(leaf_index_test("regression"));
+    CHECK(leaf_index_test("nonsymmetric"));
+    CHECK(leaf_index_test("multiclass"));
+    CHECK(leaf_index_test("nan"));
+    CHECK(deep_leaf_index_test("regression"));
+    CHECK(model_set_test());
+    CHECK(typed_test("regression"));
+    CHECK(typed_test("multiclass"));
+    CHECK(typed_test("nan"));
+    CHECK(sparse_test("regression"));
+    CHECK(sparse_test("nonsymmetric"));
+    CHECK(sparse_test("multiclass"));
+    CHECK(sparse_test("nan"));
+    CHECK(wide_sparse_test());
+    CHECK(compact_test("regression"));
+    CHECK(compact_test("nonsymmetric"));
+    CHECK(compact_test("multiclass"));
+    CHECK(compact_test("nan"));
+    CHECK(scorer_test("regression"));
+    CHECK(scorer_test("nonsymmetric"));
+    CHECK(scorer_test("multiclass"));
+    CHECK(scorer_test("nan"));
+    CHECK(wide_scorer_test());
+    CHECK(specialize_test("regression"));
+    CHECK(specialize_test("nonsymmetric"));
+    CHECK(specialize_test("multiclass"));
+    CHECK(specialize_test("nan"));
+    CHECK(cat_specialize_test());
+    CHECK(cache_test("regression"));
+    CHECK(cache_test("nonsymmetric"));
+    CHECK(cache_test("multiclass"));
+    CHECK(cache_test("nan"));
+    CHECK(strided_test("regression"));
+    CHECK(strided_test("nonsymmetric"));
+    CHECK(strided_test("multiclass"));
+    CHECK(strided_test("nan"));
+    CHECK(async_test("regression"));
+    CHECK(async_test("nonsymmetric"));
+    CHECK(async_test("multiclass"));
+    CHECK(async_test("nan"));
+    CHECK(batching_test("regression"));
+    CHECK(batching_test("nonsymmetric"));
+    CHECK(batching_test("multiclass"));
+    CHECK(batching_test("nan"));
+    CHECK(matrix_test("regression"));
+    CHECK(matrix_test("nonsymmetric"));
+    CHECK(matrix_test("multiclass"));
+    CHECK(matrix_test("nan"));
+    CHECK(tsv_test());
 }
 
 int main(int argc, char** argv) {
@@ -0,0 +1,449 @@
+#!/usr/bin/env python3
+
+# Generate random models with oblivious and non-symmetric trees in CatBoost JSON
+# format and their predictions. Unlike gen_catboost_tests.py it does not need
+# CatBoost, so models are not trained, but they have the same structure.
+# Categorical model has one-hot and CTR splits with CTR tables and hashes of
+# categories computed the way CatBoost does. NaN model has features with every
+# nan_value_treatment and NaN values in examples, which are written as null.
+
+import json
+import random
+import struct
+
+FEATURES = 8
+ROWS = 20
+
+
+def f32(x):
+    return struct.unpack("f", struct.pack("f", x))[0]
+
+
+def split(feature, border):
+    return {"border": border, "float_feature_index": feature, "split_index": 0, "split_type": "FloatFeature"}
+
+
+def values(dims):
+    # Values of a leaf. Leaves of one-dimensional models have a single value.
+    if dims == 1:
+        return [random.gauss(0.0, 1.0)]
+    return [random.gauss(0.0, 1.0) for _ in range(dims)]
+
+
+def oblivious_tree(depth, dims):
+    # Values of every leaf are adjacent.
+    return {
+        "leaf_values": [v for _ in range(1 << depth) for v in values(dims)],
+        "leaf_weights": [1] * (1 << depth),
+        "splits": [split(random.randrange(FEATURES), random.random()) for _ in range(depth)],
+    }
+
+
+def leaf(dims):
+    v = values(dims)
+    return {"value": v[0] if dims == 1 else v, "weight": 1}
+
+
+def node_tree(leaves, max_depth, dims):
+    # Lossguide-like tree: split random leaves until there are enough of them.
+    root = leaf(dims)
+    frontier = [(root, 0)]
+    for _ in range(leaves - 1):
+        candidates = [x for x in frontier if x[1] < max_depth]
+        if not candidates:
+            break
+        node, level = random.choice(candidates)
+        frontier.remove((node, level))
+        node.clear()
+        node["split"] = split(random.randrange(FEATURES), random.random())
+        node["left"] = leaf(dims)
+        node["right"] = leaf(dims)
+        frontier += [(node["left"], level + 1), (node["right"], level + 1)]
+    return root
+
+
+def apply_oblivious(tree, x, dims):
+    idx = 0
+    for i, s in enumerate(tree["splits"]):
+        if f32(x[s["float_feature_index"]]) > f32(s["border"]):
+            idx |= 1 << i
+    return tree["leaf_values"][idx * dims:(idx + 1) * dims]
+
+
+def apply_node(node, x):
+    while "split" in node:
+        s = node["split"]
+        node = node["right"] if f32(x[s["float_feature_index"]]) > f32(s["border"]) else node["left"]
+    return node["value"] if isinstance(node["value"], list) else [node["value"]]
+
+
+def gen_test(fnm, dims, bias):
+    model = {
+        "features_info": {"float_features": [{"feature_index": i, "flat_feature_index": i} for i in range(FEATURES)]},
+        "oblivious_trees": [oblivious_tree(random.randint(1, 6), dims) for _ in range(10)],
+        "trees": [leaf(dims)] + [node_tree(random.randint(2, 40), random.randint(1, 10), dims) for _ in range(30)],
+        "scale_and_bias": [0.5, bias],
+    }
+
+    x = [[random.random() for _ in range(FEATURES)] for _ in range(ROWS)]
+    y = []
+    for row in x:
+        res = [0.0] * dims
+        for v in [apply_oblivious(t, row, dims) for t in model["oblivious_trees"]] + \
+                 [apply_node(t, row) for t in model["trees"]]:
+            res = [a + b for a, b in zip(res, v)]
+        res = [0.5 * a + (bias[i] if len(bias) > 1 else bias[0]) for i, a in enumerate(res)]
+        y.append(res[0] if dims == 1 else res)
+
+    with open(fnm + "-model.json", "wt") as f:
+        json.dump(model, f, indent=1)
+    with open(fnm + ".json", "wt") as f:
+        json.dump({"x": x, "y": y}, f)
+
+
+M64 = (1 << 64) - 1
+K0 = 0xc3a5c85c97cb3127
+K1 = 0xb492b66fbe98f273
+K2 = 0x9ae16a3b2f90404f
+K3 = 0xc949d7c7509e6557
+
+
+def fetch64(s, i):
+    return int.from_bytes(s[i:i + 8], "little")
+
+
+def fetch32(s, i):
+    return int.from_bytes(s[i:i + 4], "little")
+
+
+def rotate(x, shift):
+    return x if shift == 0 else ((x >> shift) | (x << (64 - shift))) & M64
+
+
+def shift_mix(x):
+    return x ^ (x >> 47)
+
+
+def hash_len16(u, v):
+    mul = 0x9ddfea08eb382d69
+    a = ((u ^ v) * mul) & M64
+    a ^= a >> 47
+    b = ((v ^ a) * mul) & M64
+    b ^= b >> 47
+    return (b * mul) & M64
+
+
+def weak_hash_len32_with_seeds(s, i, a, b):
+    w, x, y, z = fetch64(s, i), fetch64(s, i + 8), fetch64(s, i + 16), fetch64(s, i + 24)
+    a = (a + w) & M64
+    b = rotate((b + a + z) & M64, 21)
+    c = a
+    a = (a + x + y) & M64
+    b = (b + rotate(a, 44)) & M64
+    return (a + z) & M64, (b + c) & M64
+
+
+def city_hash64(s):
+    # CityHash64 of CityHash 1.0, which CatBoost uses.
+    n = len(s)
+    if n <= 16:
+        if n > 8:
+            a = fetch64(s, 0)
+            b = fetch64(s, n - 8)
+            return hash_len16(a, rotate((b + n) & M64, n)) ^ b
+        if n >= 4:
+            return hash_len16((n + (fetch32(s, 0) << 3)) & M64, fetch32(s, n - 4))
+        if n > 0:
+            y = s[0] + (s[n >> 1] << 8)
+            z = n + (s[n - 1] << 2)
+            return (shift_mix(((y * K2) ^ (z * K3)) & M64) * K2) & M64
+        return K2
+    if n <= 32:
+        a = (fetch64(s, 0) * K1) & M64
+        b = fetch64(s, 8)
+        c = (fetch64(s, n - 8) * K2) & M64
+        d = (fetch64(s, n - 16) * K0) & M64
+        return hash_len16((rotate((a - b) & M64, 43) + rotate(c, 30) + d) & M64,
+                          (a + rotate(b ^ K3, 20) - c + n) & M64)
+    if n <= 64:
+        z = fetch64(s, 24)
+        a = (fetch64(s, 0) + (n + fetch64(s, n - 16)) * K0) & M64
+        b = rotate((a + z) & M64, 52)
+        c = rotate(a, 37)
+        a = (a + fetch64(s, 8)) & M64
+        c = (c + rotate(a, 7)) & M64
+        a = (a + fetch64(s, 16)) & M64
+        vf = (a + z) & M64
+        vs = (b + rotate(a, 31) + c) & M64
+        a = (fetch64(s, 16) + fetch64(s, n - 32)) & M64
+        z = fetch64(s, n - 8)
+        b = rotate((a + z) & M64, 52)
+        c = rotate(a, 37)
+        a = (a + fetch64(s, n - 24)) & M64
+        c = (c + rotate(a, 7)) & M64
+        a = (a + fetch64(s, n - 16)) & M64
+        wf = (a + z) & M64
+        ws = (b + rotate(a, 31) + c) & M64
+        r = shift_mix(((vf + ws) * K2 + (wf + vs) * K0) & M64)
+        return (shift_mix((r * K0 + vs) & M64) * K2) & M64
+
+    x = fetch64(s, 0)
+    y = fetch64(s, n - 16) ^ K1
+    z = fetch64(s, n - 56) ^ K0
+    v = weak_hash_len32_with_seeds(s, n - 64, n, y)
+    w = weak_hash_len32_with_seeds(s, n - 32, (n * K1) & M64, K0)
+    z = (z + shift_mix(v[1]) * K1) & M64
+    x = (rotate((z + x) & M64, 39) * K1) & M64
+    y = (rotate(y, 33) * K1) & M64
+    i = 0
+    left = (n - 1) & ~63
+    while left:
+        x = (rotate((x + y + v[0] + fetch64(s, i + 16)) & M64, 37) * K1) & M64
+        y = (rotate((y + v[1] + fetch64(s, i + 48)) & M64, 42) * K1) & M64
+        x ^= w[1]
+        y ^= v[0]
+        z = rotate(z ^ w[0], 33)
+        v = weak_hash_len32_with_seeds(s, i, (v[1] * K1) & M64, (x + w[0]) & M64)
+        w = weak_hash_len32_with_seeds(s, i + 32, (z + w[1]) & M64, y)
+        z, x = x, z
+        i += 64
+        left -= 64
+    return hash_len16((hash_len16(v[0], w[0]) + shift_mix(y) * K1 + z) & M64, (hash_len16(v[1], w[1]) + x) & M64)
+
+
+def cat_hash(value):
+    # Hash of categorical feature: low half of CityHash64 as signed int.
+    h = city_hash64(value.encode()) & 0xffffffff
+    return h - (1 << 32) if h >= (1 << 31) else h
+
+
+def calc_hash(a, b):
+    magic = 0x4906ba494954cb65
+    return (magic * (a + magic * (b & M64))) & M64
+
+
+# Values of categorical features. Lengths cover all branches of CityHash.
+CATS = 3
+VALUES = ["", "a", "ab", "red", "green", "yellowish", "-7", "42", "a categorical value of 30 bytes",
+          "categorical value longer than thirty two bytes", "x" * 64, "very long categorical value " * 5]
+
+
+def ctr_hash(ctr, x, cat):
+    h = 0
+    for e in ctr["elements"]:
+        if e["combination_element"] == "cat_feature_value":
+            h = calc_hash(h, cat_hash(cat[e["cat_feature_index"]]))
+    for e in ctr["elements"]:
+        if e["combination_element"] == "float_feature":
+            h = calc_hash(h, int(f32(x[e["float_feature_index"]]) > f32(e["border"])))
+    for e in ctr["elements"]:
+        if e["combination_element"] == "cat_feature_exact_value":
+            h = calc_hash(h, int(cat_hash(cat[e["cat_feature_index"]]) == e["value"]))
+    return h
+
+
+def ctr_value(ctr, data, counters):
+    # CTR value with float arithmetic of CatBoost.
+    stride = data["hash_stride"]
+    counters = counters or [0] * (stride - 1)
+    t = ctr["ctr_type"]
+    if t == "Borders":
+        good = sum(counters[ctr["target_border_idx"] + 1:])
+        total = sum(counters)
+    elif t == "Buckets":
+        good = counters[ctr["target_border_idx"]]
+        total = sum(counters)
+    elif t == "Counter":
+        good = counters[0]
+        total = data["counter_denominator"]
+    else:
+        good, total = counters
+    value = f32(f32(f32(good) + f32(ctr["prior_numerator"])) / f32(f32(total) + f32(ctr["prior_denomerator"])))
+    return f32(f32(value + f32(ctr["shift"])) * f32(ctr["scale"]))
+
+
+def ctr_table(ctr, stride, mean=False):
+    # Counters of random combinations of categories.
+    data = {"hash_map": [], "hash_stride": stride, "counter_denominator": 0}
+    keys = set()
+    for _ in range(40):
+        x = [random.random() for _ in range(FEATURES)]
+        cat = [random.choice(VALUES) for _ in range(CATS)]
+        keys.add(ctr_hash(ctr, x, cat))
+    for key in sorted(keys):
+        if mean:
+            counters = [round(random.uniform(0.0, 5.0), 3), random.randint(1, 5)]
+        else:
+            counters = [random.randint(0, 9) for _ in range(stride - 1)]
+        data["hash_map"] += [str(key)] + counters
+        data["counter_denominator"] = max(data["counter_denominator"], counters[0])
+    return data
+
+
+def gen_categorical_test(fnm):
+    ctrs = [
+        # Two CTRs have the same borders, their splits are told apart by split_index.
+        {"ctr_type": "Borders", "prior_numerator": 0, "prior_denomerator": 1, "shift": 0, "scale": 15,
+         "target_border_idx": 0, "elements": [{"cat_feature_index": 0, "combination_element": "cat_feature_value"}]},
+        {"ctr_type": "Borders", "prior_numerator": 0.5, "prior_denomerator": 1, "shift": 0, "scale": 15,
+         "target_border_idx": 0, "elements": [{"cat_feature_index": 0, "combination_element": "cat_feature_value"}]},
+        {"ctr_type": "Counter", "prior_numerator": 0, "prior_denomerator": 1, "shift": 0, "scale": 15,
+         "target_border_idx": 0, "elements": [{"cat_feature_index": 1, "combination_element": "cat_feature_value"}]},
+        {"ctr_type": "Buckets", "prior_numerator": 1, "prior_denomerator": 1, "shift": -0.5, "scale": 10,
+         "target_border_idx": 1, "elements": [
+             {"cat_feature_index": 0, "combination_element": "cat_feature_value"},
+             {"cat_feature_index": 2, "combination_element": "cat_feature_value"},
+             {"float_feature_index": 3, "border": 0.5, "combination_element": "float_feature"},
+             {"cat_feature_index": 1, "value": cat_hash("red"), "combination_element": "cat_feature_exact_value"}]},
+        {"ctr_type": "BinarizedTargetMeanValue", "prior_numerator": 0, "prior_denomerator": 1, "shift": 0,
+         "scale": 1, "target_border_idx": 0,
+         "elements": [{"cat_feature_index": 2, "combination_element": "cat_feature_value"}]},
+    ]
+    ctr_data = {}
+    for i, ctr in enumerate(ctrs):
+        ctr["identifier"] = json.dumps({"identifier": ctr["elements"], "type": ctr["ctr_type"], "id": i})
+        if ctr["ctr_type"] == "Borders":
+            ctr["borders"] = [f32(i + 0.5) for i in range(14)]
+        else:
+            ctr["borders"] = sorted(f32(random.uniform(0.0, 10.0)) for _ in range(5))
+        stride = {"Borders": 3, "Buckets": 4, "Counter": 2, "BinarizedTargetMeanValue": 3}[ctr["ctr_type"]]
+        ctr_data[ctr["identifier"]] = ctr_table(ctr, stride, ctr["ctr_type"] == "BinarizedTargetMeanValue")
+
+    float_borders = [sorted(f32(random.random()) for _ in range(4)) for _ in range(FEATURES)]
+    one_hot_values = [cat_hash(v) for v in ["red", "green", ""]]
+
+    # Binary features in the order of split indexes.
+    binary = [{"split_type": "FloatFeature", "float_feature_index": i, "border": b}
+              for i in range(FEATURES) for b in float_borders[i]]
+    binary += [{"split_type": "OneHotFeature", "cat_feature_index": 1, "value": v} for v in one_hot_values]
+    binary += [{"split_type": "OnlineCtr", "border": b, "ctr_target_border_idx": c["target_border_idx"], "ctr": i}
+               for i, c in enumerate(ctrs) for b in c["borders"]]
+
+    def random_split():
+        i = random.randrange(len(binary))
+        s = dict(binary[i], split_index=i)
+        s.pop("ctr", None)
+        return s
+
+    def tree_values():
+        return [random.gauss(0.0, 1.0) for _ in range(1 << 6)]
+
+    oblivious = []
+    for _ in range(20):
+        depth = random.randint(1, 6)
+        oblivious.append({"leaf_values": tree_values()[:1 << depth], "leaf_weights": [1] * (1 << depth),
+                          "splits": [random_split() for _ in range(depth)]})
+
+    def node_tree(level):
+        if level == 4 or random.random() < 0.3:
+            return {"value": random.gauss(0.0, 1.0), "weight": 1}
+        return {"split": random_split(), "left": node_tree(level + 1), "right": node_tree(level + 1)}
+
+    model = {
+        "features_info": {
+            "float_features": [{"feature_index": i, "flat_feature_index": i, "borders": float_borders[i]}
+                               for i in range(FEATURES)],
+            "categorical_features": [{"feature_index": i, "flat_feature_index": FEATURES + i} for i in range(CATS)],
+            "one_hot_features": [{"cat_feature_index": 1, "values": one_hot_values}],
+            "ctrs": ctrs,
+        },
+        "ctr_data": ctr_data,
+        "oblivious_trees": oblivious,
+        "trees": [node_tree(0) for _ in range(10)],
+        "scale_and_bias": [0.5, 1.5],
+    }
+
+    def split_value(s, x, cat):
+        i = s["split_index"]
+        if s["split_type"] == "FloatFeature":
+            return f32(x[s["float_feature_index"]]) > f32(s["border"])
+        if s["split_type"] == "OneHotFeature":
+            return cat_hash(cat[s["cat_feature_index"]]) == s["value"]
+        ctr = ctrs[binary[i]["ctr"]]
+        data = ctr_data[ctr["identifier"]]
+        h = ctr_hash(ctr, x, cat)
+        counters = None
+        stride = data["hash_stride"]
+        for j in range(0, len(data["hash_map"]), stride):
+            if int(data["hash_map"][j]) == h:
+                counters = data["hash_map"][j + 1:j + stride]
+        return ctr_value(ctr, data, counters) > f32(s["border"])
+
+    def apply_tree(node, x, cat):
+        while "split" in node:
+            node = node["right"] if split_value(node["split"], x, cat) else node["left"]
+        return node["value"]
+
+    x = [[random.random() for _ in range(FEATURES)] for _ in range(ROWS * 3)]
+    cat = []
+    for row in x:
+        # Half of examples use categories from CTR tables.
+        cat.append([random.choice(VALUES) if random.random() < 0.5 else str(random.randint(-100, 100))
+                    for _ in range(CATS)])
+    y = []
+    for row, c in zip(x, cat):
+        res = 0.0
+        for t in model["oblivious_trees"]:
+            idx = sum(1 << i for i, s in enumerate(t["splits"]) if split_value(s, row, c))
+            res += t["leaf_values"][idx]
+        for t in model["trees"]:
+            res += apply_tree(t, row, c)
+        y.append(0.5 * res + 1.5)
+
+    with open(fnm + "-model.json", "wt") as f:
+        json.dump(model, f, indent=1)
+    with open(fnm + ".json", "wt") as f:
+        json.dump({"x": x, "cat": cat, "hash": [[cat_hash(v) for v in c] for c in cat], "y": y}, f)
+
+
+TREATMENTS = ["AsIs", "AsFalse", "AsTrue"]
+
+
+def gen_nan_test(fnm):
+    # NaN goes right only for AsTrue features, CatBoost treats it as +inf.
+    features = [{"feature_index": i, "flat_feature_index": i, "has_nans": True,
+                 "nan_value_treatment": TREATMENTS[i % len(TREATMENTS)]} for i in range(FEATURES)]
+    model = {
+        "features_info": {"float_features": features},
+        "oblivious_trees": [oblivious_tree(random.randint(1, 8), 1) for _ in range(40)],
+        "trees": [node_tree(random.randint(2, 40), random.randint(1, 10), 1) for _ in range(20)],
+        "scale_and_bias": [0.5, [1.5]],
+    }
+
+    def goes_right(s, row):
+        v = row[s["float_feature_index"]]
+        if v is None:
+            return features[s["float_feature_index"]]["nan_value_treatment"] == "AsTrue"
+        return f32(v) > f32(s["border"])
+
+    def apply_tree(node, row):
+        while "split" in node:
+            node = node["right"] if goes_right(node["split"], row) else node["left"]
+        return node["value"]
+
+    x = [[None if random.random() < 0.3 else random.random() for _ in range(FEATURES)] for _ in range(ROWS)]
+    y = []
+    for row in x:
+        res = 0.0
+        for t in model["oblivious_trees"]:
+            res += t["leaf_values"][sum(1 << i for i, s in enumerate(t["splits"]) if goes_right(s, row))]
+        for t in model["trees"]:
+            res += apply_tree(t, row)
+        y.append(0.5 * res + 1.5)
+
+    with open(fnm + "-model.json", "wt") as f:
+        json.dump(model, f, indent=1)
+    with open(fnm + ".json", "wt") as f:
+        json.dump({"x": x, "y": y}, f)
+
+
+def main():
+    random.seed(42)
+    gen_test("nonsymmetric", 1, [1.5])
+    gen_test("multiclass", 3, [1.5, -0.5, 0.25])
+    gen_categorical_test("categorical")
+    gen_nan_test("nan")
+
+
+if __name__ == "__main__":
+    main()